@@ -27,7 +27,13 @@ import jp4cli_pb2_grpc
 
 p4_cmds_full = ['add-table <table-name> <key-field> <protocol-num> <default-next-obj> <table-size>',
                 'add-table-entry <table-name> <prefix> <prefix-length>',
-                'show-afi-objects']
+                'show-afi-objects',
+                'show-metrics',
+                'show-punt-policer',
+                'show-hostpath-stats [seconds]',
+                'set-punt-policer <reason|any> <port|any> <rate-pps> <burst>',
+                'clear-punt-policer <reason|any> <port|any>',
+                'dump-hostpath-capture <pcapng-file-name> [port <port>] [dir punt|inject]']
 
 cli_cmds = ['help', 'quit']
 
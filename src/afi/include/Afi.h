@@ -42,15 +42,21 @@
 #include <json/json.h>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
+#include "AfiChangeSet.h"
 #include "AfiCreator.h"
 #include "AfiDM.h"
 #include "AfiDevice.h"
+#include "AfiFieldMap.h"
 #include "AfiJsonResource.h"
+#include "AfiMetrics.h"
 #include "AfiNext.h"
 #include "AfiObject.h"
+#include "AfiPipeline.h"
+#include "AfiShadowStore.h"
 #include "AfiTree.h"
 #include "AfiTreeEntry.h"
 #include "AfiCap.h"
@@ -250,13 +256,35 @@ class Afi
     }
 
     bool handleAfiJsonObject(const Json::Value &cfg_obj,
-                             const bool &pipeline_stage);
+                             const bool &pipeline_stage,
+                             AfiChangeSet *changeSet = nullptr,
+                             std::vector<AfiObjectPtr> *objs = nullptr);
+    bool handleAfiResource(const AfiJsonResource &res,
+                           const bool &pipeline_stage,
+                           AfiChangeSet *changeSet = nullptr,
+                           std::vector<AfiObjectPtr> *objs = nullptr);
     bool handlePipelineConfig(const Json::Value &cfg_root);
+
+    //
+    // Staged pipeline config. stagePipelineConfig() creates the objects of
+    // a config off to the side and compiles its field map against p4info,
+    // without touching the target. commitPipeline() swaps it in.
+    //
+    AfiPipelinePtr stagePipelineConfig(const Json::Value &cfg_root,
+                                       const P4InfoIndex &p4info,
+                                       std::string &      error);
+    bool commitPipeline(const AfiPipelinePtr &pipeline, std::string &error);
     bool addAfiTree(const std::string &aftTreeName, const std::string &keyField,
                     const int protocol, const std::string &defaultNextObject,
                     const unsigned int treeSize);
 
-    bool addEntry(const std::string &keystr, int pLen);
+    bool addEntry(const std::string &keystr, int pLen,
+                  AfiChangeSet *changeSet = nullptr,
+                  std::vector<AfiObjectPtr> *objs = nullptr);
+
+    bool modEntry(const std::string &keystr, int pLen,
+                  std::vector<AfiObjectPtr> &objs,
+                  AfiChangeSet *changeSet = nullptr);
 
     bool afiAddCapEntry(P4InfoTablePtr table,
                         P4InfoActionPtr action,
@@ -264,10 +292,44 @@ class Afi
                         const std::vector<AfiAEntry> &aes,
                         Json::Value& result);
 
+    //
+    // Add an entry. Its AFI objects are named after entryName, see
+    // AfiShadowStore::entryName().
+    //
     bool afiAddObjEntry(const uint32_t tId,
                         const uint32_t aId,
                         const std::vector<AfiTEntryMatchField> &mfs,
-                        const std::vector<AfiAEntry> &afiActions);
+                        const std::vector<AfiAEntry> &afiActions,
+                        const std::string &entryName,
+                        AfiChangeSet *changeSet = nullptr,
+                        std::vector<AfiObjectPtr> *objs = nullptr);
+
+    //
+    // Change the action of an installed entry. objs holds the AFI objects
+    // of the entry and is updated to the objects installed afterwards.
+    //
+    bool afiModObjEntry(const uint32_t tId,
+                        const uint32_t aId,
+                        const std::vector<AfiTEntryMatchField> &mfs,
+                        const std::vector<AfiAEntry> &afiActions,
+                        const std::string &entryName,
+                        std::vector<AfiObjectPtr> &objs,
+                        AfiChangeSet *changeSet = nullptr);
+
+    //
+    // Remove an installed entry given its AFI objects
+    //
+    bool afiDelObjEntry(const std::vector<AfiObjectPtr> &objs,
+                        AfiChangeSet *changeSet = nullptr);
+
+    //
+    // Bind everything staged in changeSet and push it to the target
+    // in one batch.
+    //
+    bool commitChangeSet(AfiChangeSet &changeSet)
+    {
+        return _afiDevice->commitChangeSet(changeSet);
+    }
 
     const AfiObjectPtr getAfiObject(const std::string &name)
     {
@@ -280,12 +342,45 @@ class Afi
         return _afiDevice->getAfiObjects();
     }
 
+    //
+    // Installed P4 table entries, used to serve P4Runtime Read
+    //
+    AfiShadowStore &shadow() { return _shadow; }
+
+    //
+    // P4 field to AFI field mapping of the current pipeline config. Hold
+    // on to it while translating an entry; a commit may replace the
+    // pipeline meanwhile.
+    //
+    AfiFieldMapPtr fieldMap() const
+    {
+        AfiPipelinePtr pipeline = std::atomic_load(&_pipeline);
+        return AfiFieldMapPtr(pipeline, &pipeline->fieldMap);
+    }
+
  protected:
     Afi() {}
     ~Afi() {}
 
  private:
-    AfiDeviceUPtr _afiDevice;
+    AfiDeviceUPtr  _afiDevice;
+    AfiShadowStore _shadow;
+
+    //
+    // Committed pipeline, swapped atomically by commitPipeline()
+    //
+    AfiPipelinePtr _pipeline{std::make_shared<AfiPipeline>()};
+    std::mutex     _pipelineMtx;  ///< Serializes commits
+
+    AfiJsonResource treeEntryRes(const std::string &keystr, int pLen);
+    bool objEntryRes(const uint32_t tId, const uint32_t aId,
+                     const std::vector<AfiTEntryMatchField> &mfs,
+                     const std::vector<AfiAEntry> &aes,
+                     const std::string &entryName,
+                     std::vector<AfiJsonResource> &eRes);
+    bool modifyObjects(const std::vector<AfiJsonResource> &eRes,
+                       std::vector<AfiObjectPtr> &objs,
+                       AfiChangeSet *changeSet);
 };
 
 }  // namespace AFIHAL
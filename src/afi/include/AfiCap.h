@@ -44,7 +44,8 @@ class AfiCap : public AfiObject
                                     const uint32_t aId, //P4InfoActionPtr action,
                                     const std::vector<AfiTEntryMatchField> &mfs,
                                     const std::vector<AfiAEntry> &aes,
-                                    Json::Value& result) override;
+                                    const std::string &entryName,
+                                    std::vector<AfiJsonResource> &result) override;
 
     ::juniper::afi_cap::AfiCap_CapType type() { return _cap.cap_type(); }
     ::ywrapper::UintValue gid() { return _cap.group_id(); }
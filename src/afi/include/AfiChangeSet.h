@@ -0,0 +1,152 @@
+//
+// Juniper P4 Agent
+//
+/// @file  AfiChangeSet.h
+/// @brief Afi change set (batched object updates)
+//
+// Copyright (c) [2018] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#ifndef SRC_AFI_INCLUDE_AFICHANGESET_H_
+#define SRC_AFI_INCLUDE_AFICHANGESET_H_
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "AfiObject.h"
+
+namespace AFIHAL
+{
+///
+/// @class AfiChangeSet
+/// @brief Collects the AFI object operations of a write so that they can
+///        be pushed to the target in one commit.
+///
+/// Operations are kept in the order they were staged. Child objects of a
+/// single update are staged parent-last (e.g. encap entry, tree entry,
+/// tree-encap entry), so binding in staging order is dependency order;
+/// unbinds of a deleted entry are staged parent-first.
+///
+class AfiChangeSet
+{
+ public:
+    enum Op {
+        BIND,    ///< Bind a newly created object
+        UNBIND,  ///< Unbind an installed object
+        UPDATE   ///< Replace an installed object by a new one in place
+    };
+
+    struct Entry {
+        uint32_t     update;  ///< Index of the originating update
+        Op           op;      ///< Operation
+        AfiObjectPtr obj;     ///< Staged object
+        AfiObjectPtr oldObj;  ///< Object replaced by obj (UPDATE only)
+        bool         done;    ///< Set once op has been applied
+    };
+
+    explicit AfiChangeSet(uint32_t numUpdates)
+        : _failed(numUpdates, false),
+          _errors(numUpdates),
+          _dependsOn(numUpdates, -1)
+    {
+    }
+
+    /// Select the update subsequently staged objects belong to
+    void setUpdate(uint32_t update) { _update = update; }
+
+    uint32_t update() const { return _update; }
+
+    void stage(const AfiObjectPtr &obj)
+    {
+        _entries.push_back({_update, BIND, obj, nullptr, false});
+    }
+
+    void stageUnbind(const AfiObjectPtr &obj)
+    {
+        _entries.push_back({_update, UNBIND, obj, nullptr, false});
+    }
+
+    void stageUpdate(const AfiObjectPtr &oldObj, const AfiObjectPtr &obj)
+    {
+        _entries.push_back({_update, UPDATE, obj, oldObj, false});
+    }
+
+    void fail(uint32_t update, const std::string &error)
+    {
+        if (update >= _failed.size()) return;
+        if (!_failed[update]) {
+            _failed[update] = true;
+            _errors[update] = error;
+        }
+    }
+
+    /// Mark every update which still has no error as failed
+    void failAll(const std::string &error)
+    {
+        for (uint32_t i = 0; i < _failed.size(); i++) {
+            fail(i, error);
+        }
+    }
+
+    ///
+    /// @brief Make update fail whenever the earlier update on fails, e.g.
+    ///        a MODIFY of an entry inserted by on in the same batch.
+    ///
+    void dependsOn(uint32_t update, uint32_t on)
+    {
+        if ((update < _dependsOn.size()) && (on < update)) {
+            _dependsOn[update] = on;
+        }
+    }
+
+    bool failed(uint32_t update) const
+    {
+        while (update < _failed.size()) {
+            if (_failed[update]) return true;
+            if (_dependsOn[update] < 0) return false;
+            update = _dependsOn[update];
+        }
+        return false;
+    }
+
+    std::string error(uint32_t update) const
+    {
+        uint32_t cause = update;
+        while ((cause < _failed.size()) && !_failed[cause] &&
+               (_dependsOn[cause] >= 0)) {
+            cause = _dependsOn[cause];
+        }
+        if (cause >= _errors.size()) return "";
+        if (cause == update) return _errors[update];
+        return "Update " + std::to_string(cause) + " failed: " +
+               _errors[cause];
+    }
+
+    std::vector<Entry> &entries() { return _entries; }
+
+    size_t numUpdates() const { return _failed.size(); }
+
+ private:
+    uint32_t                 _update{0};
+    std::vector<Entry>       _entries;
+    std::vector<bool>        _failed;
+    std::vector<std::string> _errors;
+    std::vector<int>         _dependsOn;  ///< Update depended on, -1 if none
+};
+
+}  // namespace AFIHAL
+
+#endif  // SRC_AFI_INCLUDE_AFICHANGESET_H_
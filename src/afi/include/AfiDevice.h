@@ -25,9 +25,11 @@
 
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
+#include "AfiChangeSet.h"
 #include "AfiCreator.h"
 #include "AfiJsonResource.h"
 #include "AfiObject.h"
@@ -72,22 +74,50 @@ class AfiDevice
     AfiObjectPtr handleDMObject(const AfiJsonResource &res,
                                 const bool &pipelineStage);
 
+    //
+    // Create an object without inserting it into the object map
+    //
+    AfiObjectPtr createObject(const AfiJsonResource &res);
+
+    //
+    // Batch interface. Targets which can push several objects to the
+    // HALP in a single transaction override beginBatch/commitBatch;
+    // by default every bind() goes to the target on its own.
+    //
+    virtual bool beginBatch() { return true; }
+    virtual bool commitBatch() { return true; }
+
+    bool commitChangeSet(AfiChangeSet &changeSet);
+
     void insertToObjectMap(const AfiObjectPtr &obj)
     {
         Log(DEBUG) << "insertToObjectMap... obj->name():" << obj->name();
+        std::lock_guard<std::mutex> guard(_mapMtx);
         _objectsMap[obj->name()] = obj;
     }
 
+    void eraseFromObjectMap(const AfiObjectPtr &obj)
+    {
+        std::lock_guard<std::mutex> guard(_mapMtx);
+        auto it = _objectsMap.find(obj->name());
+        if ((it != _objectsMap.end()) && (it->second == obj)) {
+            _objectsMap.erase(it);
+        }
+    }
+
     const AfiObjectPtr getAfiObject(const std::string &name)
     {
         Log(DEBUG) << "getAfiObject name:" << name;
-        return _objectsMap[name];
+        std::lock_guard<std::mutex> guard(_mapMtx);
+        auto it = _objectsMap.find(name);
+        return (it == _objectsMap.end()) ? nullptr : it->second;
     }
 
     void bindAfiObjects()
     {
-        for (const auto &objpair : _objectsMap) {
-            if (!objpair.second->bind()) {
+        // bind() may look objects up, so not under _mapMtx
+        for (const auto &obj : getAfiObjects()) {
+            if (!obj->bind()) {
                 Log(ERROR) << ": Unable to bind afi object ";
             }
         }
@@ -95,6 +125,7 @@ class AfiDevice
 
     const std::vector<AfiObjectPtr> getAfiObjects() const
     {
+        std::lock_guard<std::mutex> guard(_mapMtx);
         std::vector<AfiObjectPtr> objs;
         for (const auto &objpair : _objectsMap) {
             objs.push_back(objpair.second);
@@ -103,8 +134,14 @@ class AfiDevice
     }
 
  private:
-    AfiObjectNameMap _objectsMap;
-    std::string      _name;
+    AfiObjectNameMap   _objectsMap;
+    mutable std::mutex _mapMtx;  ///< Guards _objectsMap
+    std::string        _name;
+    std::mutex         _commitMtx;  ///< Serializes change set commits
+
+    bool updateObject(const AfiObjectPtr &oldObj, const AfiObjectPtr &obj);
+    bool applyEntry(AfiChangeSet::Entry &e);
+    void revertEntry(AfiChangeSet::Entry &e);
 };
 
 }  // namespace AFIHAL
@@ -0,0 +1,150 @@
+//
+// Juniper P4 Agent
+//
+/// @file  AfiFieldMap.h
+/// @brief Table driven P4 field to AFI field translation
+//
+// Copyright (c) [2018] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#ifndef SRC_AFI_INCLUDE_AFIFIELDMAP_H_
+#define SRC_AFI_INCLUDE_AFIFIELDMAP_H_
+
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/message.h>
+#include <json/json.h>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class P4InfoIndex;
+
+namespace AFIHAL
+{
+///
+/// @brief An AFI message field and the value field of its ywrapper type
+///
+struct AfiFieldRef {
+    const google::protobuf::FieldDescriptor *field{nullptr};
+    const google::protobuf::FieldDescriptor *value{nullptr};
+
+    bool valid() const { return field != nullptr; }
+};
+
+///
+/// @brief A P4 match field or action param resolved to the AFI proto
+///        field(s) it is written to.
+///
+struct AfiFieldSlot {
+    AfiFieldRef field;         ///< Value
+    AfiFieldRef mask;          ///< Mask, if the AFI message has one
+    int         enumValue{0};  ///< Key of enum keyed targets (encap)
+    uint32_t    bitWidth{0};   ///< P4 bitwidth, 0 if not known
+
+    /// Constant fields set along with field (e.g. copy_to_cpu)
+    std::vector<std::pair<AfiFieldRef, uint64_t>> constants;
+
+    bool valid() const { return field.valid() || (enumValue != 0); }
+
+    ///
+    /// @brief Write value, and mask if the slot has a mask field, to msg.
+    ///        value and mask are network order bytestrings; an empty mask
+    ///        means all ones, bitWidth of them for an integer mask.
+    ///
+    void set(google::protobuf::Message &msg, const std::string &value,
+             const std::string &mask) const;
+};
+
+///
+/// @class AfiFieldMap
+/// @brief Declarative mapping from P4 field names to AFI proto fields.
+///
+/// The mapping is a built-in default which the pipeline config may extend
+/// or override with an "afi-field-map" element in its device data:
+///
+///     { "afi-field-map" : {
+///           "afi-cap-entry-match" : {
+///               "hdr.ipv4_base.dst_addr" : "destination_ipv4_address" },
+///           "afi-cap-entry-action" : {
+///               "queue_id" : { "field" : "cpu_queue",
+///                              "set"   : { "copy_to_cpu" : 1 } } } } }
+///
+/// A string value names the AFI field; its mask is the "<field>_mask"
+/// field if the message has one. For "afi-encap-entry" the AFI field is an
+/// AfiEncapEntryAfiField enum value name without its prefix.
+///
+/// compile() resolves the mapping against a P4Info into per table and per
+/// action slot vectors indexed by match field id and param id, so that
+/// translating an entry does no name lookups.
+///
+class AfiFieldMap
+{
+ public:
+    enum Target {
+        CAP_ENTRY_MATCH,   ///< afi-cap-entry-match, keyed by match field
+        CAP_ENTRY_ACTION,  ///< afi-cap-entry-action, keyed by action param
+        TREE_ENTRY,        ///< afi-tree-entry, keyed by match field
+        ENCAP_ENTRY,       ///< afi-encap-entry, keyed by action param
+        NUM_TARGETS
+    };
+
+    AfiFieldMap() { reset(); }
+
+    /// Go back to the built-in mapping
+    void reset();
+
+    /// Merge an "afi-field-map" json object into the mapping
+    bool load(const Json::Value &map);
+
+    /// Resolve the mapping for all tables and actions of a P4Info
+    void compile(const P4InfoIndex &p4info);
+
+    ///
+    /// @returns Slot of match field / action param fieldId of table / action
+    ///          resId, nullptr if the field is not mapped
+    ///
+    const AfiFieldSlot *slot(Target t, uint32_t resId, uint32_t fieldId) const
+    {
+        auto it = _slots[t].find(resId);
+        if ((it == _slots[t].end()) || (fieldId >= it->second.size())) {
+            return nullptr;
+        }
+        const AfiFieldSlot &s = it->second[fieldId];
+        return s.valid() ? &s : nullptr;
+    }
+
+ private:
+    struct Spec {
+        std::string                     field;
+        std::string                     mask;
+        std::map<std::string, uint64_t> constants;
+    };
+
+    using SpecMap  = std::map<std::string, Spec>;
+    using SlotsMap = std::unordered_map<uint32_t, std::vector<AfiFieldSlot>>;
+
+    SpecMap  _spec[NUM_TARGETS];   ///< P4 name -> AFI field(s)
+    SlotsMap _slots[NUM_TARGETS];  ///< Table / action id -> slots
+
+    static const google::protobuf::Descriptor *descriptor(Target t);
+
+    bool resolve(Target t, const std::string &p4Name, AfiFieldSlot &slot);
+};
+
+}  // namespace AFIHAL
+
+#endif  // SRC_AFI_INCLUDE_AFIFIELDMAP_H_
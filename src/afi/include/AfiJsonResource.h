@@ -23,6 +23,7 @@
 #ifndef SRC_AFI_INCLUDE_AFIJSONRESOURCE_H_
 #define SRC_AFI_INCLUDE_AFIJSONRESOURCE_H_
 
+#include <google/protobuf/message.h>
 #include <memory>
 #include <string>
 #include "AfiTypes.h"
@@ -34,6 +35,15 @@ class AfiJsonResource;
 using AfiJsonResourcePtr     = std::shared_ptr<AfiJsonResource>;
 using AfiJsonResourceWeakPtr = std::weak_ptr<AfiJsonResource>;
 
+using AfiMessagePtr = std::shared_ptr<google::protobuf::Message>;
+
+///
+/// @class AfiJsonResource
+/// @brief Description of an AFI object to create. The object is either a
+///        base64 encoded protobuf, as found in the pipeline config json,
+///        or a protobuf message built by the agent itself, which is handed
+///        over as is.
+///
 class AfiJsonResource
 {
  protected:
@@ -41,6 +51,7 @@ class AfiJsonResource
     AfiJsonResourceId _id;      ///< Object Id
     std::string       _name;    ///< Name
     std::string       _objStr;  ///< Object
+    AfiMessagePtr     _msg;     ///< Object, if built in the agent
 
  public:
     AfiJsonResource(const std::string &type, const AfiJsonResourceId id,
@@ -49,6 +60,12 @@ class AfiJsonResource
     {
     }
 
+    AfiJsonResource(const std::string &type, const AfiJsonResourceId id,
+                    const std::string &name, AfiMessagePtr msg)
+        : _type(type), _id(id), _name(name), _msg(std::move(msg))
+    {
+    }
+
     //
     // Debug
     //
@@ -69,8 +86,28 @@ class AfiJsonResource
     /// @returns resource name
     const std::string name() const { return _name; }
 
-    /// @returns resource object string
-    const std::string objStr() const { return _objStr; }
+    ///
+    /// @returns resource object string. For an agent built object it is
+    ///          encoded on the fly, so this is for display only.
+    ///
+    const std::string objStr() const;
+
+    /// @returns agent built object, nullptr for a json object
+    const AfiMessagePtr &msg() const { return _msg; }
+
+    ///
+    /// @brief  Get the object into msg, the message member of the object
+    ///         owning this resource. An agent built object is swapped in
+    ///         and the resource then refers to msg, so the message is not
+    ///         copied and not kept twice. The resource the object was
+    ///         created from is left with an empty message.
+    ///
+    /// @returns false if the object is not a msg
+    ///
+    bool take(google::protobuf::Message &msg);
+
+    /// @returns true if res describes the same object contents
+    bool sameObject(const AfiJsonResource &res) const;
 };
 
 }  // namespace AFIHAL
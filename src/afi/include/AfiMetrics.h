@@ -0,0 +1,67 @@
+//
+// Juniper P4 Agent
+//
+/// @file  AfiMetrics.h
+/// @brief Metrics of AFI and its targets
+//
+// Copyright (c) [2018] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+
+#ifndef SRC_AFI_INCLUDE_AFIMETRICS_H_
+#define SRC_AFI_INCLUDE_AFIMETRICS_H_
+
+#include <string>
+
+#include "Metrics.h"
+
+namespace AFIHAL
+{
+///
+/// @brief Latency of an AFI operation, e.g. handleDMObject
+///
+inline MetricHistogram &
+afiLatency(const std::string &op)
+{
+    return Metrics::instance().histogram("jp4_afi_latency_seconds",
+                                         "AFI operation latency",
+                                         "op=\"" + op + "\"");
+}
+
+///
+/// @brief Latency of binding target objects of one AFI object type
+///
+inline MetricHistogram &
+targetBindLatency(const std::string &target, const std::string &type)
+{
+    return Metrics::instance().histogram(
+        "jp4_target_bind_latency_seconds", "Target object bind latency",
+        "target=\"" + target + "\",type=\"" + type + "\"");
+}
+
+///
+/// @brief Latency of a call into the target SDK or server
+///
+inline MetricHistogram &
+targetCallLatency(const std::string &target, const std::string &call)
+{
+    return Metrics::instance().histogram(
+        "jp4_target_call_latency_seconds", "Target SDK/server call latency",
+        "target=\"" + target + "\",call=\"" + call + "\"");
+}
+
+}  // namespace AFIHAL
+
+#endif  // SRC_AFI_INCLUDE_AFIMETRICS_H_
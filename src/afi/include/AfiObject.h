@@ -26,6 +26,7 @@
 #include <map>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "AfiJsonResource.h"
 #include "AfiNext.h"
@@ -50,23 +51,46 @@ class AfiObject : public AfiNext
  protected:
     AfiJsonResource _jsonRes;  ///< Json Resource
 
+    ///
+    /// @brief  Get the object into msg, a member of the derived object.
+    ///         See AfiJsonResource::take.
+    ///
+    bool decode(google::protobuf::Message &msg) { return _jsonRes.take(msg); }
+
  public:
     explicit AfiObject(const AfiJsonResource &jsonRes) : _jsonRes(jsonRes) {}
 
+    /// _jsonRes may refer to a message member, so objects are not copied
+    AfiObject(const AfiObject &) = delete;
+    AfiObject &operator=(const AfiObject &) = delete;
+
     virtual ~AfiObject() {}
 
     virtual bool          bind()                              = 0;
     virtual bool          unbind()                            = 0;
     virtual std::ostream &description(std::ostream &os) const = 0;
 
-    // virtual bool update(void);
-    // virtual bool change(void);
-
+    ///
+    /// @brief  Take over the target state of oldObj, a bound object of the
+    ///         same name, reprogramming only what differs between the two.
+    ///
+    /// @returns false if the target cannot update the object in place; the
+    ///          caller then unbinds oldObj and binds this object.
+    ///
+    virtual bool update(const AfiObjectPtr &oldObj) { return false; }
+
+    ///
+    /// @brief  Append the resources of the child objects making up a table
+    ///         entry to result, in bind order. The objects are named
+    ///         after entryName, which stays the same when the entry is
+    ///         modified, so unchanged objects can be kept.
+    ///
     virtual bool createChildJsonRes(const uint32_t tId, //P4InfoTablePtr table,
                                     const uint32_t aId, //P4InfoActionPtr action,
                                     const std::vector<AfiTEntryMatchField> &mfs,
                                     const std::vector<AfiAEntry> &aes,
-                                    Json::Value& result)
+                                    const std::string &entryName,
+                                    std::vector<AfiJsonResource> &result)
     {
         return false;
     }
@@ -85,6 +109,15 @@ class AfiObject : public AfiNext
 
     /// @returns AfiObject objStr
     const std::string objStr() const { return _jsonRes.objStr(); }
+
+    /// @returns resource the object was created from
+    const AfiJsonResource &jsonRes() const { return _jsonRes; }
+
+    /// @returns true if res describes this object with the same contents
+    bool sameObject(const AfiJsonResource &res) const
+    {
+        return (res.name() == name()) && _jsonRes.sameObject(res);
+    }
 };
 
 }  // namespace AFIHAL
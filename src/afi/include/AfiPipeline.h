@@ -0,0 +1,59 @@
+//
+// Juniper P4 Agent
+//
+/// @file  AfiPipeline.h
+/// @brief A generation of the AFI pipeline objects
+//
+// Copyright (c) [2018] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#ifndef SRC_AFI_INCLUDE_AFIPIPELINE_H_
+#define SRC_AFI_INCLUDE_AFIPIPELINE_H_
+
+#include <memory>
+#include <vector>
+
+#include "AfiFieldMap.h"
+#include "AfiObject.h"
+
+namespace AFIHAL
+{
+class AfiPipeline;
+using AfiPipelinePtr = std::shared_ptr<AfiPipeline>;
+
+///
+/// Field map of a pipeline; keeps the pipeline alive while it is held
+///
+using AfiFieldMapPtr = std::shared_ptr<const AfiFieldMap>;
+
+///
+/// @class AfiPipeline
+/// @brief The AFI objects and the field map of one pipeline config.
+///
+/// A staged pipeline holds objects which are created but neither bound nor
+/// in the device object map. Afi::commitPipeline() swaps it in; objects
+/// equal to the ones of the current pipeline are replaced by those, so
+/// they are carried over without being rebound.
+///
+class AfiPipeline
+{
+ public:
+    std::vector<AfiObjectPtr> objs;      ///< Pipeline objects, config order
+    AfiFieldMap               fieldMap;  ///< Compiled for the P4Info
+};
+
+}  // namespace AFIHAL
+
+#endif  // SRC_AFI_INCLUDE_AFIPIPELINE_H_
@@ -0,0 +1,178 @@
+//
+// Juniper P4 Agent
+//
+/// @file  AfiShadowStore.h
+/// @brief Shadow copy of installed table entries
+//
+// Copyright (c) [2018] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#ifndef SRC_AFI_INCLUDE_AFISHADOWSTORE_H_
+#define SRC_AFI_INCLUDE_AFISHADOWSTORE_H_
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "AfiObject.h"
+
+#ifdef UBUNTU
+#include "p4runtime.pb.h"
+#else // UBUNTU
+#include "p4runtime_wrl.pb.h"
+#endif // UBUNTU
+
+namespace AFIHAL
+{
+///
+/// @brief Position of a chunked shadow read. Entries are visited in
+///        (table id, canonical key) order, so a read can be resumed after
+///        the last entry returned even if the tables changed meanwhile.
+///
+struct AfiShadowCursor {
+    uint32_t    tableId{0};      ///< Table of the last entry returned
+    std::string key;             ///< Canonical key of the last entry returned
+    bool        started{false};  ///< At least one entry returned
+    bool        done{false};     ///< No entries left
+};
+
+///
+/// @brief An installed table entry and the AFI objects it was installed as
+///
+struct AfiShadowEntry {
+    p4::TableEntry            entry;
+    std::vector<AfiObjectPtr> objs;
+};
+
+///
+/// @class AfiShadowStore
+/// @brief Per-table copy of the installed P4 table entries, indexed by
+///        canonical match key. Serves P4Runtime Read without going to the
+///        target and finds the AFI objects of an entry on MODIFY and DELETE.
+///
+class AfiShadowStore
+{
+ public:
+    using ShadowTable = std::map<std::string, AfiShadowEntry>;
+
+    ///
+    /// @brief Canonical form of an entry's match key: match fields ordered
+    ///        by id, don't-care bits masked off, leading zero bytes
+    ///        stripped, followed by the priority.
+    ///
+    static std::string canonicalKey(const p4::TableEntry &entry);
+
+    ///
+    /// @brief Printable form of the canonical key, unique within the table
+    ///        and unchanged by MODIFY. Names the AFI objects of the entry.
+    ///
+    static std::string entryName(const p4::TableEntry &entry);
+
+    /// Add or replace an entry
+    void insert(const p4::TableEntry &           entry,
+                const std::vector<AfiObjectPtr> &objs = {});
+
+    /// Replace the action and the AFI objects of an existing entry
+    bool modify(const p4::TableEntry &           entry,
+                const std::vector<AfiObjectPtr> &objs);
+
+    /// Remove an entry
+    bool erase(const p4::TableEntry &entry);
+
+    /// Look up the entry with the same table and match key as key
+    bool lookup(const p4::TableEntry &key, p4::TableEntry &entry,
+                std::vector<AfiObjectPtr> *objs = nullptr);
+
+    ///
+    /// @returns AFI objects of all entries, entry by entry, each entry's
+    ///          in bind order
+    ///
+    std::vector<AfiObjectPtr> objects();
+
+    /// Drop all entries of a table (all tables if tableId is 0)
+    void clear(uint32_t tableId = 0);
+
+    /// Number of entries in a table (all tables if tableId is 0)
+    size_t size(uint32_t tableId = 0);
+
+    ///
+    /// @brief Append entries of a table (all tables if tableId is 0) to
+    ///        response, starting after cursor, until maxEntries entries or
+    ///        maxBytes bytes have been added.
+    ///
+    /// @returns Number of entries added
+    ///
+    size_t read(uint32_t tableId, AfiShadowCursor &cursor, size_t maxEntries,
+                size_t maxBytes, p4::ReadResponse &response);
+
+ private:
+    std::mutex                      _mtx;
+    std::map<uint32_t, ShadowTable> _tables;
+};
+
+///
+/// @class AfiShadowOverlay
+/// @brief Write-local view of a shadow store. The entry changes of a write
+///        are recorded here as its updates are translated, so that a later
+///        update of the same write sees them. The store itself is changed
+///        only once the write has been committed.
+///
+class AfiShadowOverlay
+{
+ public:
+    explicit AfiShadowOverlay(AfiShadowStore &store) : _store(store) {}
+
+    ///
+    /// @brief Look up the entry with the same table and match key as key,
+    ///        changes of this write first
+    ///
+    bool lookup(const p4::TableEntry &key, p4::TableEntry &entry,
+                std::vector<AfiObjectPtr> *objs = nullptr);
+
+    ///
+    /// @returns Index of the update of this write which last changed the
+    ///          entry with the match key of key, -1 if none did
+    ///
+    int lastUpdate(const p4::TableEntry &key) const;
+
+    /// Record an entry added by update
+    void insert(uint32_t update, const p4::TableEntry &entry,
+                const std::vector<AfiObjectPtr> &objs);
+
+    /// Record the new action and AFI objects given to an entry by update
+    void modify(uint32_t update, const p4::TableEntry &entry,
+                const std::vector<AfiObjectPtr> &objs);
+
+    /// Record an entry removed by update
+    void erase(uint32_t update, const p4::TableEntry &entry);
+
+ private:
+    using Key = std::pair<uint32_t, std::string>;
+
+    struct Change {
+        uint32_t       update;   ///< Update which made the change
+        bool           present;  ///< Entry exists after the change
+        AfiShadowEntry shadow;   ///< Entry after the change, if present
+    };
+
+    AfiShadowStore &     _store;
+    std::map<Key, Change> _changes;
+};
+
+}  // namespace AFIHAL
+
+#endif  // SRC_AFI_INCLUDE_AFISHADOWSTORE_H_
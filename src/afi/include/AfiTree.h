@@ -40,6 +40,13 @@ class AfiTree : public AfiObject
 
     ~AfiTree() {}
 
+    virtual bool createChildJsonRes(const uint32_t tId, //P4InfoTablePtr table,
+                                    const uint32_t aId, //P4InfoActionPtr action,
+                                    const std::vector<AfiTEntryMatchField> &mfs,
+                                    const std::vector<AfiAEntry> &aes,
+                                    const std::string &entryName,
+                                    std::vector<AfiJsonResource> &result) override;
+
     ::juniper::enums::AfiTreeAfiTreeType type() { return _tree.type(); }
 
     //
@@ -44,7 +44,8 @@ class AfiTreeEncap : public AfiObject
                                     const uint32_t aId, //P4InfoActionPtr action,
                                     const std::vector<AfiTEntryMatchField> &mfs,
                                     const std::vector<AfiAEntry> &aes,
-                                    Json::Value& result) override;
+                                    const std::string &entryName,
+                                    std::vector<AfiJsonResource> &result) override;
     //
     // Debug
     //
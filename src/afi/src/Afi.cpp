@@ -21,17 +21,32 @@
 //
 
 #include "Afi.h"
+#include <set>
 #include <string>
 
 #include "AfiDM.h"
+#include "JaegerLog.h"
 #include "Utils.h"
 
 namespace AFIHAL
 {
+//
+// @fn
+// handleAfiJsonObject
+//
+// @brief
+// Create an AFI object from its json description, as found in the
+// pipeline config. See handleAfiResource.
+//
+
 bool
-Afi::handleAfiJsonObject(const Json::Value &cfg_obj, const bool &pipeline_stage)
+Afi::handleAfiJsonObject(const Json::Value &cfg_obj, const bool &pipeline_stage,
+                         AfiChangeSet *changeSet,
+                         std::vector<AfiObjectPtr> *objs)
 {
     Log(DEBUG) << "___ AFI::handleAfiJsonObject ___\n";
+    static MetricHistogram &latency = afiLatency("handleAfiJsonObject");
+    MetricTimer             timer(latency);
 
     // TBD: Revisit: on stack
     AfiJsonResource res(cfg_obj["afi-object-type"].asString(),
@@ -39,10 +54,30 @@ Afi::handleAfiJsonObject(const Json::Value &cfg_obj, const bool &pipeline_stage)
                         cfg_obj["afi-object-name"].asString(),
                         cfg_obj["afi-object"].asString());
 
+    return handleAfiResource(res, pipeline_stage, changeSet, objs);
+}
+
+//
+// @fn
+// handleAfiResource
+//
+// @brief
+// Create an AFI object. Unless this is the pipeline stage the object is
+// bound right away, or, when a change set is given, staged there to be
+// bound by commitChangeSet(). The created object is appended to objs if
+// given.
+//
+
+bool
+Afi::handleAfiResource(const AfiJsonResource &res, const bool &pipeline_stage,
+                       AfiChangeSet *changeSet,
+                       std::vector<AfiObjectPtr> *objs)
+{
     //
     // Create Afi Object
     //
-    AfiObjectPtr afiObj = _afiDevice->handleDMObject(res, pipeline_stage);
+    AfiObjectPtr afiObj = _afiDevice->handleDMObject(
+        res, pipeline_stage || (changeSet != nullptr));
 
     //
     // If we didn't create a object, we fail the operation
@@ -52,23 +87,203 @@ Afi::handleAfiJsonObject(const Json::Value &cfg_obj, const bool &pipeline_stage)
         return false;
     }
 
+    if (changeSet != nullptr) {
+        changeSet->stage(afiObj);
+    }
+
+    if (objs != nullptr) {
+        objs->push_back(afiObj);
+    }
+
     return true;
 }
 
+//
+// @fn
+// handlePipelineConfig
+//
+// @brief
+// Stage a pipeline config against the current P4Info and commit it
+//
+
 bool
 Afi::handlePipelineConfig(const Json::Value &cfg_root)
 {
     Log(DEBUG) << "____ AFI:: handlePipelineConfig ____\n";
+
+    std::string    error;
+    AfiPipelinePtr pipeline =
+        stagePipelineConfig(cfg_root, *P4Info::instance().current(), error);
+    if ((pipeline == nullptr) || !commitPipeline(pipeline, error)) {
+        Log(ERROR) << "Error handling pipeline config: " << error;
+        return false;
+    }
+    return true;
+}
+
+//
+// @fn
+// stagePipelineConfig
+//
+// @brief
+// Build the AFI side of a pipeline config without touching the target:
+// load and compile the field map, then create every object. Objects are
+// neither bound nor put into the object map.
+//
+// @param[in]
+//     cfg_root Array of afi objects, from the device data of the config
+// @param[in]
+//     p4info P4Info of the config
+// @param[out]
+//     error Reason the config was rejected
+// @return Staged pipeline, nullptr if the config is invalid
+//
+
+AfiPipelinePtr
+Afi::stagePipelineConfig(const Json::Value &cfg_root,
+                         const P4InfoIndex &p4info, std::string &error)
+{
+    Log(DEBUG) << "____ AFI:: stagePipelineConfig ____\n";
+
+    if (!cfg_root.isArray()) {
+        error = "Pipeline config is not an array of afi objects";
+        return nullptr;
+    }
+
+    auto pipeline = std::make_shared<AfiPipeline>();
+
+    //
+    // The field map is compiled first so that entries of the new pipeline
+    // are translated with it
+    //
     for (Json::Value::ArrayIndex i = 0; i != cfg_root.size(); i++) {
         const Json::Value &cfg_obj = cfg_root[i];
-        auto               status  = handleAfiJsonObject(cfg_obj, true);
-        if (true != status) {
-            Log(ERROR) << "Error handling afi json object";
-            return status;
+        if (cfg_obj.isObject() && cfg_obj.isMember("afi-field-map") &&
+            !pipeline->fieldMap.load(cfg_obj["afi-field-map"])) {
+            error = "Invalid afi-field-map";
+            return nullptr;
         }
     }
+    pipeline->fieldMap.compile(p4info);
 
-    _afiDevice->bindAfiObjects();
+    std::set<std::string> names;
+    for (Json::Value::ArrayIndex i = 0; i != cfg_root.size(); i++) {
+        const Json::Value &cfg_obj = cfg_root[i];
+        if (cfg_obj.isObject() && cfg_obj.isMember("afi-field-map")) {
+            continue;
+        }
+        if (!cfg_obj.isObject() || !cfg_obj["afi-object-type"].isString() ||
+            !cfg_obj["afi-object-name"].isString() ||
+            !cfg_obj["afi-object"].isString()) {
+            error = "Malformed afi object " + std::to_string(i);
+            return nullptr;
+        }
+
+        AfiJsonResource res(cfg_obj["afi-object-type"].asString(),
+                            cfg_obj["afi-object-id"].asUInt64(),
+                            cfg_obj["afi-object-name"].asString(),
+                            cfg_obj["afi-object"].asString());
+        if (!names.insert(res.name()).second) {
+            error = "Duplicate afi object " + res.name();
+            return nullptr;
+        }
+
+        AfiObjectPtr obj = _afiDevice->createObject(res);
+        if (obj == nullptr) {
+            error = "Unable to create afi object " + res.name() +
+                    " of type " + res.type();
+            return nullptr;
+        }
+        pipeline->objs.push_back(obj);
+    }
+
+    return pipeline;
+}
+
+//
+// @fn
+// commitPipeline
+//
+// @brief
+// Swap a staged pipeline in. Objects equal to the ones of the current
+// pipeline are carried over as they are, changed ones are updated, new
+// ones bound and the ones the new pipeline lacks unbound. Table entries
+// do not survive a pipeline change and are unbound as well. All of it is
+// one change set update, so on failure the current pipeline is restored
+// as it was. Committing the current pipeline again carries all of its
+// objects over and only unbinds the table entries.
+//
+// @param[in]
+//     pipeline Staged pipeline
+// @param[out]
+//     error Reason the commit failed
+// @return true on success
+//
+
+bool
+Afi::commitPipeline(const AfiPipelinePtr &pipeline, std::string &error)
+{
+    Log(DEBUG) << "____ AFI:: commitPipeline ____\n";
+    std::lock_guard<std::mutex> guard(_pipelineMtx);
+
+    AfiPipelinePtr live = std::atomic_load(&_pipeline);
+
+    std::map<std::string, AfiObjectPtr> liveObjs;
+    for (const auto &obj : live->objs) {
+        liveObjs[obj->name()] = obj;
+    }
+    std::set<std::string> names;
+    for (const auto &obj : pipeline->objs) {
+        names.insert(obj->name());
+    }
+
+    AfiChangeSet cs(1);
+
+    auto entryObjs = _shadow.objects();
+    for (auto it = entryObjs.rbegin(); it != entryObjs.rend(); ++it) {
+        cs.stageUnbind(*it);
+    }
+
+    for (auto it = live->objs.rbegin(); it != live->objs.rend(); ++it) {
+        if (names.count((*it)->name()) == 0) {
+            cs.stageUnbind(*it);
+        }
+    }
+
+    std::vector<AfiObjectPtr> objs;
+    size_t                    carried = 0;
+    for (const auto &obj : pipeline->objs) {
+        auto it = liveObjs.find(obj->name());
+        if (it == liveObjs.end()) {
+            _afiDevice->insertToObjectMap(obj);
+            cs.stage(obj);
+        } else if (it->second->type() != obj->type()) {
+            cs.stageUnbind(it->second);
+            _afiDevice->insertToObjectMap(obj);
+            cs.stage(obj);
+        } else if ((it->second == obj) ||
+                   it->second->sameObject(obj->jsonRes())) {
+            objs.push_back(it->second);
+            carried++;
+            continue;
+        } else {
+            _afiDevice->insertToObjectMap(obj);
+            cs.stageUpdate(it->second, obj);
+        }
+        objs.push_back(obj);
+    }
+
+    if (!cs.entries().empty() && !commitChangeSet(cs)) {
+        error = cs.error(0);
+        return false;
+    }
+
+    _shadow.clear();
+    pipeline->objs = objs;
+    std::atomic_store(&_pipeline, pipeline);
+
+    Log(INFO) << "Pipeline committed, " << objs.size() << " objects, "
+              << carried << " carried over";
     return true;
 }
 
@@ -81,13 +296,6 @@ Afi::addAfiTree(const std::string &aftTreeName, const std::string &keyField,
     Log(DEBUG) << "aftTreeName: " << aftTreeName;
     Log(DEBUG) << "keyField   : " << keyField;
 
-    Json::Value afiTreeJsonObject;
-
-    afiTreeJsonObject["afi-object-type"] = "afi-tree";
-
-    afiTreeJsonObject["afi-object-name"] = aftTreeName;
-    afiTreeJsonObject["afi-object-id"]   = 1000001;
-
     juniper::afi_tree::AfiTree afiTree;
 
     ::ywrapper::StringValue *tree_name = new ::ywrapper::StringValue();
@@ -110,17 +318,11 @@ Afi::addAfiTree(const std::string &aftTreeName, const std::string &keyField,
     size->set_value(treeSize);
     afiTree.set_allocated_size(size);
 
-    int   tree_size = afiTree.ByteSize();
-    char *array     = new char[tree_size];
-    std::cout << "tree_size: " << tree_size << std::endl;
-    afiTree.SerializeToArray(array, tree_size);
-
-    std::string encoded = base64_encode(array, (unsigned int)tree_size);
-    std::cout << "encoded: " << encoded << std::endl << std::endl;
+    AfiJsonResource res("afi-tree", 1000001, aftTreeName,
+                        std::make_shared<juniper::afi_tree::AfiTree>(
+                            std::move(afiTree)));
 
-    afiTreeJsonObject["afi-object"] = encoded;
-
-    auto status = handleAfiJsonObject(afiTreeJsonObject, false);
+    auto status = handleAfiResource(res, false);
     if (true != status) {
         Log(ERROR) << "Error handling afi tree entry json object";
         return status;
@@ -129,21 +331,20 @@ Afi::addAfiTree(const std::string &aftTreeName, const std::string &keyField,
     return true;
 }
 
-bool
-Afi::addEntry(const std::string &keystr, int pLen)
+//
+// @fn
+// treeEntryRes
+//
+// @brief
+// Route entry object of the ipv4_lpm tree
+//
+
+AfiJsonResource
+Afi::treeEntryRes(const std::string &keystr, int pLen)
 {
-    Log(DEBUG) << "____ AFI::addEntry ____\n";
     Log(DEBUG) << "keystr : " << keystr;
     Log(DEBUG) << "pLen   : " << pLen;
 
-    Json::Value afiTreeEntryJsonObject;
-
-    afiTreeEntryJsonObject["afi-object-type"] = "afi-tree-entry";
-
-    std::string afi_object_name               = "entry1";
-    afiTreeEntryJsonObject["afi-object-name"] = afi_object_name;
-    afiTreeEntryJsonObject["afi-object-id"]   = 1233456;
-
     juniper::afi_tree_entry::AfiTreeEntry afiTreeEntry;
 
     ::ywrapper::StringValue *entry_name = new ::ywrapper::StringValue();
@@ -167,17 +368,20 @@ Afi::addEntry(const std::string &keystr, int pLen)
     prefix_length->set_value(pLen);
     afiTreeEntry.set_allocated_prefix_length(prefix_length);
 
-    int   entry_size = afiTreeEntry.ByteSize();
-    char *array      = new char[entry_size];
-    std::cout << "entry_size: " << entry_size << std::endl;
-    afiTreeEntry.SerializeToArray(array, entry_size);
-
-    std::string encoded = base64_encode(array, (unsigned int)entry_size);
-    std::cout << "encoded: " << encoded << std::endl << std::endl;
+    return AfiJsonResource(
+        "afi-tree-entry", 1233456, "entry1",
+        std::make_shared<juniper::afi_tree_entry::AfiTreeEntry>(
+            std::move(afiTreeEntry)));
+}
 
-    afiTreeEntryJsonObject["afi-object"] = encoded;
+bool
+Afi::addEntry(const std::string &keystr, int pLen, AfiChangeSet *changeSet,
+              std::vector<AfiObjectPtr> *objs)
+{
+    Log(DEBUG) << "____ AFI::addEntry ____\n";
 
-    auto status = handleAfiJsonObject(afiTreeEntryJsonObject, false);
+    auto status = handleAfiResource(treeEntryRes(keystr, pLen), false,
+                                    changeSet, objs);
     if (true != status) {
         Log(ERROR) << "Error handling afi tree entry json object";
         return status;
@@ -187,42 +391,60 @@ Afi::addEntry(const std::string &keystr, int pLen)
 }
 
 bool
-Afi::afiAddObjEntry (const uint32_t tId,
-                     const uint32_t aId,
-                     const std::vector<AfiTEntryMatchField> &mfs,
-                     const std::vector<AfiAEntry> &aes)
+Afi::modEntry(const std::string &keystr, int pLen,
+              std::vector<AfiObjectPtr> &objs, AfiChangeSet *changeSet)
+{
+    Log(DEBUG) << "____ AFI::modEntry ____\n";
+
+    return modifyObjects({treeEntryRes(keystr, pLen)}, objs, changeSet);
+}
+
+
+//
+// @fn
+// objEntryRes
+//
+// @brief
+// AFI objects of a table entry, built by the table's AFI object
+//
+
+bool
+Afi::objEntryRes(const uint32_t tId,
+                 const uint32_t aId,
+                 const std::vector<AfiTEntryMatchField> &mfs,
+                 const std::vector<AfiAEntry> &aes,
+                 const std::string &entryName,
+                 std::vector<AfiJsonResource> &eRes)
 {
-    Log(DEBUG) << "____ AFI::addObjEntry ____\n";
     Log(DEBUG) << "Table ID  : " << tId;
     Log(DEBUG) << "Action ID : " << aId;
 
-    auto table =
-        std::dynamic_pointer_cast<P4InfoTable>(P4Info::instance().p4InfoResource(tId));
+    auto table = P4Info::instance().table(tId);
     if (table == nullptr) {
         Log(ERROR) << "Bad Table ID " << tId;
         return false;
     }
 
-    for (auto mf : mfs) {
-         auto id = mf.id();
-         std::string name;
-         uint32_t bitWidth;
-         table->matchFieldInfo(id, name, bitWidth);
+    for (const auto &mf : mfs) {
+         const auto *field = table->matchField(mf.id());
+         if (field == nullptr) {
+             Log(ERROR) << "Bad Match Field ID " << mf.id();
+             return false;
+         }
 
-         Log(DEBUG) << "Match Field Name: "     << name;
-         Log(DEBUG) << "Match Field BitWidth: " << bitWidth;
+         Log(DEBUG) << "Match Field Name: "     << field->name;
+         Log(DEBUG) << "Match Field BitWidth: " << field->bitWidth;
          Log(DEBUG) << mf;
     }
 
-    auto action =
-        std::dynamic_pointer_cast<P4InfoAction>(P4Info::instance().p4InfoResource(aId));
+    auto action = P4Info::instance().action(aId);
     if (action == nullptr) {
-        Log(ERROR) << "Bad Action ID " << tId;
+        Log(ERROR) << "Bad Action ID " << aId;
         return false;
     }
 
-    auto tName = table->name();
-    auto aName = action->name();
+    const auto &tName = table->name();
+    const auto &aName = action->name();
     Log(DEBUG) << "Table Name: "  << tName;
     Log(DEBUG) << "Action Name: " << aName;
 
@@ -236,16 +458,31 @@ Afi::afiAddObjEntry (const uint32_t tId,
     Log(DEBUG) << "Table Object Type: " << afiPObj->type();
 
     // Prepare AFI object.
-    Json::Value eObjs;
+    return afiPObj->createChildJsonRes(tId, aId, mfs, aes, entryName, eRes);
+}
+
+bool
+Afi::afiAddObjEntry (const uint32_t tId,
+                     const uint32_t aId,
+                     const std::vector<AfiTEntryMatchField> &mfs,
+                     const std::vector<AfiAEntry> &aes,
+                     const std::string &entryName,
+                     AfiChangeSet *changeSet,
+                     std::vector<AfiObjectPtr> *objs)
+{
+    Log(DEBUG) << "____ AFI::addObjEntry ____\n";
+    static MetricHistogram &latency = afiLatency("addObjEntry");
+    MetricTimer             timer(latency);
+    JaegerSpan span("AFI addObjEntry");
 
-    if (afiPObj->createChildJsonRes(tId, aId, mfs, aes, eObjs) == false) {
+    std::vector<AfiJsonResource> eRes;
+    if (objEntryRes(tId, aId, mfs, aes, entryName, eRes) == false) {
         return false;
     }
 
     // Add all objects in array.
-    for (Json::Value::ArrayIndex i = 0; i != eObjs.size(); i++) {
-        const Json::Value &eObj = eObjs[i];
-        auto status = handleAfiJsonObject(eObj, false);
+    for (const auto &res : eRes) {
+        auto status = handleAfiResource(res, false, changeSet, objs);
         if (true != status) {
             Log(ERROR) << "Error handling afi tree entry json object";
             return status;
@@ -255,4 +492,134 @@ Afi::afiAddObjEntry (const uint32_t tId,
     return true;
 }
 
+bool
+Afi::afiModObjEntry (const uint32_t tId,
+                     const uint32_t aId,
+                     const std::vector<AfiTEntryMatchField> &mfs,
+                     const std::vector<AfiAEntry> &aes,
+                     const std::string &entryName,
+                     std::vector<AfiObjectPtr> &objs,
+                     AfiChangeSet *changeSet)
+{
+    Log(DEBUG) << "____ AFI::modObjEntry ____\n";
+    static MetricHistogram &latency = afiLatency("modObjEntry");
+    MetricTimer             timer(latency);
+    JaegerSpan span("AFI modObjEntry");
+
+    std::vector<AfiJsonResource> eRes;
+    if (objEntryRes(tId, aId, mfs, aes, entryName, eRes) == false) {
+        return false;
+    }
+
+    return modifyObjects(eRes, objs, changeSet);
+}
+
+//
+// @fn
+// modifyObjects
+//
+// @brief
+// Move the installed objects of an entry to their new description.
+// Objects are compared position by position with the installed ones; an
+// object is replaced if its description changed or if it comes after a
+// replaced object, since it may refer to that one by name (e.g. the cap
+// entry referring to its action object). Objects ahead of the first change
+// are left untouched, so an action-only change does not touch the match.
+// Replacement goes through the target update hook (AfiObject::update).
+// Without a change set the operations are committed right away.
+//
+// @param[in]
+//     eRes New description of the entry objects
+// @param[inout]
+//     objs Installed objects of the entry
+// @param[in]
+//     changeSet Change set to stage the operations in, may be nullptr
+// @return true on success
+//
+
+bool
+Afi::modifyObjects(const std::vector<AfiJsonResource> &eRes,
+                   std::vector<AfiObjectPtr> &objs, AfiChangeSet *changeSet)
+{
+    AfiChangeSet  localChangeSet(1);
+    AfiChangeSet &cs = (changeSet != nullptr) ? *changeSet : localChangeSet;
+
+    std::vector<AfiObjectPtr> newObjs;
+
+    if (eRes.size() != objs.size()) {
+        //
+        // Different object layout, replace the whole entry
+        //
+        for (auto it = objs.rbegin(); it != objs.rend(); ++it) {
+            cs.stageUnbind(*it);
+        }
+        for (const auto &res : eRes) {
+            if (!handleAfiResource(res, false, &cs, &newObjs)) {
+                Log(ERROR) << "Error handling afi entry object";
+                cs.fail(cs.update(), "Error handling afi entry object");
+                break;
+            }
+        }
+    } else {
+        bool changed = false;
+        for (size_t i = 0; i != eRes.size(); i++) {
+            if (!changed && objs[i]->sameObject(eRes[i])) {
+                newObjs.push_back(objs[i]);
+                continue;
+            }
+            changed = true;
+
+            AfiObjectPtr obj = _afiDevice->handleDMObject(eRes[i], true);
+            if (obj == nullptr) {
+                Log(ERROR) << "Error creating afi object";
+                cs.fail(cs.update(), "Error creating afi object");
+                break;
+            }
+            cs.stageUpdate(objs[i], obj);
+            newObjs.push_back(obj);
+        }
+    }
+
+    if ((changeSet == nullptr) && !cs.entries().empty() &&
+        !commitChangeSet(cs)) {
+        return false;
+    }
+    if (cs.failed(cs.update())) {
+        return false;
+    }
+
+    objs = newObjs;
+    return true;
+}
+
+//
+// @fn
+// afiDelObjEntry
+//
+// @brief
+// Unbind the objects of an entry, parent first. Without a change set the
+// unbinds are committed right away.
+//
+
+bool
+Afi::afiDelObjEntry(const std::vector<AfiObjectPtr> &objs,
+                    AfiChangeSet *changeSet)
+{
+    Log(DEBUG) << "____ AFI::delObjEntry ____\n";
+    JaegerSpan span("AFI delObjEntry");
+
+    AfiChangeSet  localChangeSet(1);
+    AfiChangeSet &cs = (changeSet != nullptr) ? *changeSet : localChangeSet;
+
+    for (auto it = objs.rbegin(); it != objs.rend(); ++it) {
+        cs.stageUnbind(*it);
+    }
+
+    if (changeSet == nullptr) {
+        return commitChangeSet(cs);
+    }
+    return true;
+}
+
+
 }  // namespace AFIHAL
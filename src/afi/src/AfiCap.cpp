@@ -47,14 +47,10 @@ AfiCap::description(std::ostream &os) const
 
 AfiCap::AfiCap(const AfiJsonResource &jsonRes) : AfiObject(jsonRes)
 {
-    // TBD: FIXME magic number 5000
-    char bytes_decoded[5000];
-    memset(bytes_decoded, 0, sizeof(bytes_decoded));
-    int num_decoded_bytes =
-        base64_decode(jsonRes.objStr(), bytes_decoded, 5000);
-    _cap.ParseFromArray(bytes_decoded, num_decoded_bytes);
+    if (!decode(_cap)) {
+        Log(ERROR) << jsonRes.name() << ": Unable to decode " << jsonRes.type();
+    }
 
-    Log(DEBUG) << "num_decoded_bytes: " << num_decoded_bytes;
     Log(DEBUG) << "cap.ByteSize(): " << _cap.ByteSize();
 
 }
@@ -64,235 +60,92 @@ AfiCap::createChildJsonRes(const uint32_t tId, //P4InfoTablePtr table,
                            const uint32_t aId, //P4InfoActionPtr action,
                            const std::vector<AfiTEntryMatchField> &mfs,
                            const std::vector<AfiAEntry> &aes,
-                           Json::Value& result)
+                           const std::string &entryName,
+                           std::vector<AfiJsonResource> &result)
 {
     Log(DEBUG) << "____ AFI::addCapEntry ____\n";
 
-    auto table =
-        std::dynamic_pointer_cast<P4InfoTable>(P4Info::instance().p4InfoResource(tId));
+    auto table = P4Info::instance().table(tId);
     if (table == nullptr) {
         Log(ERROR) << "Bad Table ID " << tId;
         return false;
     }
 
-    auto action =
-        std::dynamic_pointer_cast<P4InfoAction>(P4Info::instance().p4InfoResource(aId));
+    auto action = P4Info::instance().action(aId);
     if (action == nullptr) {
         Log(ERROR) << "Bad Action ID " << aId;
         return false;
     }
 
+    //
+    // The cap entry refers to its match and action objects by name and the
+    // target looks them up when the entry is bound, which for a batched
+    // Write is after the objects of all its updates were staged. The names
+    // are therefore unique per entry, and as they follow from the entry's
+    // key a MODIFY keeps the objects whose contents did not change.
+    //
     int id = 1233457;
     Log(DEBUG) << "____ Match Keys ____";
 
+    const AfiFieldMapPtr fieldMap = Afi::instance().fieldMap();
+
     juniper::afi_cap_entry_match::AfiCapEntryMatch afiMatchObj;
-    for (auto mf : mfs) {
+    for (const auto &mf : mfs) {
         auto id = mf.id();
-        std::string name;
-        uint32_t bitWidth;
-        if (table->matchFieldInfo(id, name, bitWidth) == false) {
+        const auto *field = table->matchField(id);
+        if (field == nullptr) {
             Log(DEBUG) << "Bad Match Field ID: " << id;
             return false;
         }
 
-        Log(DEBUG) << "Match Field : " << name;
-
-        uint32_t v, m;
-        bool ternary = (mf.type() == AfiTEntryMatchField::MfType::TERNARY) ?
-                       true : false;
-
-        if (ternary == false) {
-            m = 0xffffffff;
-        }
+        Log(DEBUG) << "Match Field : " << field->name;
 
-        if (bitWidth == 0) {
+        if ((field->bitWidth == 0) || (field->bitWidth > 64)) {
             continue;
-        } else if (bitWidth <= 8) {
-            v = *((const uint8_t *) &mf.value().c_str()[0]);
-            if (ternary == true) {
-                m = *((const uint8_t *) &mf.mask().c_str()[0]);
-            }
-        } else if (bitWidth <= 16) {
-            v = *((const uint16_t *) &mf.value().c_str()[0]);
-            v = ntohs(v);
-            if (ternary == true) {
-                m = *((const uint16_t *) &mf.mask().c_str()[0]);
-                m = ntohs(m);
-            }
-        } else if (bitWidth <= 32) {
-            v = *((const uint32_t *) &mf.value().c_str()[0]);
-            v = ntohl(v);
-            if (ternary == true) {
-                m = *((const uint32_t *) &mf.mask().c_str()[0]);
-                m = ntohl(m);
-            }
-        } 
-
-        if (bitWidth <= 32) {
-            ::ywrapper::UintValue* yv = new ::ywrapper::UintValue();
-            yv->set_value(v);
-
-            ::ywrapper::UintValue* ym = new ::ywrapper::UintValue();
-            ym->set_value(m);
-
-            Log(DEBUG) << "Value, mask : " << v << " " << m;
-
-            if (name == "standard_metadata.ingress_port") {
-                afiMatchObj.set_allocated_source_port(yv);
-                afiMatchObj.set_allocated_source_port_mask(ym);
-            } else if (name == "standard_metadata.egress_spec") {
-                afiMatchObj.set_allocated_destination_port(yv);
-                afiMatchObj.set_allocated_destination_port_mask(ym);
-            } else if (name == "hdr.ethernet.ether_type") {
-                afiMatchObj.set_allocated_ethertype(yv);
-                afiMatchObj.set_allocated_ethertype_mask(ym);
-            } else if (name == "hdr.vlan_tag[0].vid") {
-                afiMatchObj.set_allocated_outer_vlan_id(yv);
-                afiMatchObj.set_allocated_outer_vlan_id_mask(ym);
-            } else if (name == "hdr.vlan_tag[0].pcp") {
-                afiMatchObj.set_allocated_outer_vlan_dot1p(yv);
-                afiMatchObj.set_allocated_outer_vlan_dot1p_mask(ym);
-            } else if (name == "hdr.ipv4_base.ttl") {
-                afiMatchObj.set_allocated_ipv4_ttl(yv);
-                afiMatchObj.set_allocated_ipv4_ttl_mask(ym);
-            } else if (name == "hdr.ipv4_base.protocol") {
-                afiMatchObj.set_allocated_ip_protocol(yv);
-                afiMatchObj.set_allocated_ip_protocol_mask(ym);
-            } else if (name == "hdr.ipv4_base.diffserv") {
-                afiMatchObj.set_allocated_tos(yv);
-                afiMatchObj.set_allocated_tos_mask(ym);
-            } else if (name == "hdr.ipv4_base.src_addr") {
-                afiMatchObj.set_allocated_source_ipv4_address(yv);
-                afiMatchObj.set_allocated_source_ipv4_address_mask(ym);
-            } else if (name == "hdr.ipv4_base.dst_addr") {
-                afiMatchObj.set_allocated_destination_ipv4_address(yv);
-                afiMatchObj.set_allocated_destination_ipv4_address_mask(ym);
-            } else if (name == "hdr.ipv6_base.traffic_class") {
-            } else if (name == "hdr.ipv6_base.dst_addr") {
-            } else if (name == "local_metadata.l4_src_port") {
-                afiMatchObj.set_allocated_l4_source_port_mask(yv);
-                afiMatchObj.set_allocated_l4_source_port_mask(ym);
-            } else if (name == "local_metadata.l4_dst_port") {
-                afiMatchObj.set_allocated_l4_destination_port(yv);
-                afiMatchObj.set_allocated_l4_destination_port_mask(ym);
-            } else if (name == "local_metadata.class_id") {
-                afiMatchObj.set_allocated_ingress_class_id(yv);
-                afiMatchObj.set_allocated_ingress_class_id_mask(ym);
-            } else if (name == "local_metadata.vrf_id") {
-                afiMatchObj.set_allocated_virtual_routing_and_forwarding_id(yv);
-                afiMatchObj.set_allocated_virtual_routing_and_forwarding_id_mask(ym);
-            } else if (name == "hdr.arp.target_proto_addr") {
-                afiMatchObj.set_allocated_arp_target_ipv4_address(yv);
-                afiMatchObj.set_allocated_arp_target_ipv4_address_mask(ym);
-            } else if (name == "hdr.icmp.type") {
-                afiMatchObj.set_allocated_icmp_type(yv);
-                afiMatchObj.set_allocated_icmp_type_mask(ym);
-            }
-        } else if (bitWidth <= 64) {
-            unsigned char mc[6] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
-            std::string m(reinterpret_cast<const char *>(mc), 6);
-
-            ::ywrapper::BytesValue* yv = new::ywrapper::BytesValue();
-            yv->set_value(mf.value());
-
-            ::ywrapper::BytesValue* ym = new::ywrapper::BytesValue();
-            if (ternary == true) {
-                m = mf.mask();
-            }
-            ym->set_value(m);
+        }
 
-            if (name == "hdr.ethernet.src_addr") {
-                afiMatchObj.set_allocated_source_mac_address(yv);
-                afiMatchObj.set_allocated_source_mac_address_mask(ym);
-            } else if (name == "hdr.ethernet.dst_addr") {
-                afiMatchObj.set_allocated_destination_mac_address(yv);
-                afiMatchObj.set_allocated_destination_mac_address_mask(ym);
-            }
-        } else {
+        const auto *slot =
+            fieldMap->slot(AfiFieldMap::CAP_ENTRY_MATCH, tId, id);
+        if (slot == nullptr) {
             continue;
         }
-    }
 
-    int matchSize = afiMatchObj.ByteSize();
-    char *mArray = new char[matchSize];
-    afiMatchObj.SerializeToArray(mArray, matchSize);
-    std::string mEncoded = base64_encode(mArray, (unsigned int) (matchSize));
+        bool ternary = (mf.type() == AfiTEntryMatchField::MfType::TERNARY);
+        slot->set(afiMatchObj, mf.value(), ternary ? mf.mask() : "");
+    }
 
-    Json::Value mObj;
-    std::string mObjName(table->name() +
-                         "_entry_match" +
-                         "_" +
-                         std::to_string(id+1));
-    mObj["afi-object-name"] = mObjName;
-    mObj["afi-object-id"] = id + 1;
-    mObj["afi-object-type"] = "afi-cap-entry-match";
-    mObj["afi-object"] = mEncoded;
-    result.append(mObj);
+    std::string mObjName(table->name() + "_entry_match_" + entryName);
+    result.emplace_back(
+        "afi-cap-entry-match", id + 1, mObjName,
+        std::make_shared<juniper::afi_cap_entry_match::AfiCapEntryMatch>(
+            std::move(afiMatchObj)));
 
     Log(DEBUG) << "____ Action Keys ____";
 
     juniper::afi_cap_entry_action::AfiCapEntryAction afiActionObj;
-    for (auto ae : aes) {
+    for (const auto &ae : aes) {
         auto id = ae.id();
-        std::string name;
-        if ((name = action->actionParamName(id)) == "") {
+        const auto *param = action->actionParam(id);
+        if (param == nullptr) {
             Log(DEBUG) << "Bad Action Param ID: " << id;
             return false;
         }
 
-        std::cout << ae;
+        Log(DEBUG) << ae;
+        Log(DEBUG) << "Action Param: " << param->name;
 
-        Log(DEBUG) << "Action Param: " << name;
-
-        if (name == "vrf_id") {
-            ::ywrapper::UintValue* yv = new ::ywrapper::UintValue();
-            uint32_t v;
-            str2Uint(ae.value(), v);
-            yv->set_value(v);
-            afiActionObj.set_allocated_vrf(yv);
-        } else if (name == "class_id_value") {
-            ::ywrapper::UintValue* yv = new ::ywrapper::UintValue();
-            uint8_t v;
-            str2Uint(ae.value(), v);
-            yv->set_value(v);
-            afiActionObj.set_allocated_destination_class_id(yv);
-        } else if (name == "queue_id") {
-            ::ywrapper::UintValue* yv = new ::ywrapper::UintValue();
-            uint8_t v;
-            str2Uint(ae.value(), v);
-            yv->set_value(v);
-            afiActionObj.set_allocated_cpu_queue(yv);
-            // TODO: Following is hard-coded for now
-            {
-            ::ywrapper::BoolValue* yv = new ::ywrapper::BoolValue();
-            yv->set_value(1);
-            afiActionObj.set_allocated_copy_to_cpu(yv);
-            }
-        } else if (name == "hdr.ethernet.src_addr") {
-        } else if (name == "hdr.ipv4_base.diffserv") {
-        } else if (name == "hdr.ipv4_base.dst_addr") {
-        } else if (name == "hdr.standard_metadata.ingress_port") {
-        } else if (name == "hdr.ipv6_base.traffic_class") {
-        } else if (name == "hdr.ipv6_base.dst_addr") {
-        } else if (name == "hdr.ipv4_base.src_addr") {
+        const auto *slot =
+            fieldMap->slot(AfiFieldMap::CAP_ENTRY_ACTION, aId, id);
+        if (slot != nullptr) {
+            slot->set(afiActionObj, ae.value(), "");
         }
     }
 
-    int actionSize = afiActionObj.ByteSize();
-    char *aArray = new char[actionSize];
-    afiActionObj.SerializeToArray(aArray, actionSize);
-    std::string aEncoded = base64_encode(aArray, (unsigned int) (actionSize));
-
-    Json::Value aObj;
-    std::string aObjName(table->name() +
-                         "_entry_action" +
-                         "_" +
-                         std::to_string(id+2));
-    aObj["afi-object-name"] = aObjName;
-    aObj["afi-object-id"] = id + 2;
-    aObj["afi-object-type"] = "afi-cap-entry-action";
-    aObj["afi-object"] = aEncoded;
-    result.append(aObj);
+    std::string aObjName(table->name() + "_entry_action_" + entryName);
+    result.emplace_back(
+        "afi-cap-entry-action", id + 2, aObjName,
+        std::make_shared<juniper::afi_cap_entry_action::AfiCapEntryAction>(
+            std::move(afiActionObj)));
 
     juniper::afi_cap_entry::AfiCapEntry afiCapEntryObj;
 
@@ -308,21 +161,11 @@ AfiCap::createChildJsonRes(const uint32_t tId, //P4InfoTablePtr table,
     ao->set_value(aObjName);
     afiCapEntryObj.set_allocated_action_object(ao);
 
-    int eSize = afiCapEntryObj.ByteSize();
-    char *eArray = new char[eSize];
-    afiCapEntryObj.SerializeToArray(eArray, eSize);
-    std::string encoded = base64_encode(eArray, (unsigned int) (eSize));
-
-    Json::Value eObj;
-    eObj["afi-object-type"] = "afi-cap-entry";
-    eObj["afi-object-name"] = table->name() +
-                              "_entry" +
-                              "_" +
-                              std::to_string(id);
-    eObj["afi-object-id"] = id;
-    eObj["afi-object"] = encoded;
-
-    result.append(eObj);
+    result.emplace_back(
+        "afi-cap-entry", id,
+        table->name() + "_entry_" + entryName,
+        std::make_shared<juniper::afi_cap_entry::AfiCapEntry>(
+            std::move(afiCapEntryObj)));
 
     return true;
 }
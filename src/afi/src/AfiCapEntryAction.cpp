@@ -42,14 +42,10 @@ AfiCapEntryAction::description(std::ostream &os) const
 
 AfiCapEntryAction::AfiCapEntryAction(const AfiJsonResource &jsonRes) : AfiObject(jsonRes)
 {
-    // TBD: FIXME magic number 5000
-    char bytes_decoded[5000];
-    memset(bytes_decoded, 0, sizeof(bytes_decoded));
-    int num_decoded_bytes =
-        base64_decode(jsonRes.objStr(), bytes_decoded, 5000);
-    capEntryAction.ParseFromArray(bytes_decoded, num_decoded_bytes);
+    if (!decode(capEntryAction)) {
+        Log(ERROR) << jsonRes.name() << ": Unable to decode " << jsonRes.type();
+    }
 
-    Log(DEBUG) << "num_decoded_bytes: " << num_decoded_bytes;
     Log(DEBUG) << "capEntryAction.ByteSize(): " << capEntryAction.ByteSize();
 }
 
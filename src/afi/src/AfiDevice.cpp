@@ -22,6 +22,9 @@
 
 #include "AfiDevice.h"
 
+#include "JaegerLog.h"
+#include "AfiMetrics.h"
+
 namespace AFIHAL
 {
 AfiObjectPtr
@@ -29,13 +32,14 @@ AfiDevice::handleDMObject(const AfiJsonResource& res,
                           const bool& pipelineStage)
 {
     Log(DEBUG) << "____ AfiDevice::handleDMObject ____\n";
-    AfiObjectPtr afiObj = _objCreator.create(res.type(), res);
+    static MetricHistogram &latency = afiLatency("handleDMObject");
+    MetricTimer             timer(latency);
+    AfiObjectPtr afiObj = createObject(res);
 
     //
     // object creation failed
     //
     if (afiObj == nullptr) {
-        Log(ERROR) << "Unable to create afi object ";
         return nullptr;
     }
 
@@ -43,8 +47,10 @@ AfiDevice::handleDMObject(const AfiJsonResource& res,
 
     if (pipelineStage == false) {
         //
-        // Now bind the afi object.
+        // Now bind the afi object. Not while a change set is being
+        // committed, the target may have a batch open.
         //
+        std::lock_guard<std::mutex> guard(_commitMtx);
         if (!(afiObj->bind())) {
             //
             // Unable to bind
@@ -56,6 +62,183 @@ AfiDevice::handleDMObject(const AfiJsonResource& res,
     return afiObj;
 }
 
+AfiObjectPtr
+AfiDevice::createObject(const AfiJsonResource &res)
+{
+    AfiObjectPtr afiObj = _objCreator.create(res.type(), res);
+    if (afiObj == nullptr) {
+        Log(ERROR) << "Unable to create afi object " << res.name()
+                   << " of type " << res.type();
+    }
+    return afiObj;
+}
+
+//
+// @fn
+// updateObject
+//
+// @brief
+// Replace bound object oldObj by obj. The target reprograms in place if
+// it can, otherwise oldObj is unbound and obj bound. If obj fails to bind
+// oldObj is bound again.
+//
+// @param[in]
+//     oldObj Bound object
+// @param[in]
+//     obj New object of the same name
+// @return true if obj is bound
+//
+
+bool
+AfiDevice::updateObject(const AfiObjectPtr &oldObj, const AfiObjectPtr &obj)
+{
+    if (obj->update(oldObj)) {
+        return true;
+    }
+
+    Log(DEBUG) << "No in-place update for " << obj->name()
+               << ", rebinding";
+    oldObj->unbind();
+    if (!obj->bind()) {
+        oldObj->bind();
+        return false;
+    }
+    return true;
+}
+
+//
+// @fn
+// applyEntry
+//
+// @brief
+// Apply one staged change set operation
+//
+
+bool
+AfiDevice::applyEntry(AfiChangeSet::Entry &e)
+{
+    switch (e.op) {
+        case AfiChangeSet::BIND:
+            return e.obj->bind();
+        case AfiChangeSet::UNBIND:
+            if (!e.obj->unbind()) {
+                return false;
+            }
+            eraseFromObjectMap(e.obj);
+            return true;
+        case AfiChangeSet::UPDATE:
+            return updateObject(e.oldObj, e.obj);
+    }
+    return false;
+}
+
+//
+// @fn
+// revertEntry
+//
+// @brief
+// Undo a staged change set operation of a failed update. Objects created
+// for the update are removed from the object map again.
+//
+
+void
+AfiDevice::revertEntry(AfiChangeSet::Entry &e)
+{
+    switch (e.op) {
+        case AfiChangeSet::BIND:
+            if (e.done) {
+                e.obj->unbind();
+            }
+            eraseFromObjectMap(e.obj);
+            break;
+        case AfiChangeSet::UNBIND:
+            if (e.done) {
+                e.obj->bind();
+            }
+            insertToObjectMap(e.obj);
+            break;
+        case AfiChangeSet::UPDATE:
+            if (e.done) {
+                updateObject(e.obj, e.oldObj);
+            }
+            eraseFromObjectMap(e.obj);
+            insertToObjectMap(e.oldObj);
+            break;
+    }
+}
+
+//
+// @fn
+// commitChangeSet
+//
+// @brief
+// Apply all operations of a change set in staging (dependency) order
+// inside one target batch. An operation that fails fails its update; the
+// remaining operations of that update are skipped and the ones already
+// applied are undone again. If the batch itself is not taken by the
+// target none of its operations reached it, so only the object map is
+// restored.
+//
+// @param[in]
+//     changeSet Staged operations
+// @return true if every update was committed
+//
+
+bool
+AfiDevice::commitChangeSet(AfiChangeSet &changeSet)
+{
+    Log(DEBUG) << "____ AfiDevice::commitChangeSet ____\n";
+    JaegerSpan span("AFI commitChangeSet");
+    static MetricHistogram &latency = afiLatency("commitChangeSet");
+    MetricTimer             timer(latency);
+    JaegerLog::getInstance()->log("AFI:Commit:Operations",
+                                  changeSet.entries().size());
+    std::lock_guard<std::mutex> guard(_commitMtx);
+
+    auto &entries = changeSet.entries();
+    if (!beginBatch()) {
+        Log(ERROR) << "Unable to open target batch";
+        changeSet.failAll("Unable to open target batch");
+    } else {
+        for (auto &e : entries) {
+            if (changeSet.failed(e.update)) {
+                continue;
+            }
+            if (!applyEntry(e)) {
+                Log(ERROR) << ": Unable to apply afi object " << e.obj->name();
+                changeSet.fail(e.update,
+                               "Unable to apply afi object " + e.obj->name());
+                continue;
+            }
+            e.done = true;
+        }
+
+        if (!commitBatch()) {
+            Log(ERROR) << "Target batch commit failed";
+            changeSet.failAll("Target batch commit failed");
+            for (auto &e : entries) {
+                e.done = false;
+            }
+        }
+    }
+
+    //
+    // Roll back operations of failed updates
+    //
+    for (auto it = entries.rbegin(); it != entries.rend(); ++it) {
+        if (changeSet.failed(it->update)) {
+            revertEntry(*it);
+        }
+    }
+
+    for (uint32_t i = 0; i < changeSet.numUpdates(); i++) {
+        if (changeSet.failed(i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
 #if 0
 
 void
@@ -45,14 +45,10 @@ AfiEncap::description(std::ostream &os) const
 
 AfiEncap::AfiEncap(const AfiJsonResource &jsonRes) : AfiObject(jsonRes)
 {
-    // TBD: FIXME magic number 5000
-    char bytes_decoded[5000];
-    memset(bytes_decoded, 0, sizeof(bytes_decoded));
-    int num_decoded_bytes =
-        base64_decode(jsonRes.objStr(), bytes_decoded, 5000);
-    _encap.ParseFromArray(bytes_decoded, num_decoded_bytes);
-
-    Log(DEBUG) << "num_decoded_bytes: " << num_decoded_bytes;
+    if (!decode(_encap)) {
+        Log(ERROR) << jsonRes.name() << ": Unable to decode " << jsonRes.type();
+    }
+
     Log(DEBUG) << "encap.ByteSize(): " << _encap.ByteSize();
 
 }
@@ -67,17 +63,15 @@ AfiCap::createChildJsonRes(const uint32_t tId, //P4InfoTablePtr table,
 {
     Log(DEBUG) << "____ AFI::addCapEntry ____\n";
 
-    auto table =
-        std::dynamic_pointer_cast<P4InfoTable>(P4Info::instance().p4InfoResource(tId));
+    auto table = P4Info::instance().table(tId);
     if (table == nullptr) {
         Log(ERROR) << "Bad Table ID " << tId;
         return false;
     }
 
-    auto action =
-        std::dynamic_pointer_cast<P4InfoAction>(P4Info::instance().p4InfoResource(aId));
+    auto action = P4Info::instance().action(aId);
     if (action == nullptr) {
-        Log(ERROR) << "Bad Action ID " << tId;
+        Log(ERROR) << "Bad Action ID " << aId;
         return false;
     }
 
@@ -85,14 +79,15 @@ AfiCap::createChildJsonRes(const uint32_t tId, //P4InfoTablePtr table,
     Log(DEBUG) << "____ Match Keys ____";
 
     juniper::afi_cap_entry_match::AfiCapEntryMatch afiMatchObj;
-    for (auto mf : mfs) {
+    for (const auto &mf : mfs) {
         auto id = mf.id();
-        std::string name;
-        uint32_t bitWidth;
-        if (table->matchFieldInfo(id, name, bitWidth) == false) {
+        const auto *field = table->matchField(id);
+        if (field == nullptr) {
             Log(DEBUG) << "Bad Match Field ID: " << id;
             return false;
         }
+        const std::string &name     = field->name;
+        const uint32_t     bitWidth = field->bitWidth;
 
         Log(DEBUG) << "Match Field : " << name;
 
@@ -212,15 +207,16 @@ AfiCap::createChildJsonRes(const uint32_t tId, //P4InfoTablePtr table,
     Log(DEBUG) << "____ Action Keys ____";
 
     juniper::afi_cap_entry_action::AfiCapEntryAction afiActionObj;
-    for (auto ae : aes) {
+    for (const auto &ae : aes) {
         auto id = ae.id();
-        std::string name;
-        if ((name = action->actionParamName(id)) == "") {
+        const auto *param = action->actionParam(id);
+        if (param == nullptr) {
             Log(DEBUG) << "Bad Action Param ID: " << id;
             return false;
         }
+        const std::string &name = param->name;
 
-        std::cout << ae;
+        Log(DEBUG) << ae;
 
         Log(DEBUG) << "Action Param: " << name;
 
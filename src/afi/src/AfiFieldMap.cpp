@@ -0,0 +1,404 @@
+//
+// Juniper P4 Agent
+//
+/// @file  AfiFieldMap.cpp
+/// @brief Table driven P4 field to AFI field translation
+//
+// Copyright (c) [2018] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#include "Afi.h"
+#include "AfiFieldMap.h"
+#include "P4Info.h"
+#include "enums/enums.pb.h"
+
+#include "Log.h"
+
+namespace AFIHAL
+{
+namespace
+{
+using google::protobuf::Descriptor;
+using google::protobuf::FieldDescriptor;
+using google::protobuf::Message;
+using google::protobuf::Reflection;
+
+//
+// Built-in mapping, used unless the pipeline config overrides it
+//
+struct AfiFieldMapDefault {
+    AfiFieldMap::Target target;
+    const char *        p4Name;
+    const char *        afiField;
+    const char *        constField;  ///< Optional constant set along
+    uint64_t            constValue;
+};
+
+const AfiFieldMapDefault kDefaults[] = {
+    {AfiFieldMap::CAP_ENTRY_MATCH, "standard_metadata.ingress_port",
+     "source_port", nullptr, 0},
+    {AfiFieldMap::CAP_ENTRY_MATCH, "standard_metadata.egress_spec",
+     "destination_port", nullptr, 0},
+    {AfiFieldMap::CAP_ENTRY_MATCH, "hdr.ethernet.ether_type", "ethertype",
+     nullptr, 0},
+    {AfiFieldMap::CAP_ENTRY_MATCH, "hdr.ethernet.src_addr",
+     "source_mac_address", nullptr, 0},
+    {AfiFieldMap::CAP_ENTRY_MATCH, "hdr.ethernet.dst_addr",
+     "destination_mac_address", nullptr, 0},
+    {AfiFieldMap::CAP_ENTRY_MATCH, "hdr.vlan_tag[0].vid", "outer_vlan_id",
+     nullptr, 0},
+    {AfiFieldMap::CAP_ENTRY_MATCH, "hdr.vlan_tag[0].pcp", "outer_vlan_dot1p",
+     nullptr, 0},
+    {AfiFieldMap::CAP_ENTRY_MATCH, "hdr.ipv4_base.ttl", "ipv4_ttl", nullptr,
+     0},
+    {AfiFieldMap::CAP_ENTRY_MATCH, "hdr.ipv4_base.protocol", "ip_protocol",
+     nullptr, 0},
+    {AfiFieldMap::CAP_ENTRY_MATCH, "hdr.ipv4_base.diffserv", "tos", nullptr,
+     0},
+    {AfiFieldMap::CAP_ENTRY_MATCH, "hdr.ipv4_base.src_addr",
+     "source_ipv4_address", nullptr, 0},
+    {AfiFieldMap::CAP_ENTRY_MATCH, "hdr.ipv4_base.dst_addr",
+     "destination_ipv4_address", nullptr, 0},
+    {AfiFieldMap::CAP_ENTRY_MATCH, "local_metadata.l4_src_port",
+     "l4_source_port", nullptr, 0},
+    {AfiFieldMap::CAP_ENTRY_MATCH, "local_metadata.l4_dst_port",
+     "l4_destination_port", nullptr, 0},
+    {AfiFieldMap::CAP_ENTRY_MATCH, "local_metadata.class_id",
+     "ingress_class_id", nullptr, 0},
+    {AfiFieldMap::CAP_ENTRY_MATCH, "local_metadata.vrf_id",
+     "virtual_routing_and_forwarding_id", nullptr, 0},
+    {AfiFieldMap::CAP_ENTRY_MATCH, "hdr.arp.target_proto_addr",
+     "arp_target_ipv4_address", nullptr, 0},
+    {AfiFieldMap::CAP_ENTRY_MATCH, "hdr.icmp.type", "icmp_type", nullptr, 0},
+
+    {AfiFieldMap::CAP_ENTRY_ACTION, "vrf_id", "vrf", nullptr, 0},
+    {AfiFieldMap::CAP_ENTRY_ACTION, "class_id_value", "destination_class_id",
+     nullptr, 0},
+    {AfiFieldMap::CAP_ENTRY_ACTION, "queue_id", "cpu_queue", "copy_to_cpu",
+     1},
+
+    {AfiFieldMap::TREE_ENTRY, "local_metadata.vrf_id", "vrf_id", nullptr, 0},
+
+    {AfiFieldMap::ENCAP_ENTRY, "port", "egress_port", nullptr, 0},
+    {AfiFieldMap::ENCAP_ENTRY, "smac", "packet_ether_saddr", nullptr, 0},
+    {AfiFieldMap::ENCAP_ENTRY, "dmac", "packet_ether_daddr", nullptr, 0},
+    {AfiFieldMap::ENCAP_ENTRY, "l3_class_id", "packet_l3_class_id", nullptr,
+     0},
+};
+
+const char *kTargetNames[AfiFieldMap::NUM_TARGETS] = {
+    "afi-cap-entry-match", "afi-cap-entry-action", "afi-tree-entry",
+    "afi-encap-entry"};
+
+const char *kEncapFieldPrefix = "AFIENCAPENTRYAFIFIELD_";
+
+//
+// Network order bytestring to integer. Longer strings keep the low order
+// 64 bits.
+//
+uint64_t
+bytes2Uint(const std::string &bytes)
+{
+    uint64_t v = 0;
+    for (const auto c : bytes) {
+        v = (v << 8) | static_cast<uint8_t>(c);
+    }
+    return v;
+}
+
+//
+// Resolve an AFI message field to its ywrapper wrapper value field
+//
+AfiFieldRef
+fieldRef(const Descriptor *desc, const std::string &name)
+{
+    AfiFieldRef ref;
+    const FieldDescriptor *f = desc->FindFieldByName(name);
+    if ((f == nullptr) || (f->cpp_type() != FieldDescriptor::CPPTYPE_MESSAGE)) {
+        return ref;
+    }
+    const FieldDescriptor *v = f->message_type()->FindFieldByName("value");
+    if (v == nullptr) {
+        return ref;
+    }
+    ref.field = f;
+    ref.value = v;
+    return ref;
+}
+
+void
+setUint(Message &msg, const AfiFieldRef &ref, uint64_t v)
+{
+    Message *w = msg.GetReflection()->MutableMessage(&msg, ref.field);
+    const Reflection *r = w->GetReflection();
+    switch (ref.value->cpp_type()) {
+        case FieldDescriptor::CPPTYPE_UINT64:
+            r->SetUInt64(w, ref.value, v);
+            break;
+        case FieldDescriptor::CPPTYPE_INT64:
+            r->SetInt64(w, ref.value, static_cast<int64_t>(v));
+            break;
+        case FieldDescriptor::CPPTYPE_BOOL:
+            r->SetBool(w, ref.value, v != 0);
+            break;
+        default:
+            break;
+    }
+}
+
+void
+setBytes(Message &msg, const AfiFieldRef &ref, const std::string &bytes)
+{
+    if (ref.value->cpp_type() != FieldDescriptor::CPPTYPE_STRING) {
+        setUint(msg, ref, bytes2Uint(bytes));
+        return;
+    }
+    Message *w = msg.GetReflection()->MutableMessage(&msg, ref.field);
+    w->GetReflection()->SetString(w, ref.value, bytes);
+}
+
+}  // namespace
+
+void
+AfiFieldSlot::set(Message &msg, const std::string &value,
+                  const std::string &mask) const
+{
+    if (field.valid()) {
+        setBytes(msg, field, value);
+    }
+
+    if (this->mask.valid()) {
+        if (!mask.empty()) {
+            setBytes(msg, this->mask, mask);
+        } else if (this->mask.value->cpp_type() ==
+                   FieldDescriptor::CPPTYPE_STRING) {
+            setBytes(msg, this->mask, std::string(value.size(), '\xff'));
+        } else {
+            // Field wide, or value wide if the bitwidth is not known
+            uint32_t bits = bitWidth ? bitWidth : uint32_t(8 * value.size());
+            setUint(msg, this->mask,
+                    ((bits == 0) || (bits >= 64)) ? UINT64_MAX
+                                                  : (1ULL << bits) - 1);
+        }
+    }
+
+    for (const auto &c : constants) {
+        setUint(msg, c.first, c.second);
+    }
+}
+
+const Descriptor *
+AfiFieldMap::descriptor(Target t)
+{
+    switch (t) {
+        case CAP_ENTRY_MATCH:
+            return juniper::afi_cap_entry_match::AfiCapEntryMatch::descriptor();
+        case CAP_ENTRY_ACTION:
+            return juniper::afi_cap_entry_action::AfiCapEntryAction::
+                descriptor();
+        case TREE_ENTRY:
+            return juniper::afi_tree_entry::AfiTreeEntry::descriptor();
+        default:
+            return nullptr;
+    }
+}
+
+//
+// @fn
+// reset
+//
+// @brief
+// Drop the pipeline config supplied mapping and go back to the built-in one
+//
+// @param[in] void
+// @return void
+//
+
+void
+AfiFieldMap::reset()
+{
+    for (int t = 0; t < NUM_TARGETS; t++) {
+        _spec[t].clear();
+        _slots[t].clear();
+    }
+
+    for (const auto &d : kDefaults) {
+        Spec &spec = _spec[d.target][d.p4Name];
+        spec.field = d.afiField;
+        if (d.constField != nullptr) {
+            spec.constants[d.constField] = d.constValue;
+        }
+    }
+}
+
+//
+// @fn
+// load
+//
+// @brief
+// Merge an "afi-field-map" object into the mapping. An entry replaces the
+// built-in mapping of the same P4 name; an empty field name unmaps it.
+//
+// @param[in]
+//     map Json object keyed by target type
+// @return true on success, false if map is malformed
+//
+
+bool
+AfiFieldMap::load(const Json::Value &map)
+{
+    if (!map.isObject()) {
+        Log(ERROR) << "afi-field-map is not an object";
+        return false;
+    }
+
+    for (const auto &targetName : map.getMemberNames()) {
+        int t = 0;
+        while ((t < NUM_TARGETS) && (targetName != kTargetNames[t])) {
+            t++;
+        }
+        if (t == NUM_TARGETS) {
+            Log(ERROR) << "afi-field-map: unknown target " << targetName;
+            return false;
+        }
+
+        const Json::Value &fields = map[targetName];
+        if (!fields.isObject()) {
+            Log(ERROR) << "afi-field-map: " << targetName
+                       << " is not an object";
+            return false;
+        }
+
+        for (const auto &p4Name : fields.getMemberNames()) {
+            const Json::Value &v = fields[p4Name];
+            Spec               spec;
+            if (v.isString()) {
+                spec.field = v.asString();
+            } else if (v.isObject() && v["field"].isString()) {
+                spec.field = v["field"].asString();
+                spec.mask  = v.get("mask", "").asString();
+                const Json::Value &set = v["set"];
+                for (const auto &c : set.getMemberNames()) {
+                    spec.constants[c] = set[c].asUInt64();
+                }
+            } else {
+                Log(ERROR) << "afi-field-map: bad mapping for " << p4Name;
+                return false;
+            }
+            _spec[t][p4Name] = spec;
+        }
+    }
+    return true;
+}
+
+bool
+AfiFieldMap::resolve(Target t, const std::string &p4Name, AfiFieldSlot &slot)
+{
+    auto it = _spec[t].find(p4Name);
+    if ((it == _spec[t].end()) || it->second.field.empty()) {
+        return false;
+    }
+    const Spec &spec = it->second;
+
+    if (t == ENCAP_ENTRY) {
+        const auto *e = juniper::enums::AfiEncapEntryAfiField_descriptor()
+                            ->FindValueByName(kEncapFieldPrefix + spec.field);
+        if (e == nullptr) {
+            Log(ERROR) << "afi-field-map: " << p4Name
+                       << ": no encap field " << spec.field;
+            return false;
+        }
+        slot.enumValue = e->number();
+        return true;
+    }
+
+    const Descriptor *desc = descriptor(t);
+    slot.field = fieldRef(desc, spec.field);
+    if (!slot.field.valid()) {
+        Log(ERROR) << "afi-field-map: " << p4Name << ": no field "
+                   << spec.field << " in " << desc->name();
+        return false;
+    }
+    slot.mask = fieldRef(desc, spec.mask.empty() ? spec.field + "_mask"
+                                                 : spec.mask);
+    for (const auto &c : spec.constants) {
+        AfiFieldRef ref = fieldRef(desc, c.first);
+        if (!ref.valid()) {
+            Log(ERROR) << "afi-field-map: " << p4Name << ": no field "
+                       << c.first << " in " << desc->name();
+            continue;
+        }
+        slot.constants.emplace_back(ref, c.second);
+    }
+    return true;
+}
+
+//
+// @fn
+// compile
+//
+// @brief
+// Resolve the mapping for every table and action of a P4Info
+//
+// @param[in]
+//     p4info Compiled P4Info of the pipeline config
+// @return void
+//
+
+void
+AfiFieldMap::compile(const P4InfoIndex &p4info)
+{
+    for (int t = 0; t < NUM_TARGETS; t++) {
+        _slots[t].clear();
+    }
+
+    for (const auto &t : p4info.tables()) {
+        const auto &fields = t.second->matchFields();
+        for (const Target target : {CAP_ENTRY_MATCH, TREE_ENTRY}) {
+            std::vector<AfiFieldSlot> slots(fields.size());
+            bool                      mapped = false;
+            for (size_t id = 0; id < fields.size(); id++) {
+                if (fields[id].valid &&
+                    resolve(target, fields[id].name, slots[id])) {
+                    slots[id].bitWidth = fields[id].bitWidth;
+                    mapped             = true;
+                }
+            }
+            if (mapped) {
+                _slots[target][t.first] = std::move(slots);
+            }
+        }
+    }
+
+    for (const auto &a : p4info.actions()) {
+        const auto &params = a.second->actionParams();
+        for (const Target target : {CAP_ENTRY_ACTION, ENCAP_ENTRY}) {
+            std::vector<AfiFieldSlot> slots(params.size());
+            bool                      mapped = false;
+            for (size_t id = 0; id < params.size(); id++) {
+                if (params[id].valid &&
+                    resolve(target, params[id].name, slots[id])) {
+                    slots[id].bitWidth = params[id].bitWidth;
+                    mapped             = true;
+                }
+            }
+            if (mapped) {
+                _slots[target][a.first] = std::move(slots);
+            }
+        }
+    }
+}
+
+}  // namespace AFIHAL
@@ -21,7 +21,12 @@
 //
 
 #include "AfiJsonResource.h"
+#include <google/protobuf/util/message_differencer.h>
 #include <iostream>
+#include <vector>
+
+#include "Log.h"
+#include "Utils.h"
 
 namespace AFIHAL
 {
@@ -39,4 +44,61 @@ AfiJsonResource::description(std::ostream &os) const
     return os;
 }
 
+const std::string
+AfiJsonResource::objStr() const
+{
+    if (_msg == nullptr) {
+        return _objStr;
+    }
+    std::string bytes = _msg->SerializeAsString();
+    return base64_encode(bytes.data(), (unsigned int)bytes.size());
+}
+
+//
+// @fn
+// take
+//
+// @brief
+// Get the object into msg. An agent built object is swapped over and _msg
+// then points at msg without owning it, msg being a member of the object
+// this resource belongs to. A json object is base64 decoded and parsed.
+//
+// @param[out]
+//     msg Message of the object type
+// @return true on success
+//
+
+bool
+AfiJsonResource::take(google::protobuf::Message &msg)
+{
+    if (_msg != nullptr) {
+        if (_msg->GetDescriptor() != msg.GetDescriptor()) {
+            Log(ERROR) << _name << ": " << _msg->GetTypeName()
+                       << " is not a " << msg.GetTypeName();
+            return false;
+        }
+        msg.GetReflection()->Swap(&msg, _msg.get());
+        _msg = AfiMessagePtr(AfiMessagePtr(), &msg);
+        return true;
+    }
+
+    // base64_decode wants room for one byte more than it writes
+    std::vector<char> bytes(_objStr.size() + 1);
+    int num_decoded_bytes =
+        base64_decode(_objStr, bytes.data(), (unsigned int)bytes.size());
+    Log(DEBUG) << "num_decoded_bytes: " << num_decoded_bytes;
+
+    return msg.ParseFromArray(bytes.data(), num_decoded_bytes);
+}
+
+bool
+AfiJsonResource::sameObject(const AfiJsonResource &res) const
+{
+    if ((_msg != nullptr) && (res._msg != nullptr)) {
+        return google::protobuf::util::MessageDifferencer::Equals(*_msg,
+                                                                  *res._msg);
+    }
+    return objStr() == res.objStr();
+}
+
 }  // namespace AFIHAL
@@ -0,0 +1,349 @@
+//
+// Juniper P4 Agent
+//
+/// @file  AfiShadowStore.cpp
+/// @brief Shadow copy of installed table entries
+//
+// Copyright (c) [2018] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#include "AfiShadowStore.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace AFIHAL
+{
+namespace
+{
+void
+appendUint32(std::string &key, uint32_t v)
+{
+    for (int s = 24; s >= 0; s -= 8) {
+        key.push_back(static_cast<char>((v >> s) & 0xff));
+    }
+}
+
+//
+// Append a length-prefixed bytestring with leading zero bytes stripped
+//
+void
+appendBytes(std::string &key, const std::string &bytes)
+{
+    size_t i = 0;
+    while ((i < bytes.size()) && (bytes[i] == 0)) {
+        i++;
+    }
+    appendUint32(key, static_cast<uint32_t>(bytes.size() - i));
+    key.append(bytes, i, std::string::npos);
+}
+
+//
+// value & mask, right aligned
+//
+std::string
+maskBytes(const std::string &value, const std::string &mask)
+{
+    std::string result(value);
+    size_t      vlen = value.size();
+    size_t      mlen = mask.size();
+    for (size_t i = 0; i < vlen; i++) {
+        result[vlen - 1 - i] &= (i < mlen) ? mask[mlen - 1 - i] : 0;
+    }
+    return result;
+}
+
+//
+// value with all bits beyond prefixLen cleared
+//
+std::string
+prefixBytes(const std::string &value, int prefixLen)
+{
+    std::string result(value);
+    for (size_t i = 0; i < result.size(); i++) {
+        int bits = prefixLen - static_cast<int>(i * 8);
+        if (bits >= 8) {
+            continue;
+        }
+        result[i] &= (bits <= 0) ? 0 : static_cast<char>(0xff << (8 - bits));
+    }
+    return result;
+}
+
+}  // namespace
+
+std::string
+AfiShadowStore::canonicalKey(const p4::TableEntry &entry)
+{
+    std::vector<const p4::FieldMatch *> mfs;
+    for (const auto &mf : entry.match()) {
+        mfs.push_back(&mf);
+    }
+    std::sort(mfs.begin(), mfs.end(),
+              [](const p4::FieldMatch *a, const p4::FieldMatch *b) {
+                  return a->field_id() < b->field_id();
+              });
+
+    std::string key;
+    for (const auto mf : mfs) {
+        appendUint32(key, mf->field_id());
+        key.push_back(static_cast<char>(mf->field_match_type_case()));
+        switch (mf->field_match_type_case()) {
+            case p4::FieldMatch::kExact:
+                appendBytes(key, mf->exact().value());
+                break;
+            case p4::FieldMatch::kTernary:
+                appendBytes(key, maskBytes(mf->ternary().value(),
+                                           mf->ternary().mask()));
+                appendBytes(key, mf->ternary().mask());
+                break;
+            case p4::FieldMatch::kLpm:
+                appendBytes(key, prefixBytes(mf->lpm().value(),
+                                             mf->lpm().prefix_len()));
+                appendUint32(key, mf->lpm().prefix_len());
+                break;
+            case p4::FieldMatch::kRange:
+                appendBytes(key, mf->range().low());
+                appendBytes(key, mf->range().high());
+                break;
+            case p4::FieldMatch::kValid:
+                key.push_back(mf->valid().value() ? 1 : 0);
+                break;
+            default:
+                break;
+        }
+    }
+    appendUint32(key, static_cast<uint32_t>(entry.priority()));
+    return key;
+}
+
+std::string
+AfiShadowStore::entryName(const p4::TableEntry &entry)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    std::string key = canonicalKey(entry);
+    std::string name;
+    name.reserve(2 * key.size());
+    for (unsigned char c : key) {
+        name.push_back(hex[c >> 4]);
+        name.push_back(hex[c & 0xf]);
+    }
+    return name;
+}
+
+void
+AfiShadowStore::insert(const p4::TableEntry &           entry,
+                       const std::vector<AfiObjectPtr> &objs)
+{
+    std::string                 key = canonicalKey(entry);
+    std::lock_guard<std::mutex> lock(_mtx);
+    _tables[entry.table_id()][key] = {entry, objs};
+}
+
+bool
+AfiShadowStore::modify(const p4::TableEntry &           entry,
+                       const std::vector<AfiObjectPtr> &objs)
+{
+    std::string                 key = canonicalKey(entry);
+    std::lock_guard<std::mutex> lock(_mtx);
+
+    auto t = _tables.find(entry.table_id());
+    if (t == _tables.end()) {
+        return false;
+    }
+    auto e = t->second.find(key);
+    if (e == t->second.end()) {
+        return false;
+    }
+    *e->second.entry.mutable_action() = entry.action();
+    e->second.entry.set_controller_metadata(entry.controller_metadata());
+    e->second.objs = objs;
+    return true;
+}
+
+bool
+AfiShadowStore::erase(const p4::TableEntry &entry)
+{
+    std::string                 key = canonicalKey(entry);
+    std::lock_guard<std::mutex> lock(_mtx);
+
+    auto t = _tables.find(entry.table_id());
+    if (t == _tables.end()) {
+        return false;
+    }
+    return (t->second.erase(key) != 0);
+}
+
+bool
+AfiShadowStore::lookup(const p4::TableEntry &key, p4::TableEntry &entry,
+                       std::vector<AfiObjectPtr> *objs)
+{
+    std::string                 k = canonicalKey(key);
+    std::lock_guard<std::mutex> lock(_mtx);
+
+    auto t = _tables.find(key.table_id());
+    if (t == _tables.end()) {
+        return false;
+    }
+    auto e = t->second.find(k);
+    if (e == t->second.end()) {
+        return false;
+    }
+    entry = e->second.entry;
+    if (objs != nullptr) {
+        *objs = e->second.objs;
+    }
+    return true;
+}
+
+std::vector<AfiObjectPtr>
+AfiShadowStore::objects()
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+
+    std::vector<AfiObjectPtr> objs;
+    for (const auto &t : _tables) {
+        for (const auto &e : t.second) {
+            objs.insert(objs.end(), e.second.objs.begin(),
+                        e.second.objs.end());
+        }
+    }
+    return objs;
+}
+
+void
+AfiShadowStore::clear(uint32_t tableId)
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    if (tableId == 0) {
+        _tables.clear();
+    } else {
+        _tables.erase(tableId);
+    }
+}
+
+size_t
+AfiShadowStore::size(uint32_t tableId)
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    if (tableId != 0) {
+        auto t = _tables.find(tableId);
+        return (t == _tables.end()) ? 0 : t->second.size();
+    }
+    size_t n = 0;
+    for (const auto &t : _tables) {
+        n += t.second.size();
+    }
+    return n;
+}
+
+size_t
+AfiShadowStore::read(uint32_t tableId, AfiShadowCursor &cursor,
+                     size_t maxEntries, size_t maxBytes,
+                     p4::ReadResponse &response)
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+
+    size_t added = 0;
+    size_t bytes = 0;
+
+    auto t = cursor.started ? _tables.lower_bound(cursor.tableId)
+                            : _tables.lower_bound(tableId);
+    for (; t != _tables.end(); ++t) {
+        if ((tableId != 0) && (t->first != tableId)) {
+            break;
+        }
+
+        auto e = t->second.begin();
+        if (cursor.started && (t->first == cursor.tableId)) {
+            e = t->second.upper_bound(cursor.key);
+        }
+
+        for (; e != t->second.end(); ++e) {
+            if ((added >= maxEntries) || (bytes >= maxBytes)) {
+                return added;
+            }
+            *response.add_entities()->mutable_table_entry() = e->second.entry;
+            bytes += e->second.entry.ByteSizeLong();
+            added++;
+
+            cursor.tableId = t->first;
+            cursor.key     = e->first;
+            cursor.started = true;
+        }
+    }
+
+    cursor.done = true;
+    return added;
+}
+
+bool
+AfiShadowOverlay::lookup(const p4::TableEntry &key, p4::TableEntry &entry,
+                         std::vector<AfiObjectPtr> *objs)
+{
+    auto c = _changes.find(
+        Key(key.table_id(), AfiShadowStore::canonicalKey(key)));
+    if (c == _changes.end()) {
+        return _store.lookup(key, entry, objs);
+    }
+    if (!c->second.present) {
+        return false;
+    }
+    entry = c->second.shadow.entry;
+    if (objs != nullptr) {
+        *objs = c->second.shadow.objs;
+    }
+    return true;
+}
+
+int
+AfiShadowOverlay::lastUpdate(const p4::TableEntry &key) const
+{
+    auto c = _changes.find(
+        Key(key.table_id(), AfiShadowStore::canonicalKey(key)));
+    return (c == _changes.end()) ? -1 : static_cast<int>(c->second.update);
+}
+
+void
+AfiShadowOverlay::insert(uint32_t update, const p4::TableEntry &entry,
+                         const std::vector<AfiObjectPtr> &objs)
+{
+    _changes[Key(entry.table_id(), AfiShadowStore::canonicalKey(entry))] = {
+        update, true, {entry, objs}};
+}
+
+void
+AfiShadowOverlay::modify(uint32_t update, const p4::TableEntry &entry,
+                         const std::vector<AfiObjectPtr> &objs)
+{
+    p4::TableEntry installed;
+    if (!lookup(entry, installed)) {
+        return;
+    }
+    *installed.mutable_action() = entry.action();
+    installed.set_controller_metadata(entry.controller_metadata());
+    _changes[Key(entry.table_id(), AfiShadowStore::canonicalKey(entry))] = {
+        update, true, {installed, objs}};
+}
+
+void
+AfiShadowOverlay::erase(uint32_t update, const p4::TableEntry &entry)
+{
+    _changes[Key(entry.table_id(), AfiShadowStore::canonicalKey(entry))] = {
+        update, false, {}};
+}
+
+}  // namespace AFIHAL
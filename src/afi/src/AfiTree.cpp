@@ -20,6 +20,7 @@
 // as noted in the Third-Party source code file.
 //
 
+#include "Afi.h"
 #include "AfiTree.h"
 #include <cstring>
 #include <memory>
@@ -42,25 +43,43 @@ AfiTree::description(std::ostream &os) const
 
 AfiTree::AfiTree(const AfiJsonResource &jsonRes) : AfiObject(jsonRes)
 {
-    // TBD: FIXME magic number 5000
-
-    char bytes_decoded[5000];
-    memset(bytes_decoded, 0, sizeof(bytes_decoded));
-    int num_decoded_bytes =
-        base64_decode(jsonRes.objStr(), bytes_decoded, 5000);
-
-    Log(DEBUG) << "bytes_decoded: " << bytes_decoded;
-    Log(DEBUG) << "num_decoded_bytes: " << num_decoded_bytes;
-
-    _tree.ParseFromArray(bytes_decoded, num_decoded_bytes);
+    if (!decode(_tree)) {
+        Log(ERROR) << jsonRes.name() << ": Unable to decode " << jsonRes.type();
+    }
 
     Log(DEBUG) << "tree.ByteSize(): " << _tree.ByteSize();
     ::ywrapper::StringValue key_field = _tree.key_field();
     Log(DEBUG) << "key_field: " << key_field.value();
 
-    std::stringstream ks;
-    ks << key_field.value();
-    JaegerLog::getInstance()->Log("AFI:AFITree:Key Field", ks.str());
+    JaegerLog::getInstance()->log("AFI:AFITree:Key Field", key_field.value());
+}
+
+//
+// @fn
+// createChildJsonRes
+//
+// @brief
+// The entries of a tree are tree entries, created from the entry's key by
+// Afi::addEntry(). Once the key has gone into the tree entry there are no
+// further child objects; match fields left over cannot be placed.
+//
+// @return true if no match field is left
+//
+
+bool
+AfiTree::createChildJsonRes(const uint32_t tId,
+                            const uint32_t aId,
+                            const std::vector<AfiTEntryMatchField> &mfs,
+                            const std::vector<AfiAEntry> &aes,
+                            const std::string &entryName,
+                            std::vector<AfiJsonResource> &result)
+{
+    if (!mfs.empty()) {
+        Log(ERROR) << name() << ": " << mfs.size()
+                   << " match fields do not fit a tree entry";
+        return false;
+    }
+    return true;
 }
 
 }  // namespace AFIHAL
@@ -47,14 +47,10 @@ AfiTreeEncap::description(std::ostream &os) const
 
 AfiTreeEncap::AfiTreeEncap(const AfiJsonResource &jsonRes) : AfiObject(jsonRes)
 {
-    // TBD: FIXME magic number 5000
-    char bytes_decoded[5000];
-    memset(bytes_decoded, 0, sizeof(bytes_decoded));
-    int num_decoded_bytes =
-        base64_decode(jsonRes.objStr(), bytes_decoded, 5000);
-    _treeEncap.ParseFromArray(bytes_decoded, num_decoded_bytes);
-
-    Log(DEBUG) << "num_decoded_bytes: " << num_decoded_bytes;
+    if (!decode(_treeEncap)) {
+        Log(ERROR) << jsonRes.name() << ": Unable to decode " << jsonRes.type();
+    }
+
     Log(DEBUG) << "treeEncap.ByteSize(): " << _treeEncap.ByteSize();
 
 }
@@ -64,49 +60,46 @@ AfiTreeEncap::createChildJsonRes(const uint32_t tId, //P4InfoTablePtr table,
                            const uint32_t aId, //P4InfoActionPtr action,
                            const std::vector<AfiTEntryMatchField> &mfs,
                            const std::vector<AfiAEntry> &aes,
-                           Json::Value& result)
+                           const std::string &entryName,
+                           std::vector<AfiJsonResource> &result)
 {
     Log(DEBUG) << "____ AFI::addTreeEncapEntry ____\n";
 
-    auto table =
-        std::dynamic_pointer_cast<P4InfoTable>(P4Info::instance().p4InfoResource(tId));
+    auto table = P4Info::instance().table(tId);
     if (table == nullptr) {
         Log(ERROR) << "Bad Table ID " << tId;
         return false;
     }
 
-    auto action =
-        std::dynamic_pointer_cast<P4InfoAction>(P4Info::instance().p4InfoResource(aId));
+    auto action = P4Info::instance().action(aId);
     if (action == nullptr) {
-        Log(ERROR) << "Bad Action ID " << tId;
+        Log(ERROR) << "Bad Action ID " << aId;
         return false;
     }
 
     int id = 1233457;
 
     Log(DEBUG) << "____ Encap ____";
+    const AfiFieldMapPtr fieldMap = Afi::instance().fieldMap();
+
     juniper::afi_encap_entry::AfiEncapEntry afiEncapEntryObj;
 
-    for (auto ae : aes) {
+    for (const auto &ae : aes) {
         auto id = ae.id();
-        std::string name;
-        if ((name = action->actionParamName(id)) == "") {
+        const auto *param = action->actionParam(id);
+        if (param == nullptr) {
             Log(DEBUG) << "Bad Action Param ID: " << id;
             return false;
         }
 
         Log(DEBUG) << ae;
-        Log(DEBUG) << "Action Param: " << name;
+        Log(DEBUG) << "Action Param: " << param->name;
 
         AfiEncapEntry_AfiKeyKey* keyKey = afiEncapEntryObj.add_afi_key();
-        if (name == "port") {
-            keyKey->set_field_name(AfiEncapEntryAfiField::AFIENCAPENTRYAFIFIELD_egress_port);
-        } else if (name == "smac") {
-            keyKey->set_field_name(AfiEncapEntryAfiField::AFIENCAPENTRYAFIFIELD_packet_ether_saddr);
-        } else if (name == "dmac") {
-            keyKey->set_field_name(AfiEncapEntryAfiField::AFIENCAPENTRYAFIFIELD_packet_ether_daddr);
-        } else if (name == "l3_class_id") {
-            keyKey->set_field_name(AfiEncapEntryAfiField::AFIENCAPENTRYAFIFIELD_packet_l3_class_id);
+        const auto *slot = fieldMap->slot(AfiFieldMap::ENCAP_ENTRY, aId, id);
+        if (slot != nullptr) {
+            keyKey->set_field_name(
+                static_cast<AfiEncapEntryAfiField>(slot->enumValue));
         }
 
         AfiEncapEntry_AfiKey* key = new::AfiEncapEntry_AfiKey();
@@ -120,36 +113,27 @@ AfiTreeEncap::createChildJsonRes(const uint32_t tId, //P4InfoTablePtr table,
     po->set_value(table->name() + "_encap");
     afiEncapEntryObj.set_allocated_parent_name(po);
 
-    int encapEntrySize = afiEncapEntryObj.ByteSize();
-    char *aArray = new char[encapEntrySize];
-    afiEncapEntryObj.SerializeToArray(aArray, encapEntrySize);
-    std::string eEncoded = base64_encode(aArray, (unsigned int) (encapEntrySize));
-
-    Json::Value eObj;
     std::string eObjName(table->name() +
                          "_entry_encap" +
                          "_" +
-                         std::to_string(id+2));
-    eObj["afi-object-name"] = eObjName;
-    eObj["afi-object-id"] = id + 2;
-    eObj["afi-object-type"] = "afi-encap-entry";
-    eObj["afi-object"] = eEncoded;
-    result.append(eObj);
+                         entryName);
+    result.emplace_back(
+        "afi-encap-entry", id + 2, eObjName,
+        std::make_shared<juniper::afi_encap_entry::AfiEncapEntry>(
+            std::move(afiEncapEntryObj)));
 
     Log(DEBUG) << "____ Tree ____";
     juniper::afi_tree_entry::AfiTreeEntry afiTreeEntryObj;
 
-    for (auto mf : mfs) {
+    for (const auto &mf : mfs) {
         auto id = mf.id();
-        std::string name;
-        uint32_t bitWidth;
-
-        if (table->matchFieldInfo(id, name, bitWidth) == false) {
+        const auto *field = table->matchField(id);
+        if (field == nullptr) {
             Log(DEBUG) << "Bad Match Field ID: " << id;
             return false;
         }
 
-        Log(DEBUG) << "Match Field : " << name;
+        Log(DEBUG) << "Match Field : " << field->name;
 
         if (mf.type() == AfiTEntryMatchField::MfType::LPM) {
             ::ywrapper::StringValue *pfx = new ::ywrapper::StringValue();
@@ -161,65 +145,17 @@ AfiTreeEncap::createChildJsonRes(const uint32_t tId, //P4InfoTablePtr table,
             afiTreeEntryObj.set_allocated_prefix_length(plen);
         }
 
-        uint32_t v, m;
-        bool ternary = (mf.type() == AfiTEntryMatchField::MfType::TERNARY) ?
-                       true : false;
-
-        if (ternary == false) {
-            m = 0xffffffff; // TODO: Must be of bitwidth
+        if ((field->bitWidth == 0) || (field->bitWidth > 64)) {
+            continue;
         }
 
-        if (bitWidth == 0) {
-            continue;
-        } else if (bitWidth <= 8) {
-            v = *((const uint8_t *) &mf.value().c_str()[0]);
-            if (ternary == true) {
-                m = *((const uint8_t *) &mf.mask().c_str()[0]);
-            }
-        } else if (bitWidth <= 16) {
-            v = *((const uint16_t *) &mf.value().c_str()[0]);
-            v = ntohs(v);
-            if (ternary == true) {
-                m = *((const uint16_t *) &mf.mask().c_str()[0]);
-                m = ntohs(m);
-            }
-        } else if (bitWidth <= 32) {
-            v = *((const uint32_t *) &mf.value().c_str()[0]);
-            v = ntohl(v);
-            if (ternary == true) {
-                m = *((const uint32_t *) &mf.mask().c_str()[0]);
-                m = ntohl(m);
-            }
-        } 
-
-        if (bitWidth <= 32) {
-            ::ywrapper::UintValue* yv = new ::ywrapper::UintValue();
-            yv->set_value(v);
-
-            Log(DEBUG) << "Value: " << v;
-
-            if (name == "local_metadata.vrf_id") {
-                afiTreeEntryObj.set_allocated_vrf_id(yv);
-            }
-        } else if (bitWidth <= 64) {
-            unsigned char mc[6] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
-            std::string m(reinterpret_cast<const char *>(mc), 6);
-
-            ::ywrapper::BytesValue* yv = new::ywrapper::BytesValue();
-            yv->set_value(mf.value());
-
-            ::ywrapper::BytesValue* ym = new::ywrapper::BytesValue();
-            if (ternary == true) {
-                m = mf.mask();
-            }
-            ym->set_value(m);
-
-            if (name == "hdr.ethernet.src_addr") {
-            } else if (name == "hdr.ethernet.dst_addr") {
-            }
-        } else {
+        const auto *slot = fieldMap->slot(AfiFieldMap::TREE_ENTRY, tId, id);
+        if (slot == nullptr) {
             continue;
         }
+
+        bool ternary = (mf.type() == AfiTEntryMatchField::MfType::TERNARY);
+        slot->set(afiTreeEntryObj, mf.value(), ternary ? mf.mask() : "");
     }
 
     ::ywrapper::StringValue* pObj = new ::ywrapper::StringValue();
@@ -230,21 +166,14 @@ AfiTreeEncap::createChildJsonRes(const uint32_t tId, //P4InfoTablePtr table,
     nObj->set_value(eObjName);
     afiTreeEntryObj.set_allocated_target_afi_object(nObj);
 
-    int treeEntrySize = afiTreeEntryObj.ByteSize();
-    char *mArray = new char[treeEntrySize];
-    afiTreeEntryObj.SerializeToArray(mArray, treeEntrySize);
-    std::string tEncoded = base64_encode(mArray, (unsigned int) (treeEntrySize));
-
-    Json::Value tObj;
     std::string tObjName(table->name() +
                          "_entry_tree" +
                          "_" +
-                         std::to_string(id+1));
-    tObj["afi-object-name"] = tObjName;
-    tObj["afi-object-id"] = id + 1;
-    tObj["afi-object-type"] = "afi-tree-entry";
-    tObj["afi-object"] = tEncoded;
-    result.append(tObj);
+                         entryName);
+    result.emplace_back(
+        "afi-tree-entry", id + 1, tObjName,
+        std::make_shared<juniper::afi_tree_entry::AfiTreeEntry>(
+            std::move(afiTreeEntryObj)));
 
     Log(DEBUG) << "____ TreeEncap ____";
     juniper::afi_tree_encap_entry::AfiTreeEncapEntry afiTreeEncapEntryObj;
@@ -261,21 +190,11 @@ AfiTreeEncap::createChildJsonRes(const uint32_t tId, //P4InfoTablePtr table,
     trObj->set_value(tObjName);
     afiTreeEncapEntryObj.set_allocated_tree_entry_object(trObj);
 
-    int treeEncapEntrySize = afiTreeEncapEntryObj.ByteSize();
-    char *teArray = new char[treeEncapEntrySize];
-    afiTreeEncapEntryObj.SerializeToArray(teArray, treeEncapEntrySize);
-    std::string teEncoded = base64_encode(teArray, (unsigned int) (treeEncapEntrySize));
-
-    Json::Value teObj;
-    std::string teObjName(table->name() +
-                         "_entry" +
-                         "_" +
-                         std::to_string(id+1));
-    teObj["afi-object-name"] = teObjName;
-    teObj["afi-object-id"] = id + 1;
-    teObj["afi-object-type"] = "afi-tree-encap-entry";
-    teObj["afi-object"] = teEncoded;
-    result.append(teObj);
+    result.emplace_back(
+        "afi-tree-encap-entry", id + 1,
+        table->name() + "_entry" + "_" + entryName,
+        std::make_shared<juniper::afi_tree_encap_entry::AfiTreeEncapEntry>(
+            std::move(afiTreeEncapEntryObj)));
 
     return true;
 }
@@ -41,16 +41,9 @@ AfiTreeEntry::description(std::ostream &os) const
 
 AfiTreeEntry::AfiTreeEntry(const AfiJsonResource &jsonRes) : AfiObject(jsonRes)
 {
-    // FIXME magic number 5000
-    char bytes_decoded[5000];
-    memset(bytes_decoded, 0, sizeof(bytes_decoded));
-    int num_decoded_bytes =
-        base64_decode(jsonRes.objStr(), bytes_decoded, 5000);
-
-    Log(DEBUG) << "bytes_decoded: " << bytes_decoded;
-    Log(DEBUG) << "num_decoded_bytes: " << num_decoded_bytes;
-
-    _treeEntry.ParseFromArray(bytes_decoded, num_decoded_bytes);
+    if (!decode(_treeEntry)) {
+        Log(ERROR) << jsonRes.name() << ": Unable to decode " << jsonRes.type();
+    }
 
     Log(DEBUG) << "tree.ByteSize(): " << _treeEntry.ByteSize();
 
@@ -69,18 +62,13 @@ AfiTreeEntry::AfiTreeEntry(const AfiJsonResource &jsonRes) : AfiObject(jsonRes)
     ::ywrapper::UintValue prefix_length = _treeEntry.prefix_length();
     Log(DEBUG) << "prefix length: " << prefix_length.value();
 
-    std::stringstream es;
-    es << entry_name.value();
-    JaegerLog::getInstance()->Log("AFI:AFITreeEntry:Name", es.str());
-
+    JaegerLog::getInstance()->log("AFI:AFITreeEntry:Name", entry_name.value());
 
-    std::stringstream ps;
-    ps << parent_name.value();
-    JaegerLog::getInstance()->Log("AFI:AFITreeEntry:Parent Name", ps.str());
 
-    std::stringstream as;
-    as << target_afi_object.value();
-    JaegerLog::getInstance()->Log("AFI:AFITreeEntry:Target AFI Object", as.str());
+    JaegerLog::getInstance()->log("AFI:AFITreeEntry:Parent Name",
+                                  parent_name.value());
+    JaegerLog::getInstance()->log("AFI:AFITreeEntry:Target AFI Object",
+                                  target_afi_object.value());
 }
 
 }  // namespace AFIHAL
@@ -24,6 +24,7 @@
 #define __JP4Agent__
 
 #include <string>
+#include <vector>
 
 #include "Afi.h"
 #include "Log.h"
@@ -65,11 +66,39 @@ private:
         // Config fields
         std::string _configFile;
         std::string _debugMode;
+        std::string _logLevel;
+        bool        _logAsync;
+        std::string _logFile;
+        size_t      _logFileSize;
+        int         _logFileCount;
         std::string _piServerAddr;
+        std::string _piServerMode;
+        int         _piServerCqs;
+        int         _piServerCqThreads;
+        std::string _pipelineCacheFile;
         std::string _pktIOServerAddr;
         std::string _cliServerAddr;
+        std::string _metricsServerAddr;
 	std::string _jaegerConfigFile;
+        double      _jaegerSamplingRate;
         uint16_t    _hostpathPort;
+        unsigned    _hostpathBatchSize;
+        unsigned    _hostpathRxThreads;
+        std::vector<int> _hostpathRxCpus;
+        uint32_t    _hostpathMaxFrameSize;
+        std::string _hostpathTransport;
+        std::string _hostpathShmSocket;
+        unsigned    _hostpathShmSlots;
+        std::vector<HostpathInterface> _hostpathInterfaces;
+        uint32_t    _hostpathAfPacketBlockSize;
+        unsigned    _hostpathAfPacketBlocks;
+        uint32_t    _hostpathCapturePackets;
+        uint32_t    _hostpathCaptureSnapLen;
+        std::string _hostpathCaptureDir;
+        std::vector<PuntPolicerRule> _puntPolicer;
+        unsigned    _packetInQueueSize;
+        std::string _packetInOverflow;
+        std::vector<uint16_t> _packetInPriorityReasons;
         std::string _targetAddr;
     };
 
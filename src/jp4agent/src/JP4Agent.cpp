@@ -20,11 +20,15 @@
 // as noted in the Third-Party source code file.
 //
 
+#include <sched.h>
+#include <algorithm>
 #include <fstream>
+#include <set>
 
 #include "JP4Agent.h"
 #include "PI.h"
 #include "JaegerLog.h"
+#include "Metrics.h"
 
 //
 // @fn
@@ -46,22 +50,120 @@ JP4Agent::Config::readConfig()
 
     _debugMode =
         cfg_root["JP4AgentConfig"]["DebugConfig"]["debug-mode"].asString();
+    _logLevel =
+        cfg_root["JP4AgentConfig"]["DebugConfig"]
+            .get("log-level", "debug").asString();
+    _logAsync =
+        cfg_root["JP4AgentConfig"]["DebugConfig"]
+            .get("log-async", true).asBool();
+    _logFile =
+        cfg_root["JP4AgentConfig"]["DebugConfig"]
+            .get("log-file", "").asString();
+    _logFileSize =
+        cfg_root["JP4AgentConfig"]["DebugConfig"]
+            .get("log-file-size", 0).asUInt64();
+    _logFileCount =
+        cfg_root["JP4AgentConfig"]["DebugConfig"]
+            .get("log-file-count", 5).asInt();
     _piServerAddr =
         cfg_root["JP4AgentConfig"]["PIConfig"]["pi-server-address"].asString();
+    _piServerMode =
+        cfg_root["JP4AgentConfig"]["PIConfig"]
+            .get("pi-server-mode", "sync").asString();
+    _piServerCqs =
+        cfg_root["JP4AgentConfig"]["PIConfig"]
+            .get("pi-server-cq-count", 1).asInt();
+    _piServerCqThreads =
+        cfg_root["JP4AgentConfig"]["PIConfig"]
+            .get("pi-server-cq-threads", 1).asInt();
+    _pipelineCacheFile =
+        cfg_root["JP4AgentConfig"]["PIConfig"]
+            .get("pipeline-cache-file", "").asString();
     _pktIOServerAddr =
         cfg_root["JP4AgentConfig"]["DevicePktIOConfig"]["pktio-server-address"]
             .asString();
     _cliServerAddr =
         cfg_root["JP4AgentConfig"]["DebugCLIConfig"]["cli-server-address"]
             .asString();
+    _metricsServerAddr =
+        cfg_root["JP4AgentConfig"]["MetricsConfig"]
+            .get("metrics-server-address", "").asString();
     _hostpathPort =
         cfg_root["JP4AgentConfig"]["HostpathConfig"]["hostpath-server-port"]
             .asUInt();
+    _hostpathBatchSize =
+        cfg_root["JP4AgentConfig"]["HostpathConfig"]
+            .get("hostpath-batch-size", 1).asUInt();
+    _hostpathRxThreads =
+        cfg_root["JP4AgentConfig"]["HostpathConfig"]
+            .get("hostpath-rx-threads", 1).asUInt();
+    for (const auto &cpu :
+         cfg_root["JP4AgentConfig"]["HostpathConfig"]["hostpath-rx-cpus"]) {
+        _hostpathRxCpus.push_back(cpu.asInt());
+    }
+    _hostpathMaxFrameSize =
+        cfg_root["JP4AgentConfig"]["HostpathConfig"]
+            .get("hostpath-max-frame-size", 9216).asUInt();
+    _hostpathTransport =
+        cfg_root["JP4AgentConfig"]["HostpathConfig"]
+            .get("hostpath-transport", "udp").asString();
+    _hostpathShmSocket =
+        cfg_root["JP4AgentConfig"]["HostpathConfig"]
+            .get("hostpath-shm-socket", "/var/run/jp4agent-hostpath.sock")
+            .asString();
+    _hostpathShmSlots =
+        cfg_root["JP4AgentConfig"]["HostpathConfig"]
+            .get("hostpath-shm-slots", 1024).asUInt();
+    for (const auto &intf :
+         cfg_root["JP4AgentConfig"]["HostpathConfig"]["hostpath-interfaces"]) {
+        HostpathInterface i;
+        i.name = intf.get("name", "").asString();
+        i.port = intf.get("port", 0).asUInt();
+        _hostpathInterfaces.push_back(i);
+    }
+    _hostpathAfPacketBlockSize =
+        cfg_root["JP4AgentConfig"]["HostpathConfig"]
+            .get("hostpath-afpacket-block-size", 1 << 20).asUInt();
+    _hostpathAfPacketBlocks =
+        cfg_root["JP4AgentConfig"]["HostpathConfig"]
+            .get("hostpath-afpacket-blocks", 8).asUInt();
+    _hostpathCapturePackets =
+        cfg_root["JP4AgentConfig"]["HostpathConfig"]
+            .get("hostpath-capture-packets", 4096).asUInt();
+    _hostpathCaptureSnapLen =
+        cfg_root["JP4AgentConfig"]["HostpathConfig"]
+            .get("hostpath-capture-snaplen", 256).asUInt();
+    _hostpathCaptureDir =
+        cfg_root["JP4AgentConfig"]["HostpathConfig"]
+            .get("hostpath-capture-dir", "/var/tmp/jp4agent-capture")
+            .asString();
+    for (const auto &rule :
+         cfg_root["JP4AgentConfig"]["HostpathConfig"]["punt-policer"]) {
+        PuntPolicerRule r;
+        r.reason = rule.get("reason", -1).asInt();
+        r.port   = rule.get("port", -1).asInt();
+        r.rate   = rule.get("rate", 0.0).asDouble();
+        r.burst  = rule.get("burst", 1.0).asDouble();
+        _puntPolicer.push_back(r);
+    }
+    _packetInQueueSize =
+        cfg_root["JP4AgentConfig"]["HostpathConfig"]
+            .get("packet-in-queue-size", 1024).asUInt();
+    _packetInOverflow =
+        cfg_root["JP4AgentConfig"]["HostpathConfig"]
+            .get("packet-in-overflow", "drop-oldest").asString();
+    for (const auto &reason : cfg_root["JP4AgentConfig"]["HostpathConfig"]
+                                      ["packet-in-priority-reasons"]) {
+        _packetInPriorityReasons.push_back(reason.asUInt());
+    }
     _targetAddr =
         cfg_root["JP4AgentConfig"]["TargetConfig"]["target-address"].asString();
     _jaegerConfigFile =
         cfg_root["JP4AgentConfig"]["JaegerConfig"]["jaeger-config-file"]
             .asString();
+    _jaegerSamplingRate =
+        cfg_root["JP4AgentConfig"]["JaegerConfig"]
+            .get("jaeger-sampling-rate", 1.0).asDouble();
     return true;
 }
 
@@ -80,6 +182,127 @@ bool
 JP4Agent::Config::validateConfig()
 {
     Log(DEBUG) << "Validating Configuration :TBD ";
+    if ((_piServerMode != "sync") && (_piServerMode != "async")) {
+        Log(ERROR) << "Invalid pi-server-mode " << _piServerMode
+                   << ", using sync";
+        _piServerMode = "sync";
+    }
+    LogLevel level;
+    if (!logLevelFromStr(_logLevel, level)) {
+        Log(ERROR) << "Invalid log-level " << _logLevel << ", using debug";
+        _logLevel = "debug";
+    }
+    if ((_hostpathBatchSize < 1) || (_hostpathBatchSize > 1024)) {
+        Log(ERROR) << "Invalid hostpath-batch-size " << _hostpathBatchSize
+                   << ", using 1";
+        _hostpathBatchSize = 1;
+    }
+    if ((_hostpathRxThreads < 1) || (_hostpathRxThreads > 64)) {
+        Log(ERROR) << "Invalid hostpath-rx-threads " << _hostpathRxThreads
+                   << ", using 1";
+        _hostpathRxThreads = 1;
+    }
+    if ((_hostpathMaxFrameSize < 1514) ||
+        (_hostpathMaxFrameSize >
+         DeviceHPPacket::kMaxSize - DeviceHPPacket::_headerSize)) {
+        Log(ERROR) << "Invalid hostpath-max-frame-size "
+                   << _hostpathMaxFrameSize << ", using 9216";
+        _hostpathMaxFrameSize = 9216;
+    }
+    if ((_hostpathTransport != "udp") && (_hostpathTransport != "shm") &&
+        (_hostpathTransport != "afpacket")) {
+        Log(ERROR) << "Invalid hostpath-transport " << _hostpathTransport
+                   << ", using udp";
+        _hostpathTransport = "udp";
+    }
+    if ((_hostpathShmSlots < 16) || (_hostpathShmSlots > 65536)) {
+        Log(ERROR) << "Invalid hostpath-shm-slots " << _hostpathShmSlots
+                   << ", using 1024";
+        _hostpathShmSlots = 1024;
+    }
+    std::set<uint16_t> intfPorts;
+    for (const auto &intf : _hostpathInterfaces) {
+        if (intf.name.empty()) {
+            Log(ERROR) << "Invalid hostpath-interfaces entry without name";
+            _hostpathInterfaces.clear();
+            break;
+        }
+        if (!intfPorts.insert(intf.port).second) {
+            Log(ERROR) << "Invalid hostpath-interfaces entry " << intf.name
+                       << ", port " << intf.port << " used twice";
+            _hostpathInterfaces.clear();
+            break;
+        }
+    }
+    if ((_hostpathTransport == "afpacket") && _hostpathInterfaces.empty()) {
+        Log(ERROR) << "No hostpath-interfaces for hostpath-transport "
+                   << "afpacket, using udp";
+        _hostpathTransport = "udp";
+    }
+    if ((_hostpathAfPacketBlockSize < 4096) ||
+        (_hostpathAfPacketBlockSize > (1U << 26)) ||
+        (_hostpathAfPacketBlockSize & (_hostpathAfPacketBlockSize - 1))) {
+        Log(ERROR) << "Invalid hostpath-afpacket-block-size "
+                   << _hostpathAfPacketBlockSize << ", using 1048576";
+        _hostpathAfPacketBlockSize = 1 << 20;
+    }
+    if ((_hostpathAfPacketBlocks < 2) || (_hostpathAfPacketBlocks > 1024)) {
+        Log(ERROR) << "Invalid hostpath-afpacket-blocks "
+                   << _hostpathAfPacketBlocks << ", using 8";
+        _hostpathAfPacketBlocks = 8;
+    }
+    if (_hostpathCapturePackets > (1U << 20)) {
+        Log(ERROR) << "Invalid hostpath-capture-packets "
+                   << _hostpathCapturePackets << ", using 4096";
+        _hostpathCapturePackets = 4096;
+    }
+    if ((_hostpathCaptureSnapLen < 64) || (_hostpathCaptureSnapLen > 65535)) {
+        Log(ERROR) << "Invalid hostpath-capture-snaplen "
+                   << _hostpathCaptureSnapLen << ", using 256";
+        _hostpathCaptureSnapLen = 256;
+    }
+    for (int cpu : _hostpathRxCpus) {
+        if ((cpu < 0) || (cpu >= CPU_SETSIZE)) {
+            Log(ERROR) << "Invalid hostpath-rx-cpus entry " << cpu
+                       << ", not pinning";
+            _hostpathRxCpus.clear();
+            break;
+        }
+    }
+    for (const auto &rule : _puntPolicer) {
+        if (!rule.valid()) {
+            Log(ERROR) << "Invalid punt-policer rule, reason " << rule.reason
+                       << " port " << rule.port << " rate " << rule.rate
+                       << " burst " << rule.burst << ", not policing";
+            _puntPolicer.clear();
+            break;
+        }
+    }
+    if ((_packetInQueueSize < 16) || (_packetInQueueSize > 65536)) {
+        Log(ERROR) << "Invalid packet-in-queue-size " << _packetInQueueSize
+                   << ", using 1024";
+        _packetInQueueSize = 1024;
+    }
+    PacketInOverflow overflow;
+    if (!packetInOverflowFromStr(_packetInOverflow, overflow)) {
+        Log(ERROR) << "Invalid packet-in-overflow " << _packetInOverflow
+                   << ", using drop-oldest";
+        _packetInOverflow = "drop-oldest";
+    }
+    // The device hostpath header has no punt reason, every punt has 0
+    if (!_packetInPriorityReasons.empty() &&
+        (std::find(_packetInPriorityReasons.begin(),
+                   _packetInPriorityReasons.end(),
+                   0) == _packetInPriorityReasons.end())) {
+        Log(WARNING) << "packet-in-priority-reasons lacks 0, the punt reason "
+                        "of every packet from the device; no PacketIn gets "
+                        "high priority";
+    }
+    if ((_jaegerSamplingRate < 0.0) || (_jaegerSamplingRate > 1.0)) {
+        Log(ERROR) << "Invalid jaeger-sampling-rate " << _jaegerSamplingRate
+                   << ", using 1";
+        _jaegerSamplingRate = 1.0;
+    }
     return true;
 }
 
@@ -101,11 +324,33 @@ JP4Agent::Config::displayConfig()
 
     Log(DEBUG) << "configFile      : " << _configFile;
     Log(DEBUG) << "debugmode       : " << _debugmode;
+    Log(DEBUG) << "logLevel        : " << _logLevel;
+    Log(DEBUG) << "logAsync        : " << _logAsync;
+    Log(DEBUG) << "logFile         : " << _logFile;
+    Log(DEBUG) << "logFileSize     : " << _logFileSize;
+    Log(DEBUG) << "logFileCount    : " << _logFileCount;
     Log(DEBUG) << "piServerAddr    : " << _piServerAddr;
+    Log(DEBUG) << "piServerMode    : " << _piServerMode;
+    Log(DEBUG) << "piServerCqs     : " << _piServerCqs;
+    Log(DEBUG) << "piServerCqThrds : " << _piServerCqThreads;
+    Log(DEBUG) << "pipelineCache   : " << _pipelineCacheFile;
     Log(DEBUG) << "pktIOServerAddr : " << _pktIOServerAddr;
     Log(DEBUG) << "dbgCLIServAddr  : " << _cliServerAddr;
+    Log(DEBUG) << "metricsServAddr : " << _metricsServerAddr;
     Log(DEBUG) << "hostpathPort    : " << _hostpathPort;
+    Log(DEBUG) << "hostpathBatch   : " << _hostpathBatchSize;
+    Log(DEBUG) << "hostpathRxThrds : " << _hostpathRxThreads;
+    Log(DEBUG) << "hostpathMaxFrame: " << _hostpathMaxFrameSize;
+    Log(DEBUG) << "hostpathTransp  : " << _hostpathTransport;
+    Log(DEBUG) << "hostpathShmSock : " << _hostpathShmSocket;
+    Log(DEBUG) << "hostpathIfs     : " << _hostpathInterfaces.size();
+    Log(DEBUG) << "hostpathCapture : " << _hostpathCapturePackets;
+    Log(DEBUG) << "hostpathCaptDir : " << _hostpathCaptureDir;
+    Log(DEBUG) << "puntPolicer     : " << _puntPolicer.size() << " rules";
+    Log(DEBUG) << "packetInQueue   : " << _packetInQueueSize;
+    Log(DEBUG) << "packetInOverflow: " << _packetInOverflow;
     Log(DEBUG) << "jaegerConfigFile: " << _jaegerConfigFile;
+    Log(DEBUG) << "jaegerSampling  : " << _jaegerSamplingRate;
 }
 
 //
@@ -127,15 +372,59 @@ JP4Agent::init()
     _config.validateConfig();
     _config.displayConfig();
 
+    LogLevel level = DEBUG;
+    logLevelFromStr(_config._logLevel, level);
+    setLogLevel(level);
+
+    LogConfig logCfg;
+    logCfg.async     = _config._logAsync;
+    logCfg.file      = _config._logFile;
+    logCfg.fileSize  = _config._logFileSize;
+    logCfg.fileCount = _config._logFileCount;
+    if (!logStart(logCfg)) {
+        Log(ERROR) << "Unable to open log file " << logCfg.file
+                   << ", logging to stdout";
+    }
+    Metrics::instance().gauge("jp4_log_dropped_total",
+                              "Log lines dropped by the async log backend",
+                              [] { return double(logDropped()); });
+
     std::string cfg = _config._jaegerConfigFile;
     if (!cfg.empty()) {
-      JaegerLog::getInstance()->initTracing(cfg);
+      JaegerLog::getInstance()->initTracing(cfg,
+                                            _config._jaegerSamplingRate);
     }
 
-    _pi = std::make_unique<PI>(_config._piServerAddr,
-                               _config._hostpathPort,
-                               _config._pktIOServerAddr,
-                               _config._cliServerAddr);
+    PIServerConfig piCfg;
+    piCfg.serverAddr        = _config._piServerAddr;
+    piCfg.async             = (_config._piServerMode == "async");
+    piCfg.numCqs            = _config._piServerCqs;
+    piCfg.threadsPerCq      = _config._piServerCqThreads;
+    piCfg.pipelineCacheFile = _config._pipelineCacheFile;
+    piCfg.metricsServerAddr = _config._metricsServerAddr;
+
+    HostpathConfig hpCfg;
+    hpCfg.port      = _config._hostpathPort;
+    hpCfg.pktIOAddr = _config._pktIOServerAddr;
+    hpCfg.batchSize = _config._hostpathBatchSize;
+    hpCfg.rxThreads = _config._hostpathRxThreads;
+    hpCfg.rxCpus    = _config._hostpathRxCpus;
+    hpCfg.maxFrameSize = _config._hostpathMaxFrameSize;
+    hpCfg.transport = _config._hostpathTransport;
+    hpCfg.shmSocket = _config._hostpathShmSocket;
+    hpCfg.shmSlots  = _config._hostpathShmSlots;
+    hpCfg.interfaces        = _config._hostpathInterfaces;
+    hpCfg.afPacketBlockSize = _config._hostpathAfPacketBlockSize;
+    hpCfg.afPacketBlocks    = _config._hostpathAfPacketBlocks;
+    hpCfg.capturePackets    = _config._hostpathCapturePackets;
+    hpCfg.captureSnapLen    = _config._hostpathCaptureSnapLen;
+    hpCfg.captureDir        = _config._hostpathCaptureDir;
+    hpCfg.packetIn.size = _config._packetInQueueSize;
+    packetInOverflowFromStr(_config._packetInOverflow, hpCfg.packetIn.overflow);
+    hpCfg.priorityReasons = _config._packetInPriorityReasons;
+    hpCfg.puntPolicer     = _config._puntPolicer;
+
+    _pi = std::make_unique<PI>(piCfg, hpCfg, _config._cliServerAddr);
     //
     // Initialize PI
     //
@@ -145,4 +434,11 @@ JP4Agent::init()
     // Initialize Afi
     //
     AFIHAL::Afi::instance().init(_config._targetAddr);
+
+    //
+    // Forward with the last committed pipeline until the controller
+    // pushes one. The P4Runtime server runs already, a pipeline committed
+    // by a controller that connected first is not replaced.
+    //
+    _pi->restorePipeline();
 }
@@ -23,47 +23,113 @@
 #ifndef __ControllerConnection__
 #define __ControllerConnection__
 
+#include <atomic>
+#include <condition_variable>
+#include <memory>
 #include <mutex>
+#include <thread>
+#include <vector>
+#include "PacketInQueue.h"
 #include "pvtPI.h"
 
 class ControllerConnection;
 extern ControllerConnection controller_conn;
 
+// Stream channel of the asynchronous PI server. write() queues the
+// response on the call; it is sent from the completion queue thread.
+class StreamChannelWriter
+{
+ public:
+    virtual ~StreamChannelWriter() {}
+    virtual bool write(const p4::StreamMessageResponse &response) = 0;
+};
+
 // This connection represents the bi-directional streaming channel between the
 // controller and the JP4Agent. For now, assume that there is only one
 // controller connected at a time.
+//
+// PacketIns are queued by the hostpath threads and written by a dedicated
+// writer thread, so a slow controller never blocks punting; the queue
+// overflow policy decides what is dropped instead. PacketIns queued for
+// a stream are dropped when it is replaced or cleared, a new controller
+// does not get the backlog of the previous one.
 class ControllerConnection
 {
  public:
+    ~ControllerConnection() { stop_pkt_in_writer(); }
+
     void set_stream(StreamChannelReaderWriter *stream)
     {
         std::lock_guard<std::mutex> lock{scm};
+        drop_queued_pkt_ins();
         stream_ = stream;
+        connected_.store(true);
+    }
+    void set_stream(StreamChannelWriter *writer)
+    {
+        std::lock_guard<std::mutex> lock{scm};
+        drop_queued_pkt_ins();
+        writer_ = writer;
+        connected_.store(true);
     }
     void clear_stream()
     {
         std::lock_guard<std::mutex> lock{scm};
+        drop_queued_pkt_ins();
         stream_ = nullptr;
+        writer_ = nullptr;
+        connected_.store(false);
     }
-
-    // Send pkt on the stream channel to the controller.
-    bool send_pkt_in(p4::PacketIn *pkt) const
+    // Clear handle only if it still refers to writer.
+    void clear_stream(StreamChannelWriter *writer)
     {
-        bool                        pkt_sent = false;
         std::lock_guard<std::mutex> lock{scm};
-        if (stream_) {
-            p4::StreamMessageResponse response;
-            response.set_allocated_packet(pkt);
-            stream_->Write(response);
-            response.release_packet();
-            pkt_sent = true;
+        if (writer_ == writer) {
+            drop_queued_pkt_ins();
+            writer_ = nullptr;
+            connected_.store(stream_ != nullptr);
         }
-        return pkt_sent;
     }
 
+    bool connected() const { return connected_.load(); }
+
+    // Start the thread writing queued PacketIns to the stream channel.
+    // Until it runs, send_pkt_in() writes synchronously.
+    void start_pkt_in_writer(const PacketInQueueConfig &cfg);
+    void stop_pkt_in_writer();
+
+    // Queue pkt for the stream channel. Its contents are taken, pkt is
+    // left with the storage of a PacketIn already written. Returns false
+    // if there is no stream or pkt was dropped by the overflow policy.
+    // ingress_ns (CLOCK_REALTIME) times the punt up to the stream write.
+    bool send_pkt_in(p4::PacketIn *pkt, bool priority = false,
+                     uint64_t ingress_ns = 0);
+
  private:
+    static constexpr size_t kWriteBatch = 64;  // PacketIns per flush
+
     mutable std::mutex         scm;  // Guards access to stream channel ptr.
     StreamChannelReaderWriter *stream_{nullptr};
+    StreamChannelWriter *      writer_{nullptr};
+    std::atomic<bool>          connected_{false};
+
+    std::unique_ptr<PacketInQueue> pkt_in_queue_;
+    std::thread                    pkt_in_writer_;
+    std::atomic<bool>              writer_running_{false};
+    std::atomic<bool>              writer_idle_{false};
+    std::mutex                     writer_mtx_;
+    std::condition_variable        writer_cv_;
+
+    // Write a batch under one lock. Writes on the synchronous stream are
+    // coalesced, only the last one flushes.
+    bool write_pkt_ins(p4::PacketIn *pkts, const PacketInTimes *times,
+                       size_t count);
+
+    void pkt_in_writer();
+
+    // Drop the PacketIns queued for the current stream, called with scm
+    // held
+    void drop_queued_pkt_ins();
 };
 
 #endif  // __ControllerConnection__
@@ -23,7 +23,11 @@
 #ifndef __DeviceHPPacket__
 #define __DeviceHPPacket__
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
+#include <utility>
 
 // TBD : Change them to enum/const?
 #define DEVICE_HOSTPATH_PACKET_HDR_VERSION 0
@@ -31,6 +35,7 @@
 #define AFT_PACKETIO_HOSTPATH_PORT_STR "8002"
 
 class DeviceHPPacket;
+class DeviceHPPacketPool;
 
 using SandboxId = uint16_t;  ///< 16 bit sandbox id
 using PortIndex = uint16_t;  ///< 16 bit port index
@@ -39,8 +44,50 @@ using PortIndex = uint16_t;  ///< 16 bit port index
 /// @addtogroup DeviceHPPacket
 /// @{
 ///
-using DeviceHPPacketPtr     = std::shared_ptr<DeviceHPPacket>;
-using DeviceHPPacketWeakPtr = std::weak_ptr<DeviceHPPacket>;
+
+///
+/// @class   DeviceHPPacketPtr
+/// @brief   Reference to a pooled packet. The packet goes back to its pool
+///          when the last reference is dropped.
+///
+class DeviceHPPacketPtr
+{
+ public:
+    DeviceHPPacketPtr() = default;
+    DeviceHPPacketPtr(std::nullptr_t) {}
+    DeviceHPPacketPtr(const DeviceHPPacketPtr &other);
+    DeviceHPPacketPtr(DeviceHPPacketPtr &&other) : _pkt(other._pkt)
+    {
+        other._pkt = nullptr;
+    }
+    ~DeviceHPPacketPtr() { reset(); }
+
+    DeviceHPPacketPtr &operator=(DeviceHPPacketPtr other)
+    {
+        std::swap(_pkt, other._pkt);
+        return *this;
+    }
+
+    ///
+    /// @brief Drop the reference
+    ///
+    void reset();
+
+    DeviceHPPacket *get() const { return _pkt; }
+    DeviceHPPacket *operator->() const { return _pkt; }
+    DeviceHPPacket &operator*() const { return *_pkt; }
+    explicit operator bool() const { return _pkt != nullptr; }
+    bool operator==(std::nullptr_t) const { return _pkt == nullptr; }
+    bool operator!=(std::nullptr_t) const { return _pkt != nullptr; }
+
+ private:
+    friend class DeviceHPPacketPool;
+
+    // Adopts the reference the pool handed out
+    explicit DeviceHPPacketPtr(DeviceHPPacket *pkt) : _pkt(pkt) {}
+
+    DeviceHPPacket *_pkt{nullptr};
+};
 
 ///
 /// @}
@@ -79,11 +126,36 @@ class DeviceHPPacket
 
     static const int _headerSize = 8;  // 8 Bytes
 
+    /// Largest packet, header included, as the 16 bit total length allows
+    static constexpr size_t kMaxSize = 65535;
+
+    ///
+    /// Buffer size classes, header included. A packet gets the smallest
+    /// class it fits, so small packets don't tie up jumbo buffers.
+    ///
+    static constexpr unsigned kSizeClasses                = 3;
+    static constexpr size_t   kClassSize[kSizeClasses]    = {2048, 16384,
+                                                          65536};
+    static constexpr uint32_t kClassPackets[kSizeClasses] = {2048, 128, 32};
+
+    ///
+    /// @brief          Size class of a packet
+    /// @param [in]     size Packet size, header included
+    /// @returns        Class index, kSizeClasses if size is over kMaxSize
+    ///
+    static unsigned sizeClass(size_t size);
+
  private:
-    DeviceHPPacketWeakPtr _selfPtr;  ///< Weak pointer to itself
+    friend class DeviceHPPacketPtr;
+    friend class DeviceHPPacketPool;
+
+    std::atomic<uint32_t> _refCount{0};  ///< DeviceHPPacketPtr references
+    std::atomic<uint32_t> _poolNext{0};  ///< Free list link
+    bool                  _pooled{true};  ///< false if allocated on overflow
+    uint8_t               _sizeClass{0};  ///< Index in kClassSize
+    std::unique_ptr<uint8_t[]> _heapBuffer;  ///< Buffer if not pooled
 
-    // TBD: For now, initialize length to 1500
-    uint16_t                   _totalLength{1500};
+    uint16_t                   _totalLength{0};
     SandboxId                  _sandboxId;     ///< Sandbox ID
     PortIndex                  _portIndex;     ///< Port Index
     DeviceHPPacket::PacketDir  _pktDir;        ///< Packet Direction
@@ -116,7 +188,8 @@ class DeviceHPPacket
     // Port Index    : 16 bits < Port Index
     //
 
-    uint8_t *_pktDataBuffer{nullptr};  ///< Packet Data Buffer
+    uint8_t *_pktDataBuffer{nullptr};  ///< Header and data, kClassSize
+                                       ///< of _sizeClass bytes
 
  public:
     //
@@ -126,12 +199,10 @@ class DeviceHPPacket
     /// @brief              Default constructor for DeviceHPPacket
     ///
     DeviceHPPacket() = default;
-    ~DeviceHPPacket()
-    {
-        if (_pktDataBuffer) {
-            delete[] _pktDataBuffer;
-        }
-    }
+    ~DeviceHPPacket() = default;
+
+    DeviceHPPacket(const DeviceHPPacket &) = delete;
+    DeviceHPPacket &operator=(const DeviceHPPacket &) = delete;
 
     ///
     /// @brief                 Factory method to create packet for transmit
@@ -152,6 +223,21 @@ class DeviceHPPacket
     ///
     static DeviceHPPacketPtr createReceive(uint16_t dataSize);
 
+    ///
+    /// @brief                 Packet of the smallest size class to receive
+    ///                        a datagram into, the whole buffer is
+    ///                        available. Call setSize() with the length
+    ///                        received, then headerParse().
+    /// @returns               Return Aft packet shared pointer
+    ///
+    static DeviceHPPacketPtr createReceive();
+
+    /// @brief Set the packet size, header included
+    void setSize(uint16_t size) { _totalLength = size; }
+
+    /// @returns Buffer capacity, header included
+    size_t capacity() const { return kClassSize[_sizeClass]; }
+
     //
     // Accessors
     //
@@ -193,10 +279,90 @@ class DeviceHPPacket
     /// @brief Serializes header
     void headerSerialize();
 
+    ///
+    /// @brief                  Write a transmit header, for packets framed
+    ///                         outside a DeviceHPPacket
+    /// @param [out] hdr        Header, _headerSize bytes
+    /// @param [in] totalLength Packet length including header
+    /// @param [in] sandboxId   Sandbox Id
+    /// @param [in] portIndex   Port index
+    ///
+    static void writeHeader(uint8_t *hdr, uint16_t totalLength,
+                            SandboxId sandboxId, PortIndex portIndex);
+
     /// @brief Parses header
     void headerParse();
 };
 
+///
+/// @class   DeviceHPPacketPool
+/// @brief   Fixed set of packets per size class, recycled through lock
+///          free free lists, so the hostpath does not allocate per
+///          packet. When a class is exhausted its packets are allocated
+///          and freed on the heap.
+///
+class DeviceHPPacketPool
+{
+ public:
+    static DeviceHPPacketPool &instance();
+
+    ///
+    /// @brief   Take a packet of the smallest class holding size bytes,
+    ///          with a single reference
+    /// @returns Packet, nullptr if size is over DeviceHPPacket::kMaxSize
+    ///
+    DeviceHPPacketPtr get(size_t size);
+
+    ///
+    /// @brief   Packets of a size class currently free
+    ///
+    uint32_t available(unsigned sizeClass) const
+    {
+        return _classes[sizeClass].available.load(std::memory_order_relaxed);
+    }
+
+ private:
+    friend class DeviceHPPacketPtr;
+
+    static constexpr uint32_t kNil = UINT32_MAX;
+
+    //
+    // Packets of one size class, their buffers carved out of one
+    // allocation. Buffer pages are only backed once first used.
+    //
+    struct SizeClass {
+        std::unique_ptr<DeviceHPPacket[]> pkts;
+        std::unique_ptr<uint8_t[]>        buffers;
+        std::atomic<uint64_t> head{kNil};  ///< Tag (high 32 bits), free index
+        std::atomic<uint32_t> available{0};
+        std::atomic<uint64_t> misses{0};
+    };
+
+    SizeClass _classes[DeviceHPPacket::kSizeClasses];
+
+    DeviceHPPacketPool();
+
+    void put(DeviceHPPacket *pkt);
+};
+
+inline DeviceHPPacketPtr::DeviceHPPacketPtr(const DeviceHPPacketPtr &other)
+    : _pkt(other._pkt)
+{
+    if (_pkt != nullptr) {
+        _pkt->_refCount.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+inline void
+DeviceHPPacketPtr::reset()
+{
+    if ((_pkt != nullptr) &&
+        (_pkt->_refCount.fetch_sub(1, std::memory_order_acq_rel) == 1)) {
+        DeviceHPPacketPool::instance().put(_pkt);
+    }
+    _pkt = nullptr;
+}
+
 ///
 /// @}
 ///
@@ -23,10 +23,20 @@
 #ifndef __Hostpath__
 #define __Hostpath__
 
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 #include <boost/algorithm/string.hpp>
 #include <boost/asio.hpp>
+#include "DeviceHPPacket.h"
+#include "HostpathAfPacket.h"
+#include "HostpathCapture.h"
+#include "HostpathShm.h"
+#include "PacketInQueue.h"
+#include "PuntPolicer.h"
 #include "pvtPI.h"
 
 using boost::asio::io_service;
@@ -38,14 +48,68 @@ struct __attribute__((packed)) cpu_header_t {
     uint16_t port;
 };
 
+//
+// Hostpath configuration (HostpathConfig)
+//
+struct HostpathConfig {
+    uint16_t    port{0};       // UDP port receiving punted packets
+    std::string pktIOAddr;     // Device packet IO server, ip:port
+    unsigned    batchSize{1};  // Packets per recvmmsg/sendmmsg, 1: no batching
+    unsigned    rxThreads{1};  // Receive threads, each with its own socket
+    std::vector<int> rxCpus;   // CPUs receive threads are pinned to, round
+                               // robin. Not pinned if empty.
+    uint32_t maxFrameSize{9216};  // Largest layer 2 frame punted or
+                                  // injected, larger ones are dropped
+
+    PacketInQueueConfig   packetIn;         // PacketIns waiting for the stream
+    std::vector<uint16_t> priorityReasons;  // Punt reasons of high priority,
+                                            // all punts have reason 0 yet
+
+    std::vector<PuntPolicerRule> puntPolicer;  // Punt rate limits
+
+    std::string transport{"udp"};  // udp, shm: rings shared with PktIO, or
+                                   // afpacket: Linux interfaces as ports
+    std::string shmSocket;         // UNIX socket handing out the rings
+    unsigned    shmSlots{1024};    // Packets per ring
+
+    std::vector<HostpathInterface> interfaces;  // afpacket interfaces
+    uint32_t afPacketBlockSize{1 << 20};  // Receive ring block, bytes
+    uint32_t afPacketBlocks{8};           // Receive ring blocks
+
+    uint32_t capturePackets{4096};  // Packets kept for capture dumps
+    uint32_t captureSnapLen{256};   // Bytes kept of each
+    std::string captureDir;         // Where dumps are written, none if empty
+};
+
 class Hostpath
 {
  public:
-    Hostpath(uint16_t hpUdpPort, const std::string &pktIOListenAddr)
-        : _pktIOListenAddr(pktIOListenAddr),
-          _hpUdpPort(hpUdpPort),
-          _hpUdpSock(_ioService, udp::endpoint(udp::v4(), _hpUdpPort))
+    explicit Hostpath(const HostpathConfig &cfg)
+        : _pktIOListenAddr(cfg.pktIOAddr),
+          _hpUdpPort(cfg.port),
+          _batchSize(std::max(cfg.batchSize, 1U)),
+          _maxPacketSize(std::min<size_t>(
+              DeviceHPPacket::_headerSize + cfg.maxFrameSize,
+              DeviceHPPacket::kMaxSize)),
+          _rxCpus(cfg.rxCpus),
+          _packetInCfg(cfg.packetIn),
+          _priorityReasons(cfg.priorityReasons)
     {
+        if (cfg.transport == "shm") {
+            _shm = std::make_unique<HostpathShmTransport>(
+                cfg.shmSocket, cfg.shmSlots, _maxPacketSize);
+        } else if ((cfg.transport == "afpacket") &&
+                   !cfg.interfaces.empty()) {
+            _afPacket = true;
+            for (const auto &intf : cfg.interfaces) {
+                _afPackets.push_back(std::make_unique<HostpathAfPacket>(
+                    intf, cfg.afPacketBlockSize, cfg.afPacketBlocks,
+                    _maxPacketSize - DeviceHPPacket::_headerSize));
+            }
+        } else {
+            openSockets(std::max(cfg.rxThreads, 1U));
+        }
+
         // Connect to the pktIO UDP server on the devide to send packets
         std::vector<std::string> hostpathAddr_substrings;
         boost::split(hostpathAddr_substrings, _pktIOListenAddr,
@@ -55,10 +119,19 @@ class Hostpath
 
         udp::resolver resolver(_ioService);
         _pktIOEndpoint = *resolver.resolve({udp::v4(), hpIpStr, hpUDPPortStr});
+
+        std::sort(_priorityReasons.begin(), _priorityReasons.end());
+
+        PuntPolicer::instance().configure(cfg.puntPolicer);
+        HostpathCapture::instance().configure(
+            cfg.capturePackets, cfg.captureSnapLen, cfg.captureDir);
     }
 
-    // Send pkt out via the UDP socket to device
-    void sendPacketOut(const std::string &pkt);
+    //
+    // Send a PacketOut to the device. Its payload is taken, the transmit
+    // thread sends the frame straight from its buffer.
+    //
+    void sendPacketOut(p4::PacketOut &packetOut);
 
     //
     // Start packet listener thread
@@ -67,29 +140,131 @@ class Hostpath
     void startDevicePacketHandler();
 
  private:
+    //
+    // PacketOut queued for transmit: device header, and the payload the
+    // layer 2 frame is sent from
+    //
+    struct TxPacket {
+        uint8_t     header[DeviceHPPacket::_headerSize];
+        std::string payload;
+        uint16_t    port;      // Egress port
+        size_t      offset;    // Start of the frame in payload
+        uint64_t    readNs;    // Read from the stream, HostpathStats::now()
+        uint64_t    queuedNs;  // Queued for transmit
+    };
+
+    //
+    // PacketOuts queued for transmit, sent by the transmit thread
+    //
+    struct TxQueue {
+        std::mutex              mtx;
+        std::condition_variable cv;
+        std::vector<TxPacket>   pkts;
+    };
+
     io_service        _ioService;
     const std::string _pktIOListenAddr;
 
     const uint16_t _hpUdpPort;  //< Hospath UDP port
-    udp::socket    _hpUdpSock;  //< Hospath UDP socket
+    const unsigned _batchSize;  //< Packets per batch
+    const size_t   _maxPacketSize;  //< Largest datagram, header included
+    const std::vector<int> _rxCpus;
+
+    const PacketInQueueConfig _packetInCfg;
+    std::vector<uint16_t>     _priorityReasons;  //< Sorted
+
+    //< Hostpath UDP sockets, one per receive thread. The first one also
+    //< transmits.
+    std::vector<std::unique_ptr<udp::socket>> _hpUdpSocks;
+    TxQueue _txQueue;
+
+    //< Shared memory transport replacing the sockets, if configured
+    std::unique_ptr<HostpathShmTransport> _shm;
+    std::mutex                            _shmInjectMtx;  //< Ring producer
+
+    //< Linux interfaces replacing the device, if configured. Those that
+    //< fail to open are removed on start.
+    bool                                           _afPacket{false};
+    std::vector<std::unique_ptr<HostpathAfPacket>> _afPackets;
 
     udp::endpoint _pktIOEndpoint;
 
     //
-    // Handler for hostpath packet from device
+    // Bind the receive sockets, sharded by SO_REUSEPORT
     //
-    int handlePacketFromDevice();
+    void openSockets(unsigned count);
 
     //
-    // Hostpath UDP server
+    // Steer packets of a (sandbox, port) to the same socket
+    //
+    void attachShardFilter();
+
+    enum class PuntResult { Ok, Malformed, Policed };
+
+    //
+    // Punt a received packet, counting it if dropped
+    //
+    bool punt(DeviceHPPacket &pkt, size_t len, p4::PacketIn &packetIn,
+              uint64_t ingressNs);
+
+    //
+    // Send packetIn built with result, or count why it was dropped
+    //
+    bool finishPunt(PuntResult result, p4::PacketIn &packetIn,
+                    uint64_t ingressNs);
+
+    //
+    // Build the PacketIn of a packet received from the device
+    //
+    PuntResult puntPacket(DeviceHPPacket &pkt, size_t len,
+                          p4::PacketIn &packetIn);
+
+    //
+    // Build the PacketIn of a frame received on a port
+    //
+    PuntResult puntFrame(uint16_t port, const uint8_t *frame, size_t len,
+                         p4::PacketIn &packetIn);
+
+    //
+    // Whether the punt reason of packetIn is of high priority
+    //
+    bool isPriority(const p4::PacketIn &packetIn) const;
+
+    //
+    // Queue a PacketIn for the controller, counting the outcome
+    //
+    void sendPacketIn(p4::PacketIn &packetIn, uint64_t ingressNs);
+
+    //
+    // Receive and punt packets in batches of up to _batchSize
+    //
+    void receiveBatches(udp::socket &sock, MetricCounter &received);
+
+    //
+    // Punt packets from the shared memory punt ring
+    //
+    void receiveShm();
+
+    //
+    // Punt the frames received on an AF_PACKET interface
     //
-    void hostPathUDPServer();
+    void receiveAfPacket(unsigned queue);
 
     //
-    // Inject layer 2 packet to a port
+    // Send a PacketOut on the interface of its egress port
+    //
+    void transmitAfPacket(uint16_t port, const uint8_t *frame, size_t len,
+                          uint64_t readNs);
+
+    //
+    // Send queued packets in batches of up to _batchSize
+    //
+    void transmitBatches();
+
+    //
+    // Hostpath UDP server
     //
-    int injectL2Packet(SandboxId sandboxId, DevicePortIndex portIndex,
-                       const uint8_t *l2Packet, int l2PacketLen);
+    void hostPathUDPServer(unsigned queue);
 };
 
 #endif  // __Hostpath__
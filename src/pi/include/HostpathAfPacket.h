@@ -0,0 +1,161 @@
+//
+// Juniper P4 Agent
+//
+/// @file  HostpathAfPacket.h
+/// @brief Hostpath attached to Linux interfaces through AF_PACKET rings
+//
+// Copyright (c) [2018] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#ifndef __HostpathAfPacket__
+#define __HostpathAfPacket__
+
+#include <linux/if_packet.h>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+//
+// Linux interface (TAP, veth) standing in for a device port
+//
+struct HostpathInterface {
+    std::string name;     // Interface name
+    uint16_t    port{0};  // Port index its packets are punted from and
+                          // PacketOuts to it are injected to
+};
+
+//
+// Hostpath without PktIO: frames received on a Linux interface are
+// punted from its port, PacketOuts to the port are sent on it. Receive
+// uses a TPACKET_V3 ring, where the kernel fills whole blocks of frames
+// and hands a block over once it is full or timed out, so a single poll
+// covers a batch. Transmit uses a TPACKET_V2 ring on a second socket;
+// frames are queued in the ring and one send() flushes all queued.
+//
+class HostpathAfPacket
+{
+ public:
+    HostpathAfPacket(const HostpathInterface &intf, uint32_t blockSize,
+                     uint32_t blocks, size_t maxFrame);
+    ~HostpathAfPacket();
+
+    HostpathAfPacket(const HostpathAfPacket &) = delete;
+    HostpathAfPacket &operator=(const HostpathAfPacket &) = delete;
+
+    //
+    // Open the sockets and map the rings
+    //
+    bool open();
+
+    const std::string &name() const { return _intf.name; }
+    uint16_t           port() const { return _intf.port; }
+
+    //
+    // Largest frame transmit() takes
+    //
+    size_t maxFrame() const;
+
+    //
+    // Hand every frame of the next block to f(data, len, wireLen, ns),
+    // then return the block to the kernel. len is short of wireLen if the
+    // frame did not fit the block; ns is its kernel receive time,
+    // CLOCK_REALTIME nanoseconds. Waits up to timeoutMs for a block;
+    // returns the number of frames handed. Frames must not be used after
+    // f returns.
+    //
+    template <class F>
+    size_t receiveBlock(F &&f, int timeoutMs);
+
+    //
+    // Copy a frame to the transmit ring and have it sent. Returns false
+    // if the ring is full or the frame too large.
+    //
+    bool transmit(const uint8_t *frame, size_t len);
+
+    //
+    // Send the frames transmit() queues, run by the transmit thread
+    //
+    void transmitLoop();
+
+ private:
+    const HostpathInterface _intf;
+    const uint32_t          _blockSize;
+    const uint32_t          _blocks;
+    const uint32_t          _txFrameSize;  // Transmit ring frame, bytes
+    const uint32_t          _txFrames;     // Transmit ring frames
+
+    // Receive ring, TPACKET_V3
+    int      _rxFd{-1};
+    uint8_t *_rxRing{nullptr};
+    uint32_t _rxBlock{0};  // Next block to read
+
+    // Transmit ring, TPACKET_V2
+    int      _txFd{-1};
+    uint8_t *_txRing{nullptr};
+    uint32_t _txFrame{0};  // Next frame to fill
+
+    std::mutex              _txMtx;  // Serializes PacketOuts
+    std::condition_variable _txCv;
+    bool                    _txPending{false};  // Frames queued, not sent
+
+    int  openSocket(int version);
+    bool waitBlock(int timeoutMs);
+
+    struct tpacket_block_desc *block(uint32_t index) const
+    {
+        return reinterpret_cast<struct tpacket_block_desc *>(
+            _rxRing + size_t(index) * _blockSize);
+    }
+};
+
+template <class F>
+size_t
+HostpathAfPacket::receiveBlock(F &&f, int timeoutMs)
+{
+    struct tpacket_block_desc *desc = block(_rxBlock);
+    if (!(__atomic_load_n(&desc->hdr.bh1.block_status, __ATOMIC_ACQUIRE) &
+          TP_STATUS_USER)) {
+        if (!waitBlock(timeoutMs)) {
+            return 0;
+        }
+    }
+
+    const uint32_t count = desc->hdr.bh1.num_pkts;
+    uint8_t *      next  = reinterpret_cast<uint8_t *>(desc) +
+                     desc->hdr.bh1.offset_to_first_pkt;
+    size_t handed = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        auto *hdr = reinterpret_cast<struct tpacket3_hdr *>(next);
+        auto *sll = reinterpret_cast<struct sockaddr_ll *>(
+            next + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+        // Frames sent by the transmit socket loop back, skip them
+        if (sll->sll_pkttype != PACKET_OUTGOING) {
+            f(next + hdr->tp_mac, size_t(hdr->tp_snaplen),
+              size_t(hdr->tp_len),
+              uint64_t(hdr->tp_sec) * 1000000000ULL + hdr->tp_nsec);
+            handed++;
+        }
+        next += hdr->tp_next_offset;
+    }
+
+    __atomic_store_n(&desc->hdr.bh1.block_status, TP_STATUS_KERNEL,
+                     __ATOMIC_RELEASE);
+    _rxBlock = (_rxBlock + 1) % _blocks;
+    return handed;
+}
+
+#endif  // __HostpathAfPacket__
@@ -0,0 +1,106 @@
+//
+// Juniper P4 Agent
+//
+/// @file  HostpathCapture.h
+/// @brief Capture ring of hostpath packets
+//
+// Copyright (c) [2018] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#ifndef __HostpathCapture__
+#define __HostpathCapture__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+//
+// Which captured packets a dump includes
+//
+struct HostpathCaptureFilter {
+    int32_t port{-1};  // Port index, -1 for any
+    int32_t dir{-1};   // HostpathCapture::Dir, -1 for any
+};
+
+//
+// Always on capture of the last packets through the hostpath, the layer
+// 2 frame of each with its port, direction and time. Recording a packet
+// is a slot claim and a copy of up to snapLen bytes, cheap enough for
+// every packet. A dump renders the ring as pcap-ng, one interface per
+// port, the direction in the packet flags.
+//
+class HostpathCapture
+{
+ public:
+    enum Dir : uint8_t {
+        Punt   = 0,  // From the device, inbound
+        Inject = 1,  // To the device, outbound
+    };
+
+    static HostpathCapture &instance();
+
+    //
+    // Size the ring, 0 packets disables capture. Dumps are written to
+    // files in dir only, none if it is empty. Called at startup, before
+    // packets are recorded.
+    //
+    void configure(uint32_t packets, uint32_t snapLen,
+                   const std::string &dir);
+
+    bool enabled() const { return _slotCount != 0; }
+
+    //
+    // Record a frame. Safe from any thread.
+    //
+    void record(Dir dir, uint16_t port, const uint8_t *frame, size_t len);
+
+    //
+    // The captured packets passing filter as pcap-ng, oldest first
+    //
+    std::string pcapng(const HostpathCaptureFilter &filter,
+                       size_t &                     count) const;
+
+    //
+    // Write pcapng() to a new file of the capture directory. name is a
+    // plain file name; an existing file is not overwritten. Returns false
+    // with error set if the file is not written.
+    //
+    bool dump(const std::string &name, const HostpathCaptureFilter &filter,
+              size_t &count, std::string &error) const;
+
+ private:
+    static constexpr uint64_t kBusy = UINT64_MAX;  // Slot being written
+
+    struct Slot {
+        std::atomic<uint64_t> seq{0};  // Record number + 1, 0 if unused
+        uint64_t              ns;      // CLOCK_REALTIME
+        uint32_t              len;     // Length on the wire
+        uint16_t              capLen;  // Bytes captured
+        uint16_t              port;
+        uint8_t               dir;
+    };
+
+    uint32_t                _slotCount{0};  // Power of 2
+    uint32_t                _snapLen{0};
+    std::string             _dir;  // Dump directory, dumps disabled if empty
+    std::unique_ptr<Slot[]> _slots;
+    std::unique_ptr<uint8_t[]> _data;  // snapLen bytes per slot
+
+    alignas(64) std::atomic<uint64_t> _next{0};  // Next record number
+};
+
+#endif  // __HostpathCapture__
@@ -0,0 +1,192 @@
+//
+// Juniper P4 Agent
+//
+/// @file  HostpathShm.h
+/// @brief Shared memory hostpath transport
+//
+// Copyright (c) [2018] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+
+#ifndef __HostpathShm__
+#define __HostpathShm__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+//
+// Single producer, single consumer ring of fixed size slots in memory
+// shared with PktIO. A slot holds one device hostpath packet, 8 byte
+// DeviceHPPacket header included, preceded by its length. Positions are
+// free running counts in the shared header. The consumer sleeps on an
+// eventfd the producer rings only while the consumer says it waits.
+//
+class HostpathShmRing
+{
+ public:
+    static constexpr uint32_t kSlotHeader = 64;  // Length, data aligned
+
+    struct Header {
+        uint32_t                          slots;     // Power of 2
+        uint32_t                          slotSize;  // kSlotHeader + frame
+        alignas(64) std::atomic<uint64_t> head;      // Producer
+        alignas(64) std::atomic<uint64_t> tail;      // Consumer
+        alignas(64) std::atomic<uint32_t> waiting;   // Consumer sleeps
+    };
+
+    static size_t regionSize(uint32_t slots, uint32_t maxFrame);
+
+    HostpathShmRing() = default;
+
+    //
+    // Use the ring at base, initializing it if init is set
+    //
+    void attach(void *base, int doorbell, bool init, uint32_t slots,
+                uint32_t maxFrame);
+
+    uint32_t maxFrame() const { return _slotSize - kSlotHeader; }
+
+    //
+    // Producer: copy a packet into the next slot. Returns false if the
+    // ring is full or the packet too large. Producers must be serialized.
+    //
+    bool push(const uint8_t *pkt, size_t len)
+    {
+        return push(nullptr, 0, pkt, len);
+    }
+
+    //
+    // Producer: as above, for a packet in two parts
+    //
+    bool push(const uint8_t *hdr, size_t hdrLen, const uint8_t *pkt,
+              size_t len);
+
+    //
+    // Consumer: oldest packet, nullptr if the ring is empty. len is read
+    // once; the producer may scribble over the slot, copy before use.
+    //
+    const uint8_t *front(size_t &len) const;
+
+    //
+    // Consumer: release the oldest slot
+    //
+    void pop();
+
+    //
+    // Consumer: sleep until a packet is queued, or timeoutMs passed
+    //
+    void wait(int timeoutMs);
+
+ private:
+    Header * _hdr{nullptr};
+    uint8_t *_slots{nullptr};
+    int      _doorbell{-1};  // eventfd
+
+    // Private copies, the shared header may be scribbled over
+    uint32_t _slotCount{0};
+    uint32_t _slotSize{0};
+
+    uint8_t *slot(uint64_t pos) const
+    {
+        return _slots + (pos & (_slotCount - 1)) * size_t(_slotSize);
+    }
+};
+
+//
+// Setup sent with the memory and eventfds to a connecting PktIO
+//
+struct HostpathShmSetup {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slots;
+    uint32_t maxFrame;
+};
+
+//
+// Agent side of the transport. The memory holds the punt ring (PktIO to
+// agent) followed by the inject ring (agent to PktIO). PktIO connects
+// to the UNIX socket and receives the memfd and both doorbells. The rings
+// have one producer and one consumer each, so only one PktIO gets them:
+// it keeps the connection open while it uses them, and connections made
+// meanwhile are refused. Only root or the agent's own user may connect.
+//
+class HostpathShmTransport
+{
+ public:
+    static constexpr uint32_t kMagic   = 0x4a503448;  // "JP4H"
+    static constexpr uint32_t kVersion = 1;
+
+    HostpathShmTransport(const std::string &sockPath, uint32_t slots,
+                         uint32_t maxFrame);
+    ~HostpathShmTransport();
+
+    //
+    // Create the rings and start handing them out on the socket
+    //
+    bool start();
+
+    HostpathShmRing &punt() { return _punt; }
+    HostpathShmRing &inject() { return _inject; }
+
+ private:
+    const std::string _sockPath;
+    const uint32_t    _slots;
+    const uint32_t    _maxFrame;
+
+    int    _memFd{-1};
+    int    _puntDoorbell{-1};
+    int    _injectDoorbell{-1};
+    int    _listenFd{-1};
+    int    _stopFd{-1};  // eventfd, stops the server thread
+    void * _base{nullptr};
+    size_t _size{0};
+
+    HostpathShmRing _punt;
+    HostpathShmRing _inject;
+    std::thread     _server;
+
+    void serve();
+    bool peerAllowed(int conn) const;
+    bool sendRings(int conn) const;
+};
+
+//
+// PktIO side of the transport, also a local stand-in for PktIO. Holds the
+// rings until destroyed.
+//
+class HostpathShmPeer
+{
+ public:
+    ~HostpathShmPeer();
+
+    bool connect(const std::string &sockPath);
+
+    HostpathShmRing &punt() { return _punt; }
+    HostpathShmRing &inject() { return _inject; }
+
+ private:
+    int    _sock{-1};            // Held open while the rings are in use
+    int    _fds[3]{-1, -1, -1};  // memfd, punt and inject doorbells
+    void * _base{nullptr};
+    size_t _size{0};
+
+    HostpathShmRing _punt;
+    HostpathShmRing _inject;
+};
+
+#endif  // __HostpathShm__
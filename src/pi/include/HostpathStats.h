@@ -0,0 +1,154 @@
+//
+// Juniper P4 Agent
+//
+/// @file  HostpathStats.h
+/// @brief Hostpath latency by stage and throughput by port and reason
+//
+// Copyright (c) [2018] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+
+#ifndef __HostpathStats__
+#define __HostpathStats__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Metrics.h"
+
+//
+// Hostpath latency by stage, and punt and inject throughput by port and
+// punt reason. Stages are timed in CLOCK_REALTIME nanoseconds, the clock
+// of the kernel receive timestamps punts are stamped with on ingress
+// (SO_TIMESTAMPNS, TPACKET_V3). All of it is in the metrics registry;
+// show() adds rates measured over an interval for the CLI.
+//
+class HostpathStats
+{
+ public:
+    enum Stage {
+        PuntSocket,   // Kernel receive to agent read
+        PuntAgent,    // Agent read to PacketIn queued
+        PuntQueue,    // PacketIn queued to taken by the stream writer
+        PuntStream,   // Taken by the stream writer to written
+        PuntTotal,    // Ingress to written to the stream
+        InjectAgent,  // Stream read to queued for the device
+        InjectQueue,  // Queued to sent to the device
+        InjectTotal,  // Stream read to sent to the device
+        kStages
+    };
+
+    static HostpathStats &instance();
+
+    //
+    // CLOCK_REALTIME in nanoseconds
+    //
+    static uint64_t now();
+
+    MetricHistogram &stage(Stage stage) { return *_stages[stage]; }
+
+    //
+    // Record the time from..to spent in a stage. Nothing is recorded if
+    // from is 0, not known.
+    //
+    void record(Stage stage, uint64_t from, uint64_t to)
+    {
+        if ((from != 0) && (to >= from)) {
+            _stages[stage]->record(to - from);
+        }
+    }
+
+    //
+    // Count a frame punted from port for reason
+    //
+    void punted(uint16_t port, uint16_t reason, size_t bytes);
+
+    //
+    // Count a frame injected to port
+    //
+    void injected(uint16_t port, size_t bytes);
+
+    //
+    // Stage latencies, and packet and bit rates by port and reason
+    // measured over intervalMs. Blocks for the interval.
+    //
+    std::string show(unsigned intervalMs);
+
+ private:
+    //
+    // Packet and byte counters of a port or reason
+    //
+    struct Counters {
+        MetricCounter &packets;
+        MetricCounter &bytes;
+    };
+
+    //
+    // Counters by 16 bit key (port, reason), registered with Metrics when
+    // a key is first counted. Keys are looked up lock free through
+    // lazily allocated chunks.
+    //
+    class Table
+    {
+     public:
+        Table(const std::string &name, const std::string &labels,
+              const std::string &key);
+
+        void count(uint16_t key, size_t bytes)
+        {
+            Counters &c = counters(key);
+            c.packets.inc();
+            c.bytes.inc(bytes);
+        }
+
+        struct Sample {
+            uint16_t key;
+            uint64_t packets;
+            uint64_t bytes;
+        };
+
+        //
+        // Values of the keys counted so far, in key order
+        //
+        std::vector<Sample> sample() const;
+
+     private:
+        static constexpr size_t kChunkSize = 256;
+        static constexpr size_t kChunks    = 65536 / kChunkSize;
+
+        struct Chunk {
+            std::atomic<Counters *> entries[kChunkSize]{};
+        };
+
+        const std::string       _name;    // Metric name prefix
+        const std::string       _labels;  // Labels before the key
+        const std::string       _key;     // Label name of the key
+        std::atomic<Chunk *>    _chunks[kChunks]{};
+
+        Counters &counters(uint16_t key);
+    };
+
+    MetricHistogram *_stages[kStages];
+    Table            _puntPorts;
+    Table            _puntReasons;
+    Table            _injectPorts;
+
+    HostpathStats();
+};
+
+#endif  // __HostpathStats__
@@ -0,0 +1,50 @@
+//
+// Juniper P4 Agent
+//
+/// @file  MetricsServer.h
+/// @brief HTTP endpoint serving the agent metrics
+//
+// Copyright (c) [2018] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+
+#ifndef __MetricsServer__
+#define __MetricsServer__
+
+#include <string>
+
+//
+// Minimal HTTP/1.0 server answering GET /metrics with Metrics::render().
+// Meant for a local scraper, so it serves one connection at a time.
+//
+class MetricsServer
+{
+ public:
+    explicit MetricsServer(const std::string &servAddr) : _servAddr(servAddr)
+    {
+    }
+
+    //
+    // Start the server thread, unless no address is configured
+    //
+    void startMetricsServer();
+
+ private:
+    const std::string _servAddr;  // ip:port, empty to disable
+
+    void run();
+};
+
+#endif  // __MetricsServer__
@@ -23,9 +23,13 @@
 #ifndef __P4Info__
 #define __P4Info__
 
+#include <atomic>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <utility>
+#include <vector>
 
 class P4InfoResource;
 
@@ -57,14 +61,40 @@ class P4InfoResource
     P4InfoResourceId id() const { return _id; }
 
     /// @returns P4Info resource name
-    const std::string name() const { return _name; }
+    const std::string &name() const { return _name; }
 
     /// @returns P4Info resource alias
-    const std::string alias() const { return _alias; }
+    const std::string &alias() const { return _alias; }
 
     virtual void display() = 0;
 };
 
+//
+// Dense index slots, compiled once per pipeline config so that the per
+// entry translation path looks match fields and action params up by id
+// without string copies or compares.
+//
+struct P4InfoMatchFieldSlot {
+    using MatchType = p4::config::MatchField_MatchType;
+
+    std::string name;
+    uint32_t    bitWidth{0};
+    MatchType   matchType{p4::config::MatchField_MatchType_UNSPECIFIED};
+    bool        valid{false};
+};
+
+struct P4InfoActionParamSlot {
+    std::string name;
+    uint32_t    bitWidth{0};
+    bool        valid{false};
+};
+
+//
+// Largest match field and action param id; P4Info::build() rejects larger
+// ones (p4c numbers match fields and action params from 1)
+//
+constexpr uint32_t kP4InfoMaxDenseId = 4096;
+
 class P4InfoTable;
 using P4InfoTablePtr =
     std::shared_ptr<P4InfoTable>;  ///< Pointer type of all P4Info resources
@@ -78,10 +108,26 @@ class P4InfoTable : public P4InfoResource
                          table.preamble().alias()),
           _table(table)
     {
+        compile();
     }
 
     ~P4InfoTable() {}
 
+    /// @returns Match field slot of fieldId, nullptr if there is none
+    const P4InfoMatchFieldSlot *matchField(
+        const P4InfoMatchFieldId fieldId) const
+    {
+        return ((fieldId < _fields.size()) && _fields[fieldId].valid)
+                   ? &_fields[fieldId]
+                   : nullptr;
+    }
+
+    /// @returns Match field slots, indexed by field id
+    const std::vector<P4InfoMatchFieldSlot> &matchFields() const
+    {
+        return _fields;
+    }
+
     void display()
     {
         const auto &pre = _table.preamble();
@@ -97,33 +143,30 @@ class P4InfoTable : public P4InfoResource
 
     const std::string matchFieldName(const P4InfoMatchFieldId fieldId)
     {
-        const auto &fields = _table.match_fields();
-        for (const auto &field : fields) {
-            if (field.id() == fieldId) {
-                return field.name();
-            }
-        }
+        const auto *field = matchField(fieldId);
         // TBD: FIXME : revisit
-        return "";
+        return (field != nullptr) ? field->name : "";
     }
 
     bool matchFieldInfo(const P4InfoMatchFieldId fieldId,
                         std::string& name,
                         uint32_t& bitWidth)
     {
-        const auto &fields = _table.match_fields();
-        for (const auto &field : fields) {
-            if (field.id() == fieldId) {
-                name = field.name();
-                bitWidth = field.bitwidth();
-                return true;
-            }
+        const auto *field = matchField(fieldId);
+        if (field == nullptr) {
+            return false;
         }
-
-        return false;
+        name     = field->name;
+        bitWidth = field->bitWidth;
+        return true;
     }
 
  private:
+    //
+    // Build the match field index
+    //
+    void compile();
+
     //
     // Debug
     //
@@ -145,7 +188,8 @@ class P4InfoTable : public P4InfoResource
     }
 
  private:
-    p4::config::Table _table;
+    p4::config::Table                 _table;
+    std::vector<P4InfoMatchFieldSlot> _fields;  ///< Indexed by field id
     // AftNodeToken      _token{AFT_NODE_TOKEN_NONE};
 };
 
@@ -162,10 +206,26 @@ class P4InfoAction : public P4InfoResource
                          action.preamble().alias()),
           _action(action)
     {
+        compile();
     }
 
     ~P4InfoAction() {}
 
+    /// @returns Action param slot of paramId, nullptr if there is none
+    const P4InfoActionParamSlot *actionParam(
+        const P4InfoActionParamId paramId) const
+    {
+        return ((paramId < _params.size()) && _params[paramId].valid)
+                   ? &_params[paramId]
+                   : nullptr;
+    }
+
+    /// @returns Action param slots, indexed by param id
+    const std::vector<P4InfoActionParamSlot> &actionParams() const
+    {
+        return _params;
+    }
+
     void display()
     {
         std::cout << "___ P4InfoAction ___" << std::endl;
@@ -204,20 +264,198 @@ class P4InfoAction : public P4InfoResource
 
     const std::string actionParamName(const P4InfoActionParamId paramId)
     {
-        const auto &params = _action.params();
-        for (const auto &param : params) {
-            if (param.id() == paramId) {
-                return param.name();
-            }
-        }
+        const auto *param = actionParam(paramId);
         // TBD: FIXME : revisit
-        return "";
+        return (param != nullptr) ? param->name : "";
+    }
+
+ private:
+    //
+    // Build the action param index
+    //
+    void compile();
+
+    p4::config::Action                 _action;
+    std::vector<P4InfoActionParamSlot> _params;  ///< Indexed by param id
+};
+
+//
+// A field of a controller packet header
+//
+struct P4InfoPacketMetadataField {
+    enum Role : uint8_t {
+        Other,   // Not known to the agent, sent as 0
+        Port,    // Ingress port of a PacketIn, egress port of a PacketOut
+        Reason,  // Punt reason of a PacketIn
+    };
+
+    uint32_t id{0};
+    uint32_t bitWidth{0};
+    uint32_t bytes{0};  // Encoded value length, bitWidth rounded up
+    Role     role{Other};
+};
+
+//
+// PacketIn or PacketOut metadata layout of the controller packet header
+// ("packet_in", "packet_out") of a P4Info, compiled once per pipeline
+// config so that hostpath packets get their metadata encoded and decoded
+// without name lookups. Values are big endian, bitWidth rounded up to
+// whole bytes, as P4Runtime wants them.
+//
+class P4InfoPacketMetadata
+{
+ public:
+    //
+    // Compile the layout of header, false with the reason in error if it
+    // is invalid
+    //
+    bool compile(const p4::config::ControllerPacketMetadata &header,
+                 std::string &                               error);
+
+    /// @returns true if the P4Info has the header
+    bool present() const { return !_fields.empty(); }
+
+    /// @returns Fields in header order
+    const std::vector<P4InfoPacketMetadataField> &fields() const
+    {
+        return _fields;
+    }
+
+    //
+    // Set the metadata of a PacketIn, reusing the entries it has
+    //
+    void encode(uint16_t port, uint16_t reason, p4::PacketIn &packetIn) const;
+
+    //
+    // Reason encode() set, 0 if the header has none
+    //
+    uint16_t reason(const p4::PacketIn &packetIn) const;
+
+    //
+    // Egress port of a PacketOut, false if its metadata lacks it
+    //
+    bool port(const p4::PacketOut &packetOut, uint16_t &port) const;
+
+ private:
+    std::vector<P4InfoPacketMetadataField> _fields;
+    int                                    _port{-1};    // Index in _fields
+    int                                    _reason{-1};  // Index in _fields
+};
+
+//
+// One generation of the P4Info of a pipeline config: the resources and the
+// id sorted table and action indices. Built and validated off to the side
+// by P4Info::build(), read only once built.
+//
+class P4InfoIndex;
+using P4InfoIndexPtr = std::shared_ptr<const P4InfoIndex>;
+
+class P4InfoIndex
+{
+ public:
+    void insert2IdMap(const P4InfoResourcePtr &res) { _idMap[res->id()] = res; }
+
+    void insert2NameMap(const P4InfoResourcePtr &res)
+    {
+        _nameMap[res->name()] = res;
+    }
+
+    const P4InfoResourcePtr p4InfoResource(P4InfoResourceId id) const
+    {
+        auto it = _idMap.find(id);
+        return (it != _idMap.end()) ? it->second : nullptr;
+    }
+
+    const P4InfoResourcePtr p4InfoResource(const std::string &name) const
+    {
+        auto it = _nameMap.find(name);
+        return (it != _nameMap.end()) ? it->second : nullptr;
+    }
+
+    //
+    // Build the table and action indices from the resources inserted so
+    // far
+    //
+    void compile();
+
+    /// @returns Table with id, nullptr if there is none
+    const P4InfoTable *table(P4InfoResourceId id) const
+    {
+        return find(_tables, id);
     }
 
+    /// @returns Action with id, nullptr if there is none
+    const P4InfoAction *action(P4InfoResourceId id) const
+    {
+        return find(_actions, id);
+    }
+
+    /// @returns Compiled tables, in id order
+    const std::vector<std::pair<P4InfoResourceId, const P4InfoTable *>> &
+    tables() const
+    {
+        return _tables;
+    }
+
+    /// @returns Compiled actions, in id order
+    const std::vector<std::pair<P4InfoResourceId, const P4InfoAction *>> &
+    actions() const
+    {
+        return _actions;
+    }
+
+    /// @returns PacketIn metadata layout
+    const P4InfoPacketMetadata &packetIn() const { return _packetIn; }
+
+    /// @returns PacketOut metadata layout
+    const P4InfoPacketMetadata &packetOut() const { return _packetOut; }
+
  private:
-    p4::config::Action _action;
+    friend class P4Info;
+
+    P4InfoPacketMetadata _packetIn;
+    P4InfoPacketMetadata _packetOut;
+
+    P4InfoResourceNameMap _nameMap;
+    P4InfoResourceIdMap   _idMap;
+
+    //
+    // Id sorted, searched by bisection. P4 ids carry the resource type in
+    // the top byte and are not dense, so they can't index an array.
+    //
+    std::vector<std::pair<P4InfoResourceId, const P4InfoTable *>>  _tables;
+    std::vector<std::pair<P4InfoResourceId, const P4InfoAction *>> _actions;
+
+    template <typename T>
+    static const T *find(
+        const std::vector<std::pair<P4InfoResourceId, const T *>> &index,
+        P4InfoResourceId                                          id)
+    {
+        size_t lo = 0;
+        size_t hi = index.size();
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (index[mid].first < id) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return ((lo < index.size()) && (index[lo].first == id))
+                   ? index[lo].second
+                   : nullptr;
+    }
 };
 
+//
+// The P4Info of the committed pipeline config. A new config is built into
+// its own P4InfoIndex and swapped in with a pointer flip once the AFI side
+// has committed, so nothing of a rejected or replaced config lingers.
+//
+// table() and action() return pointers into the current generation. The
+// generation replaced by the last swap is kept alive, so a request that
+// looked a table up just before a swap can finish with it.
+//
 class P4Info
 {
  public:
@@ -232,30 +470,65 @@ class P4Info
     P4Info &operator=(P4Info const &) = delete;
     P4Info &operator=(P4Info &&) = delete;
 
-    void insert2IdMap(const P4InfoResourcePtr &res) { _idMap[res->id()] = res; }
+    //
+    // Build and validate the index of a P4Info. Returns nullptr, with the
+    // reason in error, if the P4Info is invalid.
+    //
+    static P4InfoIndexPtr build(const p4::config::P4Info &p4info,
+                                std::string &             error);
 
-    void insert2NameMap(const P4InfoResourcePtr &res)
+    /// @returns Current generation
+    P4InfoIndexPtr current() const { return std::atomic_load(&_index); }
+
+    /// Make index the current generation
+    void swap(const P4InfoIndexPtr &index)
     {
-        _nameMap[res->name()] = res;
+        std::lock_guard<std::mutex> guard(_swapMtx);
+        _retired = std::atomic_exchange(&_index, index);
+        _generation.fetch_add(1, std::memory_order_release);
     }
 
-    const P4InfoResourcePtr p4InfoResource(P4InfoResourceId id)
+    //
+    // Number of swaps so far. Per packet users keep current() and reload
+    // it only when this changed.
+    //
+    uint32_t generation() const
     {
-        return (_idMap[id]);
+        return _generation.load(std::memory_order_acquire);
     }
 
-    const P4InfoResourcePtr p4InfoResource(const std::string &name)
+    const P4InfoResourcePtr p4InfoResource(P4InfoResourceId id) const
     {
-        return (_nameMap[name]);
+        return current()->p4InfoResource(id);
+    }
+
+    const P4InfoResourcePtr p4InfoResource(const std::string &name) const
+    {
+        return current()->p4InfoResource(name);
+    }
+
+    /// @returns Table with id, nullptr if there is none
+    const P4InfoTable *table(P4InfoResourceId id) const
+    {
+        return current()->table(id);
+    }
+
+    /// @returns Action with id, nullptr if there is none
+    const P4InfoAction *action(P4InfoResourceId id) const
+    {
+        return current()->action(id);
     }
 
  protected:
-    P4Info() {}
+    P4Info() : _index(std::make_shared<P4InfoIndex>()) {}
     ~P4Info() {}
 
  private:
-    P4InfoResourceNameMap _nameMap;
-    P4InfoResourceIdMap   _idMap;
+    P4InfoIndexPtr _index;    ///< Current generation
+    P4InfoIndexPtr _retired;  ///< Generation replaced by the last swap
+    std::mutex     _swapMtx;  ///< Serializes swaps
+
+    std::atomic<uint32_t> _generation{0};
 };
 
 #endif  // __P4Info__
@@ -23,22 +23,48 @@
 #ifndef __P4RuntimeService__
 #define __P4RuntimeService__
 
+#include <mutex>
+
 #include "Hostpath.h"
+#include "PipelineCache.h"
+
+//
+// A verified pipeline config
+//
+struct StagedPipeline {
+    P4InfoIndexPtr         p4info;
+    AFIHAL::AfiPipelinePtr afi;
+    uint64_t               fingerprint{0};  // PipelineCache::fingerprint
+    std::shared_ptr<const p4::ForwardingPipelineConfig> config;
+};
+
+//
+// Progress of a P4Runtime Read which is answered in chunks
+//
+struct ReadCursor {
+    int                     entity{0};  // Entity of the request being read
+    AFIHAL::AfiShadowCursor shadow;     // Position in the shadow store
+};
 
 class P4RuntimeServiceImpl : public p4::P4Runtime::Service
 {
  public:
-    explicit P4RuntimeServiceImpl(Hostpath &hpPktIO) : _hpPktHdl{hpPktIO} {}
-
- private:
-    Hostpath &_hpPktHdl;  // Handle to the hostpath packet IO methods.
+    explicit P4RuntimeServiceImpl(Hostpath &         hpPktIO,
+                                  const std::string &pipelineCacheFile = "")
+        : _hpPktHdl{hpPktIO}, _pipelineCache{pipelineCacheFile}
+    {
+    }
 
-    // Methods
-    Status tableInsert(const p4::TableEntry &tableEntry);
-    Status tableWrite(p4::Update_Type       update,
-                      const p4::TableEntry &table_entry);
-    Status _write(const p4::WriteRequest &request);
+    //
+    // Commit the pipeline config found in the pipeline cache, if any and
+    // if no controller committed one yet. Called once at startup.
+    //
+    bool restorePipeline();
 
+    //
+    // RPC handlers. Registered with the synchronous server and also called
+    // by the asynchronous server's call state machines (PIAsyncServer).
+    //
     Status Write(ServerContext *context, const p4::WriteRequest *request,
                  p4::WriteResponse *rep) override;
 
@@ -58,6 +84,64 @@ class P4RuntimeServiceImpl : public p4::P4Runtime::Service
     Status StreamChannel(ServerContext *            context,
                          StreamChannelReaderWriter *stream) override;
 
+    // Fill response with the next chunk of a Read. done is set on the
+    // last chunk.
+    Status readChunk(const p4::ReadRequest &request, ReadCursor &cursor,
+                     p4::ReadResponse &response, bool &done);
+
+    // Chunk bounds for Read responses
+    static constexpr size_t kReadChunkMaxEntities = 1024;
+    static constexpr size_t kReadChunkMaxBytes    = 1024 * 1024;
+
+    // Handle one stream channel message, returns true if response is to
+    // be sent back to the controller. A PacketOut payload is moved out of
+    // request.
+    bool streamMessage(p4::StreamMessageRequest & request,
+                       p4::StreamMessageResponse &response);
+
+ private:
+    Hostpath &_hpPktHdl;  // Handle to the hostpath packet IO methods.
+
+    std::mutex     _pipelineMtx;        // Serializes pipeline config requests
+    std::mutex     _writeMtx;           // Serializes Writes and commits
+    StagedPipeline _savedPipeline;      // Saved by VERIFY_AND_SAVE
+    StagedPipeline _committedPipeline;  // Pipeline in use
+    PipelineCache  _pipelineCache;
+
+    // Methods
+    void   afiEntryParams(const p4::TableEntry &                    tableEntry,
+                          std::vector<AFIHAL::AfiTEntryMatchField> &afiMFs,
+                          std::vector<AFIHAL::AfiAEntry> &          afiActions,
+                          P4InfoResourceId &                        actionId,
+                          const p4::FieldMatch_LPM *&               route);
+    Status tableInsert(const p4::TableEntry &           tableEntry,
+                       AFIHAL::AfiChangeSet *           changeSet,
+                       AFIHAL::AfiShadowOverlay &       shadow,
+                       std::vector<AFIHAL::AfiObjectPtr> &objs);
+    Status tableModify(const p4::TableEntry &           tableEntry,
+                       AFIHAL::AfiChangeSet *           changeSet,
+                       AFIHAL::AfiShadowOverlay &       shadow,
+                       std::vector<AFIHAL::AfiObjectPtr> &objs);
+    Status tableDelete(const p4::TableEntry &    tableEntry,
+                       AFIHAL::AfiChangeSet *    changeSet,
+                       AFIHAL::AfiShadowOverlay &shadow);
+    Status tableWrite(p4::Update_Type       update,
+                      const p4::TableEntry &table_entry,
+                      AFIHAL::AfiChangeSet *changeSet = nullptr,
+                      std::vector<AFIHAL::AfiObjectPtr> *objs = nullptr,
+                      AFIHAL::AfiShadowOverlay *         shadow = nullptr);
+    Status _writeUpdate(const p4::Update &     update,
+                        AFIHAL::AfiChangeSet *changeSet = nullptr,
+                        std::vector<AFIHAL::AfiObjectPtr> *objs = nullptr,
+                        AFIHAL::AfiShadowOverlay *         shadow = nullptr);
+    Status stagePipeline(const p4::ForwardingPipelineConfig &config,
+                         StagedPipeline &                    staged);
+    Status commitPipeline(const StagedPipeline &staged);
+    Status _write(const p4::WriteRequest &request);
+    Status _writeBatch(const p4::WriteRequest &request);
+    void   shadowUpdate(p4::Update_Type update, const p4::TableEntry &entry,
+                        const std::vector<AFIHAL::AfiObjectPtr> &objs);
+
     static Uint128 convert_u128(const p4::Uint128 &from)
     {
         return Uint128(from.high(), from.low());
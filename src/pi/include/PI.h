@@ -33,11 +33,10 @@ using PIUPtr = std::unique_ptr<PI>;
 class PI
 {
  public:
-    PI(const std::string &piServAddr, uint16_t hpUdpPort,
-       const std::string &pktIOListenAddr, const std::string &cliServAddr)
+    PI(const PIServerConfig &piCfg, const HostpathConfig &hpCfg,
+       const std::string &cliServAddr)
     {
-        _piServer = std::make_unique<PIServer>(piServAddr, hpUdpPort,
-                                               pktIOListenAddr, cliServAddr);
+        _piServer = std::make_unique<PIServer>(piCfg, hpCfg, cliServAddr);
     }
 
     void init()
@@ -45,8 +44,11 @@ class PI
         _piServer->startPIServer();
         _piServer->startPktIOHandler();
         _piServer->startDbgCLIServer();
+        _piServer->startMetricsServer();
     }
 
+    bool restorePipeline() { return _piServer->restorePipeline(); }
+
  private:
     PIServerUPtr _piServer;
 };
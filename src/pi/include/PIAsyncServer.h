@@ -0,0 +1,105 @@
+//
+// Juniper P4 Agent
+//
+/// @file  PIAsyncServer.h
+/// @brief Asynchronous (completion queue based) PI server
+//
+// Copyright (c) [2018] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#ifndef __PIAsyncServer__
+#define __PIAsyncServer__
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+class PIAsyncServer;
+using PIAsyncServerUPtr = std::unique_ptr<PIAsyncServer>;
+
+//
+// Base class of the per-RPC state machines. Every completion queue tag is
+// a PIAsyncCall::Tag which names the call and the event that completed.
+//
+class PIAsyncCall
+{
+ public:
+    struct Tag {
+        PIAsyncCall *call;
+        int          event;
+    };
+
+    virtual ~PIAsyncCall() {}
+    virtual void proceed(bool ok, int event) = 0;
+};
+
+//
+// P4Runtime server on the gRPC async API.
+//
+// StreamChannel (packet I/O) is served from its own completion queue and
+// threads; Write, Read and the pipeline config RPCs are spread over
+// numCqs programming completion queues with threadsPerCq threads each, so
+// a slow Write does not hold up packet-out.
+//
+class PIAsyncServer
+{
+ public:
+    PIAsyncServer(const std::string &serverAddr, P4RuntimeServiceImpl &piService,
+                  int numCqs, int threadsPerCq);
+    ~PIAsyncServer();
+
+    //
+    // Build the server, post the initial calls and start the polling
+    // threads.
+    //
+    void run();
+
+    //
+    // Wait for the polling threads to exit
+    //
+    void wait();
+
+    //
+    // Shutdown server and drain the completion queues
+    //
+    void shutdown();
+
+    bool isShutdown() const { return _shutdown; }
+
+    p4::P4Runtime::AsyncService &asyncService() { return _asyncService; }
+    P4RuntimeServiceImpl &       piService() { return _piService; }
+
+ private:
+    const std::string           _serverAddr;
+    P4RuntimeServiceImpl &      _piService;
+    p4::P4Runtime::AsyncService _asyncService;
+    std::unique_ptr<Server>     _server;
+    const int                   _numCqs;
+    const int                   _threadsPerCq;
+    std::atomic<bool>           _shutdown{false};
+
+    std::unique_ptr<grpc::ServerCompletionQueue>              _streamCq;
+    std::vector<std::unique_ptr<grpc::ServerCompletionQueue>> _cqs;
+    std::vector<std::thread>                                  _threads;
+
+    //
+    // Completion queue polling loop
+    //
+    void pollCq(grpc::ServerCompletionQueue *cq);
+};
+
+#endif  // __PIAsyncServer__
@@ -27,19 +27,34 @@
 #include <string>
 #include "Hostpath.h"
 #include "CLIService.h"
+#include "MetricsServer.h"
 
 class PIServer;
 using PIServerUPtr = std::unique_ptr<PIServer>;
 
+//
+// PI server configuration (PIConfig)
+//
+struct PIServerConfig {
+    std::string serverAddr;         // Listen address
+    bool        async{false};       // Use the async (completion queue) server
+    int         numCqs{1};          // Async: programming completion queues
+    int         threadsPerCq{1};    // Async: polling threads per queue
+    std::string pipelineCacheFile;  // Pipeline cache, empty to disable
+    std::string metricsServerAddr;  // Metrics HTTP endpoint, empty to disable
+};
+
 class PIServer
 {
  public:
-    PIServer(const std::string &piServerAddr, uint16_t hpUdpPort,
-             const std::string &pktIOListenAddr, const std::string &cliServAddr)
-        : _piServerAddr{piServerAddr},
-          _hpPktIO{hpUdpPort, pktIOListenAddr},
-          _piService{_hpPktIO},
-          _cliService{cliServAddr}
+    PIServer(const PIServerConfig &piCfg, const HostpathConfig &hpCfg,
+             const std::string &cliServAddr)
+        : _piCfg{piCfg},
+          _piServerAddr{piCfg.serverAddr},
+          _hpPktIO{hpCfg},
+          _piService{_hpPktIO, piCfg.pipelineCacheFile},
+          _cliService{cliServAddr},
+          _metricsServer{piCfg.metricsServerAddr}
     {
     }
 
@@ -58,14 +73,27 @@ class PIServer
     //
     void startDbgCLIServer();
 
+    //
+    // Start metrics HTTP server thread.
+    //
+    void startMetricsServer();
+
+    //
+    // Commit the cached pipeline config, if any.
+    //
+    bool restorePipeline() { return _piService.restorePipeline(); }
+
  private:
-    const std::string _piServerAddr;
+    const PIServerConfig _piCfg;
+    const std::string    _piServerAddr;
     Hostpath          _hpPktIO;
 
     P4RuntimeServiceImpl    _piService;
     ServerBuilder           _piBuilder;
     std::unique_ptr<Server> _piServer;
+    PIAsyncServerUPtr       _piAsyncServer;
     CLIService              _cliService;
+    MetricsServer           _metricsServer;
 
     // Start server and bind to default address (0.0.0.0:50051)
     void PIGrpcServerRun();
@@ -0,0 +1,121 @@
+//
+// Juniper P4 Agent
+//
+/// @file  PacketInQueue.h
+/// @brief Bounded queue of PacketIns waiting for the stream writer
+//
+// Copyright (c) [2018] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+
+#ifndef __PacketInQueue__
+#define __PacketInQueue__
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#include "Metrics.h"
+#include "p4runtime.pb.h"
+
+//
+// What a full queue does with a PacketIn (packet-in-overflow)
+//
+enum class PacketInOverflow {
+    DropOldest,  // Discard the oldest queued PacketIn
+    DropNewest,  // Discard the PacketIn being queued
+    Priority     // Low priority PacketIns may not use the last quarter of
+                 // the queue, high priority ones drop the oldest
+};
+
+bool packetInOverflowFromStr(const std::string &str, PacketInOverflow &policy);
+
+//
+// jp4_packet_in_total counter of PacketIns by result
+//
+MetricCounter &packetInCounter(const std::string &result);
+
+//
+// When a PacketIn passed the punt stages, CLOCK_REALTIME nanoseconds, 0
+// if not known
+//
+struct PacketInTimes {
+    uint64_t ingress{0};  // Received by the host, or else by the agent
+    uint64_t queued{0};   // Queued for the stream writer
+};
+
+struct PacketInQueueConfig {
+    size_t           size{1024};  // Rounded up to a power of 2
+    PacketInOverflow overflow{PacketInOverflow::DropOldest};
+};
+
+//
+// Bounded lock free queue of PacketIns (Vyukov). The hostpath threads
+// produce, the stream writer consumes; a producer applying drop-oldest
+// pops too. PacketIns are swapped in and out of preallocated cells, so
+// producers get back the payload storage of PacketIns already written
+// and nothing is allocated in steady state.
+//
+class PacketInQueue
+{
+ public:
+    explicit PacketInQueue(const PacketInQueueConfig &cfg);
+
+    //
+    // Queue the contents of pkt, pkt is left with stale contents.
+    // Returns false if pkt was dropped.
+    //
+    bool push(p4::PacketIn &pkt, bool priority,
+              const PacketInTimes &times = PacketInTimes());
+
+    //
+    // Swap the oldest PacketIn into pkt. Returns false if empty.
+    //
+    bool pop(p4::PacketIn &pkt, PacketInTimes &times);
+    bool pop(p4::PacketIn &pkt)
+    {
+        PacketInTimes times;
+        return pop(pkt, times);
+    }
+
+    //
+    // Drop the queued PacketIns, at most a queue full of them. Returns
+    // the number dropped.
+    //
+    size_t clear();
+
+    size_t size() const;
+    bool   empty() const { return size() == 0; }
+
+ private:
+    struct Cell {
+        std::atomic<size_t> seq;
+        p4::PacketIn        pkt;
+        PacketInTimes       times;
+    };
+
+    const PacketInOverflow  _overflow;
+    const size_t            _mask;
+    size_t                  _lowLimit;  // Depth refusing low priority
+    std::unique_ptr<Cell[]> _cells;
+
+    alignas(64) std::atomic<size_t> _enqueuePos{0};
+    alignas(64) std::atomic<size_t> _dequeuePos{0};
+
+    bool tryPush(p4::PacketIn &pkt, const PacketInTimes &times);
+};
+
+#endif  // __PacketInQueue__
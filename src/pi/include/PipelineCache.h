@@ -0,0 +1,72 @@
+//
+// Juniper P4 Agent
+//
+/// @file  PipelineCache.h
+/// @brief Local cache of the committed forwarding pipeline config
+//
+// Copyright (c) [2018] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#ifndef __PipelineCache__
+#define __PipelineCache__
+
+#include <cstdint>
+#include <string>
+
+//
+// Persists the last committed ForwardingPipelineConfig, tagged with its
+// fingerprint, so the agent can restore the pipeline when it restarts
+// without waiting for the controller to push it again.
+//
+// File layout: magic, version, fingerprint and length of the config, all
+// in host byte order, followed by the binary encoded config.
+//
+class PipelineCache
+{
+ public:
+    explicit PipelineCache(const std::string &path) : _path(path) {}
+
+    //
+    // FNV-1a over p4info and p4_device_config. Equal configs from the
+    // controller have equal fingerprints.
+    //
+    static uint64_t fingerprint(const p4::ForwardingPipelineConfig &config);
+
+    bool enabled() const { return !_path.empty(); }
+
+    bool store(const p4::ForwardingPipelineConfig &config,
+               uint64_t                            fingerprint) const;
+
+    bool load(p4::ForwardingPipelineConfig &config,
+              uint64_t &                    fingerprint) const;
+
+ private:
+    static constexpr uint32_t kMagic   = 0x4a503443;  // "JP4C"
+    static constexpr uint32_t kVersion = 1;
+
+    // Largest config the PI server accepts
+    static constexpr uint64_t kMaxLength = 256 * 1024 * 1024;
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t fingerprint;
+        uint64_t length;
+    };
+
+    const std::string _path;  // Cache file, empty if caching is disabled
+};
+
+#endif  // __PipelineCache__
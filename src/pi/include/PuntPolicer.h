@@ -0,0 +1,123 @@
+//
+// Juniper P4 Agent
+//
+/// @file  PuntPolicer.h
+/// @brief Token bucket policer of hostpath punts
+//
+// Copyright (c) [2018] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+
+#ifndef __PuntPolicer__
+#define __PuntPolicer__
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//
+// Rate limit of the punts of a (reason, ingress port). -1 matches any
+// reason or port; the most specific rule applies, each (reason, port)
+// getting a bucket of its own.
+//
+struct PuntPolicerRule {
+    int32_t reason{-1};
+    int32_t port{-1};
+    double  rate{0};   // Packets per second
+    double  burst{0};  // Bucket depth in packets, at least 1
+
+    //
+    // Reason and port are 16 bit or -1, rate and burst positive
+    //
+    bool valid() const
+    {
+        return (reason >= -1) && (reason <= 0xffff) && (port >= -1) &&
+               (port <= 0xffff) && (rate > 0.0) && (burst > 0.0);
+    }
+};
+
+//
+// Software punt policer, so that a storm on one port cannot monopolize
+// the punt path. Buckets are spread over locked stripes; receive threads
+// are sharded by port, so they rarely share a stripe.
+//
+class PuntPolicer
+{
+ public:
+    static PuntPolicer &instance();
+
+    //
+    // Replace all rules
+    //
+    void configure(const std::vector<PuntPolicerRule> &rules);
+
+    //
+    // Add a rule, or replace the one of the same reason and port
+    //
+    void setRule(const PuntPolicerRule &rule);
+
+    //
+    // Remove the rule of reason and port. Returns false if there is none.
+    //
+    bool clearRule(int32_t reason, int32_t port);
+
+    //
+    // Take a token of the bucket of (reason, port). Returns false if the
+    // packet is to be dropped.
+    //
+    bool admit(uint16_t reason, uint16_t port);
+
+    //
+    // Rules, and packets passed and dropped by bucket
+    //
+    std::string show() const;
+
+ private:
+    static constexpr size_t kStripes = 16;
+
+    struct Bucket {
+        uint64_t generation{0};  // Of the rules rate and burst come from
+        bool     policed{false};
+        double   rate{0};
+        double   burst{0};
+        double   tokens{0};
+        uint64_t lastNs{0};
+        uint64_t passed{0};
+        uint64_t dropped{0};
+    };
+
+    struct Stripe {
+        mutable std::mutex                   mtx;
+        std::unordered_map<uint32_t, Bucket> buckets;  // By reason << 16 | port
+    };
+
+    mutable std::mutex           _rulesMtx;
+    std::vector<PuntPolicerRule> _rules;
+    std::atomic<uint64_t>        _generation{1};
+    std::atomic<bool>            _enabled{false};  // Any rules
+    Stripe                       _stripes[kStripes];
+
+    PuntPolicer() = default;
+
+    void rulesChanged();
+
+    // Most specific rule of (reason, port), nullptr if none
+    const PuntPolicerRule *match(uint16_t reason, uint16_t port) const;
+};
+
+#endif  // __PuntPolicer__
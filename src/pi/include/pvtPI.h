@@ -56,7 +56,9 @@ using grpc::Status;
 using grpc::StatusCode;
 
 #include "P4Info.h"
+#include "PipelineCache.h"
 #include "P4RuntimeService.h"
+#include "PIAsyncServer.h"
 #include "PIServer.h"
 
 #endif  // __pvtPI__
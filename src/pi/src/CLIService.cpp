@@ -20,6 +20,7 @@
 // as noted in the Third-Party source code file.
 //
 
+#include <fstream>
 #include <iostream>
 #include <memory>
 #include <sstream>
@@ -29,7 +30,10 @@
 
 #include "Afi.h"
 #include "CLIService.h"
-#include "JaegerLog.h"
+#include "HostpathCapture.h"
+#include "HostpathStats.h"
+#include "Metrics.h"
+#include "PuntPolicer.h"
 
 Status
 CmdHandlerSvcImpl::SendCmd(ServerContext *context, const CmdRequest *req,
@@ -78,6 +82,104 @@ CmdHandlerSvcImpl::SendCmd(ServerContext *context, const CmdRequest *req,
             obj_details << "Object string: " << obj->objStr() << "\n\n";
         }
         cmdoutstr = obj_details.str();
+    } else if (cmd_sub_str[0] == "show-metrics") {
+        cmdoutstr = Metrics::instance().render();
+    } else if (cmd_sub_str[0] == "show-punt-policer") {
+        cmdoutstr = PuntPolicer::instance().show();
+    } else if (cmd_sub_str[0] == "show-hostpath-stats") {
+        // show-hostpath-stats [seconds], rates are measured over seconds
+        unsigned secs = 1;
+        if (cmd_sub_str.size() > 2) {
+            cmdoutstr = "Invalid show-hostpath-stats cmd.";
+            goto quit;
+        }
+        if (cmd_sub_str.size() == 2) {
+            try {
+                secs = std::stoul(cmd_sub_str[1]);
+            } catch (const std::exception &) {
+                secs = 0;
+            }
+            if ((secs < 1) || (secs > 60)) {
+                cmdoutstr = "Interval must be 1..60 seconds.";
+                goto quit;
+            }
+        }
+        cmdoutstr = HostpathStats::instance().show(secs * 1000);
+    } else if ((cmd_sub_str[0] == "set-punt-policer") ||
+               (cmd_sub_str[0] == "clear-punt-policer")) {
+        const bool set = (cmd_sub_str[0] == "set-punt-policer");
+        if (cmd_sub_str.size() != (set ? 5U : 3U)) {
+            cmdoutstr = "Invalid " + cmd_sub_str[0] + " cmd.";
+            goto quit;
+        }
+        PuntPolicerRule rule;
+        try {
+            rule.reason =
+                (cmd_sub_str[1] == "any") ? -1 : std::stoi(cmd_sub_str[1]);
+            rule.port =
+                (cmd_sub_str[2] == "any") ? -1 : std::stoi(cmd_sub_str[2]);
+            if (set) {
+                rule.rate  = std::stod(cmd_sub_str[3]);
+                rule.burst = std::stod(cmd_sub_str[4]);
+            }
+        } catch (const std::exception &) {
+            cmdoutstr = "Invalid " + cmd_sub_str[0] + " cmd.";
+            goto quit;
+        }
+        if (set && !rule.valid()) {
+            cmdoutstr = "Invalid punt policer rule, reason and port must be "
+                        "any or 0..65535, rate and burst positive.";
+            goto quit;
+        }
+        if (set) {
+            PuntPolicer::instance().setRule(rule);
+            cmdoutstr = "Punt policer rule set";
+        } else if (PuntPolicer::instance().clearRule(rule.reason, rule.port)) {
+            cmdoutstr = "Punt policer rule cleared";
+        } else {
+            cmdoutstr = "No such punt policer rule";
+        }
+    } else if (cmd_sub_str[0] == "dump-hostpath-capture") {
+        // dump-hostpath-capture <file-name> [port <n>] [dir punt|inject],
+        // file-name is created in the capture directory
+        if ((cmd_sub_str.size() < 2) || (cmd_sub_str.size() % 2 != 0)) {
+            cmdoutstr = "Invalid dump-hostpath-capture cmd.";
+            goto quit;
+        }
+        HostpathCaptureFilter filter;
+        for (size_t i = 2; i < cmd_sub_str.size(); i += 2) {
+            const std::string &key   = cmd_sub_str[i];
+            const std::string &value = cmd_sub_str[i + 1];
+            if ((key == "dir") && (value == "punt")) {
+                filter.dir = HostpathCapture::Punt;
+            } else if ((key == "dir") && (value == "inject")) {
+                filter.dir = HostpathCapture::Inject;
+            } else if (key == "port") {
+                try {
+                    filter.port = std::stoi(value);
+                } catch (const std::exception &) {
+                    cmdoutstr = "Invalid port " + value;
+                    goto quit;
+                }
+            } else {
+                cmdoutstr = "Invalid dump-hostpath-capture filter " + key +
+                            " " + value;
+                goto quit;
+            }
+        }
+        if (!HostpathCapture::instance().enabled()) {
+            cmdoutstr = "Hostpath capture is disabled";
+            goto quit;
+        }
+        size_t      count;
+        std::string error;
+        if (!HostpathCapture::instance().dump(cmd_sub_str[1], filter, count,
+                                              error)) {
+            cmdoutstr = error;
+        } else {
+            cmdoutstr = std::to_string(count) + " packets written to " +
+                        cmd_sub_str[1];
+        }
     } else {
         cmdoutstr = "Invalid cmd: " + cmd_sub_str[0];
     }
@@ -97,7 +199,6 @@ CLIService::runGrpcServer()
     std::unique_ptr<Server> server{builder.BuildAndStart()};
     std::cout << "CLI Server listening on " << _cli_serv_addr << std::endl;
 
-    JaegerLog::getInstance()->startSpan("CLI Service");
     server->Wait();
 }
 
@@ -21,6 +21,255 @@
 //
 
 #include "ControllerConnection.h"
+#include "HostpathStats.h"
+
+constexpr size_t ControllerConnection::kWriteBatch;
 
 ControllerConnection controller_conn;
 
+namespace
+{
+struct PacketInMetrics {
+    MetricCounter &sent{packetInCounter("sent")};
+    MetricCounter &noStream{packetInCounter("no-stream")};
+    MetricCounter &writeError{packetInCounter("write-error")};
+    MetricCounter &streamChanged{packetInCounter("dropped-stream-changed")};
+};
+
+PacketInMetrics &
+metrics()
+{
+    static PacketInMetrics m;
+    return m;
+}
+}  // namespace
+
+//
+// @fn
+// start_pkt_in_writer
+//
+// @brief
+// Create the PacketIn queue and start the thread writing it out
+//
+// @param[in]
+//     cfg Queue size and overflow policy
+// @return void
+//
+
+void
+ControllerConnection::start_pkt_in_writer(const PacketInQueueConfig &cfg)
+{
+    if (pkt_in_queue_) {
+        return;
+    }
+    pkt_in_queue_ = std::make_unique<PacketInQueue>(cfg);
+    writer_running_.store(true, std::memory_order_release);
+    Metrics::instance().gauge("jp4_packet_in_queue_depth",
+                              "PacketIns waiting for the stream writer",
+                              [this] {
+                                  return writer_running_.load()
+                                             ? double(pkt_in_queue_->size())
+                                             : 0.0;
+                              });
+    pkt_in_writer_ = std::thread([this] { pkt_in_writer(); });
+}
+
+//
+// @fn
+// stop_pkt_in_writer
+//
+// @brief
+// Stop the writer thread. Queued PacketIns are written out first.
+//
+// @param[in] void
+// @return void
+//
+
+void
+ControllerConnection::stop_pkt_in_writer()
+{
+    if (!writer_running_.exchange(false)) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock{writer_mtx_};
+        writer_cv_.notify_one();
+    }
+    pkt_in_writer_.join();
+}
+
+//
+// @fn
+// drop_queued_pkt_ins
+//
+// @brief
+// Drop the PacketIns still queued for the stream being replaced or
+// cleared. Called with scm held. A batch the writer thread has already
+// taken from the queue, at most kWriteBatch PacketIns, is still written.
+//
+// @param[in] void
+// @return void
+//
+
+void
+ControllerConnection::drop_queued_pkt_ins()
+{
+    if (!writer_running_.load(std::memory_order_acquire)) {
+        return;
+    }
+    size_t dropped = pkt_in_queue_->clear();
+    if (dropped != 0) {
+        metrics().streamChanged.inc(dropped);
+    }
+}
+
+//
+// @fn
+// send_pkt_in
+//
+// @brief
+// Hand a PacketIn to the writer thread, or write it if there is none
+//
+// @param[in]
+//     pkt PacketIn, its contents are taken
+// @param[in]
+//     priority PacketIn has a high priority punt reason
+// @param[in]
+//     ingress_ns When the packet was received, 0 if not known
+// @return false if the PacketIn is not going to be sent
+//
+
+bool
+ControllerConnection::send_pkt_in(p4::PacketIn *pkt, bool priority,
+                                  uint64_t ingress_ns)
+{
+    if (!connected()) {
+        metrics().noStream.inc();
+        return false;
+    }
+
+    PacketInTimes times;
+    times.ingress = ingress_ns;
+    times.queued  = HostpathStats::now();
+
+    if (!writer_running_.load(std::memory_order_acquire)) {
+        return write_pkt_ins(pkt, &times, 1);
+    }
+
+    if (!pkt_in_queue_->push(*pkt, priority, times)) {
+        return false;
+    }
+    if (writer_idle_.load()) {
+        std::lock_guard<std::mutex> lock{writer_mtx_};
+        writer_cv_.notify_one();
+    }
+    return true;
+}
+
+//
+// @fn
+// write_pkt_ins
+//
+// @brief
+// Write PacketIns to the stream channel under one lock, timing the queue
+// and stream stages of each
+//
+// @param[in]
+//     pkts PacketIns, left in place
+// @param[in]
+//     times Punt timestamps of pkts
+// @param[in]
+//     count Number of PacketIns
+// @return false if any was not written
+//
+
+bool
+ControllerConnection::write_pkt_ins(p4::PacketIn *       pkts,
+                                    const PacketInTimes *times, size_t count)
+{
+    PacketInMetrics &m     = metrics();
+    HostpathStats &  stats = HostpathStats::instance();
+    const uint64_t   taken = HostpathStats::now();
+
+    std::lock_guard<std::mutex> lock{scm};
+    if (!stream_ && !writer_) {
+        m.noStream.inc(count);
+        return false;
+    }
+    bool pkt_sent = true;
+    for (size_t i = 0; i < count; i++) {
+        p4::StreamMessageResponse response;
+        response.set_allocated_packet(&pkts[i]);
+        bool ok;
+        if (stream_) {
+            grpc::WriteOptions options;
+            if (i + 1 < count) {
+                options.set_buffer_hint();
+            }
+            ok = stream_->Write(response, options);
+        } else {
+            ok = writer_->write(response);
+        }
+        // pkts keeps ownership
+        p4::PacketIn *released = response.release_packet();
+        (void)released;
+
+        if (ok) {
+            m.sent.inc();
+        } else {
+            m.writeError.inc();
+            pkt_sent = false;
+        }
+    }
+
+    // The last write flushes the batch, it is on the wire only then
+    const uint64_t written = HostpathStats::now();
+    for (size_t i = 0; i < count; i++) {
+        stats.record(HostpathStats::PuntQueue, times[i].queued, taken);
+        stats.record(HostpathStats::PuntStream, taken, written);
+        stats.record(HostpathStats::PuntTotal, times[i].ingress, written);
+    }
+    return pkt_sent;
+}
+
+//
+// @fn
+// pkt_in_writer
+//
+// @brief
+// Writer thread: drain the queue in batches, sleep while it is empty
+//
+// @param[in] void
+// @return void
+//
+
+void
+ControllerConnection::pkt_in_writer()
+{
+    std::vector<p4::PacketIn>  batch(kWriteBatch);
+    std::vector<PacketInTimes> times(kWriteBatch);
+
+    while (true) {
+        size_t n = 0;
+        while ((n < batch.size()) && pkt_in_queue_->pop(batch[n], times[n])) {
+            n++;
+        }
+        if (n > 0) {
+            write_pkt_ins(batch.data(), times.data(), n);
+            continue;
+        }
+        if (!writer_running_.load()) {
+            break;
+        }
+
+        // Producers notify only while the writer is idle. The queue is
+        // checked again once idle is set, so no wakeup is lost.
+        std::unique_lock<std::mutex> lock{writer_mtx_};
+        writer_idle_.store(true);
+        writer_cv_.wait_for(lock, std::chrono::milliseconds(100), [this] {
+            return !pkt_in_queue_->empty() || !writer_running_.load();
+        });
+        writer_idle_.store(false);
+    }
+}
+
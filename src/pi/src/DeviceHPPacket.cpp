@@ -22,9 +22,32 @@
 
 #include "DeviceHPPacket.h"
 #include <arpa/inet.h>
-#include <iomanip>
 #include <iostream>
-#include <boost/io/ios_state.hpp>
+
+#include "Log.h"
+#include "Metrics.h"
+
+constexpr size_t   DeviceHPPacket::kMaxSize;
+constexpr unsigned DeviceHPPacket::kSizeClasses;
+constexpr size_t   DeviceHPPacket::kClassSize[];
+constexpr uint32_t DeviceHPPacket::kClassPackets[];
+constexpr uint32_t DeviceHPPacketPool::kNil;
+
+//
+// @brief Size class of a packet
+//
+unsigned
+DeviceHPPacket::sizeClass(size_t size)
+{
+    if (size > kMaxSize) {
+        return kSizeClasses;
+    }
+    unsigned cls = 0;
+    while (kClassSize[cls] < size) {
+        cls++;
+    }
+    return cls;
+}
 
 //
 // @brief  Create Transmit Packet
@@ -34,9 +57,11 @@ DeviceHPPacket::createTransmit(uint16_t dataSize, SandboxId sandboxId,
                                PortIndex                  portIndex,
                                DeviceHPPacket::PacketType packetType)
 {
-    DeviceHPPacketPtr pkt = std::make_shared<DeviceHPPacket>();
-
-    pkt->_selfPtr = pkt;
+    DeviceHPPacketPtr pkt =
+        DeviceHPPacketPool::instance().get(_headerSize + size_t(dataSize));
+    if (pkt == nullptr) {
+        return nullptr;
+    }
 
     pkt->_sandboxId    = sandboxId;
     pkt->_portIndex    = portIndex;
@@ -44,15 +69,6 @@ DeviceHPPacket::createTransmit(uint16_t dataSize, SandboxId sandboxId,
     pkt->_innerPktType = packetType;
 
     pkt->_totalLength = pkt->_headerSize + dataSize;
-    // TBD: Revisit
-    // pkt->_pktDataBuffer = new (std::nothrow) uint8_t
-    // [pkt->_baseHdr.totalLength()];
-    pkt->_pktDataBuffer = new (std::nothrow) uint8_t[pkt->_totalLength]{};
-
-    if (pkt->_pktDataBuffer == nullptr) {
-        // TBD: error assigning memory. Take measures.
-        return nullptr;
-    }
 
     // Serialize the hdr into the data buffer
     pkt->headerSerialize();
@@ -66,24 +82,140 @@ DeviceHPPacket::createTransmit(uint16_t dataSize, SandboxId sandboxId,
 DeviceHPPacketPtr
 DeviceHPPacket::createReceive(uint16_t dataSize)
 {
-    DeviceHPPacketPtr pkt = std::make_shared<DeviceHPPacket>();
-
-    pkt->_selfPtr = pkt;
+    DeviceHPPacketPtr pkt =
+        DeviceHPPacketPool::instance().get(_headerSize + size_t(dataSize));
+    if (pkt == nullptr) {
+        return nullptr;
+    }
 
     pkt->_pktDir      = PacketDirReceive;  // TBD: Revisit
     pkt->_totalLength = pkt->_headerSize + dataSize;
 
-    // TBD: Revisit
-    // First allocate for header and then increase/decrease
-    // pkt->_pktDataBuffer = new (std::nothrow) uint8_t [BaseHeader::size +
-    // 5000];
-    pkt->_pktDataBuffer = new (std::nothrow) uint8_t[pkt->_totalLength]{};
-    if (pkt->_pktDataBuffer == nullptr) {
-        // error assigning memory. Take measures.
+    return pkt;
+}
+
+//
+// @brief Create Receive Packet spanning the whole buffer of the smallest
+// size class
+//
+DeviceHPPacketPtr
+DeviceHPPacket::createReceive()
+{
+    DeviceHPPacketPtr pkt = DeviceHPPacketPool::instance().get(kClassSize[0]);
+
+    pkt->_pktDir      = PacketDirReceive;
+    pkt->_totalLength = kClassSize[0];
+
+    return pkt;
+}
+
+//
+// @brief Packet pool shared by the hostpath threads
+//
+DeviceHPPacketPool &
+DeviceHPPacketPool::instance()
+{
+    // Never destroyed, packets may be released while the process exits
+    static DeviceHPPacketPool *pool = new DeviceHPPacketPool();
+    return *pool;
+}
+
+DeviceHPPacketPool::DeviceHPPacketPool()
+{
+    for (unsigned c = 0; c < DeviceHPPacket::kSizeClasses; c++) {
+        SizeClass &    cls   = _classes[c];
+        const uint32_t count = DeviceHPPacket::kClassPackets[c];
+        const size_t   size  = DeviceHPPacket::kClassSize[c];
+
+        cls.pkts.reset(new DeviceHPPacket[count]);
+        cls.buffers.reset(new uint8_t[size_t(count) * size]);
+        for (uint32_t i = count; i-- > 0;) {
+            cls.pkts[i]._sizeClass     = uint8_t(c);
+            cls.pkts[i]._pktDataBuffer = &cls.buffers[size_t(i) * size];
+            put(&cls.pkts[i]);
+        }
+
+        const std::string labels = "size=\"" + std::to_string(size) + "\"";
+        Metrics::instance().gauge(
+            "jp4_hostpath_pool_free", "Free hostpath packet buffers",
+            [this, c] { return double(available(c)); }, labels);
+        Metrics::instance().gauge(
+            "jp4_hostpath_pool_misses_total",
+            "Hostpath packets allocated because the pool was empty",
+            [this, c] {
+                return double(
+                    _classes[c].misses.load(std::memory_order_relaxed));
+            },
+            labels);
+    }
+}
+
+//
+// @brief Pop a packet off the free list of the size class, or allocate
+// one if it is empty
+//
+DeviceHPPacketPtr
+DeviceHPPacketPool::get(size_t size)
+{
+    const unsigned c = DeviceHPPacket::sizeClass(size);
+    if (c == DeviceHPPacket::kSizeClasses) {
         return nullptr;
     }
 
-    return pkt;
+    SizeClass &     cls  = _classes[c];
+    DeviceHPPacket *pkt  = nullptr;
+    uint64_t        head = cls.head.load(std::memory_order_acquire);
+
+    while (uint32_t(head) != kNil) {
+        DeviceHPPacket *top  = &cls.pkts[uint32_t(head)];
+        uint32_t        next = top->_poolNext.load(std::memory_order_relaxed);
+        // The tag makes a pop fail if top was taken and put back meanwhile
+        uint64_t newHead = ((head >> 32) + 1) << 32 | next;
+        if (cls.head.compare_exchange_weak(head, newHead,
+                                           std::memory_order_acquire,
+                                           std::memory_order_acquire)) {
+            pkt = top;
+            cls.available.fetch_sub(1, std::memory_order_relaxed);
+            break;
+        }
+    }
+
+    if (pkt == nullptr) {
+        cls.misses.fetch_add(1, std::memory_order_relaxed);
+        pkt                 = new DeviceHPPacket();
+        pkt->_pooled        = false;
+        pkt->_sizeClass     = uint8_t(c);
+        pkt->_heapBuffer.reset(new uint8_t[DeviceHPPacket::kClassSize[c]]);
+        pkt->_pktDataBuffer = pkt->_heapBuffer.get();
+    }
+
+    pkt->_refCount.store(1, std::memory_order_relaxed);
+    return DeviceHPPacketPtr(pkt);
+}
+
+//
+// @brief Push a packet without references back on the free list of its
+// size class
+//
+void
+DeviceHPPacketPool::put(DeviceHPPacket *pkt)
+{
+    if (!pkt->_pooled) {
+        delete pkt;
+        return;
+    }
+
+    SizeClass &cls   = _classes[pkt->_sizeClass];
+    uint32_t   index = uint32_t(pkt - &cls.pkts[0]);
+    uint64_t   head  = cls.head.load(std::memory_order_relaxed);
+    uint64_t   newHead;
+    do {
+        pkt->_poolNext.store(uint32_t(head), std::memory_order_relaxed);
+        newHead = ((head >> 32) + 1) << 32 | index;
+    } while (!cls.head.compare_exchange_weak(head, newHead,
+                                             std::memory_order_release,
+                                             std::memory_order_relaxed));
+    cls.available.fetch_add(1, std::memory_order_relaxed);
 }
 
 //
@@ -91,12 +223,22 @@ DeviceHPPacket::createReceive(uint16_t dataSize)
 //
 void
 DeviceHPPacket::headerSerialize(void)
+{
+    writeHeader(_pktDataBuffer, _totalLength, _sandboxId, _portIndex);
+}
+
+//
+// @brief Writes a transmit header
+//
+void
+DeviceHPPacket::writeHeader(uint8_t *hdr, uint16_t totalLength,
+                            SandboxId sandboxId, PortIndex portIndex)
 {
     uint8_t version   = 0;
     uint8_t direction = DeviceHPPacket::PacketDirTransmit;
 
-    uint8_t *hdr = _pktDataBuffer;
-
+    // Pooled buffers hold the previous packet
+    *hdr = 0;
     ((*(uint8_t *)hdr) &= 0x0F);
     ((*(uint8_t *)hdr) |= (((uint8_t)version) << 4) & 0xF0);
 
@@ -104,9 +246,9 @@ DeviceHPPacket::headerSerialize(void)
     ((*(uint8_t *)hdr) |= (((uint8_t)direction) << 3) & 0x08);
 
     *(uint8_t *)(hdr + 1)  = 0;
-    *(uint16_t *)(hdr + 2) = htons(_totalLength);
-    *(uint16_t *)(hdr + 4) = htons(_sandboxId);
-    *(uint16_t *)(hdr + 6) = htons(_portIndex);
+    *(uint16_t *)(hdr + 2) = htons(totalLength);
+    *(uint16_t *)(hdr + 4) = htons(sandboxId);
+    *(uint16_t *)(hdr + 6) = htons(portIndex);
 }
 
 //
@@ -115,16 +257,6 @@ DeviceHPPacket::headerSerialize(void)
 void
 DeviceHPPacket::headerParse(void)
 {
-    {
-        boost::io::ios_all_saver ias(std::cout);
-        std::cout << "Pkt hdr:" << std::hex;
-        for (int i = 0; i < _headerSize; i++) {
-            std::cout << " " << std::setfill('0') << std::setw(2)
-                      << +_pktDataBuffer[i];
-        }
-        std::cout << "\n";
-    }
-
     uint8_t *hdr = _pktDataBuffer;
     //    uint8_t  version      = (((*(uint8_t *)hdr) & 0xF0) >> 4);
     uint8_t  direction    = (((*(uint8_t *)hdr) & 0x08) >> 3);
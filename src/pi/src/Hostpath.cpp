@@ -20,99 +20,524 @@
 // as noted in the Third-Party source code file.
 //
 
-#include <array>
+#include <linux/filter.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
 #include <iostream>
 #include <thread>
 
 #include "ControllerConnection.h"
 #include "DeviceHPPacket.h"
 #include "Hostpath.h"
+#include "HostpathAfPacket.h"
+#include "HostpathCapture.h"
+#include "HostpathShm.h"
+#include "HostpathStats.h"
+#include "Metrics.h"
+#include "PuntPolicer.h"
+
+namespace
+{
+// PacketOuts queued for transmit before they are dropped: this many
+// batches, at least kTxQueueMinPackets
+constexpr size_t kTxQueueBatches    = 64;
+constexpr size_t kTxQueueMinPackets = 1024;
+
+// Pause of a receive thread after a transient socket error
+constexpr unsigned kRxErrorBackoffMs = 10;
+
+MetricCounter &
+hostpathPackets(const std::string &dir, const std::string &result)
+{
+    return Metrics::instance().counter(
+        "jp4_hostpath_packets_total", "Hostpath packets by direction",
+        "dir=\"" + dir + "\",result=\"" + result + "\"");
+}
+
+MetricCounter &
+hostpathQueuePackets(unsigned queue)
+{
+    return Metrics::instance().counter(
+        "jp4_hostpath_rx_queue_packets_total",
+        "Hostpath datagrams received by receive thread",
+        "queue=\"" + std::to_string(queue) + "\"");
+}
+
+using ReusePort = boost::asio::detail::socket_option::boolean<SOL_SOCKET,
+                                                              SO_REUSEPORT>;
+
+struct HostpathMetrics {
+    MetricHistogram &puntLatency{
+        HostpathStats::instance().stage(HostpathStats::PuntAgent)};
+    MetricCounter &  punted{hostpathPackets("punt", "ok")};
+    MetricCounter &  puntMalformed{hostpathPackets("punt", "malformed")};
+    MetricCounter &  puntNoStream{hostpathPackets("punt", "no-stream")};
+    MetricCounter &  puntDropped{hostpathPackets("punt", "dropped")};
+    MetricCounter &  puntPoliced{hostpathPackets("punt", "policed")};
+    MetricCounter &  puntOversized{hostpathPackets("punt", "oversized")};
+    MetricHistogram &injectLatency{
+        HostpathStats::instance().stage(HostpathStats::InjectAgent)};
+    MetricCounter &  injected{hostpathPackets("inject", "ok")};
+    MetricCounter &  injectMalformed{hostpathPackets("inject", "malformed")};
+    MetricCounter &  injectQueueFull{hostpathPackets("inject", "queue-full")};
+    MetricCounter &  injectSendError{hostpathPackets("inject", "send-error")};
+    MetricCounter &  injectNoPort{hostpathPackets("inject", "no-port")};
+    MetricCounter &  injectOversized{hostpathPackets("inject", "oversized")};
+};
+
+HostpathMetrics &
+metrics()
+{
+    static HostpathMetrics m;
+    return m;
+}
+
+//
+// P4Info of the committed pipeline, for its packet metadata layouts. Each
+// thread keeps the generation it last saw, so a packet costs one atomic
+// load rather than a shared_ptr copy.
+//
+const P4InfoIndex &
+pipeline()
+{
+    thread_local uint32_t       generation = UINT32_MAX;
+    thread_local P4InfoIndexPtr index;
+
+    uint32_t current = P4Info::instance().generation();
+    if (current != generation) {
+        index      = P4Info::instance().current();
+        generation = current;
+    }
+    return *index;
+}
+}  // namespace
 
 //
 // @fn
-// handlePacketFromDevice
+// openSockets
 //
 // @brief
-// Receive hostpath packet
+// Bind one socket per receive thread to the hostpath port. With more
+// than one, the sockets form a SO_REUSEPORT group. Datagrams are
+// stamped with their kernel receive time, for the socket stage latency.
 //
 // @param[in]
-//     pkt Aft packet where received packet will be copied to
-// @return 0 - Success, -1 - Error
+//     count Number of receive threads
+// @return void
 //
 
-int Hostpath::handlePacketFromDevice()
+void Hostpath::openSockets(unsigned count)
 {
-    std::array<char, 2000> _buf;
-    udp::endpoint sender_endpoint;
+    const udp::endpoint local(udp::v4(), _hpUdpPort);
+
+    for (unsigned i = 0; i < count; i++) {
+        auto sock = std::make_unique<udp::socket>(_ioService);
+        sock->open(udp::v4());
+        if (count > 1) {
+            sock->set_option(ReusePort(true));
+        }
+        sock->bind(local);
+        int on = 1;
+        if (setsockopt(sock->native_handle(), SOL_SOCKET, SO_TIMESTAMPNS, &on,
+                       sizeof(on)) != 0) {
+            Log(WARNING) << "No hostpath receive timestamps: "
+                         << strerror(errno);
+        }
+        _hpUdpSocks.push_back(std::move(sock));
+    }
 
-    // Block until data has been received successfully or an error occurs.
-    const size_t recvlen =
-        _hpUdpSock.receive_from(boost::asio::buffer(_buf), sender_endpoint);
-    if (recvlen == 0) {
-        std::cout << "Read empty packet!!\n";
-        return 0;
-    } else if (recvlen <= DeviceHPPacket::_headerSize) {
-        std::cout << "Received malformed pkt(len: " << recvlen
-                  << "). Dropping it.\n";
-        return 0;
+    if (count > 1) {
+        attachShardFilter();
     }
+}
 
-    // Allocate packet context *and* buffer
-    DeviceHPPacketPtr pkt =
-        DeviceHPPacket::createReceive(recvlen - DeviceHPPacket::_headerSize);
+//
+// @fn
+// attachShardFilter
+//
+// @brief
+// The device sends all hostpath packets from one address, so the kernel
+// hash of the 4-tuple would put them all on one socket. A classic BPF
+// program hashes sandbox id and port index of the hostpath header
+// instead, which keeps the packets of a port on one thread, in order.
+//
+// @param[in] void
+// @return void
+//
 
-    pktTrace("Received (hostpath) pkt ", _buf.data(), recvlen);
+void Hostpath::attachShardFilter()
+{
+#ifdef SO_ATTACH_REUSEPORT_CBPF
+    struct sock_filter code[] = {
+        // The program sees the UDP payload. A = sandbox id << 16 | port
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 4),
+        BPF_STMT(BPF_MISC | BPF_TAX, 0),
+        BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 16),
+        BPF_STMT(BPF_ALU | BPF_XOR | BPF_X, 0),
+        BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, uint32_t(_hpUdpSocks.size())),
+        BPF_STMT(BPF_RET | BPF_A, 0),
+    };
+    struct sock_fprog prog;
+    prog.len    = sizeof(code) / sizeof(code[0]);
+    prog.filter = code;
+
+    if (setsockopt(_hpUdpSocks[0]->native_handle(), SOL_SOCKET,
+                   SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) == 0) {
+        return;
+    }
+    Log(ERROR) << "Unable to attach hostpath shard filter: " << strerror(errno);
+#endif  // SO_ATTACH_REUSEPORT_CBPF
+    Log(WARNING) << "Hostpath packets sharded by the kernel flow hash";
+}
 
-    std::copy_n(_buf.data(), recvlen, pkt->header());
+//
+// @fn
+// puntPacket
+//
+// @brief
+// Build the PacketIn of a hostpath packet received from the device. The
+// header is parsed in place and the inner packet copied once, into the
+// payload of packetIn. Reused PacketIns keep their payload capacity, so
+// nothing is allocated in steady state. Packets over the rate of their
+// punt reason and ingress port are dropped before the copy.
+//
+// @param[in]
+//     pkt Packet the datagram was received into
+// @param[in]
+//     len Length of the datagram
+// @param[out]
+//     packetIn PacketIn carrying cpu header and inner packet
+// @return Ok, or why the packet is dropped
+//
 
-    pktTrace("packet header", (char *)(pkt->header()), pkt->headerSize());
+Hostpath::PuntResult Hostpath::puntPacket(DeviceHPPacket &pkt, size_t len,
+                                          p4::PacketIn &packetIn)
+{
+    if (len == 0) {
+        Log(ERROR) << "Read empty packet!!";
+        return PuntResult::Malformed;
+    } else if (len <= DeviceHPPacket::_headerSize) {
+        Log(ERROR) << "Received malformed pkt(len: " << len
+                   << "). Dropping it.";
+        return PuntResult::Malformed;
+    }
 
-    std::cout << "\n\n";
-    std::cout << "pkt->headerSize(): " << pkt->headerSize() << " bytes\n";
-    std::cout << "Header: Received " << recvlen << " bytes\n";
+    pkt.setSize(len);
 
-    pkt->headerParse();
+    Log(DEBUG) << "pkt.headerSize(): " << pkt.headerSize() << " bytes";
+    Log(DEBUG) << "Header: Received " << len << " bytes";
 
-    std::cout << "Received packet:" << std::endl;
-    std::cout << "----------------" << std::endl;
-    std::cout << "Sandbox Id : " << pkt->sandboxId() << std::endl;
-    std::cout << "Port Index : " << pkt->portIndex() << std::endl;
-    std::cout << "Data Size  : " << pkt->dataSize() << std::endl;
+    pkt.headerParse();
 
-    std::cout << "pkt->dataSize(): " << pkt->dataSize() << " bytes"
-              << std::endl;
+    Log(DEBUG) << "Received packet:"
+               << " Sandbox Id : " << pkt.sandboxId()
+               << " Port Index : " << pkt.portIndex()
+               << " Data Size  : " << pkt.dataSize();
 
-    std::cout << "Data: Received " << recvlen << " bytes" << std::endl;
+#ifdef SUD
+    // XXX: HACK ALERT: Possible bug in VMXZT leads to 5 extra bytes being
+    // appended to the punted packet. Work around this for now.
+    size_t payload_len =
+        (pkt.dataSize() > 5) ? pkt.dataSize() - 5 : pkt.dataSize();
+#else
+    size_t payload_len = pkt.dataSize();
+#endif // SUD
+    return puntFrame(pkt.portIndex(), pkt.data(), payload_len, packetIn);
+}
 
-    pktTrace("pkt data", (char *)(pkt->data()), pkt->dataSize());
+//
+// @fn
+// puntFrame
+//
+// @brief
+// Build the PacketIn of a layer 2 frame received on a port. The frame is
+// copied once, into the payload of packetIn.
+// Frames over the rate of their punt reason and port are dropped before
+// the copy. Every frame is recorded in the capture ring first.
+//
+// @param[in]
+//     port Ingress port index
+// @param[in]
+//     frame Layer 2 frame
+// @param[in]
+//     len Length of frame
+// @param[out]
+//     packetIn PacketIn carrying the frame, port and reason in its
+//     metadata if the pipeline has a packet_in header, in a cpu header
+//     in front of the frame if not
+// @return Ok, or why the frame is dropped
+//
+
+Hostpath::PuntResult Hostpath::puntFrame(uint16_t port, const uint8_t *frame,
+                                         size_t len, p4::PacketIn &packetIn)
+{
+    HostpathCapture::instance().record(HostpathCapture::Punt, port, frame,
+                                       len);
+
+    // The device hostpath header carries no punt reason (yet)
+    const uint16_t reason = 0;
+    if (!PuntPolicer::instance().admit(reason, port)) {
+        return PuntResult::Policed;
+    }
+
+    std::string *payload = packetIn.mutable_payload();
+
+    const P4InfoPacketMetadata &metadata = pipeline().packetIn();
+    if (metadata.present()) {
+        metadata.encode(port, reason, packetIn);
+        payload->assign((const char *)frame, len);
+        HostpathStats::instance().punted(port, reason, len);
+        return PuntResult::Ok;
+    }
 
     // Construct pkt with cpu header
     cpu_header_t cpu_hdr;
     constexpr size_t cpu_hdr_sz = sizeof(cpu_hdr);
     memset(&cpu_hdr, 0, cpu_hdr_sz);
-    cpu_hdr.port = htons(pkt->portIndex());
+    cpu_hdr.reason = htons(reason);
+    cpu_hdr.port   = htons(port);
+
+    packetIn.clear_metadata();
+    payload->assign((const char *)&cpu_hdr, cpu_hdr_sz);
+    payload->append((const char *)frame, len);
+    HostpathStats::instance().punted(port, reason, len);
+    return PuntResult::Ok;
+}
 
-#ifdef SUD
-    // XXX: HACK ALERT: Possible bug in VMXZT leads to 5 extra bytes being
-    // appended to the punted packet. Work around this for now.
-    size_t payload_len =
-        (pkt->dataSize() > 5) ? pkt->dataSize() - 5 : pkt->dataSize();
-#else
-    size_t payload_len = pkt->dataSize();
-#endif // SUD
-    std::string payload(cpu_hdr_sz + payload_len, '\0');
-    memcpy(&payload[0], &cpu_hdr, cpu_hdr_sz);
-    memcpy(&payload[cpu_hdr_sz], pkt->data(), payload_len);
+//
+// @fn
+// punt
+//
+// @brief
+// Punt a packet received from the device to the controller, counting
+// the packets dropped
+//
+// @param[in]
+//     pkt Packet the datagram was received into
+// @param[in]
+//     len Length of the datagram
+// @param[in]
+//     packetIn PacketIn reused for every packet
+// @param[in]
+//     ingressNs When the packet was received, 0 if not known
+// @return false if the packet was dropped
+//
+
+bool Hostpath::punt(DeviceHPPacket &pkt, size_t len, p4::PacketIn &packetIn,
+                    uint64_t ingressNs)
+{
+    return finishPunt(puntPacket(pkt, len, packetIn), packetIn, ingressNs);
+}
+
+//
+// @fn
+// finishPunt
+//
+// @brief
+// Punt a PacketIn to the controller, or count why it was dropped
+//
+// @param[in]
+//     result Outcome of building packetIn
+// @param[in]
+//     packetIn PacketIn reused for every packet
+// @param[in]
+//     ingressNs When the packet was received, 0 if not known
+// @return false if the packet was dropped
+//
+
+bool Hostpath::finishPunt(PuntResult result, p4::PacketIn &packetIn,
+                          uint64_t ingressNs)
+{
+    HostpathMetrics &m = metrics();
+
+    if (result == PuntResult::Malformed) {
+        m.puntMalformed.inc();
+        return false;
+    } else if (result == PuntResult::Policed) {
+        m.puntPoliced.inc();
+        return false;
+    }
 
     // Punt it to the controller on the stream channel
-    p4::PacketIn packet_in;
-    packet_in.set_payload(std::move(payload));
-    bool result = controller_conn.send_pkt_in(&packet_in);
-    if (!result) {
-        std::cout << "Failed to send pkt to master controller. No stream.\n";
+    sendPacketIn(packetIn, ingressNs);
+    return true;
+}
+
+//
+// @fn
+// isPriority
+//
+// @brief
+// Whether the punt reason of a PacketIn, in its metadata or cpu header,
+// is one of the high priority reasons. The device hostpath header has no
+// punt reason yet, so every punt has reason 0 and is either high
+// priority, if 0 is listed, or not.
+//
+// @param[in]
+//     packetIn PacketIn built by puntPacket()
+// @return true for a high priority reason
+//
+
+bool Hostpath::isPriority(const p4::PacketIn &packetIn) const
+{
+    if (_priorityReasons.empty()) {
+        return false;
     }
+    uint16_t reason;
+    if (packetIn.metadata_size() > 0) {
+        reason = pipeline().packetIn().reason(packetIn);
+    } else {
+        cpu_header_t cpu_hdr;
+        memcpy(&cpu_hdr, packetIn.payload().data(), sizeof(cpu_hdr));
+        reason = ntohs(cpu_hdr.reason);
+    }
+    return std::binary_search(_priorityReasons.begin(),
+                              _priorityReasons.end(), reason);
+}
 
-    return 0;
+//
+// @fn
+// sendPacketIn
+//
+// @brief
+// Queue a PacketIn for the stream channel writer
+//
+// @param[in]
+//     packetIn PacketIn, its contents are taken
+// @param[in]
+//     ingressNs When the packet was received, 0 if not known
+// @return void
+//
+
+void Hostpath::sendPacketIn(p4::PacketIn &packetIn, uint64_t ingressNs)
+{
+    HostpathMetrics &m = metrics();
+
+    if (controller_conn.send_pkt_in(&packetIn, isPriority(packetIn),
+                                    ingressNs)) {
+        m.punted.inc();
+    } else if (!controller_conn.connected()) {
+        Log(ERROR) << "Failed to send pkt to master controller. No stream.";
+        m.puntNoStream.inc();
+    } else {
+        m.puntDropped.inc();
+    }
+}
+
+//
+// @fn
+// receiveBatches
+//
+// @brief
+// Batched receive: recvmmsg fills a pre-registered array of pooled
+// packets with whatever is queued on the socket, up to _batchSize
+// datagrams. Packets are reused across batches. They are of the smallest
+// size class; the rest of a larger datagram is scattered to a spill area
+// of its slot, and gathered into a packet of its size class to be
+// punted. Datagrams over _maxPacketSize come back truncated and are
+// dropped. Each datagram carries its kernel receive timestamp. Receiving
+// backs off while the kernel is short of memory and stops on any other
+// socket error, which would only repeat (e.g. EBADF, ENOTSOCK).
+//
+// @param[in]
+//     sock Socket of the receive thread
+// @param[in]
+//     received Datagram counter of the receive thread
+// @return void
+//
+
+void Hostpath::receiveBatches(udp::socket &sock, MetricCounter &received)
+{
+    const int    fd   = sock.native_handle();
+    const auto   n    = _batchSize;
+    const size_t head = std::min(DeviceHPPacket::kClassSize[0], _maxPacketSize);
+    const size_t spill = _maxPacketSize - head;
+
+    // Spill pages are only backed once a large datagram lands in them
+    std::vector<DeviceHPPacketPtr> pkts(n);
+    std::unique_ptr<uint8_t[]>     spills(new uint8_t[n * spill]);
+    std::vector<struct iovec>      iovs(2 * n);
+    std::vector<struct mmsghdr>    msgs(n);
+    const size_t                   ctrlLen = CMSG_SPACE(sizeof(timespec));
+    std::unique_ptr<uint64_t[]>    ctrls(new uint64_t[n * ctrlLen / 8]());
+    for (unsigned i = 0; i < n; i++) {
+        pkts[i]                    = DeviceHPPacket::createReceive();
+        iovs[2 * i].iov_base       = pkts[i]->header();
+        iovs[2 * i].iov_len        = head;
+        iovs[2 * i + 1].iov_base   = &spills[i * spill];
+        iovs[2 * i + 1].iov_len    = spill;
+        msgs[i].msg_hdr            = {};
+        msgs[i].msg_hdr.msg_iov    = &iovs[2 * i];
+        msgs[i].msg_hdr.msg_iovlen = 2;
+    }
+
+    HostpathMetrics &m     = metrics();
+    HostpathStats &  stats = HostpathStats::instance();
+    p4::PacketIn     packetIn;
+
+    while (true) {
+        for (unsigned i = 0; i < n; i++) {
+            msgs[i].msg_hdr.msg_control    = &ctrls[i * ctrlLen / 8];
+            msgs[i].msg_hdr.msg_controllen = ctrlLen;
+        }
+
+        // Block for the first datagram only, then take what is queued
+        int cnt = recvmmsg(fd, msgs.data(), n, MSG_WAITFORONE, nullptr);
+        if (cnt < 0) {
+            if ((errno == EINTR) || (errno == EAGAIN) ||
+                (errno == EWOULDBLOCK)) {
+                continue;
+            }
+            Log(ERROR) << "Hostpath recvmmsg failed: " << strerror(errno);
+            if ((errno == ENOMEM) || (errno == ENOBUFS)) {
+                std::this_thread::sleep_for(
+                    std::chrono::milliseconds(kRxErrorBackoffMs));
+                continue;
+            }
+            Log(ERROR) << "Hostpath receive thread stopped";
+            return;
+        }
+
+        const uint64_t readNs = HostpathStats::now();
+        received.inc(cnt);
+
+        for (int i = 0; i < cnt; i++) {
+            uint64_t        ingressNs = readNs;
+            struct cmsghdr *cmsg      = CMSG_FIRSTHDR(&msgs[i].msg_hdr);
+            if ((cmsg != nullptr) && (cmsg->cmsg_level == SOL_SOCKET) &&
+                (cmsg->cmsg_type == SCM_TIMESTAMPNS)) {
+                struct timespec ts;
+                memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+                ingressNs = uint64_t(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+                stats.record(HostpathStats::PuntSocket, ingressNs, readNs);
+            }
+
+            if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+                Log(ERROR) << "Hostpath packet larger than " << _maxPacketSize
+                           << " bytes. Dropping it.";
+                m.puntOversized.inc();
+                continue;
+            }
+
+            const size_t      len = msgs[i].msg_len;
+            DeviceHPPacket *  pkt = pkts[i].get();
+            DeviceHPPacketPtr large;
+            if (len > head) {
+                large = DeviceHPPacket::createReceive(
+                    len - DeviceHPPacket::_headerSize);
+                memcpy(large->header(), pkt->header(), head);
+                memcpy(large->header() + head, &spills[i * spill], len - head);
+                pkt = large.get();
+            }
+            if (punt(*pkt, len, packetIn, ingressNs)) {
+                stats.record(HostpathStats::PuntAgent, readNs,
+                             HostpathStats::now());
+            }
+        }
+    }
 }
 
 //
@@ -120,108 +545,411 @@ int Hostpath::handlePacketFromDevice()
 // hostPathUDPServer
 //
 // @brief
-// Hostpath UDP server
+// Hostpath UDP server, run by each receive thread
 //
-// @param[in] void
+// @param[in]
+//     queue Receive thread index
 // @return void
 //
 
-void Hostpath::hostPathUDPServer()
+void Hostpath::hostPathUDPServer(unsigned queue)
 {
     // TBD:: move this log to appropriate place
     Log(DEBUG) << "Listening for hostpath packets from device on (UDP) 0.0.0.0:"
-               << _hpUdpPort;
+               << _hpUdpPort << ", queue " << queue;
+
+    // Without batching, recvmmsg of a single datagram is a recvmsg
+    receiveBatches(*_hpUdpSocks[queue], hostpathQueuePackets(queue));
+}
+
+//
+// @fn
+// receiveShm
+//
+// @brief
+// Punt the packets PktIO queues on the shared memory punt ring. The ring
+// has no receive timestamps, packets are timed from when they are read.
+//
+// @param[in] void
+// @return void
+//
+
+void Hostpath::receiveShm()
+{
+    HostpathShmRing & ring     = _shm->punt();
+    DeviceHPPacketPtr pkt      = DeviceHPPacket::createReceive();
+    MetricCounter &   received = hostpathQueuePackets(0);
+    p4::PacketIn      packetIn;
+
     while (true) {
-        handlePacketFromDevice();
+        size_t         len;
+        const uint8_t *frame = ring.front(len);
+        if (frame == nullptr) {
+            ring.wait(100);
+            continue;
+        }
+
+        MetricTimer    timer(metrics().puntLatency);
+        const uint64_t ingressNs = HostpathStats::now();
+
+        // Copy out before parsing, PktIO may write the shared memory. The
+        // ring slots hold up to _maxPacketSize.
+        DeviceHPPacketPtr buf =
+            (len <= pkt->capacity())
+                ? pkt
+                : DeviceHPPacket::createReceive(len -
+                                                DeviceHPPacket::_headerSize);
+        memcpy(buf->header(), frame, len);
+        ring.pop();
+        received.inc();
+
+        punt(*buf, len, packetIn, ingressNs);
     }
 }
 
 //
 // @fn
-// startDevicePacketHandler
+// receiveAfPacket
 //
 // @brief
-// Start AFI packer receiver
+// Punt the frames received on an AF_PACKET interface, a ring block at a
+// time. Frames are punted straight from the ring, the PacketIn payload
+// being their only copy.
+//
+// @param[in]
+//     queue Index of the interface
+// @return void
+//
+
+void Hostpath::receiveAfPacket(unsigned queue)
+{
+    HostpathAfPacket &intf     = *_afPackets[queue];
+    HostpathMetrics & m        = metrics();
+    HostpathStats &   stats    = HostpathStats::instance();
+    MetricCounter &   received = hostpathQueuePackets(queue);
+    p4::PacketIn      packetIn;
+
+    while (true) {
+        uint64_t readNs = 0;
+        size_t   cnt    = intf.receiveBlock(
+            [&](const uint8_t *frame, size_t len, size_t wireLen,
+                uint64_t ingressNs) {
+                if (readNs == 0) {
+                    readNs = HostpathStats::now();
+                }
+                stats.record(HostpathStats::PuntSocket, ingressNs, readNs);
+                if ((len < wireLen) ||
+                    (wireLen > _maxPacketSize - DeviceHPPacket::_headerSize)) {
+                    m.puntOversized.inc();
+                } else if (finishPunt(
+                               puntFrame(intf.port(), frame, len, packetIn),
+                               packetIn, ingressNs)) {
+                    stats.record(HostpathStats::PuntAgent, readNs,
+                                 HostpathStats::now());
+                }
+            },
+            100);
+        received.inc(cnt);
+    }
+}
+
+//
+// @fn
+// transmitAfPacket
+//
+// @brief
+// Queue a PacketOut on the transmit ring of the interface of its egress
+// port
+//
+// @param[in]
+//     port Egress port index
+// @param[in]
+//     frame Layer 2 frame
+// @param[in]
+//     len Length of frame
+// @param[in]
+//     readNs When the PacketOut was read from the stream
+// @return void
+//
+
+void Hostpath::transmitAfPacket(uint16_t port, const uint8_t *frame,
+                                size_t len, uint64_t readNs)
+{
+    HostpathMetrics &m = metrics();
+
+    for (auto &intf : _afPackets) {
+        if (intf->port() != port) {
+            continue;
+        }
+        if (len > intf->maxFrame()) {
+            Log(ERROR) << "PacketOut larger than " << intf->maxFrame()
+                       << " bytes. Dropping it.";
+            m.injectOversized.inc();
+        } else if (intf->transmit(frame, len)) {
+            m.injected.inc();
+            HostpathStats::instance().injected(port, len);
+            HostpathStats::instance().record(HostpathStats::InjectTotal,
+                                             readNs, HostpathStats::now());
+        } else {
+            m.injectQueueFull.inc();
+        }
+        return;
+    }
+
+    Log(DEBUG) << "No hostpath interface for port " << port;
+    m.injectNoPort.inc();
+}
+
+//
+// @fn
+// transmitBatches
+//
+// @brief
+// Transmit thread: send the PacketOuts queued by sendPacketOut() with
+// sendmmsg, up to _batchSize datagrams per call. Each datagram gathers
+// the device header and the frame, straight from the buffer the PacketOut
+// was received into.
 //
 // @param[in] void
 // @return void
 //
 
-void Hostpath::startDevicePacketHandler()
+void Hostpath::transmitBatches()
 {
-    std::thread udpSrvr([this] { this->hostPathUDPServer(); });
-    udpSrvr.detach();
+    const int  fd = _hpUdpSocks[0]->native_handle();
+    const auto n  = _batchSize;
+
+    std::vector<struct iovec>   iovs(2 * n);
+    std::vector<struct mmsghdr> msgs(n);
+    std::vector<TxPacket>       batch;
+
+    HostpathMetrics &m     = metrics();
+    HostpathStats &  stats = HostpathStats::instance();
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(_txQueue.mtx);
+            _txQueue.cv.wait(lock, [this] { return !_txQueue.pkts.empty(); });
+            batch.swap(_txQueue.pkts);
+        }
+
+        for (size_t first = 0; first < batch.size();) {
+            unsigned cnt = std::min<size_t>(n, batch.size() - first);
+            for (unsigned i = 0; i < cnt; i++) {
+                TxPacket &pkt               = batch[first + i];
+                iovs[2 * i].iov_base        = pkt.header;
+                iovs[2 * i].iov_len         = sizeof(pkt.header);
+                iovs[2 * i + 1].iov_base    = &pkt.payload[pkt.offset];
+                iovs[2 * i + 1].iov_len     = pkt.payload.size() - pkt.offset;
+                msgs[i].msg_hdr             = {};
+                msgs[i].msg_hdr.msg_name    = _pktIOEndpoint.data();
+                msgs[i].msg_hdr.msg_namelen = _pktIOEndpoint.size();
+                msgs[i].msg_hdr.msg_iov     = &iovs[2 * i];
+                msgs[i].msg_hdr.msg_iovlen  = 2;
+            }
+
+            int sent = sendmmsg(fd, msgs.data(), cnt, 0);
+            if (sent < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                Log(ERROR) << "Hostpath sendmmsg failed: " << strerror(errno);
+                m.injectSendError.inc(cnt);
+                sent = cnt;  // Drop them
+            } else {
+                m.injected.inc(sent);
+                const uint64_t sentNs = HostpathStats::now();
+                for (int i = 0; i < sent; i++) {
+                    const TxPacket &pkt = batch[first + i];
+                    stats.injected(pkt.port, pkt.payload.size() - pkt.offset);
+                    stats.record(HostpathStats::InjectQueue, pkt.queuedNs,
+                                 sentNs);
+                    stats.record(HostpathStats::InjectTotal, pkt.readNs,
+                                 sentNs);
+                }
+            }
+            first += sent;
+        }
+        batch.clear();
+    }
 }
 
-void Hostpath::sendPacketOut(const std::string &pkt)
+//
+// @fn
+// startDevicePacketHandler
+//
+// @brief
+// Start AFI packer receiver
+//
+// @param[in] void
+// @return void
+//
+
+void Hostpath::startDevicePacketHandler()
 {
-    constexpr auto cpu_hdr_sz = sizeof(cpu_header_t);
-    const auto in_pkt_sz = pkt.size();
+    controller_conn.start_pkt_in_writer(_packetInCfg);
+
+    if (_shm) {
+        if (!_shm->start()) {
+            Log(ERROR) << "Hostpath shared memory transport not started";
+            return;
+        }
+        std::thread shmSrvr([this] { this->receiveShm(); });
+        shmSrvr.detach();
+        return;
+    }
 
-    // Sanity check
-    char zero[8]{};
-    if ((in_pkt_sz <= cpu_hdr_sz) || (memcmp(zero, pkt.data(), 8) != 0)) {
-        std::cout << "Malformed packet!!\n";
+    if (_afPacket) {
+        // PacketOuts to the port of an interface not started are counted
+        // as no-port
+        for (auto it = _afPackets.begin(); it != _afPackets.end();) {
+            if ((*it)->open()) {
+                ++it;
+                continue;
+            }
+            Log(ERROR) << "Hostpath interface " << (*it)->name()
+                       << " not started";
+            it = _afPackets.erase(it);
+        }
+        if (_afPackets.empty()) {
+            Log(ERROR) << "No hostpath interface started";
+        }
+
+        for (unsigned queue = 0; queue < _afPackets.size(); queue++) {
+            HostpathAfPacket &intf = *_afPackets[queue];
+            std::thread afRx([this, queue] { this->receiveAfPacket(queue); });
+            afRx.detach();
+            std::thread afTx([&intf] { intf.transmitLoop(); });
+            afTx.detach();
+        }
         return;
     }
 
-    uint16_t egress_port = ntohs(((struct cpu_header_t *)pkt.data())->port);
+    for (unsigned queue = 0; queue < _hpUdpSocks.size(); queue++) {
+        std::thread udpSrvr([this, queue] { this->hostPathUDPServer(queue); });
+        if (!_rxCpus.empty()) {
+            int       cpu = _rxCpus[queue % _rxCpus.size()];
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(cpu, &cpus);
+            int err = pthread_setaffinity_np(udpSrvr.native_handle(),
+                                             sizeof(cpus), &cpus);
+            if (err != 0) {
+                Log(ERROR) << "Unable to pin hostpath queue " << queue
+                           << " to cpu " << cpu << ": " << strerror(err);
+            }
+        }
+        udpSrvr.detach();
+    }
 
-    // XXX: For now, use sandbox ID 0
-    injectL2Packet(0, egress_port, (uint8_t *)&pkt[cpu_hdr_sz],
-                   (in_pkt_sz - cpu_hdr_sz));
+    std::thread udpTx([this] { this->transmitBatches(); });
+    udpTx.detach();
 }
 
 //
 // @fn
-// injectL2Packet
+// sendPacketOut
 //
 // @brief
-// Inject layer 2 packet on specified (output)
-// port of specified sandbox
+// Queue a PacketOut for the device. Its egress port comes from its
+// metadata, or from the cpu header in front of the frame if it has none.
+// The payload buffer is taken over and sent from with the device header
+// in front, so the frame is not copied. The stream reader only queues
+// it, the transmit thread does the socket send.
 //
 // @param[in]
-//     sandboxId Sandbox index
-// @param[in]
-//     portIndex Port index
-// @param[in]
-//     l2Packet Pointer to layer 2 packet to be injected
-// @param[in]
-//     l2PacketLen Length of layer 2 packet
+//     packetOut PacketOut, its payload is taken
 // @return void
 //
 
-int Hostpath::injectL2Packet(SandboxId sandboxId, DevicePortIndex portIndex,
-                             const uint8_t *l2Packet, int l2PacketLen)
+void Hostpath::sendPacketOut(p4::PacketOut &packetOut)
 {
-    std::cout << "Injecting layer2 packet - ";
-    std::cout << "Sandbox index:" << sandboxId << " ";
-    std::cout << "Port index: " << portIndex << std::endl;
+    HostpathMetrics &m = metrics();
+    MetricTimer      timer(m.injectLatency);
+    const uint64_t   readNs = HostpathStats::now();
+
+    std::string &pkt = *packetOut.mutable_payload();
+    uint16_t     egress_port;
+    size_t       offset;
+
+    if (packetOut.metadata_size() > 0) {
+        if (!pipeline().packetOut().port(packetOut, egress_port)) {
+            Log(ERROR) << "PacketOut metadata without egress port";
+            m.injectMalformed.inc();
+            return;
+        }
+        offset = 0;
+    } else {
+        // Sanity check
+        char zero[8]{};
+        if ((pkt.size() < sizeof(cpu_header_t)) ||
+            (memcmp(zero, pkt.data(), 8) != 0)) {
+            Log(ERROR) << "Malformed packet!!";
+            m.injectMalformed.inc();
+            return;
+        }
+        egress_port = ntohs(((struct cpu_header_t *)pkt.data())->port);
+        offset      = sizeof(cpu_header_t);
+    }
 
-    if (!l2Packet) {
-        std::cout << "l2Packet NULL" << std::endl;
+    const uint8_t *frame    = (const uint8_t *)pkt.data() + offset;
+    const size_t   frame_sz = pkt.size() - offset;
+    if (frame_sz == 0) {
+        Log(ERROR) << "Malformed packet!!";
+        m.injectMalformed.inc();
+        return;
     }
 
-    DeviceHPPacketPtr pkt = DeviceHPPacket::createTransmit(
-        l2PacketLen, sandboxId, portIndex, DeviceHPPacket::PacketTypeL2);
+    const size_t dgram_sz = DeviceHPPacket::_headerSize + frame_sz;
+    if (dgram_sz > _maxPacketSize) {
+        Log(ERROR) << "PacketOut larger than " << _maxPacketSize
+                   << " bytes. Dropping it.";
+        m.injectOversized.inc();
+        return;
+    }
 
-    //
-    // Get base of packet data.
-    // This is in the buffer immediately after the header.
-    //
-    uint8_t *pktData = pkt->data();
+    HostpathCapture::instance().record(HostpathCapture::Inject, egress_port,
+                                       frame, frame_sz);
 
-    //
-    // Fill the pktData with 'L2 packet to be injected'
-    //
-    memcpy(pktData, l2Packet, l2PacketLen);
+    if (_afPacket) {
+        transmitAfPacket(egress_port, frame, frame_sz, readNs);
+        return;
+    }
 
-    pktTrace("xmit pkt ", (char *)(pkt->header()), pkt->size());
+    // XXX: For now, use sandbox ID 0
+    TxPacket tx;
+    DeviceHPPacket::writeHeader(tx.header, dgram_sz, 0, egress_port);
+
+    if (_shm) {
+        bool queued;
+        {
+            std::lock_guard<std::mutex> lock(_shmInjectMtx);
+            queued = _shm->inject().push(tx.header, sizeof(tx.header), frame,
+                                         frame_sz);
+        }
+        if (queued) {
+            m.injected.inc();
+            HostpathStats::instance().injected(egress_port, frame_sz);
+            HostpathStats::instance().record(HostpathStats::InjectTotal,
+                                             readNs, HostpathStats::now());
+        } else {
+            m.injectQueueFull.inc();
+        }
+        return;
+    }
 
-    std::cout << __PRETTY_FUNCTION__
-              << ": Injecting pkt of size: " << pkt->size() << "\n";
+    tx.port     = egress_port;
+    tx.offset   = offset;
+    tx.readNs   = readNs;
+    tx.queuedNs = HostpathStats::now();
+    tx.payload.swap(pkt);
 
-    _hpUdpSock.send_to(boost::asio::buffer(pkt->header(), pkt->size()),
-                       _pktIOEndpoint);
-    return 0;
+    std::lock_guard<std::mutex> lock(_txQueue.mtx);
+    if (_txQueue.pkts.size() >=
+        std::max(kTxQueueBatches * _batchSize, kTxQueueMinPackets)) {
+        m.injectQueueFull.inc();
+        return;
+    }
+    _txQueue.pkts.push_back(std::move(tx));
+    _txQueue.cv.notify_one();
 }
@@ -0,0 +1,352 @@
+//
+// Juniper P4 Agent
+//
+/// @file  HostpathAfPacket.cpp
+/// @brief Hostpath attached to Linux interfaces through AF_PACKET rings
+//
+// Copyright (c) [2018] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#include "HostpathAfPacket.h"
+
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+#include <net/if.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "Log.h"
+
+namespace
+{
+// Receive blocks are retired to the agent at the latest this long after
+// their first frame, bounding the punt latency a partial block adds
+constexpr unsigned kRetireTimeoutMs = 2;
+
+// Nominal receive frame size; TPACKET_V3 packs frames of any size into
+// a block, this only sizes the frame count the kernel checks
+constexpr uint32_t kRxFrameSize = 2048;
+
+// Transmit ring: fixed frames of whole pages, as many as fit kTxRingSize
+// but at least kTxMinFrames
+constexpr size_t   kTxPageSize   = 4096;
+constexpr size_t   kTxRingSize   = 1 << 20;
+constexpr uint32_t kTxMinFrames  = 16;
+constexpr size_t   kTxDataOffset = TPACKET_ALIGN(sizeof(struct tpacket2_hdr));
+
+uint32_t
+txFrameSize(size_t maxFrame)
+{
+    return (kTxDataOffset + maxFrame + kTxPageSize - 1) & ~(kTxPageSize - 1);
+}
+}  // namespace
+
+HostpathAfPacket::HostpathAfPacket(const HostpathInterface &intf,
+                                   uint32_t blockSize, uint32_t blocks,
+                                   size_t maxFrame)
+    : _intf(intf),
+      _blockSize(blockSize),
+      _blocks(blocks),
+      _txFrameSize(txFrameSize(maxFrame)),
+      _txFrames(std::max<uint32_t>(kTxRingSize / _txFrameSize, kTxMinFrames))
+{
+}
+
+HostpathAfPacket::~HostpathAfPacket()
+{
+    if (_rxRing != nullptr) {
+        munmap(_rxRing, size_t(_blockSize) * _blocks);
+    }
+    if (_txRing != nullptr) {
+        munmap(_txRing, size_t(_txFrameSize) * _txFrames);
+    }
+    if (_rxFd >= 0) {
+        close(_rxFd);
+    }
+    if (_txFd >= 0) {
+        close(_txFd);
+    }
+}
+
+//
+// @fn
+// maxFrame
+//
+// @brief
+// Largest frame a transmit ring frame holds
+//
+// @param[in] void
+// @return Size in bytes
+//
+
+size_t
+HostpathAfPacket::maxFrame() const
+{
+    return _txFrameSize - kTxDataOffset;
+}
+
+//
+// @fn
+// openSocket
+//
+// @brief
+// Open a packet socket of a TPACKET version, not yet bound
+//
+// @param[in]
+//     version TPACKET_V2 or TPACKET_V3
+// @return Socket, -1 on error
+//
+
+int
+HostpathAfPacket::openSocket(int version)
+{
+    int fd = socket(AF_PACKET, SOCK_RAW, 0);
+    if (fd < 0) {
+        Log(ERROR) << "Unable to open packet socket for " << _intf.name
+                   << ": " << strerror(errno);
+        return -1;
+    }
+    if (setsockopt(fd, SOL_PACKET, PACKET_VERSION, &version,
+                   sizeof(version)) != 0) {
+        Log(ERROR) << "TPACKET_V" << (version + 1) << " unsupported for "
+                   << _intf.name << ": " << strerror(errno);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+//
+// @fn
+// open
+//
+// @brief
+// Open the receive and transmit sockets of the interface and map their
+// rings. The receive socket is bound only once its ring is set up, so
+// no frame is ever copied outside the ring.
+//
+// @param[in] void
+// @return true on success
+//
+
+bool
+HostpathAfPacket::open()
+{
+    const unsigned ifindex = if_nametoindex(_intf.name.c_str());
+    if (ifindex == 0) {
+        Log(ERROR) << "No hostpath interface " << _intf.name;
+        return false;
+    }
+
+    _rxFd = openSocket(TPACKET_V3);
+    _txFd = openSocket(TPACKET_V2);
+    if ((_rxFd < 0) || (_txFd < 0)) {
+        return false;
+    }
+
+    struct tpacket_req3 rxReq;
+    memset(&rxReq, 0, sizeof(rxReq));
+    rxReq.tp_block_size       = _blockSize;
+    rxReq.tp_block_nr         = _blocks;
+    rxReq.tp_frame_size       = kRxFrameSize;
+    rxReq.tp_frame_nr         = (_blockSize / kRxFrameSize) * _blocks;
+    rxReq.tp_retire_blk_tov   = kRetireTimeoutMs;
+    rxReq.tp_feature_req_word = 0;
+    if (setsockopt(_rxFd, SOL_PACKET, PACKET_RX_RING, &rxReq,
+                   sizeof(rxReq)) != 0) {
+        Log(ERROR) << "Unable to set up receive ring of " << _intf.name
+                   << ": " << strerror(errno);
+        return false;
+    }
+
+    // Skip frames the kernel refuses rather than stall the ring on them.
+    // Only takes before the ring is set up.
+    int loss = 1;
+    setsockopt(_txFd, SOL_PACKET, PACKET_LOSS, &loss, sizeof(loss));
+
+    struct tpacket_req txReq;
+    memset(&txReq, 0, sizeof(txReq));
+    txReq.tp_block_size = _txFrameSize;
+    txReq.tp_block_nr   = _txFrames;
+    txReq.tp_frame_size = _txFrameSize;
+    txReq.tp_frame_nr   = _txFrames;
+    if (setsockopt(_txFd, SOL_PACKET, PACKET_TX_RING, &txReq,
+                   sizeof(txReq)) != 0) {
+        Log(ERROR) << "Unable to set up transmit ring of " << _intf.name
+                   << ": " << strerror(errno);
+        return false;
+    }
+
+    const int prot  = PROT_READ | PROT_WRITE;
+    const int flags = MAP_SHARED | MAP_POPULATE;
+    void *rx =
+        mmap(nullptr, size_t(_blockSize) * _blocks, prot, flags, _rxFd, 0);
+    void *tx =
+        mmap(nullptr, size_t(_txFrameSize) * _txFrames, prot, flags, _txFd, 0);
+    if ((rx == MAP_FAILED) || (tx == MAP_FAILED)) {
+        Log(ERROR) << "Unable to map rings of " << _intf.name << ": "
+                   << strerror(errno);
+        if (rx != MAP_FAILED) munmap(rx, size_t(_blockSize) * _blocks);
+        if (tx != MAP_FAILED) munmap(tx, size_t(_txFrameSize) * _txFrames);
+        return false;
+    }
+    _rxRing = static_cast<uint8_t *>(rx);
+    _txRing = static_cast<uint8_t *>(tx);
+
+#ifdef PACKET_QDISC_BYPASS
+    // The agent is the only sender that matters on a hostpath interface
+    int one = 1;
+    setsockopt(_txFd, SOL_PACKET, PACKET_QDISC_BYPASS, &one, sizeof(one));
+#endif  // PACKET_QDISC_BYPASS
+
+    // Frames addressed to anyone are punted, as by a device port
+    struct packet_mreq mreq;
+    memset(&mreq, 0, sizeof(mreq));
+    mreq.mr_ifindex = ifindex;
+    mreq.mr_type    = PACKET_MR_PROMISC;
+    if (setsockopt(_rxFd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq,
+                   sizeof(mreq)) != 0) {
+        Log(WARNING) << "Unable to make " << _intf.name
+                     << " promiscuous: " << strerror(errno);
+    }
+
+    struct sockaddr_ll sll;
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family   = AF_PACKET;
+    sll.sll_ifindex  = ifindex;
+    sll.sll_protocol = htons(ETH_P_ALL);
+    if ((bind(_rxFd, reinterpret_cast<struct sockaddr *>(&sll),
+              sizeof(sll)) != 0) ||
+        (bind(_txFd, reinterpret_cast<struct sockaddr *>(&sll),
+              sizeof(sll)) != 0)) {
+        Log(ERROR) << "Unable to bind to " << _intf.name << ": "
+                   << strerror(errno);
+        return false;
+    }
+
+    Log(INFO) << "Hostpath interface " << _intf.name << " is port "
+              << _intf.port << ", " << _blocks << " receive blocks of "
+              << _blockSize << " bytes";
+    return true;
+}
+
+//
+// @fn
+// waitBlock
+//
+// @brief
+// Sleep until the kernel hands over the next receive block
+//
+// @param[in]
+//     timeoutMs Longest wait
+// @return true if the block is ready
+//
+
+bool
+HostpathAfPacket::waitBlock(int timeoutMs)
+{
+    struct pollfd pfd;
+    pfd.fd      = _rxFd;
+    pfd.events  = POLLIN | POLLERR;
+    pfd.revents = 0;
+    if ((poll(&pfd, 1, timeoutMs) < 0) && (errno != EINTR)) {
+        Log(ERROR) << "Hostpath poll on " << _intf.name
+                   << " failed: " << strerror(errno);
+    }
+    return __atomic_load_n(&block(_rxBlock)->hdr.bh1.block_status,
+                           __ATOMIC_ACQUIRE) &
+           TP_STATUS_USER;
+}
+
+//
+// @fn
+// transmit
+//
+// @brief
+// Copy a frame to the next free transmit ring frame and wake the
+// transmit thread, unless a send is already due. Frames queued while a
+// send is in progress go out with the next one.
+//
+// @param[in]
+//     frame Layer 2 frame
+// @param[in]
+//     len Length of frame
+// @return false if the frame was dropped
+//
+
+bool
+HostpathAfPacket::transmit(const uint8_t *frame, size_t len)
+{
+    if ((_txRing == nullptr) || (len > maxFrame())) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(_txMtx);
+
+    auto *hdr = reinterpret_cast<struct tpacket2_hdr *>(
+        _txRing + size_t(_txFrame) * _txFrameSize);
+    uint32_t status = __atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE);
+    if (status == TP_STATUS_WRONG_FORMAT) {
+        Log(ERROR) << "Hostpath frame rejected by " << _intf.name;
+    } else if (status != TP_STATUS_AVAILABLE) {
+        return false;  // Ring full
+    }
+
+    memcpy(reinterpret_cast<uint8_t *>(hdr) + kTxDataOffset, frame, len);
+    hdr->tp_len = len;
+    __atomic_store_n(&hdr->tp_status, TP_STATUS_SEND_REQUEST,
+                     __ATOMIC_RELEASE);
+    _txFrame = (_txFrame + 1) % _txFrames;
+
+    if (!_txPending) {
+        _txPending = true;
+        _txCv.notify_one();
+    }
+    return true;
+}
+
+//
+// @fn
+// transmitLoop
+//
+// @brief
+// Have the kernel send all frames queued in the transmit ring, one
+// send() per wakeup however many PacketOuts were queued since
+//
+// @param[in] void
+// @return void
+//
+
+void
+HostpathAfPacket::transmitLoop()
+{
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(_txMtx);
+            _txCv.wait(lock, [this] { return _txPending; });
+            _txPending = false;
+        }
+
+        if ((send(_txFd, nullptr, 0, 0) < 0) && (errno != EINTR)) {
+            Log(ERROR) << "Hostpath send on " << _intf.name
+                       << " failed: " << strerror(errno);
+        }
+    }
+}
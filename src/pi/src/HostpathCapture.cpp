@@ -0,0 +1,387 @@
+//
+// Juniper P4 Agent
+//
+/// @file  HostpathCapture.cpp
+/// @brief Capture ring of hostpath packets
+//
+// Copyright (c) [2018] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#include "HostpathCapture.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <vector>
+
+#include "Log.h"
+
+constexpr uint64_t HostpathCapture::kBusy;
+
+namespace
+{
+// pcap-ng block types and options
+constexpr uint32_t kSectionHeaderBlock   = 0x0a0d0d0a;
+constexpr uint32_t kInterfaceBlock       = 0x00000001;
+constexpr uint32_t kEnhancedPacketBlock  = 0x00000006;
+constexpr uint32_t kByteOrderMagic       = 0x1a2b3c4d;
+constexpr uint16_t kLinkTypeEthernet     = 1;
+constexpr uint16_t kOptEnd               = 0;
+constexpr uint16_t kOptIfName            = 2;
+constexpr uint16_t kOptIfTsResol         = 9;
+constexpr uint16_t kOptEpbFlags          = 2;
+constexpr uint32_t kEpbFlagsInbound      = 1;
+constexpr uint32_t kEpbFlagsOutbound     = 2;
+
+//
+// Appends pcap-ng blocks, in host byte order
+//
+class PcapngWriter
+{
+ public:
+    explicit PcapngWriter(std::string &out) : _out(out) {}
+
+    void sectionHeader()
+    {
+        size_t start = begin(kSectionHeaderBlock);
+        put32(kByteOrderMagic);
+        put16(1);  // Version 1.0
+        put16(0);
+        put32(UINT32_MAX);  // Section length unknown
+        put32(UINT32_MAX);
+        end(start);
+    }
+
+    void interface(const std::string &name, uint32_t snapLen)
+    {
+        size_t start = begin(kInterfaceBlock);
+        put16(kLinkTypeEthernet);
+        put16(0);
+        put32(snapLen);
+        option(kOptIfName, name.data(), name.size());
+        const uint8_t nanoseconds = 9;
+        option(kOptIfTsResol, &nanoseconds, 1);
+        put32(kOptEnd);
+        end(start);
+    }
+
+    void packet(uint32_t ifId, uint64_t ns, const uint8_t *data,
+                uint32_t capLen, uint32_t len, uint32_t flags)
+    {
+        size_t start = begin(kEnhancedPacketBlock);
+        put32(ifId);
+        put32(uint32_t(ns >> 32));
+        put32(uint32_t(ns));
+        put32(capLen);
+        put32(len);
+        append(data, capLen);
+        option(kOptEpbFlags, &flags, sizeof(flags));
+        put32(kOptEnd);
+        end(start);
+    }
+
+ private:
+    std::string &_out;
+
+    void append(const void *data, size_t len)
+    {
+        _out.append(static_cast<const char *>(data), len);
+        _out.append((4 - (len & 3)) & 3, '\0');
+    }
+    void put16(uint16_t v) { _out.append((const char *)&v, sizeof(v)); }
+    void put32(uint32_t v) { _out.append((const char *)&v, sizeof(v)); }
+
+    void option(uint16_t code, const void *data, size_t len)
+    {
+        put16(code);
+        put16(uint16_t(len));
+        append(data, len);
+    }
+
+    size_t begin(uint32_t type)
+    {
+        size_t start = _out.size();
+        put32(type);
+        put32(0);  // Total length, set by end()
+        return start;
+    }
+
+    void end(size_t start)
+    {
+        uint32_t len = _out.size() - start + sizeof(uint32_t);
+        put32(len);
+        memcpy(&_out[start + sizeof(uint32_t)], &len, sizeof(len));
+    }
+};
+}  // namespace
+
+//
+// @fn
+// instance
+//
+// @brief
+// The capture ring shared by hostpath and CLI
+//
+// @return Capture ring
+//
+
+HostpathCapture &
+HostpathCapture::instance()
+{
+    static HostpathCapture capture;
+    return capture;
+}
+
+//
+// @fn
+// configure
+//
+// @brief
+// Allocate the ring
+//
+// @param[in]
+//     packets Packets kept, rounded up to a power of 2. 0 disables.
+// @param[in]
+//     snapLen Bytes kept of each packet
+// @param[in]
+//     dir Directory dumps are written to, created if missing. Empty
+//     disables dumps.
+// @return void
+//
+
+void
+HostpathCapture::configure(uint32_t packets, uint32_t snapLen,
+                           const std::string &dir)
+{
+    uint32_t count = 0;
+    if (packets != 0) {
+        count = 1;
+        while (count < packets) {
+            count <<= 1;
+        }
+    }
+
+    _snapLen   = std::min<uint32_t>(snapLen, UINT16_MAX);
+    _slots     = count ? std::make_unique<Slot[]>(count) : nullptr;
+    _data      = count ? std::make_unique<uint8_t[]>(size_t(count) * _snapLen)
+                       : nullptr;
+    _slotCount = count;
+    _next.store(0);
+
+    _dir = dir;
+    if (!_dir.empty() && (::mkdir(_dir.c_str(), 0750) != 0) &&
+        (errno != EEXIST)) {
+        Log(ERROR) << "Unable to create hostpath capture directory " << _dir
+                   << ": " << strerror(errno);
+    }
+}
+
+//
+// @fn
+// record
+//
+// @brief
+// Copy the head of a frame into the next slot. A writer lapping another
+// one still copying into the same slot, which needs a full ring of
+// packets in between, skips its packet.
+//
+// @param[in]
+//     dir Punt or Inject
+// @param[in]
+//     port Port index
+// @param[in]
+//     frame Layer 2 frame
+// @param[in]
+//     len Length of frame
+// @return void
+//
+
+void
+HostpathCapture::record(Dir dir, uint16_t port, const uint8_t *frame,
+                        size_t len)
+{
+    if (_slotCount == 0) {
+        return;
+    }
+
+    uint64_t seq  = _next.fetch_add(1, std::memory_order_relaxed);
+    size_t   idx  = seq & (_slotCount - 1);
+    Slot &   slot = _slots[idx];
+    if (slot.seq.exchange(kBusy, std::memory_order_acquire) == kBusy) {
+        return;
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    slot.ns     = uint64_t(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+    slot.len    = uint32_t(len);
+    slot.capLen = uint16_t(std::min<size_t>(len, _snapLen));
+    slot.port   = port;
+    slot.dir    = dir;
+    memcpy(&_data[idx * _snapLen], frame, slot.capLen);
+
+    slot.seq.store(seq + 1, std::memory_order_release);
+}
+
+//
+// @fn
+// pcapng
+//
+// @brief
+// Render the captured packets as a pcap-ng section. Packets recorded
+// while the ring is read may be left out, never torn.
+//
+// @param[in]
+//     filter Port and direction of the packets included
+// @param[out]
+//     count Packets included
+// @return pcap-ng data
+//
+
+std::string
+HostpathCapture::pcapng(const HostpathCaptureFilter &filter,
+                        size_t &                     count) const
+{
+    struct Packet {
+        uint64_t             seq;
+        uint64_t             ns;
+        uint32_t             len;
+        uint16_t             port;
+        uint8_t              dir;
+        std::vector<uint8_t> data;
+    };
+    std::vector<Packet> pkts;
+
+    for (uint32_t idx = 0; idx < _slotCount; idx++) {
+        const Slot &slot = _slots[idx];
+        uint64_t    seq  = slot.seq.load(std::memory_order_acquire);
+        if ((seq == 0) || (seq == kBusy)) {
+            continue;
+        }
+
+        Packet pkt;
+        pkt.seq  = seq;
+        pkt.ns   = slot.ns;
+        pkt.len  = slot.len;
+        pkt.port = slot.port;
+        pkt.dir  = slot.dir;
+        uint16_t capLen = std::min<uint16_t>(slot.capLen, _snapLen);
+        const uint8_t *data = &_data[size_t(idx) * _snapLen];
+        pkt.data.assign(data, data + capLen);
+
+        // Overwritten while copied out
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.seq.load(std::memory_order_relaxed) != seq) {
+            continue;
+        }
+
+        if (((filter.port >= 0) && (filter.port != pkt.port)) ||
+            ((filter.dir >= 0) && (filter.dir != pkt.dir))) {
+            continue;
+        }
+        pkts.push_back(std::move(pkt));
+    }
+
+    std::sort(pkts.begin(), pkts.end(),
+              [](const Packet &a, const Packet &b) { return a.seq < b.seq; });
+
+    std::string  out;
+    PcapngWriter writer(out);
+    writer.sectionHeader();
+
+    std::map<uint16_t, uint32_t> ifIds;  // Port to interface
+    for (const auto &pkt : pkts) {
+        auto it = ifIds.find(pkt.port);
+        if (it == ifIds.end()) {
+            it = ifIds.emplace(pkt.port, uint32_t(ifIds.size())).first;
+            writer.interface("port" + std::to_string(pkt.port), _snapLen);
+        }
+        writer.packet(it->second, pkt.ns, pkt.data.data(),
+                      uint32_t(pkt.data.size()), pkt.len,
+                      (pkt.dir == Punt) ? kEpbFlagsInbound
+                                        : kEpbFlagsOutbound);
+    }
+
+    count = pkts.size();
+    return out;
+}
+
+//
+// @fn
+// dump
+//
+// @brief
+// Write the captured packets to a new file of the capture directory. The
+// name comes from the CLI, so it may not leave the directory, and the
+// file may not exist yet, as a file or a symlink.
+//
+// @param[in]
+//     name File name, without directory
+// @param[in]
+//     filter Port and direction of the packets included
+// @param[out]
+//     count Packets written
+// @param[out]
+//     error Why the file was not written
+// @return true if the file was written
+//
+
+bool
+HostpathCapture::dump(const std::string &name,
+                      const HostpathCaptureFilter &filter, size_t &count,
+                      std::string &error) const
+{
+    if (_dir.empty()) {
+        error = "No hostpath capture directory configured";
+        return false;
+    }
+    if (name.empty() || (name == ".") || (name == "..") ||
+        (name.find('/') != std::string::npos)) {
+        error = "Invalid file name " + name;
+        return false;
+    }
+
+    const std::string path = _dir + "/" + name;
+    int fd = ::open(path.c_str(),
+                    O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0640);
+    if (fd < 0) {
+        error = "Unable to create " + path + ": " + strerror(errno);
+        return false;
+    }
+
+    std::string data = pcapng(filter, count);
+    const char *p    = data.data();
+    size_t      left = data.size();
+    while (left > 0) {
+        ssize_t n = ::write(fd, p, left);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        p += n;
+        left -= n;
+    }
+    if ((::close(fd) != 0) || (left != 0)) {
+        error = "Unable to write " + path;
+        ::unlink(path.c_str());
+        return false;
+    }
+    return true;
+}
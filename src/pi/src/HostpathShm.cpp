@@ -0,0 +1,583 @@
+//
+// Juniper P4 Agent
+//
+/// @file  HostpathShm.cpp
+/// @brief Shared memory hostpath transport
+//
+// Copyright (c) [2018] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+
+#include "HostpathShm.h"
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <new>
+
+#include "Log.h"
+
+constexpr uint32_t HostpathShmRing::kSlotHeader;
+constexpr uint32_t HostpathShmTransport::kMagic;
+constexpr uint32_t HostpathShmTransport::kVersion;
+
+namespace
+{
+constexpr size_t kHeaderArea = 4096;  // Ring header, page aligned slots
+
+uint32_t
+slotSize(uint32_t maxFrame)
+{
+    return HostpathShmRing::kSlotHeader + ((maxFrame + 63) & ~63U);
+}
+
+uint32_t
+roundUpPow2(uint32_t n)
+{
+    uint32_t size = 1;
+    while (size < n) {
+        size <<= 1;
+    }
+    return size;
+}
+}  // namespace
+
+//
+// @fn
+// regionSize
+//
+// @brief
+// Bytes of memory a ring takes
+//
+// @param[in]
+//     slots Number of slots, a power of 2
+// @param[in]
+//     maxFrame Largest packet, device header included
+// @return Size of the ring
+//
+
+size_t
+HostpathShmRing::regionSize(uint32_t slots, uint32_t maxFrame)
+{
+    return kHeaderArea + size_t(slots) * slotSize(maxFrame);
+}
+
+//
+// @fn
+// attach
+//
+// @brief
+// Use the ring at base
+//
+// @param[in]
+//     base Start of the ring in the shared memory
+// @param[in]
+//     doorbell eventfd the consumer sleeps on
+// @param[in]
+//     init Initialize the ring, done by its creator only
+// @param[in]
+//     slots Number of slots, a power of 2
+// @param[in]
+//     maxFrame Largest packet, device header included
+// @return void
+//
+
+void
+HostpathShmRing::attach(void *base, int doorbell, bool init, uint32_t slots,
+                        uint32_t maxFrame)
+{
+    _hdr       = static_cast<Header *>(base);
+    _slots     = static_cast<uint8_t *>(base) + kHeaderArea;
+    _doorbell  = doorbell;
+    _slotCount = slots;
+    _slotSize  = slotSize(maxFrame);
+
+    if (init) {
+        new (_hdr) Header();
+        _hdr->slots    = _slotCount;
+        _hdr->slotSize = _slotSize;
+        _hdr->head.store(0);
+        _hdr->tail.store(0);
+        _hdr->waiting.store(0);
+    }
+}
+
+//
+// @fn
+// push
+//
+// @brief
+// Copy a packet, given as header and rest, into the next slot and ring
+// the doorbell if the consumer sleeps
+//
+// @param[in]
+//     hdr Start of the packet, device header first
+// @param[in]
+//     hdrLen Length of hdr, may be 0
+// @param[in]
+//     pkt Rest of the packet
+// @param[in]
+//     len Length of pkt
+// @return false if the ring is full or the packet too large
+//
+
+bool
+HostpathShmRing::push(const uint8_t *hdr, size_t hdrLen, const uint8_t *pkt,
+                      size_t len)
+{
+    if (hdrLen + len > maxFrame()) {
+        return false;
+    }
+    uint64_t head = _hdr->head.load(std::memory_order_relaxed);
+    uint64_t tail = _hdr->tail.load(std::memory_order_acquire);
+    if (head - tail >= _slotCount) {
+        return false;
+    }
+
+    uint8_t *s     = slot(head);
+    uint32_t len32 = uint32_t(hdrLen + len);
+    std::memcpy(s, &len32, sizeof(len32));
+    if (hdrLen != 0) {
+        std::memcpy(s + kSlotHeader, hdr, hdrLen);
+    }
+    std::memcpy(s + kSlotHeader + hdrLen, pkt, len);
+    _hdr->head.store(head + 1, std::memory_order_release);
+
+    // Pairs with the fence in wait(), either the consumer sees the packet
+    // or we see it waiting
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (_hdr->waiting.load(std::memory_order_relaxed) != 0) {
+        uint64_t one = 1;
+        ssize_t  n   = ::write(_doorbell, &one, sizeof(one));
+        (void)n;
+    }
+    return true;
+}
+
+//
+// @fn
+// front
+//
+// @brief
+// Oldest packet of the ring
+//
+// @param[out]
+//     len Packet length, 0 if the slot holds a bad length
+// @return Packet, nullptr if the ring is empty
+//
+
+const uint8_t *
+HostpathShmRing::front(size_t &len) const
+{
+    uint64_t tail = _hdr->tail.load(std::memory_order_relaxed);
+    uint64_t head = _hdr->head.load(std::memory_order_acquire);
+    if (head == tail) {
+        return nullptr;
+    }
+
+    const uint8_t *s = slot(tail);
+    uint32_t       len32;
+    std::memcpy(&len32, s, sizeof(len32));
+    len = (len32 <= maxFrame()) ? len32 : 0;
+    return s + kSlotHeader;
+}
+
+//
+// @fn
+// pop
+//
+// @brief
+// Hand the oldest slot back to the producer
+//
+// @return void
+//
+
+void
+HostpathShmRing::pop()
+{
+    uint64_t tail = _hdr->tail.load(std::memory_order_relaxed);
+    _hdr->tail.store(tail + 1, std::memory_order_release);
+}
+
+//
+// @fn
+// wait
+//
+// @brief
+// Sleep on the doorbell until a packet is queued
+//
+// @param[in]
+//     timeoutMs Longest sleep
+// @return void
+//
+
+void
+HostpathShmRing::wait(int timeoutMs)
+{
+    _hdr->waiting.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (_hdr->head.load(std::memory_order_acquire) ==
+        _hdr->tail.load(std::memory_order_relaxed)) {
+        struct pollfd pfd = {_doorbell, POLLIN, 0};
+        if (::poll(&pfd, 1, timeoutMs) > 0) {
+            uint64_t count;
+            ssize_t  n = ::read(_doorbell, &count, sizeof(count));
+            (void)n;
+        }
+    }
+
+    _hdr->waiting.store(0, std::memory_order_relaxed);
+}
+
+HostpathShmTransport::HostpathShmTransport(const std::string &sockPath,
+                                           uint32_t slots, uint32_t maxFrame)
+    : _sockPath(sockPath),
+      _slots(roundUpPow2(std::max(slots, 2U))),
+      _maxFrame(maxFrame)
+{
+}
+
+HostpathShmTransport::~HostpathShmTransport()
+{
+    if (_server.joinable()) {
+        uint64_t one = 1;
+        ssize_t  n   = ::write(_stopFd, &one, sizeof(one));
+        (void)n;
+        _server.join();
+    }
+    if (_stopFd >= 0) {
+        ::close(_stopFd);
+    }
+    if (_listenFd >= 0) {
+        ::close(_listenFd);
+        ::unlink(_sockPath.c_str());
+    }
+    if (_base != nullptr) {
+        ::munmap(_base, _size);
+    }
+    for (int fd : {_memFd, _puntDoorbell, _injectDoorbell}) {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+}
+
+//
+// @fn
+// start
+//
+// @brief
+// Create the shared memory, the doorbells and the rings, and listen on
+// the UNIX socket for PktIO
+//
+// @param[in] void
+// @return false on failure
+//
+
+bool
+HostpathShmTransport::start()
+{
+    size_t ringSize = HostpathShmRing::regionSize(_slots, _maxFrame);
+    _size           = 2 * ringSize;
+
+    _memFd = int(::syscall(SYS_memfd_create, "jp4-hostpath", 0));
+    if ((_memFd < 0) || (::ftruncate(_memFd, _size) != 0)) {
+        Log(ERROR) << "Unable to create hostpath shared memory: "
+                   << strerror(errno);
+        return false;
+    }
+    _base = ::mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, _memFd,
+                   0);
+    if (_base == MAP_FAILED) {
+        _base = nullptr;
+        Log(ERROR) << "Unable to map hostpath shared memory: "
+                   << strerror(errno);
+        return false;
+    }
+
+    _puntDoorbell   = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    _injectDoorbell = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if ((_puntDoorbell < 0) || (_injectDoorbell < 0)) {
+        Log(ERROR) << "Unable to create hostpath doorbells: "
+                   << strerror(errno);
+        return false;
+    }
+
+    _punt.attach(_base, _puntDoorbell, true, _slots, _maxFrame);
+    _inject.attach(static_cast<uint8_t *>(_base) + ringSize, _injectDoorbell,
+                   true, _slots, _maxFrame);
+
+    struct sockaddr_un addr = {};
+    addr.sun_family         = AF_UNIX;
+    if (_sockPath.size() >= sizeof(addr.sun_path)) {
+        Log(ERROR) << "Hostpath socket path too long: " << _sockPath;
+        return false;
+    }
+    std::strncpy(addr.sun_path, _sockPath.c_str(), sizeof(addr.sun_path) - 1);
+    ::unlink(_sockPath.c_str());
+
+    _listenFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if ((_listenFd < 0) ||
+        (::bind(_listenFd, (struct sockaddr *)&addr, sizeof(addr)) != 0) ||
+        (::listen(_listenFd, 1) != 0)) {
+        Log(ERROR) << "Unable to listen on hostpath socket " << _sockPath
+                   << ": " << strerror(errno);
+        return false;
+    }
+
+    _stopFd = ::eventfd(0, EFD_CLOEXEC);
+    if (_stopFd < 0) {
+        Log(ERROR) << "Unable to create hostpath server eventfd: "
+                   << strerror(errno);
+        return false;
+    }
+    _server = std::thread([this] { serve(); });
+
+    Log(INFO) << "Hostpath shared memory rings of " << _slots
+              << " slots, PktIO connects to " << _sockPath;
+    return true;
+}
+
+//
+// @fn
+// serve
+//
+// @brief
+// Hand the rings to one PktIO at a time. The connection of the PktIO
+// using the rings is watched; once it is closed the next one may connect.
+//
+// @param[in] void
+// @return void
+//
+
+void
+HostpathShmTransport::serve()
+{
+    int peer = -1;
+
+    while (true) {
+        struct pollfd pfds[3] = {
+            {_listenFd, POLLIN, 0}, {peer, POLLIN, 0}, {_stopFd, POLLIN, 0}};
+        if (::poll(pfds, 3, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            Log(ERROR) << "Hostpath socket poll failed: " << strerror(errno);
+            break;
+        }
+        if (pfds[2].revents != 0) {
+            break;
+        }
+
+        if ((peer >= 0) && (pfds[1].revents != 0)) {
+            char    byte;
+            ssize_t n = ::recv(peer, &byte, sizeof(byte), MSG_DONTWAIT);
+            if ((n == 0) ||
+                ((n < 0) && (errno != EAGAIN) && (errno != EINTR))) {
+                Log(INFO) << "PktIO released the hostpath rings";
+                ::close(peer);
+                peer = -1;
+            }
+        }
+
+        if ((pfds[0].revents & POLLIN) == 0) {
+            continue;
+        }
+        int conn = ::accept4(_listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (conn < 0) {
+            if ((errno == EINTR) || (errno == ECONNABORTED)) {
+                continue;
+            }
+            Log(ERROR) << "Hostpath socket accept failed: " << strerror(errno);
+            break;
+        }
+
+        if (peer >= 0) {
+            Log(WARNING) << "Hostpath rings in use, connection refused";
+            ::close(conn);
+        } else if (!peerAllowed(conn) || !sendRings(conn)) {
+            ::close(conn);
+        } else {
+            Log(INFO) << "Hostpath rings sent to PktIO";
+            peer = conn;
+        }
+    }
+
+    if (peer >= 0) {
+        ::close(peer);
+    }
+}
+
+//
+// @fn
+// peerAllowed
+//
+// @brief
+// Check the credentials of a connecting PktIO
+//
+// @param[in]
+//     conn Accepted connection
+// @return true if the peer runs as root or as the agent's user
+//
+
+bool
+HostpathShmTransport::peerAllowed(int conn) const
+{
+    struct ucred cred = {};
+    socklen_t    len  = sizeof(cred);
+    if (::getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0) {
+        Log(ERROR) << "Hostpath peer credentials unavailable: "
+                   << strerror(errno);
+        return false;
+    }
+    if ((cred.uid != 0) && (cred.uid != ::geteuid())) {
+        Log(WARNING) << "Hostpath connection of pid " << cred.pid << " uid "
+                     << cred.uid << " refused";
+        return false;
+    }
+    return true;
+}
+
+//
+// @fn
+// sendRings
+//
+// @brief
+// Send setup, memfd and doorbells to a PktIO
+//
+// @param[in]
+//     conn Accepted connection
+// @return false on failure
+//
+
+bool
+HostpathShmTransport::sendRings(int conn) const
+{
+    HostpathShmSetup setup  = {kMagic, kVersion, _slots, _maxFrame};
+    struct iovec     iov    = {&setup, sizeof(setup)};
+    int              fds[3] = {_memFd, _puntDoorbell, _injectDoorbell};
+    char             ctrl[CMSG_SPACE(sizeof(fds))] = {};
+
+    struct msghdr msg  = {};
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = ctrl;
+    msg.msg_controllen = sizeof(ctrl);
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level     = SOL_SOCKET;
+    cmsg->cmsg_type      = SCM_RIGHTS;
+    cmsg->cmsg_len       = CMSG_LEN(sizeof(fds));
+    std::memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    if (::sendmsg(conn, &msg, MSG_NOSIGNAL) < 0) {
+        Log(ERROR) << "Hostpath rings not sent to PktIO: " << strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+HostpathShmPeer::~HostpathShmPeer()
+{
+    if (_base != nullptr) {
+        ::munmap(_base, _size);
+    }
+    for (int fd : _fds) {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+    if (_sock >= 0) {
+        ::close(_sock);
+    }
+}
+
+//
+// @fn
+// connect
+//
+// @brief
+// Get the rings from the agent listening on sockPath. The connection is
+// kept until the peer is destroyed, the agent refuses others meanwhile.
+//
+// @param[in]
+//     sockPath UNIX socket of the agent
+// @return false on failure
+//
+
+bool
+HostpathShmPeer::connect(const std::string &sockPath)
+{
+    struct sockaddr_un addr = {};
+    addr.sun_family         = AF_UNIX;
+    std::strncpy(addr.sun_path, sockPath.c_str(), sizeof(addr.sun_path) - 1);
+
+    int sock = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if ((sock < 0) ||
+        (::connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0)) {
+        if (sock >= 0) {
+            ::close(sock);
+        }
+        return false;
+    }
+
+    HostpathShmSetup setup = {};
+    struct iovec     iov   = {&setup, sizeof(setup)};
+    char             ctrl[CMSG_SPACE(sizeof(_fds))] = {};
+    struct msghdr    msg = {};
+    msg.msg_iov          = &iov;
+    msg.msg_iovlen       = 1;
+    msg.msg_control      = ctrl;
+    msg.msg_controllen   = sizeof(ctrl);
+
+    ssize_t n = ::recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+
+    // Refused if the connection is closed without the rings
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if ((n != sizeof(setup)) || (cmsg == nullptr) ||
+        (cmsg->cmsg_type != SCM_RIGHTS) ||
+        (cmsg->cmsg_len != CMSG_LEN(sizeof(_fds)))) {
+        ::close(sock);
+        return false;
+    }
+    _sock = sock;
+    std::memcpy(_fds, CMSG_DATA(cmsg), sizeof(_fds));
+    if ((setup.magic != HostpathShmTransport::kMagic) ||
+        (setup.version != HostpathShmTransport::kVersion)) {
+        return false;
+    }
+
+    size_t ringSize = HostpathShmRing::regionSize(setup.slots, setup.maxFrame);
+    _size           = 2 * ringSize;
+    _base = ::mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, _fds[0],
+                   0);
+    if (_base == MAP_FAILED) {
+        _base = nullptr;
+        return false;
+    }
+
+    _punt.attach(_base, _fds[1], false, setup.slots, setup.maxFrame);
+    _inject.attach(static_cast<uint8_t *>(_base) + ringSize, _fds[2], false,
+                   setup.slots, setup.maxFrame);
+    return true;
+}
@@ -0,0 +1,316 @@
+//
+// Juniper P4 Agent
+//
+/// @file  HostpathStats.cpp
+/// @brief Hostpath latency by stage and throughput by port and reason
+//
+// Copyright (c) [2018] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+
+#include "HostpathStats.h"
+
+#include <time.h>
+#include <chrono>
+#include <map>
+#include <sstream>
+#include <thread>
+
+constexpr size_t HostpathStats::Table::kChunkSize;
+constexpr size_t HostpathStats::Table::kChunks;
+
+namespace
+{
+struct StageInfo {
+    const char *dir;
+    const char *name;
+};
+
+const StageInfo kStageInfo[HostpathStats::kStages] = {
+    {"punt", "socket"},   {"punt", "agent"},   {"punt", "queue"},
+    {"punt", "stream"},   {"punt", "total"},   {"inject", "agent"},
+    {"inject", "queue"},  {"inject", "total"},
+};
+
+//
+// Latency histogram of a stage. The agent stages keep the series they had
+// before the other stages were timed.
+//
+MetricHistogram &
+stageHistogram(HostpathStats::Stage stage)
+{
+    const StageInfo &info = kStageInfo[stage];
+    const std::string dir = std::string("dir=\"") + info.dir + "\"";
+
+    if ((stage == HostpathStats::PuntAgent) ||
+        (stage == HostpathStats::InjectAgent)) {
+        return Metrics::instance().histogram(
+            "jp4_hostpath_latency_seconds",
+            "Hostpath packet handling latency, punt from device receive to "
+            "PacketIn, inject from PacketOut to device send or transmit queue",
+            dir);
+    }
+    return Metrics::instance().histogram(
+        "jp4_hostpath_stage_latency_seconds",
+        "Hostpath packet latency by stage: punt socket (kernel receive to "
+        "agent read), queue (PacketIn queue), stream (stream write) and "
+        "total (ingress to stream write); inject queue (transmit queue) and "
+        "total (stream read to device send)",
+        dir + ",stage=\"" + info.name + "\"");
+}
+}  // namespace
+
+//
+// @fn
+// instance
+//
+// @brief
+// Hostpath statistics of the agent
+//
+
+HostpathStats &
+HostpathStats::instance()
+{
+    // Never destroyed, hostpath threads may count while the process exits
+    static HostpathStats *stats = new HostpathStats();
+    return *stats;
+}
+
+HostpathStats::HostpathStats()
+    : _puntPorts("jp4_hostpath_port", "dir=\"punt\",", "port"),
+      _puntReasons("jp4_hostpath_reason", "dir=\"punt\",", "reason"),
+      _injectPorts("jp4_hostpath_port", "dir=\"inject\",", "port")
+{
+    for (int s = 0; s < kStages; s++) {
+        _stages[s] = &stageHistogram(Stage(s));
+    }
+}
+
+//
+// @fn
+// now
+//
+// @brief
+// Current time on the clock of the kernel receive timestamps
+//
+// @param[in] void
+// @return CLOCK_REALTIME in nanoseconds
+//
+
+uint64_t
+HostpathStats::now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+//
+// @fn
+// punted
+//
+// @brief
+// Count a frame punted by the agent, by ingress port and punt reason
+//
+// @param[in]
+//     port Ingress port index
+// @param[in]
+//     reason Punt reason
+// @param[in]
+//     bytes Frame length
+// @return void
+//
+
+void
+HostpathStats::punted(uint16_t port, uint16_t reason, size_t bytes)
+{
+    _puntPorts.count(port, bytes);
+    _puntReasons.count(reason, bytes);
+}
+
+//
+// @fn
+// injected
+//
+// @brief
+// Count a PacketOut frame, by egress port
+//
+// @param[in]
+//     port Egress port index
+// @param[in]
+//     bytes Frame length
+// @return void
+//
+
+void
+HostpathStats::injected(uint16_t port, size_t bytes)
+{
+    _injectPorts.count(port, bytes);
+}
+
+//
+// @fn
+// show
+//
+// @brief
+// Render stage latencies, and rates sampled over an interval, for the CLI
+//
+// @param[in]
+//     intervalMs Interval rates are measured over
+// @return Text for the CLI
+//
+
+std::string
+HostpathStats::show(unsigned intervalMs)
+{
+    const Table *tables[] = {&_puntPorts, &_puntReasons, &_injectPorts};
+    const char * names[]  = {"punt   port  ", "punt   reason", "inject port  "};
+
+    std::vector<Table::Sample> before[3];
+    for (int t = 0; t < 3; t++) {
+        before[t] = tables[t]->sample();
+    }
+    auto start = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::milliseconds(intervalMs));
+    std::vector<Table::Sample> after[3];
+    for (int t = 0; t < 3; t++) {
+        after[t] = tables[t]->sample();
+    }
+    double secs = std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+
+    std::ostringstream os;
+    os << "Latency (us)           count        p50        p99        max\n";
+    for (int s = 0; s < kStages; s++) {
+        const MetricHistogram &h = *_stages[s];
+        char line[128];
+        snprintf(line, sizeof(line), "%-6s %-8s %12llu %10.1f %10.1f %10.1f\n",
+                 kStageInfo[s].dir, kStageInfo[s].name,
+                 (unsigned long long)h.count(), h.quantile(0.5) / 1e3,
+                 h.quantile(0.99) / 1e3, h.max() / 1e3);
+        os << line;
+    }
+
+    char line[128];
+    snprintf(line, sizeof(line),
+             "\nRates over %.1f s               pps            bps\n", secs);
+    os << line;
+    for (int t = 0; t < 3; t++) {
+        std::map<uint16_t, Table::Sample> prev;
+        for (const auto &s : before[t]) {
+            prev[s.key] = s;
+        }
+        for (const auto &s : after[t]) {
+            Table::Sample p{s.key, 0, 0};
+            auto          it = prev.find(s.key);
+            if (it != prev.end()) {
+                p = it->second;
+            }
+            snprintf(line, sizeof(line), "%s %5u %14.0f %14.0f\n", names[t],
+                     unsigned(s.key), (s.packets - p.packets) / secs,
+                     (s.bytes - p.bytes) * 8 / secs);
+            os << line;
+        }
+    }
+    return os.str();
+}
+
+HostpathStats::Table::Table(const std::string &name, const std::string &labels,
+                            const std::string &key)
+    : _name(name), _labels(labels), _key(key)
+{
+}
+
+//
+// @fn
+// counters
+//
+// @brief
+// Counters of a key, registered on first use. Threads racing to register
+// get the same counters from Metrics; one of them installs the entry.
+//
+// @param[in]
+//     key Port index or punt reason
+// @return Counters
+//
+
+HostpathStats::Counters &
+HostpathStats::Table::counters(uint16_t key)
+{
+    std::atomic<Chunk *> &slot  = _chunks[key / kChunkSize];
+    Chunk *               chunk = slot.load(std::memory_order_acquire);
+    if (chunk == nullptr) {
+        Chunk *fresh = new Chunk();
+        if (slot.compare_exchange_strong(chunk, fresh,
+                                         std::memory_order_acq_rel)) {
+            chunk = fresh;
+        } else {
+            delete fresh;
+        }
+    }
+
+    std::atomic<Counters *> &entry = chunk->entries[key % kChunkSize];
+    Counters *               c     = entry.load(std::memory_order_acquire);
+    if (c != nullptr) {
+        return *c;
+    }
+
+    const std::string labels =
+        _labels + _key + "=\"" + std::to_string(key) + "\"";
+    Counters *fresh = new Counters{
+        Metrics::instance().counter(_name + "_packets_total",
+                                    "Hostpath packets by " + _key, labels),
+        Metrics::instance().counter(_name + "_bytes_total",
+                                    "Hostpath frame bytes by " + _key,
+                                    labels)};
+    if (entry.compare_exchange_strong(c, fresh, std::memory_order_acq_rel)) {
+        return *fresh;
+    }
+    delete fresh;
+    return *c;
+}
+
+//
+// @fn
+// sample
+//
+// @brief
+// Current values of the keys counted so far
+//
+// @param[in] void
+// @return Samples in key order
+//
+
+std::vector<HostpathStats::Table::Sample>
+HostpathStats::Table::sample() const
+{
+    std::vector<Sample> samples;
+    for (size_t i = 0; i < kChunks; i++) {
+        const Chunk *chunk = _chunks[i].load(std::memory_order_acquire);
+        if (chunk == nullptr) {
+            continue;
+        }
+        for (size_t j = 0; j < kChunkSize; j++) {
+            const Counters *c =
+                chunk->entries[j].load(std::memory_order_acquire);
+            if (c != nullptr) {
+                samples.push_back({uint16_t(i * kChunkSize + j),
+                                   c->packets.value(), c->bytes.value()});
+            }
+        }
+    }
+    return samples;
+}
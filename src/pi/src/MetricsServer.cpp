@@ -0,0 +1,149 @@
+//
+// Juniper P4 Agent
+//
+/// @file  MetricsServer.cpp
+/// @brief HTTP endpoint serving the agent metrics
+//
+// Copyright (c) [2018] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+
+#include <poll.h>
+#include <thread>
+#include <boost/algorithm/string.hpp>
+#include <boost/asio.hpp>
+
+#include "Log.h"
+#include "Metrics.h"
+#include "MetricsServer.h"
+
+using boost::asio::ip::tcp;
+
+namespace
+{
+constexpr size_t kMaxRequest = 8192;
+constexpr int    kTimeoutMs  = 2000;  // A stalled client can't block others
+
+void
+reply(tcp::socket &sock, const std::string &status, const std::string &body)
+{
+    std::string rsp = "HTTP/1.0 " + status +
+                      "\r\n"
+                      "Content-Type: text/plain; version=0.0.4\r\n"
+                      "Content-Length: " +
+                      std::to_string(body.size()) +
+                      "\r\n"
+                      "Connection: close\r\n\r\n" +
+                      body;
+    boost::system::error_code ec;
+    boost::asio::write(sock, boost::asio::buffer(rsp), ec);
+}
+
+void
+serve(tcp::socket &sock)
+{
+    //
+    // Read up to the end of the request headers
+    //
+    std::string               req;
+    char                      buf[1024];
+    boost::system::error_code ec;
+    while ((req.find("\r\n\r\n") == std::string::npos) &&
+           (req.size() < kMaxRequest)) {
+        struct pollfd pfd = {sock.native_handle(), POLLIN, 0};
+        if (::poll(&pfd, 1, kTimeoutMs) <= 0) {
+            return;
+        }
+        size_t n = sock.read_some(boost::asio::buffer(buf), ec);
+        if (ec) {
+            return;
+        }
+        req.append(buf, n);
+    }
+
+    std::vector<std::string> words;
+    std::string              line = req.substr(0, req.find("\r\n"));
+    boost::split(words, line, boost::is_any_of(" "));
+    if ((words.size() < 2) || (words[0] != "GET")) {
+        reply(sock, "405 Method Not Allowed", "Only GET is supported\n");
+        return;
+    }
+    if ((words[1] != "/metrics") && (words[1] != "/")) {
+        reply(sock, "404 Not Found", "Not found: " + words[1] + "\n");
+        return;
+    }
+    reply(sock, "200 OK", Metrics::instance().render());
+}
+}  // namespace
+
+//
+// @fn
+// run
+//
+// @brief
+// Accept and serve metrics requests
+//
+// @param[in] void
+// @return void
+//
+
+void
+MetricsServer::run()
+{
+    try {
+        std::vector<std::string> addr;
+        boost::split(addr, _servAddr, boost::is_any_of(":"));
+        if (addr.size() != 2) {
+            Log(ERROR) << "Invalid metrics server address " << _servAddr;
+            return;
+        }
+
+        boost::asio::io_service ioService;
+        tcp::resolver           resolver(ioService);
+        tcp::endpoint endpoint = *resolver.resolve({addr[0], addr[1]});
+        tcp::acceptor acceptor(ioService, endpoint);
+        Log(INFO) << "Metrics server listening on " << _servAddr;
+
+        while (true) {
+            tcp::socket sock(ioService);
+            acceptor.accept(sock);
+            serve(sock);
+        }
+    } catch (const std::exception &e) {
+        Log(ERROR) << "Metrics server on " << _servAddr
+                   << " stopped: " << e.what();
+    }
+}
+
+//
+// @fn
+// startMetricsServer
+//
+// @brief
+// Start the metrics server thread
+//
+// @param[in] void
+// @return void
+//
+
+void
+MetricsServer::startMetricsServer()
+{
+    if (_servAddr.empty()) {
+        return;
+    }
+    std::thread server([this] { this->run(); });
+    server.detach();
+}
@@ -22,6 +22,376 @@
 
 #include "pvtPI.h"
 
+#include <set>
+
+void
+P4InfoTable::compile()
+{
+    for (const auto &field : _table.match_fields()) {
+        if ((field.id() == 0) || (field.id() > kP4InfoMaxDenseId)) {
+            continue;  // Rejected by P4Info::build()
+        }
+        if (field.id() >= _fields.size()) {
+            _fields.resize(field.id() + 1);
+        }
+        auto &slot     = _fields[field.id()];
+        slot.name      = field.name();
+        slot.bitWidth  = field.bitwidth();
+        slot.matchType = field.match_type();
+        slot.valid     = true;
+    }
+}
+
+void
+P4InfoAction::compile()
+{
+    for (const auto &param : _action.params()) {
+        if ((param.id() == 0) || (param.id() > kP4InfoMaxDenseId)) {
+            continue;  // Rejected by P4Info::build()
+        }
+        if (param.id() >= _params.size()) {
+            _params.resize(param.id() + 1);
+        }
+        auto &slot    = _params[param.id()];
+        slot.name     = param.name();
+        slot.bitWidth = param.bitwidth();
+        slot.valid    = true;
+    }
+}
+
+//
+// @fn
+// compile
+//
+// @brief
+// Compile the field layout of a controller packet header. Fields the
+// agent fills in or reads are recognized by name.
+//
+// @param[in]
+//     header packet_in or packet_out header of the P4Info
+// @param[out]
+//     error Reason the header was rejected
+// @return true on success
+//
+
+bool
+P4InfoPacketMetadata::compile(
+    const p4::config::ControllerPacketMetadata &header, std::string &error)
+{
+    const std::string &hdrName = header.preamble().name();
+    std::set<uint32_t> ids;
+
+    _fields.clear();
+    _port   = -1;
+    _reason = -1;
+    for (const auto &md : header.metadata()) {
+        if ((md.id() == 0) || !ids.insert(md.id()).second) {
+            error = "Controller header " + hdrName + ": bad metadata id " +
+                    std::to_string(md.id());
+            return false;
+        }
+        if (md.bitwidth() <= 0) {
+            error = "Controller header " + hdrName + ": metadata " +
+                    md.name() + " has no bitwidth";
+            return false;
+        }
+
+        P4InfoPacketMetadataField field;
+        field.id       = md.id();
+        field.bitWidth = md.bitwidth();
+        field.bytes    = (field.bitWidth + 7) / 8;
+
+        const std::string &name = md.name();
+        if ((name == "ingress_port") || (name == "egress_port") ||
+            (name == "port")) {
+            field.role = P4InfoPacketMetadataField::Port;
+            _port      = int(_fields.size());
+        } else if ((name == "reason") || (name == "punt_reason")) {
+            field.role = P4InfoPacketMetadataField::Reason;
+            _reason    = int(_fields.size());
+        }
+        _fields.push_back(field);
+    }
+    return true;
+}
+
+//
+// @fn
+// encode
+//
+// @brief
+// Set the metadata of a PacketIn. The entries of a reused PacketIn are
+// overwritten in place, nothing is allocated in steady state.
+//
+// @param[in]
+//     port Ingress port index
+// @param[in]
+//     reason Punt reason
+// @param[out]
+//     packetIn PacketIn
+// @return void
+//
+
+void
+P4InfoPacketMetadata::encode(uint16_t port, uint16_t reason,
+                             p4::PacketIn &packetIn) const
+{
+    auto *metadata = packetIn.mutable_metadata();
+    while (metadata->size() > int(_fields.size())) {
+        metadata->RemoveLast();
+    }
+    while (metadata->size() < int(_fields.size())) {
+        metadata->Add();
+    }
+
+    for (size_t i = 0; i < _fields.size(); i++) {
+        const auto &field = _fields[i];
+        uint64_t    value = 0;
+        if (field.role == P4InfoPacketMetadataField::Port) {
+            value = port;
+        } else if (field.role == P4InfoPacketMetadataField::Reason) {
+            value = reason;
+        }
+        if (field.bitWidth < 64) {
+            value &= (uint64_t(1) << field.bitWidth) - 1;
+        }
+
+        p4::PacketMetadata *md = metadata->Mutable(int(i));
+        md->set_metadata_id(field.id);
+        std::string *bytes = md->mutable_value();
+        bytes->assign(field.bytes, '\0');
+        for (uint32_t b = 0; (b < field.bytes) && (b < 8); b++) {
+            (*bytes)[field.bytes - 1 - b] = char(value >> (8 * b));
+        }
+    }
+}
+
+namespace
+{
+//
+// Big endian value of PacketMetadata, the low 64 bits
+//
+uint64_t
+decodeValue(const std::string &bytes)
+{
+    uint64_t value = 0;
+    for (unsigned char c : bytes) {
+        value = (value << 8) | c;
+    }
+    return value;
+}
+}  // namespace
+
+//
+// @fn
+// reason
+//
+// @brief
+// Punt reason in the metadata of a PacketIn built by encode()
+//
+// @param[in]
+//     packetIn PacketIn
+// @return Reason, 0 if the header has no reason field
+//
+
+uint16_t
+P4InfoPacketMetadata::reason(const p4::PacketIn &packetIn) const
+{
+    if ((_reason < 0) || (packetIn.metadata_size() <= _reason)) {
+        return 0;
+    }
+    return uint16_t(decodeValue(packetIn.metadata(_reason).value()));
+}
+
+//
+// @fn
+// port
+//
+// @brief
+// Egress port in the metadata of a PacketOut. Controllers may send the
+// metadata in any order, it is matched by id.
+//
+// @param[in]
+//     packetOut PacketOut
+// @param[out]
+//     port Egress port index
+// @return false if the header has no port field or packetOut lacks it
+//
+
+bool
+P4InfoPacketMetadata::port(const p4::PacketOut &packetOut,
+                           uint16_t &           port) const
+{
+    if (_port < 0) {
+        return false;
+    }
+    const uint32_t id = _fields[_port].id;
+    for (const auto &md : packetOut.metadata()) {
+        if (md.metadata_id() == id) {
+            port = uint16_t(decodeValue(md.value()));
+            return true;
+        }
+    }
+    return false;
+}
+
+//
+// @fn
+// compile
+//
+// @brief
+// Build the id sorted table and action indices
+//
+
+void
+P4InfoIndex::compile()
+{
+    _tables.clear();
+    _actions.clear();
+    for (const auto &res : _idMap) {
+        if (res.second == nullptr) {
+            continue;
+        }
+        if (auto t = std::dynamic_pointer_cast<P4InfoTable>(res.second)) {
+            _tables.emplace_back(res.first, t.get());
+        } else if (auto a =
+                       std::dynamic_pointer_cast<P4InfoAction>(res.second)) {
+            _actions.emplace_back(res.first, a.get());
+        }
+    }
+    // _idMap iterates in id order, so both indices are sorted already
+}
+
+namespace
+{
+//
+// Check preamble of a resource against the ones seen so far
+//
+bool
+checkPreamble(const p4::config::Preamble &pre, std::set<uint32_t> &ids,
+              std::set<std::string> &names, std::string &error)
+{
+    if ((pre.id() == 0) || pre.name().empty()) {
+        error = "Resource '" + pre.name() + "' id " +
+                std::to_string(pre.id()) + ": missing id or name";
+        return false;
+    }
+    if (!ids.insert(pre.id()).second) {
+        error = "Duplicate resource id " + std::to_string(pre.id());
+        return false;
+    }
+    if (!names.insert(pre.name()).second) {
+        error = "Duplicate resource name " + pre.name();
+        return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+//
+// @fn
+// build
+//
+// @brief
+// Build the index of a P4Info, checking that ids and names are unique, that
+// match field and action param ids can be indexed, and that tables only
+// refer to actions of the P4Info. The PacketIn and
+// PacketOut metadata layouts are compiled from the controller headers.
+//
+// @param[in]
+//     p4info P4Info of a pipeline config
+// @param[out]
+//     error Reason the P4Info was rejected
+// @return Index, nullptr if p4info is invalid
+//
+
+P4InfoIndexPtr
+P4Info::build(const p4::config::P4Info &p4info, std::string &error)
+{
+    auto                  index = std::make_shared<P4InfoIndex>();
+    std::set<uint32_t>    ids;
+    std::set<std::string> names;
+
+    for (const auto &action : p4info.actions()) {
+        if (!checkPreamble(action.preamble(), ids, names, error)) {
+            return nullptr;
+        }
+        std::set<uint32_t> paramIds;
+        for (const auto &param : action.params()) {
+            if ((param.id() == 0) || (param.id() > kP4InfoMaxDenseId)) {
+                error = "Action " + action.preamble().name() + ": param id " +
+                        std::to_string(param.id()) + " out of range 1.." +
+                        std::to_string(kP4InfoMaxDenseId);
+                return nullptr;
+            }
+            if (!paramIds.insert(param.id()).second) {
+                error = "Action " + action.preamble().name() +
+                        ": duplicate param id " + std::to_string(param.id());
+                return nullptr;
+            }
+        }
+
+        P4InfoResourcePtr res(new P4InfoAction(action));
+        index->insert2IdMap(res);
+        index->insert2NameMap(res);
+    }
+
+    for (const auto &table : p4info.tables()) {
+        if (!checkPreamble(table.preamble(), ids, names, error)) {
+            return nullptr;
+        }
+        std::set<uint32_t> fieldIds;
+        for (const auto &field : table.match_fields()) {
+            if ((field.id() == 0) || (field.id() > kP4InfoMaxDenseId)) {
+                error = "Table " + table.preamble().name() +
+                        ": match field id " + std::to_string(field.id()) +
+                        " out of range 1.." +
+                        std::to_string(kP4InfoMaxDenseId);
+                return nullptr;
+            }
+            if (!fieldIds.insert(field.id()).second) {
+                error = "Table " + table.preamble().name() +
+                        ": duplicate match field id " +
+                        std::to_string(field.id());
+                return nullptr;
+            }
+        }
+        for (const auto &ref : table.action_refs()) {
+            if (index->p4InfoResource(ref.id()) == nullptr) {
+                error = "Table " + table.preamble().name() +
+                        ": unknown action id " + std::to_string(ref.id());
+                return nullptr;
+            }
+        }
+
+        P4InfoResourcePtr res(new P4InfoTable(table));
+        index->insert2IdMap(res);
+        index->insert2NameMap(res);
+    }
+
+    for (const auto &header : p4info.controller_packet_metadata()) {
+        if (!checkPreamble(header.preamble(), ids, names, error)) {
+            return nullptr;
+        }
+        const std::string &name = header.preamble().name();
+        if (name == "packet_in") {
+            if (!index->_packetIn.compile(header, error)) {
+                return nullptr;
+            }
+        } else if (name == "packet_out") {
+            if (!index->_packetOut.compile(header, error)) {
+                return nullptr;
+            }
+        } else {
+            Log(WARNING) << "Controller header " << name << " ignored";
+        }
+    }
+
+    index->compile();
+    return index;
+}
+
 //
 // Description
 //
@@ -24,9 +24,35 @@
 #include "ControllerConnection.h"
 #include "pvtPI.h"
 #include "JaegerLog.h"
+#include "Metrics.h"
 #include <vector>
 
-const std::string _debugmode = "debug-afi-objects:debug-pi";
+namespace
+{
+MetricHistogram &
+rpcLatency(const std::string &rpc)
+{
+    return Metrics::instance().histogram("jp4_pi_rpc_latency_seconds",
+                                         "P4Runtime RPC handling latency",
+                                         "rpc=\"" + rpc + "\"");
+}
+
+MetricCounter &
+rpcErrors(const std::string &rpc)
+{
+    return Metrics::instance().counter("jp4_pi_rpc_errors_total",
+                                       "P4Runtime RPCs failed",
+                                       "rpc=\"" + rpc + "\"");
+}
+
+MetricCounter &
+streamMessages(const std::string &type)
+{
+    return Metrics::instance().counter("jp4_pi_stream_messages_total",
+                                       "Stream channel messages received",
+                                       "type=\"" + type + "\"");
+}
+}  // namespace
 
 Status
 P4RuntimeServiceImpl::SetForwardingPipelineConfig(
@@ -34,124 +60,287 @@ P4RuntimeServiceImpl::SetForwardingPipelineConfig(
     const p4::SetForwardingPipelineConfigRequest *request,
     p4::SetForwardingPipelineConfigResponse *     rep)
 {
-    if (_debugmode.find("debug-pi") != std::string::npos) {
-        Log(DEBUG) << "P4Runtime SetForwardingPipelineConfig\n";
-        Log(DEBUG) << request->DebugString();
-    }
+    Log(DEBUG) << "P4Runtime SetForwardingPipelineConfig\n";
+    Log(DEBUG) << request->DebugString();
     (void)rep;
-    // Create a span for route table
-    JaegerLog::getInstance()->startSpan("Route Table");
-
-    p4::SetForwardingPipelineConfigRequest_Action a      = request->action();
-    p4::ForwardingPipelineConfig                  config = request->config();
+    static MetricHistogram &latency = rpcLatency("SetForwardingPipelineConfig");
+    MetricTimer             timer(latency);
+    JaegerSpan span("P4Runtime SetForwardingPipelineConfig");
+    JaegerLog::getInstance()->log(
+        "PI:SetFwdPpln:Action",
+        p4::SetForwardingPipelineConfigRequest_Action_Name(request->action()));
+
+    p4::SetForwardingPipelineConfigRequest_Action a = request->action();
+
+    Log(DEBUG) << "action:" << a;
+    Log(DEBUG) << "request->configs_size():" << request->configs_size();
+
+    std::lock_guard<std::mutex> guard(_pipelineMtx);
+
+    StagedPipeline staged;
+    Status         status;
+    switch (a) {
+        case p4::SetForwardingPipelineConfigRequest::VERIFY:
+            return stagePipeline(request->config(), staged);
+
+        case p4::SetForwardingPipelineConfigRequest::VERIFY_AND_SAVE:
+            status = stagePipeline(request->config(), staged);
+            if (status.ok()) {
+                _savedPipeline = staged;
+            }
+            return status;
 
-    p4::config::P4Info p4info_proto = config.p4info();
+        case p4::SetForwardingPipelineConfigRequest::VERIFY_AND_COMMIT:
+            status = stagePipeline(request->config(), staged);
+            if (!status.ok()) {
+                return status;
+            }
+            status = commitPipeline(staged);
+            if (status.ok()) {
+                _savedPipeline = StagedPipeline();
+            }
+            return status;
 
-    if (_debugmode.find("debug-pi") != std::string::npos) {
-        Log(DEBUG) << "action:" << a;
-        Log(DEBUG) << "request->configs_size():" << request->configs_size();
-        Log(DEBUG) << p4info_proto.DebugString();
-        Log(DEBUG) << "________ P4 INFO __________";
+        case p4::SetForwardingPipelineConfigRequest::COMMIT:
+            if (_savedPipeline.p4info == nullptr) {
+                return Status(StatusCode::FAILED_PRECONDITION,
+                              "No saved pipeline config to commit");
+            }
+            // Used up even if the commit fails, the target may have bound
+            // and unbound some of its objects
+            status         = commitPipeline(_savedPipeline);
+            _savedPipeline = StagedPipeline();
+            return status;
 
-        Log(DEBUG) << "p4info_proto.tables_size():"
-                   << p4info_proto.tables_size();
-        Log(DEBUG) << "p4info_proto.actions_size():"
-                   << p4info_proto.actions_size();
+        default:
+            break;
     }
-    Log(DEBUG) << p4info_proto.DebugString();
 
-    const auto &actions = p4info_proto.actions();
-    for (const auto &action : actions) {
-        const auto &pre = action.preamble();
-        if (_debugmode.find("debug-pi") != std::string::npos) {
-            Log(DEBUG) << "_________ Action _______";
-            Log(DEBUG) << "Id:" << pre.id();
-            Log(DEBUG) << "Name:" << pre.name();
-        }
+    std::stringstream es;
+    es << "Unsupported pipeline config action " << a;
+    Log(ERROR) << es.str();
+    return Status(StatusCode::INVALID_ARGUMENT, es.str());
+}
 
+//
+// @fn
+// stagePipeline
+//
+// @brief
+// Verify a pipeline config: build its P4Info and create its AFI objects,
+// without changing the pipeline in use.
+//
+// @param[in]
+//     config Pipeline config of the request
+// @param[out]
+//     staged Verified pipeline
+// @return OK, or INVALID_ARGUMENT if the config is rejected
+//
 
-        P4InfoResourcePtr res(new P4InfoAction(action));
-        P4Info::instance().insert2IdMap(res);
-        P4Info::instance().insert2NameMap(res);
+Status
+P4RuntimeServiceImpl::stagePipeline(const p4::ForwardingPipelineConfig &config,
+                                    StagedPipeline &                    staged)
+{
+    //
+    // A config identical to the committed one, as pushed again by a
+    // controller after it reconnects, is not translated again: the
+    // committed pipeline is its staged form, and committing it again only
+    // drops the table entries. One identical to the saved one keeps its
+    // P4Info index, but its AFI objects are built again, as a failed
+    // commit may have bound and unbound some of the saved ones.
+    //
+    uint64_t       fingerprint = PipelineCache::fingerprint(config);
+    P4InfoIndexPtr known_p4info;
+    for (const auto *known : {&_committedPipeline, &_savedPipeline}) {
+        if ((known->p4info != nullptr) &&
+            (known->fingerprint == fingerprint) &&
+            (known->config->SerializeAsString() ==
+             config.SerializeAsString())) {
+            if (known == &_committedPipeline) {
+                Log(DEBUG) << "Pipeline config " << std::hex << fingerprint
+                           << std::dec << " is the committed one";
+                staged = _committedPipeline;
+                return Status::OK;
+            }
+            Log(DEBUG) << "Pipeline config " << std::hex << fingerprint
+                       << std::dec << " already verified, P4Info reused";
+            known_p4info = known->p4info;
+            break;
+        }
     }
 
-    const auto &tables = p4info_proto.tables();
-    Log(DEBUG) << "tables.size():" << tables.size();
-    for (const auto &table : tables) {
-        const auto &pre = table.preamble();
-        if (_debugmode.find("debug-pi") != std::string::npos) {
-            Log(DEBUG) << "_________ Table _______";
-            Log(DEBUG) << "Id:" << pre.id();
-            Log(DEBUG) << "Name:" << pre.name();
-        }
+    const p4::config::P4Info &p4info_proto = config.p4info();
 
-        P4InfoResourcePtr res(new P4InfoTable(table));
-        P4Info::instance().insert2IdMap(res);
-        P4Info::instance().insert2NameMap(res);
+    Log(DEBUG) << p4info_proto.DebugString();
+    Log(DEBUG) << "________ P4 INFO __________";
+
+    Log(DEBUG) << "p4info_proto.tables_size():"
+               << p4info_proto.tables_size();
+    Log(DEBUG) << "p4info_proto.actions_size():"
+               << p4info_proto.actions_size();
+
+    std::string error;
+    staged.p4info = (known_p4info != nullptr)
+                        ? known_p4info
+                        : P4Info::build(p4info_proto, error);
+    if (staged.p4info == nullptr) {
+        Log(ERROR) << "Invalid p4info: " << error;
+        return Status(StatusCode::INVALID_ARGUMENT, "Invalid p4info: " + error);
     }
 
     p4::tmp::P4DeviceConfig p4_device_config;
     if (!p4_device_config.ParseFromString(config.p4_device_config())) {
         Log(ERROR) << "Invalid 'p4_device_config', not an instance of "
                    << "p4::tmp::P4DeviceConfig";
+        return Status(StatusCode::INVALID_ARGUMENT,
+                      "Invalid p4_device_config");
     }
 
     const auto &device_data = p4_device_config.device_data();
 
     std::string dd_str =
         std::string((char *)device_data.data(), device_data.size());
-    JaegerLog::getInstance()->Log("PI:SetFwdPpln:Device Data", dd_str);
+    JaegerLog::getInstance()->log("PI:SetFwdPpln:Device Data", dd_str);
+
+    Log(DEBUG) << "device_data.data():" << device_data.data();
+    Log(DEBUG) << "device_data.size():" << device_data.size();
+    Log(DEBUG) << "_____ JASON ________\n";
+    Log(DEBUG) << dd_str;
+
+    std::istringstream      ss(dd_str);
+    Json::CharReaderBuilder rb;
+    Json::Value             cfg_root;
+    std::string             errs;
+    if (!Json::parseFromStream(rb, ss, &cfg_root, &errs)) {
+        Log(ERROR) << "Invalid device data: " << errs;
+        return Status(StatusCode::INVALID_ARGUMENT,
+                      "Invalid device data: " + errs);
+    }
 
-    if (_debugmode.find("debug-pi") != std::string::npos) {
-        Log(DEBUG) << "device_data.data():" << device_data.data();
-        Log(DEBUG) << "device_data.size():" << device_data.size();
-        Log(DEBUG) << "_____ JASON ________\n";
-        Log(DEBUG) << dd_str;
+    Log(DEBUG) << "_____ Calling AFI stagePipelineConfig ________\n";
+    staged.afi = AFIHAL::Afi::instance().stagePipelineConfig(
+        cfg_root, *staged.p4info, error);
+    if (staged.afi == nullptr) {
+        Log(ERROR) << "Invalid device data: " << error;
+        return Status(StatusCode::INVALID_ARGUMENT,
+                      "Invalid device data: " + error);
     }
 
-    std::istringstream ss(dd_str);
-    std::istream *     is = &ss;
+    staged.fingerprint = fingerprint;
+    staged.config = std::make_shared<p4::ForwardingPipelineConfig>(config);
+    return Status::OK;
+}
+
+//
+// @fn
+// commitPipeline
+//
+// @brief
+// Make a verified pipeline the one in use. The AFI objects are swapped
+// first; the P4Info only once the target accepted them, so a failed
+// commit leaves the previous pipeline in place.
+//
+// @param[in]
+//     staged Verified pipeline
+// @return OK, or INTERNAL if the target rejected the pipeline
+//
 
-    Json::Value cfg_root;
-    (*is) >> cfg_root;
+Status
+P4RuntimeServiceImpl::commitPipeline(const StagedPipeline &staged)
+{
+    // No Write may see the entries dropped but the old P4Info still current
+    std::lock_guard<std::mutex> guard(_writeMtx);
+
+    std::string error;
+    Log(DEBUG) << "_____ Calling AFI commitPipeline ________\n";
+    if (!AFIHAL::Afi::instance().commitPipeline(staged.afi, error)) {
+        Log(ERROR) << "Pipeline commit failed: " << error;
+        return Status(StatusCode::INTERNAL, "Pipeline commit failed: " + error);
+    }
+
+    if (staged.p4info != P4Info::instance().current()) {
+        P4Info::instance().swap(staged.p4info);
+    }
 
-    Log(DEBUG) << "_____ Calling AFI handlePipelineConfig ________\n";
-    AFIHAL::Afi::instance().handlePipelineConfig(cfg_root);
+    bool changed = (_committedPipeline.p4info == nullptr) ||
+                   (_committedPipeline.fingerprint != staged.fingerprint);
+    _committedPipeline = staged;
+    if (changed && _pipelineCache.enabled()) {
+        _pipelineCache.store(*staged.config, staged.fingerprint);
+    }
     return Status::OK;
 }
 
-Status
-P4RuntimeServiceImpl::tableInsert(const p4::TableEntry &tableEntry)
+//
+// @fn
+// restorePipeline
+//
+// @brief
+// Commit the pipeline config of the pipeline cache, so that the agent
+// forwards with the last committed pipeline right after a restart. The
+// cache holds the config, not its translation: the config is verified
+// and its AFI objects created here, once per start. The
+// P4Runtime server is already up by then; a pipeline a controller
+// committed in the meantime is newer than the cached one and is kept.
+//
+// @return true if a cached pipeline was committed
+//
+
+bool
+P4RuntimeServiceImpl::restorePipeline()
 {
-    const auto tableId  = tableEntry.table_id();
-    const auto priority = tableEntry.priority();
-    Log(DEBUG) << "tableInsert: tableId: " << tableId;
-    Log(DEBUG) << "tableInsert: priority: " << priority;
+    std::lock_guard<std::mutex> guard(_pipelineMtx);
 
-    std::stringstream ts, ps;
-    ts << tableId;
-    ps << priority;
-    JaegerLog::getInstance()->Log("PI:Tbl Insert:Table ID", ts.str());
-    JaegerLog::getInstance()->Log("PI:Tbl Insert:Priority", ps.str());
+    if (_committedPipeline.p4info != nullptr) {
+        Log(INFO) << "Pipeline committed by the controller, cache not used";
+        return false;
+    }
 
-    Status status = Status::OK;
+    p4::ForwardingPipelineConfig config;
+    uint64_t                     fingerprint;
+    if (!_pipelineCache.load(config, fingerprint)) {
+        return false;
+    }
 
-    if (tableEntry.is_default_action()) {
-        if (!tableEntry.match().empty()) {
-            Log(ERROR) << "Default tableEntry has non-empty key";
-            // TBD: Return error status and translate it to
-            // grpc status
-        }
-        if (tableEntry.priority() != 0) {
-            Log(ERROR) << "Default tableEntry has non-zero priority";
-        }
-        return status;
+    StagedPipeline staged;
+    Status         status = stagePipeline(config, staged);
+    if (status.ok()) {
+        status = commitPipeline(staged);
+    }
+    if (!status.ok()) {
+        Log(ERROR) << "Unable to restore cached pipeline: "
+                   << status.error_message();
+        return false;
     }
 
-    Log(DEBUG) << "tableInsert: match size: "
-               << static_cast<size_t>(tableEntry.match().size());
+    Log(INFO) << "Restored cached pipeline " << std::hex << fingerprint
+              << std::dec;
+    return true;
+}
 
-    std::vector<AFIHAL::AfiTEntryMatchField> afiMFs;
+//
+// @fn
+// afiEntryParams
+//
+// @brief
+// Convert the match key and action of a table entry to AFI match fields
+// and action parameters. route is set to the LPM match of the hard-coded
+// route table, which is installed through Afi::addEntry().
+//
+
+void
+P4RuntimeServiceImpl::afiEntryParams(
+    const p4::TableEntry &                    tableEntry,
+    std::vector<AFIHAL::AfiTEntryMatchField> &afiMFs,
+    std::vector<AFIHAL::AfiAEntry> &          afiActions,
+    P4InfoResourceId &                        actionId,
+    const p4::FieldMatch_LPM *&               route)
+{
+    const auto tableId = tableEntry.table_id();
+    route              = nullptr;
+
+    Log(DEBUG) << "afiEntryParams: match size: "
+               << static_cast<size_t>(tableEntry.match().size());
 
     for (const auto &mf : tableEntry.match()) {
         Log(DEBUG) << "match field id: " << mf.field_id();
@@ -178,20 +367,19 @@ P4RuntimeServiceImpl::tableInsert(const p4::TableEntry &tableEntry)
             const std::string &keystr    = lpm.value();
             int                prefixLen = lpm.prefix_len();
             Log(DEBUG) << "keystr.size(): " << keystr.size();
-            Log(DEBUG) << "bytes: ";
             if (keystr.size() == 4) {
                 // Print IPv4 prefix
                 const char *c = keystr.c_str();
-                std::cout << +c[0] << "." << +c[1] << "." << +c[2] << "."
-                          << +c[3] << "\n";
+                Log(DEBUG) << "bytes: " << +c[0] << "." << +c[1] << "."
+                           << +c[2] << "." << +c[3];
             }
 
             Log(DEBUG) << "prefixLen: " << prefixLen;
 
             // Below is hard-coded to keep the initial gtest still passing.
-            if (tableId == 33581985)
-                AFIHAL::Afi::instance().addEntry(keystr, prefixLen);
-            else {
+            if (tableId == 33581985) {
+                route = &mf.lpm();
+            } else {
                 AFIHAL::AfiTEntryMatchField afiMF(mf.field_id(),
                                                   AFIHAL::AfiTEntryMatchField::MfType::LPM,
                                                   lpm.value(),
@@ -218,9 +406,6 @@ P4RuntimeServiceImpl::tableInsert(const p4::TableEntry &tableEntry)
         }
     }
 
-    std::vector<AFIHAL::AfiAEntry> afiActions;
-    P4InfoResourceId actionId;
-
     const p4::TableAction &tableAction = tableEntry.action();
     if (tableAction.type_case() == p4::TableAction::kAction) {
         const p4::Action &action = tableAction.action();
@@ -231,11 +416,81 @@ P4RuntimeServiceImpl::tableInsert(const p4::TableEntry &tableEntry)
             afiActions.push_back(afiAEntry);
         }
     }
+}
+
+Status
+P4RuntimeServiceImpl::tableInsert(const p4::TableEntry &             tableEntry,
+                                  AFIHAL::AfiChangeSet *             changeSet,
+                                  AFIHAL::AfiShadowOverlay &         shadow,
+                                  std::vector<AFIHAL::AfiObjectPtr> &objs)
+{
+    const auto tableId  = tableEntry.table_id();
+    const auto priority = tableEntry.priority();
+    Log(DEBUG) << "tableInsert: tableId: " << tableId;
+    Log(DEBUG) << "tableInsert: priority: " << priority;
+
+    JaegerSpan span("PI tableInsert");
+    JaegerLog::getInstance()->log("PI:Tbl Insert:Table ID", tableId);
+    JaegerLog::getInstance()->log("PI:Tbl Insert:Priority", priority);
+
+    Status status = Status::OK;
+
+    if (tableEntry.is_default_action()) {
+        if (!tableEntry.match().empty()) {
+            Log(ERROR) << "Default tableEntry has non-empty key";
+            // TBD: Return error status and translate it to
+            // grpc status
+        }
+        if (tableEntry.priority() != 0) {
+            Log(ERROR) << "Default tableEntry has non-zero priority";
+        }
+        return status;
+    }
+
+    p4::TableEntry installed;
+    if (shadow.lookup(tableEntry, installed)) {
+        std::stringstream es;
+        es << "Entry already exists in table " << tableId;
+        return Status(StatusCode::ALREADY_EXISTS, es.str());
+    }
 
-    AFIHAL::Afi::instance().afiAddObjEntry(tableId,
-                                           actionId,
-                                           afiMFs,
-                                           afiActions);
+    std::vector<AFIHAL::AfiTEntryMatchField> afiMFs;
+    std::vector<AFIHAL::AfiAEntry>           afiActions;
+    P4InfoResourceId                         actionId = 0;
+    const p4::FieldMatch_LPM *               route;
+
+    afiEntryParams(tableEntry, afiMFs, afiActions, actionId, route);
+    const std::string entryName =
+        AFIHAL::AfiShadowStore::entryName(tableEntry);
+
+    //
+    // The route goes into a tree entry, ahead of the objects for the
+    // remaining match fields
+    //
+    if ((route != nullptr) &&
+        !AFIHAL::Afi::instance().addEntry(route->value(), route->prefix_len(),
+                                          changeSet, &objs)) {
+        std::stringstream es;
+        es << "Unable to add route to table " << tableId;
+        return Status(StatusCode::INTERNAL, es.str());
+    }
+
+    if (!AFIHAL::Afi::instance().afiAddObjEntry(tableId,
+                                                actionId,
+                                                afiMFs,
+                                                afiActions,
+                                                entryName,
+                                                changeSet,
+                                                &objs)) {
+        if ((changeSet == nullptr) && !objs.empty()) {
+            // The route is bound already
+            AFIHAL::Afi::instance().afiDelObjEntry(objs, nullptr);
+            objs.clear();
+        }
+        std::stringstream es;
+        es << "Unable to add entry to table " << tableId;
+        return Status(StatusCode::INVALID_ARGUMENT, es.str());
+    }
 
 #if 0
     uint16_t               portId      = 0;
@@ -337,9 +592,133 @@ P4RuntimeServiceImpl::tableInsert(const p4::TableEntry &tableEntry)
     return status;
 }
 
+//
+// @fn
+// tableModify
+//
+// @brief
+// Change the action of an installed table entry. Only the AFI objects
+// affected by the new action are reprogrammed; see Afi::modifyObjects().
+//
+// @param[in]
+//     tableEntry Table entry
+// @param[in]
+//     changeSet Change set of a batched write, may be nullptr
+// @param[in]
+//     shadow Installed entries, including the changes of the write
+// @param[out]
+//     objs AFI objects of the entry after the modification
+// @return Status
+//
+
+Status
+P4RuntimeServiceImpl::tableModify(const p4::TableEntry &             tableEntry,
+                                  AFIHAL::AfiChangeSet *             changeSet,
+                                  AFIHAL::AfiShadowOverlay &         shadow,
+                                  std::vector<AFIHAL::AfiObjectPtr> &objs)
+{
+    const auto tableId = tableEntry.table_id();
+    Log(DEBUG) << "tableModify: tableId: " << tableId;
+
+    JaegerSpan span("PI tableModify");
+    JaegerLog::getInstance()->log("PI:Tbl Modify:Table ID", tableId);
+
+    if (tableEntry.is_default_action()) {
+        Log(DEBUG) << "tableModify: default action not supported yet";
+        return Status::OK;
+    }
+
+    p4::TableEntry installed;
+    if (!shadow.lookup(tableEntry, installed, &objs)) {
+        std::stringstream es;
+        es << "Entry not found in table " << tableId;
+        return Status(StatusCode::NOT_FOUND, es.str());
+    }
+
+    std::vector<AFIHAL::AfiTEntryMatchField> afiMFs;
+    std::vector<AFIHAL::AfiAEntry>           afiActions;
+    P4InfoResourceId                         actionId = 0;
+    const p4::FieldMatch_LPM *               route;
+
+    afiEntryParams(tableEntry, afiMFs, afiActions, actionId, route);
+    const std::string entryName =
+        AFIHAL::AfiShadowStore::entryName(tableEntry);
+
+    //
+    // The tree entry of a route comes first, see tableInsert()
+    //
+    std::vector<AFIHAL::AfiObjectPtr> routeObjs;
+    if ((route != nullptr) && !objs.empty()) {
+        routeObjs.push_back(objs.front());
+        objs.erase(objs.begin());
+    }
+
+    bool modified =
+        ((route == nullptr) ||
+         AFIHAL::Afi::instance().modEntry(route->value(), route->prefix_len(),
+                                          routeObjs, changeSet)) &&
+        AFIHAL::Afi::instance().afiModObjEntry(tableId, actionId, afiMFs,
+                                               afiActions, entryName, objs,
+                                               changeSet);
+    objs.insert(objs.begin(), routeObjs.begin(), routeObjs.end());
+
+    if (!modified) {
+        std::stringstream es;
+        es << "Unable to modify entry in table " << tableId;
+        return Status(StatusCode::INVALID_ARGUMENT, es.str());
+    }
+    return Status::OK;
+}
+
+//
+// @fn
+// tableDelete
+//
+// @brief
+// Remove an installed table entry by unbinding its AFI objects
+//
+// @param[in]
+//     tableEntry Table entry
+// @param[in]
+//     changeSet Change set of a batched write, may be nullptr
+// @param[in]
+//     shadow Installed entries, including the changes of the write
+// @return Status
+//
+
+Status
+P4RuntimeServiceImpl::tableDelete(const p4::TableEntry &    tableEntry,
+                                  AFIHAL::AfiChangeSet *    changeSet,
+                                  AFIHAL::AfiShadowOverlay &shadow)
+{
+    const auto tableId = tableEntry.table_id();
+    Log(DEBUG) << "tableDelete: tableId: " << tableId;
+
+    JaegerSpan span("PI tableDelete");
+    JaegerLog::getInstance()->log("PI:Tbl Delete:Table ID", tableId);
+
+    p4::TableEntry                    installed;
+    std::vector<AFIHAL::AfiObjectPtr> objs;
+    if (!shadow.lookup(tableEntry, installed, &objs)) {
+        std::stringstream es;
+        es << "Entry not found in table " << tableId;
+        return Status(StatusCode::NOT_FOUND, es.str());
+    }
+
+    if (!AFIHAL::Afi::instance().afiDelObjEntry(objs, changeSet)) {
+        std::stringstream es;
+        es << "Unable to delete entry from table " << tableId;
+        return Status(StatusCode::UNKNOWN, es.str());
+    }
+    return Status::OK;
+}
+
 Status
-P4RuntimeServiceImpl::tableWrite(p4::Update_Type       update,
-                                 const p4::TableEntry &table_entry)
+P4RuntimeServiceImpl::tableWrite(p4::Update_Type                    update,
+                                 const p4::TableEntry &             table_entry,
+                                 AFIHAL::AfiChangeSet *             changeSet,
+                                 std::vector<AFIHAL::AfiObjectPtr> *objs,
+                                 AFIHAL::AfiShadowOverlay *         shadow)
 {
     Log(DEBUG) << "tableWrite: table_id: " << table_entry.table_id();
     // if (!check_p4_id(table_entry.table_id(), P4ResourceType::TABLE))
@@ -348,6 +727,15 @@ P4RuntimeServiceImpl::tableWrite(p4::Update_Type       update,
         Log(DEBUG) << "Direct resources not supported in TableEntry yet: ";
         return Status::OK;
     }
+    std::vector<AFIHAL::AfiObjectPtr> entryObjs;
+    if (objs == nullptr) {
+        objs = &entryObjs;
+    }
+    AFIHAL::AfiShadowOverlay entryShadow(AFIHAL::Afi::instance().shadow());
+    if (shadow == nullptr) {
+        shadow = &entryShadow;
+    }
+
     // Status status;
     Status status = Status::OK;
     switch (update) {
@@ -356,58 +744,228 @@ P4RuntimeServiceImpl::tableWrite(p4::Update_Type       update,
             break;
         case p4::Update_Type_INSERT:
             Log(DEBUG) << "p4::Update_Type_INSERT";
-            return tableInsert(table_entry);
+            status = tableInsert(table_entry, changeSet, *shadow, *objs);
             break;
         case p4::Update_Type_MODIFY:
             Log(DEBUG) << "p4::Update_Type_MODIFY";
+            status = tableModify(table_entry, changeSet, *shadow, *objs);
             break;
         case p4::Update_Type_DELETE:
             Log(DEBUG) << "p4::Update_Type_DELETE";
+            status = tableDelete(table_entry, changeSet, *shadow);
             break;
         default:
             Log(DEBUG) << "tableWrite: ____ default";
             break;
     }
+
+    if (!status.ok() || table_entry.is_default_action()) {
+        return status;
+    }
+
+    //
+    // Batched updates are recorded in the store once the change set is
+    // committed. Until then later updates of the batch see them through
+    // the overlay, and fail with the update they build on.
+    //
+    if (changeSet == nullptr) {
+        shadowUpdate(update, table_entry, *objs);
+        return status;
+    }
+
+    const uint32_t updateIdx = changeSet->update();
+    const int      last      = shadow->lastUpdate(table_entry);
+    if (last >= 0) {
+        changeSet->dependsOn(updateIdx, last);
+    }
+    switch (update) {
+        case p4::Update_Type_INSERT:
+            shadow->insert(updateIdx, table_entry, *objs);
+            break;
+        case p4::Update_Type_MODIFY:
+            shadow->modify(updateIdx, table_entry, *objs);
+            break;
+        case p4::Update_Type_DELETE:
+            shadow->erase(updateIdx, table_entry);
+            break;
+        default:
+            break;
+    }
+    return status;
+}
+
+//
+// @fn
+// shadowUpdate
+//
+// @brief
+// Record a table entry change in the AFI shadow store
+//
+// @param[in]
+//     update Update type
+// @param[in]
+//     entry Table entry
+// @param[in]
+//     objs AFI objects the entry is installed as
+// @return void
+//
+
+void
+P4RuntimeServiceImpl::shadowUpdate(p4::Update_Type                          update,
+                                   const p4::TableEntry &                   entry,
+                                   const std::vector<AFIHAL::AfiObjectPtr> &objs)
+{
+    if (entry.is_default_action() || entry.has_meter_config() ||
+        entry.has_counter_data()) {
+        return;
+    }
+
+    auto &shadow = AFIHAL::Afi::instance().shadow();
+    switch (update) {
+        case p4::Update_Type_INSERT:
+            shadow.insert(entry, objs);
+            break;
+        case p4::Update_Type_MODIFY:
+            shadow.modify(entry, objs);
+            break;
+        case p4::Update_Type_DELETE:
+            shadow.erase(entry);
+            break;
+        default:
+            break;
+    }
+}
+
+Status
+P4RuntimeServiceImpl::_writeUpdate(const p4::Update &                 update,
+                                   AFIHAL::AfiChangeSet *             changeSet,
+                                   std::vector<AFIHAL::AfiObjectPtr> *objs,
+                                   AFIHAL::AfiShadowOverlay *         shadow)
+{
+    Status      status = Status::OK;
+    const auto &entity = update.entity();
+    switch (entity.entity_case()) {
+        case p4::Entity::kExternEntry:
+            Log(DEBUG) << "p4::Entity::kExternEntry";
+            break;
+        case p4::Entity::kTableEntry:
+            Log(DEBUG) << "p4::Entity::kTableEntry";
+            status = tableWrite(update.type(), entity.table_entry(),
+                                changeSet, objs, shadow);
+            break;
+        case p4::Entity::kActionProfileMember:
+            Log(DEBUG) << "p4::Entity::kActionProfileMember";
+            break;
+        case p4::Entity::kActionProfileGroup:
+            Log(DEBUG) << "p4::Entity::kActionProfileGroup";
+            break;
+        case p4::Entity::kMeterEntry:
+            Log(DEBUG) << "p4::Entity::kMeterEntry";
+            break;
+        case p4::Entity::kDirectMeterEntry:
+            Log(DEBUG) << "p4::Entity::kDirectMeterEntry";
+            break;
+        case p4::Entity::kCounterEntry:
+            Log(DEBUG) << "p4::Entity::kCounterEntry";
+            break;
+        case p4::Entity::kDirectCounterEntry:
+            Log(DEBUG) << "p4::Entity::kDirectCounterEntry";
+            break;
+        default:
+            Log(DEBUG) << "_____default";
+            break;
+    }
     return status;
 }
 
+//
+// @fn
+// _writeBatch
+//
+// @brief
+// Translate all updates of a WriteRequest into one AFI change set and
+// commit it to the target in a single batch. On failure the per-update
+// status is returned as google.rpc.Status messages packed in the details
+// of the gRPC error, one per update in request order.
+//
+// @param[in]
+//     request Write request
+// @return Status
+//
+
+Status
+P4RuntimeServiceImpl::_writeBatch(const p4::WriteRequest &request)
+{
+    const int numUpdates = request.updates_size();
+    Log(DEBUG) << "_writeBatch: updates: " << numUpdates;
+
+    AFIHAL::AfiChangeSet     changeSet(numUpdates);
+    AFIHAL::AfiShadowOverlay shadow(AFIHAL::Afi::instance().shadow());
+    std::vector<Status>      updateStatus(numUpdates, Status::OK);
+    std::vector<std::vector<AFIHAL::AfiObjectPtr>> updateObjs(numUpdates);
+
+    for (int i = 0; i < numUpdates; i++) {
+        changeSet.setUpdate(i);
+        updateStatus[i] = _writeUpdate(request.updates(i), &changeSet,
+                                       &updateObjs[i], &shadow);
+        if (!updateStatus[i].ok()) {
+            changeSet.fail(i, updateStatus[i].error_message());
+        }
+    }
+
+    bool committed = AFIHAL::Afi::instance().commitChangeSet(changeSet);
+
+    for (int i = 0; i < numUpdates; i++) {
+        const auto &update = request.updates(i);
+        if (!changeSet.failed(i) && update.entity().has_table_entry()) {
+            shadowUpdate(update.type(), update.entity().table_entry(),
+                         updateObjs[i]);
+        }
+    }
+
+    if (committed) {
+        return Status::OK;
+    }
+
+    ::google::rpc::Status details;
+    details.set_code(::google::rpc::Code::UNKNOWN);
+    details.set_message("Write failure");
+    for (int i = 0; i < numUpdates; i++) {
+        ::google::rpc::Status updStatus;
+        if (!changeSet.failed(i)) {
+            updStatus.set_code(::google::rpc::Code::OK);
+        } else if (!updateStatus[i].ok()) {
+            updStatus.set_code(static_cast<int>(updateStatus[i].error_code()));
+            updStatus.set_message(updateStatus[i].error_message());
+        } else {
+            updStatus.set_code(::google::rpc::Code::INTERNAL);
+            updStatus.set_message(changeSet.error(i));
+        }
+        details.add_details()->PackFrom(updStatus);
+    }
+
+    return Status(StatusCode::UNKNOWN, details.message(),
+                  details.SerializeAsString());
+}
+
 Status
 P4RuntimeServiceImpl::_write(const p4::WriteRequest &request)
 {
+    //
+    // The shadow lookups of the updates, their commit and the shadow
+    // update afterwards must not interleave with another Write or with a
+    // pipeline commit. The gRPC servers call Write from several threads.
+    //
+    std::lock_guard<std::mutex> guard(_writeMtx);
+
+    if (request.updates_size() > 1) {
+        return _writeBatch(request);
+    }
+
     Status status = Status::OK;
     // status.set_code(Code::OK);
     for (const auto &update : request.updates()) {
-        const auto &entity = update.entity();
-        switch (entity.entity_case()) {
-            case p4::Entity::kExternEntry:
-                Log(DEBUG) << "p4::Entity::kExternEntry";
-                break;
-            case p4::Entity::kTableEntry:
-                Log(DEBUG) << "p4::Entity::kTableEntry";
-                status = tableWrite(update.type(), entity.table_entry());
-                break;
-            case p4::Entity::kActionProfileMember:
-                Log(DEBUG) << "p4::Entity::kActionProfileMember";
-                break;
-            case p4::Entity::kActionProfileGroup:
-                Log(DEBUG) << "p4::Entity::kActionProfileGroup";
-                break;
-            case p4::Entity::kMeterEntry:
-                Log(DEBUG) << "p4::Entity::kMeterEntry";
-                break;
-            case p4::Entity::kDirectMeterEntry:
-                Log(DEBUG) << "p4::Entity::kDirectMeterEntry";
-                break;
-            case p4::Entity::kCounterEntry:
-                Log(DEBUG) << "p4::Entity::kCounterEntry";
-                break;
-            case p4::Entity::kDirectCounterEntry:
-                Log(DEBUG) << "p4::Entity::kDirectCounterEntry";
-                break;
-            default:
-                Log(DEBUG) << "_____default";
-                break;
-        }
+        status = _writeUpdate(update);
         // if (status.code() != Code::OK) break;
     }
     return status;
@@ -418,14 +976,19 @@ P4RuntimeServiceImpl::Write(ServerContext *         context,
                             const p4::WriteRequest *request,
                             p4::WriteResponse *     rep)
 {
-    if (_debugmode.find("debug-pi") != std::string::npos) {
-        Log(DEBUG) << "_____ P4Runtime Write _____\n";
-        Log(DEBUG) << request->DebugString();
-    }
     Log(DEBUG) << "_____ P4Runtime Write _____\n";
-    // Log(DEBUG) << request->DebugString();
+    Log(DEBUG) << request->DebugString();
     (void)rep;
 
+    static MetricHistogram &latency = rpcLatency("Write");
+    static MetricCounter &  errors  = rpcErrors("Write");
+    static MetricCounter &  updates = Metrics::instance().counter(
+        "jp4_pi_write_updates_total", "P4Runtime Write updates received");
+    MetricTimer timer(latency);
+    updates.inc(request->updates_size());
+
+    JaegerSpan span("P4Runtime Write");
+
     auto deviceId = request->device_id();
     Log(DEBUG) << "Device id :" << deviceId;
     if (request->has_election_id()) {
@@ -435,13 +998,14 @@ P4RuntimeServiceImpl::Write(ServerContext *         context,
     // Log(DEBUG) << "Election id :" << static_cast<int>(electionId);
     // std::cout << "Election id :" << electionId << "\n";
 
-    std::stringstream ds, es;
-    ds << deviceId;
-    es << electionId;
-    JaegerLog::getInstance()->Log("PI:Write:Device ID", ds.str());
-    JaegerLog::getInstance()->Log("PI:Write:Election ID", es.str());
+    JaegerLog::getInstance()->log("PI:Write:Device ID", deviceId);
+    JaegerLog::getInstance()->log("PI:Write:Election ID", electionId);
+    JaegerLog::getInstance()->log("PI:Write:Updates", request->updates_size());
 
     auto status = _write(*request);
+    if (!status.ok()) {
+        errors.inc();
+    }
 
     // Error on WRL : commenting from now
     // P4RuntimeService.cpp:396:10: error: 'std::this_thread' has not been declared
@@ -457,11 +1021,90 @@ P4RuntimeServiceImpl::Read(ServerContext *                 context,
                            const p4::ReadRequest *         request,
                            ServerWriter<p4::ReadResponse> *writer)
 {
-    if (_debugmode.find("debug-pi") != std::string::npos) {
+    ReadCursor cursor;
+    bool       done = false;
+    while (!done) {
+        p4::ReadResponse response;
+        auto             status = readChunk(*request, cursor, response, done);
+        if (!status.ok()) {
+            return status;
+        }
+        if (!writer->Write(response)) {
+            break;
+        }
+    }
+    return Status::OK;
+}
+
+//
+// @fn
+// readChunk
+//
+// @brief
+// Serve a Read from the AFI shadow store, one bounded chunk at a time.
+// Table entries with a match key are looked up, otherwise the whole
+// table (all tables for table id 0) is dumped. Other entities are not
+// stored and read as empty.
+//
+// @param[in]
+//     request Read request
+// @param[in,out]
+//     cursor Progress of this Read, zero initialized for the first chunk
+// @param[out]
+//     response Next chunk
+// @param[out]
+//     done true if this is the last chunk
+// @return Status
+//
+
+Status
+P4RuntimeServiceImpl::readChunk(const p4::ReadRequest &request,
+                                ReadCursor &cursor, p4::ReadResponse &response,
+                                bool &done)
+{
+    static MetricHistogram &latency = Metrics::instance().histogram(
+        "jp4_pi_read_chunk_latency_seconds",
+        "P4Runtime Read latency per response chunk");
+    MetricTimer timer(latency);
+
+    if ((cursor.entity == 0) && !cursor.shadow.started) {
         Log(DEBUG) << "_____ P4Runtime Read _____\n";
-        Log(DEBUG) << request->DebugString();
+        Log(DEBUG) << request.DebugString();
+    }
+
+    auto &shadow = AFIHAL::Afi::instance().shadow();
+    while (cursor.entity < request.entities_size()) {
+        const auto &entity = request.entities(cursor.entity);
+        size_t      added  = response.entities_size();
+        if ((added >= kReadChunkMaxEntities) ||
+            (response.ByteSizeLong() >= kReadChunkMaxBytes)) {
+            break;
+        }
+
+        if (entity.entity_case() == p4::Entity::kTableEntry) {
+            const auto &te = entity.table_entry();
+            if ((te.table_id() != 0) && (te.match_size() != 0)) {
+                p4::TableEntry entry;
+                if (shadow.lookup(te, entry)) {
+                    *response.add_entities()->mutable_table_entry() = entry;
+                }
+            } else {
+                shadow.read(te.table_id(), cursor.shadow,
+                            kReadChunkMaxEntities - added,
+                            kReadChunkMaxBytes - response.ByteSizeLong(),
+                            response);
+                if (!cursor.shadow.done) {
+                    break;
+                }
+            }
+        }
+
+        cursor.entity++;
+        cursor.shadow = AFIHAL::AfiShadowCursor();
     }
-    p4::ReadResponse response;
+
+    done = (cursor.entity >= request.entities_size());
+    response.set_complete(done);
     return Status::OK;
 }
 
@@ -471,14 +1114,64 @@ P4RuntimeServiceImpl::GetForwardingPipelineConfig(
     const p4::GetForwardingPipelineConfigRequest *request,
     p4::GetForwardingPipelineConfigResponse *     rep)
 {
-    if (_debugmode.find("debug-pi") != std::string::npos) {
-        Log(DEBUG) << "_____ P4Runtime GetForwardingPipelineConfig _____\n";
-        Log(DEBUG) << request->DebugString();
-    }
+    Log(DEBUG) << "_____ P4Runtime GetForwardingPipelineConfig _____\n";
+    Log(DEBUG) << request->DebugString();
     (void)rep;
+    static MetricHistogram &latency = rpcLatency("GetForwardingPipelineConfig");
+    MetricTimer             timer(latency);
     return Status::OK;
 }
 
+//
+// @fn
+// streamMessage
+//
+// @brief
+// Handle one message received on the stream channel
+//
+// @param[in]
+//     request Stream message from the controller, a PacketOut payload
+//     is moved out
+// @param[out]
+//     response Response to send back, if any
+// @return true if response is to be sent to the controller
+//
+
+bool
+P4RuntimeServiceImpl::streamMessage(p4::StreamMessageRequest & request,
+                                    p4::StreamMessageResponse &response)
+{
+    switch (request.update_case()) {
+        case p4::StreamMessageRequest::kArbitration: {
+            Log(DEBUG) << "p4::StreamMessageRequest::kArbitration\n";
+            static MetricCounter &arbitrations = streamMessages("arbitration");
+            arbitrations.inc();
+            const auto device_id = request.arbitration().device_id();
+            const auto election_id =
+                convert_u128(request.arbitration().election_id());
+            Log(DEBUG) << "device_id:" << device_id;
+            Log(DEBUG) << "election_id:" << election_id;
+            auto arbitration = response.mutable_arbitration();
+            auto status      = arbitration->mutable_status();
+            status->set_code(::google::rpc::Code::OK);
+            return true;
+        }
+
+        case p4::StreamMessageRequest::kPacket: {
+            Log(DEBUG) << "p4::StreamMessageRequest::kPacket\n";
+            static MetricCounter &packets = streamMessages("packet");
+            packets.inc();
+            // Received L2 pkt. Hand its buffer on to the device, the
+            // request is overwritten by the next read anyway.
+            _hpPktHdl.sendPacketOut(*request.mutable_packet());
+        } break;
+
+        default:
+            break;
+    }
+    return false;
+}
+
 Status
 P4RuntimeServiceImpl::StreamChannel(ServerContext *            context,
                                     StreamChannelReaderWriter *stream)
@@ -488,38 +1181,9 @@ P4RuntimeServiceImpl::StreamChannel(ServerContext *            context,
 
     p4::StreamMessageRequest request;
     while (stream->Read(&request)) {
-        switch (request.update_case()) {
-            case p4::StreamMessageRequest::kArbitration: {
-                if (_debugmode.find("debug-pi") != std::string::npos) {
-                    Log(DEBUG) << "p4::StreamMessageRequest::kArbitration\n";
-                }
-                const auto device_id = request.arbitration().device_id();
-                const auto election_id =
-                    convert_u128(request.arbitration().election_id());
-                if (_debugmode.find("debug-pi") != std::string::npos) {
-                    Log(DEBUG) << "device_id:" << device_id;
-                    Log(DEBUG) << "election_id:" << election_id;
-                }
-                p4::StreamMessageResponse response;
-                auto arbitration = response.mutable_arbitration();
-                auto status      = arbitration->mutable_status();
-                status->set_code(::google::rpc::Code::OK);
-
-                stream->Write(response);
-            } break;
-
-            case p4::StreamMessageRequest::kPacket: {
-                if (_debugmode.find("debug-pi") != std::string::npos) {
-                    Log(DEBUG) << "p4::StreamMessageRequest::kPacket\n";
-                }
-                const std::string &payload = request.packet().payload();
-
-                // Received L2 pkt. Send to the device on the UDP socket.
-                _hpPktHdl.sendPacketOut(payload);
-            } break;
-
-            default:
-                break;
+        p4::StreamMessageResponse response;
+        if (streamMessage(request, response)) {
+            stream->Write(response);
         }
     }
 
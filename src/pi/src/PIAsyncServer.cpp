@@ -0,0 +1,503 @@
+//
+// Juniper P4 Agent
+//
+/// @file  PIAsyncServer.cpp
+/// @brief Asynchronous (completion queue based) PI server
+//
+// Copyright (c) [2018] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include "ControllerConnection.h"
+#include "pvtPI.h"
+
+using grpc::ServerAsyncReaderWriter;
+using grpc::ServerAsyncResponseWriter;
+using grpc::ServerAsyncWriter;
+using grpc::ServerCompletionQueue;
+
+namespace
+{
+//
+// @class PIUnaryCall
+// @brief State machine for unary RPCs (Write, pipeline config)
+//
+// REQUEST: waiting for a new RPC. On arrival a fresh call is posted for
+//          the next RPC, the handler runs and the reply is sent.
+// FINISH : reply sent, call is done.
+//
+template <typename Req, typename Rep>
+class PIUnaryCall : public PIAsyncCall
+{
+ public:
+    using RequestFn = std::function<void(ServerContext *, Req *,
+                                         ServerAsyncResponseWriter<Rep> *,
+                                         ServerCompletionQueue *, void *)>;
+    using HandlerFn =
+        std::function<Status(ServerContext *, const Req *, Rep *)>;
+
+    static void post(PIAsyncServer &server, ServerCompletionQueue *cq,
+                     const RequestFn &request, const HandlerFn &handler)
+    {
+        new PIUnaryCall(server, cq, request, handler);
+    }
+
+    void proceed(bool ok, int event) override
+    {
+        if (event == FINISH || !ok) {
+            delete this;
+            return;
+        }
+
+        if (!_server.isShutdown()) {
+            post(_server, _cq, _request, _handler);
+        }
+
+        Rep rep;
+        Status status = _handler(&_ctx, &_req, &rep);
+        _responder.Finish(rep, status, &_finishTag);
+    }
+
+ private:
+    enum Event { REQUEST, FINISH };
+
+    PIAsyncServer &                _server;
+    ServerCompletionQueue *        _cq;
+    RequestFn                      _request;
+    HandlerFn                      _handler;
+    ServerContext                  _ctx;
+    Req                            _req;
+    ServerAsyncResponseWriter<Rep> _responder{&_ctx};
+    Tag                            _requestTag{this, REQUEST};
+    Tag                            _finishTag{this, FINISH};
+
+    PIUnaryCall(PIAsyncServer &server, ServerCompletionQueue *cq,
+                const RequestFn &request, const HandlerFn &handler)
+        : _server(server), _cq(cq), _request(request), _handler(handler)
+    {
+        _request(&_ctx, &_req, &_responder, _cq, &_requestTag);
+    }
+};
+
+//
+// @class PIReadCall
+// @brief State machine for the server streaming Read RPC
+//
+// REQUEST: waiting for a new RPC; the first chunk is read and written.
+// WRITE  : chunk written, read and write the next one or finish.
+// FINISH : status sent, call is done.
+//
+// Only one chunk is held at a time, however large the dump.
+//
+class PIReadCall : public PIAsyncCall
+{
+ public:
+    static void post(PIAsyncServer &server, ServerCompletionQueue *cq)
+    {
+        new PIReadCall(server, cq);
+    }
+
+    void proceed(bool ok, int event) override
+    {
+        if (event == FINISH || !ok) {
+            delete this;
+            return;
+        }
+
+        if ((event == REQUEST) && !_server.isShutdown()) {
+            post(_server, _cq);
+        }
+
+        if (_done) {
+            _writer.Finish(Status::OK, &_finishTag);
+            return;
+        }
+
+        _response.Clear();
+        Status status =
+            _server.piService().readChunk(_req, _cursor, _response, _done);
+        if (!status.ok()) {
+            _writer.Finish(status, &_finishTag);
+            return;
+        }
+        _writer.Write(_response, &_writeTag);
+    }
+
+ private:
+    enum Event { REQUEST, WRITE, FINISH };
+
+    PIAsyncServer &                     _server;
+    ServerCompletionQueue *             _cq;
+    ServerContext                       _ctx;
+    p4::ReadRequest                     _req;
+    ServerAsyncWriter<p4::ReadResponse> _writer{&_ctx};
+    p4::ReadResponse                    _response;
+    ReadCursor                          _cursor;
+    bool                                _done{false};
+    Tag                                 _requestTag{this, REQUEST};
+    Tag                                 _writeTag{this, WRITE};
+    Tag                                 _finishTag{this, FINISH};
+
+    PIReadCall(PIAsyncServer &server, ServerCompletionQueue *cq)
+        : _server(server), _cq(cq)
+    {
+        _server.asyncService().RequestRead(&_ctx, &_req, &_writer, _cq, _cq,
+                                           &_requestTag);
+    }
+};
+
+//
+// @class PIStreamChannelCall
+// @brief State machine for the bi-directional StreamChannel RPC
+//
+// A read is kept outstanding for the lifetime of the stream. Responses
+// (arbitration replies and packet-ins from the hostpath) are queued and
+// written one at a time. Once the controller half-closes, the call
+// finishes after the pending writes; it is deleted when no operation is
+// outstanding anymore.
+//
+class PIStreamChannelCall : public PIAsyncCall, public StreamChannelWriter
+{
+ public:
+    static void post(PIAsyncServer &server, ServerCompletionQueue *cq)
+    {
+        new PIStreamChannelCall(server, cq);
+    }
+
+    void proceed(bool ok, int event) override
+    {
+        //
+        // controller_conn calls write() with its lock held, so it is
+        // never entered with _mtx held.
+        //
+        if (event == REQUEST && ok) {
+            {
+                std::lock_guard<std::mutex> lock(_mtx);
+                _active = true;
+            }
+            controller_conn.set_stream(this);
+        } else if (event == READ && !ok) {
+            controller_conn.clear_stream(this);
+        }
+
+        std::unique_lock<std::mutex> lock(_mtx);
+        switch (event) {
+            case REQUEST:
+                _pending--;
+                if (!ok) {
+                    break;
+                }
+                if (!_server.isShutdown()) {
+                    post(_server, _cq);
+                }
+                startRead();
+                break;
+
+            case READ:
+                if (!ok) {
+                    // Controller is done (or the call was cancelled)
+                    _pending--;
+                    _active = false;
+                    startFinish();
+                    break;
+                }
+                {
+                    //
+                    // The completed read stays counted in _pending until
+                    // the next one is posted, so the call cannot go away
+                    // while the message is handled without the lock.
+                    //
+                    p4::StreamMessageResponse response;
+                    lock.unlock();
+                    bool reply =
+                        _server.piService().streamMessage(_req, response);
+                    lock.lock();
+                    if (reply) {
+                        enqueue(response);
+                    }
+                }
+                startRead();
+                _pending--;
+                break;
+
+            case WRITE:
+                _pending--;
+                _writing = false;
+                _writeQ.pop_front();
+                if (!ok) {
+                    _writeQ.clear();
+                }
+                startWrite();
+                startFinish();
+                break;
+
+            case FINISH:
+                _pending--;
+                break;
+        }
+
+        if (_pending == 0) {
+            lock.unlock();
+            controller_conn.clear_stream(this);
+            delete this;
+        }
+    }
+
+    //
+    // StreamChannelWriter: called from the hostpath thread
+    //
+    bool write(const p4::StreamMessageResponse &response) override
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        if (!_active) {
+            return false;
+        }
+        enqueue(response);
+        return true;
+    }
+
+ private:
+    enum Event { REQUEST, READ, WRITE, FINISH };
+
+    PIAsyncServer &        _server;
+    ServerCompletionQueue *_cq;
+    ServerContext          _ctx;
+    ServerAsyncReaderWriter<p4::StreamMessageResponse,
+                            p4::StreamMessageRequest>
+                                          _stream{&_ctx};
+    p4::StreamMessageRequest              _req;
+    std::deque<p4::StreamMessageResponse> _writeQ;
+    std::mutex                            _mtx;
+    int  _pending{0};       // Operations outstanding on the cq
+    bool _active{false};    // Reading from the controller
+    bool _writing{false};   // A write is outstanding
+    bool _finishing{false}; // Finish has been issued
+    Tag  _requestTag{this, REQUEST};
+    Tag  _readTag{this, READ};
+    Tag  _writeTag{this, WRITE};
+    Tag  _finishTag{this, FINISH};
+
+    PIStreamChannelCall(PIAsyncServer &server, ServerCompletionQueue *cq)
+        : _server(server), _cq(cq)
+    {
+        _pending++;
+        _server.asyncService().RequestStreamChannel(&_ctx, &_stream, _cq, _cq,
+                                                    &_requestTag);
+    }
+
+    // Called with _mtx held
+    void startRead()
+    {
+        _pending++;
+        _stream.Read(&_req, &_readTag);
+    }
+
+    // Called with _mtx held
+    void enqueue(const p4::StreamMessageResponse &response)
+    {
+        if (_finishing) {
+            return;
+        }
+        _writeQ.push_back(response);
+        startWrite();
+    }
+
+    // Called with _mtx held
+    void startWrite()
+    {
+        if (_writing || _finishing || _writeQ.empty()) {
+            return;
+        }
+        _writing = true;
+        _pending++;
+        _stream.Write(_writeQ.front(), &_writeTag);
+    }
+
+    // Called with _mtx held
+    void startFinish()
+    {
+        if (_active || _writing || _finishing) {
+            return;
+        }
+        _finishing = true;
+        _pending++;
+        _stream.Finish(Status::OK, &_finishTag);
+    }
+};
+
+//
+// Post one call for every programming RPC on cq
+//
+void
+postProgrammingCalls(PIAsyncServer &server, ServerCompletionQueue *cq)
+{
+    auto &svc = server.asyncService();
+    auto &pi  = server.piService();
+
+    PIUnaryCall<p4::WriteRequest, p4::WriteResponse>::post(
+        server, cq,
+        [&svc, cq](ServerContext *ctx, p4::WriteRequest *req,
+                   ServerAsyncResponseWriter<p4::WriteResponse> *rsp,
+                   ServerCompletionQueue *, void *tag) {
+            svc.RequestWrite(ctx, req, rsp, cq, cq, tag);
+        },
+        [&pi](ServerContext *ctx, const p4::WriteRequest *req,
+              p4::WriteResponse *rep) { return pi.Write(ctx, req, rep); });
+
+    PIUnaryCall<p4::SetForwardingPipelineConfigRequest,
+                p4::SetForwardingPipelineConfigResponse>::
+        post(server, cq,
+             [&svc, cq](ServerContext *                          ctx,
+                        p4::SetForwardingPipelineConfigRequest *req,
+                        ServerAsyncResponseWriter<
+                            p4::SetForwardingPipelineConfigResponse> *rsp,
+                        ServerCompletionQueue *, void *tag) {
+                 svc.RequestSetForwardingPipelineConfig(ctx, req, rsp, cq, cq,
+                                                        tag);
+             },
+             [&pi](ServerContext *                               ctx,
+                   const p4::SetForwardingPipelineConfigRequest *req,
+                   p4::SetForwardingPipelineConfigResponse *     rep) {
+                 return pi.SetForwardingPipelineConfig(ctx, req, rep);
+             });
+
+    PIUnaryCall<p4::GetForwardingPipelineConfigRequest,
+                p4::GetForwardingPipelineConfigResponse>::
+        post(server, cq,
+             [&svc, cq](ServerContext *                          ctx,
+                        p4::GetForwardingPipelineConfigRequest *req,
+                        ServerAsyncResponseWriter<
+                            p4::GetForwardingPipelineConfigResponse> *rsp,
+                        ServerCompletionQueue *, void *tag) {
+                 svc.RequestGetForwardingPipelineConfig(ctx, req, rsp, cq, cq,
+                                                        tag);
+             },
+             [&pi](ServerContext *                               ctx,
+                   const p4::GetForwardingPipelineConfigRequest *req,
+                   p4::GetForwardingPipelineConfigResponse *     rep) {
+                 return pi.GetForwardingPipelineConfig(ctx, req, rep);
+             });
+
+    PIReadCall::post(server, cq);
+}
+
+}  // namespace
+
+PIAsyncServer::PIAsyncServer(const std::string &   serverAddr,
+                             P4RuntimeServiceImpl &piService, int numCqs,
+                             int threadsPerCq)
+    : _serverAddr(serverAddr),
+      _piService(piService),
+      _numCqs((numCqs > 0) ? numCqs : 1),
+      _threadsPerCq((threadsPerCq > 0) ? threadsPerCq : 1)
+{
+}
+
+PIAsyncServer::~PIAsyncServer()
+{
+    shutdown();
+    wait();
+}
+
+//
+// @fn
+// run
+//
+// @brief
+// Build and start the async server
+//
+// @param[in] void
+// @return void
+//
+
+void
+PIAsyncServer::run()
+{
+    ServerBuilder builder;
+    builder.AddListeningPort(_serverAddr, grpc::InsecureServerCredentials());
+    builder.RegisterService(&_asyncService);
+    builder.SetMaxMessageSize(256 * 1024 * 1024);  // 256MB
+
+    _streamCq = builder.AddCompletionQueue();
+    for (int i = 0; i < _numCqs; i++) {
+        _cqs.push_back(builder.AddCompletionQueue());
+    }
+
+    _server = builder.BuildAndStart();
+    Log(DEBUG) << "PI async server listening on " << _serverAddr
+               << " cqs: " << _numCqs << " threads/cq: " << _threadsPerCq;
+
+    //
+    // Each thread keeps one call of every kind posted on its queue, so
+    // that concurrent RPCs do not wait for a new call to be posted.
+    //
+    for (int t = 0; t < _threadsPerCq; t++) {
+        PIStreamChannelCall::post(*this, _streamCq.get());
+        for (auto &cq : _cqs) {
+            postProgrammingCalls(*this, cq.get());
+        }
+    }
+
+    for (int t = 0; t < _threadsPerCq; t++) {
+        auto scq = _streamCq.get();
+        _threads.emplace_back([this, scq] { this->pollCq(scq); });
+        for (auto &cq : _cqs) {
+            auto pcq = cq.get();
+            _threads.emplace_back([this, pcq] { this->pollCq(pcq); });
+        }
+    }
+}
+
+void
+PIAsyncServer::pollCq(ServerCompletionQueue *cq)
+{
+    void *tag;
+    bool  ok;
+    while (cq->Next(&tag, &ok)) {
+        auto t = static_cast<PIAsyncCall::Tag *>(tag);
+        t->call->proceed(ok, t->event);
+    }
+}
+
+void
+PIAsyncServer::wait()
+{
+    for (auto &t : _threads) {
+        if (t.joinable()) {
+            t.join();
+        }
+    }
+}
+
+void
+PIAsyncServer::shutdown()
+{
+    if (_shutdown.exchange(true) || (_server == nullptr)) {
+        return;
+    }
+
+    _server->Shutdown();
+
+    //
+    // Queues are shut down after the server; the polling threads drain
+    // them and exit.
+    //
+    _streamCq->Shutdown();
+    for (auto &cq : _cqs) {
+        cq->Shutdown();
+    }
+}
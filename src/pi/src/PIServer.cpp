@@ -37,6 +37,14 @@
 void
 PIServer::piServer(void)
 {
+    if (_piCfg.async) {
+        _piAsyncServer = std::make_unique<PIAsyncServer>(
+            _piServerAddr, _piService, _piCfg.numCqs, _piCfg.threadsPerCq);
+        _piAsyncServer->run();
+        _piAsyncServer->wait();
+        return;
+    }
+
     PIGrpcServerRun();
     PIGrpcServerWait();
 }
@@ -71,6 +79,12 @@ PIServer::startDbgCLIServer()
     _cliService.startCLIService();
 }
 
+void
+PIServer::startMetricsServer()
+{
+    _metricsServer.startMetricsServer();
+}
+
 void
 PIServer::PIGrpcServerRun()
 {
@@ -0,0 +1,275 @@
+//
+// Juniper P4 Agent
+//
+/// @file  PacketInQueue.cpp
+/// @brief Bounded queue of PacketIns waiting for the stream writer
+//
+// Copyright (c) [2018] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+
+#include "PacketInQueue.h"
+
+namespace
+{
+struct PacketInQueueMetrics {
+    MetricCounter &droppedOldest{packetInCounter("dropped-oldest")};
+    MetricCounter &droppedNewest{packetInCounter("dropped-newest")};
+    MetricCounter &droppedLowPriority{packetInCounter("dropped-low-priority")};
+};
+
+PacketInQueueMetrics &
+metrics()
+{
+    static PacketInQueueMetrics m;
+    return m;
+}
+
+size_t
+roundUpPow2(size_t n)
+{
+    size_t size = 2;
+    while (size < n) {
+        size <<= 1;
+    }
+    return size;
+}
+}  // namespace
+
+//
+// @fn
+// packetInOverflowFromStr
+//
+// @brief
+// Parse a packet-in-overflow name
+//
+// @param[in]
+//     str drop-oldest, drop-newest or priority
+// @param[out]
+//     policy Overflow policy
+// @return false if str is not a policy
+//
+
+bool
+packetInOverflowFromStr(const std::string &str, PacketInOverflow &policy)
+{
+    if (str == "drop-oldest") {
+        policy = PacketInOverflow::DropOldest;
+    } else if (str == "drop-newest") {
+        policy = PacketInOverflow::DropNewest;
+    } else if (str == "priority") {
+        policy = PacketInOverflow::Priority;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+//
+// @fn
+// packetInCounter
+//
+// @brief
+// Counter of PacketIns by result
+//
+// @param[in]
+//     result What became of the PacketIns
+// @return Counter
+//
+
+MetricCounter &
+packetInCounter(const std::string &result)
+{
+    return Metrics::instance().counter(
+        "jp4_packet_in_total", "PacketIns punted to the controller by result",
+        "result=\"" + result + "\"");
+}
+
+PacketInQueue::PacketInQueue(const PacketInQueueConfig &cfg)
+    : _overflow(cfg.overflow),
+      _mask(roundUpPow2(cfg.size) - 1),
+      _cells(new Cell[_mask + 1])
+{
+    _lowLimit = (_mask + 1) - (_mask + 1) / 4;
+    for (size_t i = 0; i <= _mask; i++) {
+        _cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+    metrics();
+}
+
+//
+// @fn
+// tryPush
+//
+// @brief
+// Swap pkt into the next free cell
+//
+// @param[in]
+//     pkt PacketIn to queue
+// @param[in]
+//     times Punt timestamps of pkt
+// @return false if the queue is full
+//
+
+bool
+PacketInQueue::tryPush(p4::PacketIn &pkt, const PacketInTimes &times)
+{
+    size_t pos = _enqueuePos.load(std::memory_order_relaxed);
+    while (true) {
+        Cell &   cell = _cells[pos & _mask];
+        size_t   seq  = cell.seq.load(std::memory_order_acquire);
+        intptr_t diff = intptr_t(seq) - intptr_t(pos);
+        if (diff == 0) {
+            if (_enqueuePos.compare_exchange_weak(pos, pos + 1,
+                                                  std::memory_order_relaxed)) {
+                cell.pkt.Swap(&pkt);
+                cell.times = times;
+                cell.seq.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = _enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+//
+// @fn
+// push
+//
+// @brief
+// Queue a PacketIn, applying the overflow policy if the queue is full
+//
+// @param[in]
+//     pkt PacketIn to queue, left with stale contents
+// @param[in]
+//     priority PacketIn has a high priority punt reason
+// @param[in]
+//     times Punt timestamps of pkt
+// @return false if pkt was dropped
+//
+
+bool
+PacketInQueue::push(p4::PacketIn &pkt, bool priority,
+                    const PacketInTimes &times)
+{
+    PacketInQueueMetrics &m = metrics();
+
+    bool dropOldest = (_overflow == PacketInOverflow::DropOldest);
+    if (_overflow == PacketInOverflow::Priority) {
+        if (!priority && (size() >= _lowLimit)) {
+            m.droppedLowPriority.inc();
+            return false;
+        }
+        dropOldest = priority;
+    }
+
+    // Bounded, producers racing for the freed cells may win them
+    for (int attempt = 0; attempt < 4; attempt++) {
+        if (tryPush(pkt, times)) {
+            return true;
+        }
+        if (!dropOldest) {
+            break;
+        }
+        thread_local p4::PacketIn discarded;
+        if (pop(discarded)) {
+            m.droppedOldest.inc();
+        }
+    }
+
+    m.droppedNewest.inc();
+    return false;
+}
+
+//
+// @fn
+// pop
+//
+// @brief
+// Take the oldest PacketIn
+//
+// @param[out]
+//     pkt Oldest PacketIn, its previous contents are recycled
+// @param[out]
+//     times Punt timestamps of pkt
+// @return false if the queue is empty
+//
+
+bool
+PacketInQueue::pop(p4::PacketIn &pkt, PacketInTimes &times)
+{
+    size_t pos = _dequeuePos.load(std::memory_order_relaxed);
+    while (true) {
+        Cell &   cell = _cells[pos & _mask];
+        size_t   seq  = cell.seq.load(std::memory_order_acquire);
+        intptr_t diff = intptr_t(seq) - intptr_t(pos + 1);
+        if (diff == 0) {
+            if (_dequeuePos.compare_exchange_weak(pos, pos + 1,
+                                                  std::memory_order_relaxed)) {
+                cell.pkt.Swap(&pkt);
+                times = cell.times;
+                cell.seq.store(pos + _mask + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = _dequeuePos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+//
+// @fn
+// clear
+//
+// @brief
+// Drop the queued PacketIns. Bounded by the queue size, so producers
+// queueing meanwhile cannot keep it going.
+//
+// @return Number of PacketIns dropped
+//
+
+size_t
+PacketInQueue::clear()
+{
+    thread_local p4::PacketIn discarded;
+    size_t                    count = 0;
+    while ((count <= _mask) && pop(discarded)) {
+        count++;
+    }
+    return count;
+}
+
+//
+// @fn
+// size
+//
+// @brief
+// PacketIns queued, approximate while producers or the writer run
+//
+// @return Queue depth
+//
+
+size_t
+PacketInQueue::size() const
+{
+    size_t tail = _dequeuePos.load(std::memory_order_acquire);
+    size_t head = _enqueuePos.load(std::memory_order_acquire);
+    return (head > tail) ? head - tail : 0;
+}
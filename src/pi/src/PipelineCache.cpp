@@ -0,0 +1,234 @@
+//
+// Juniper P4 Agent
+//
+/// @file  PipelineCache.cpp
+/// @brief Local cache of the committed forwarding pipeline config
+//
+// Copyright (c) [2018] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include "pvtPI.h"
+
+constexpr uint32_t PipelineCache::kMagic;
+constexpr uint32_t PipelineCache::kVersion;
+constexpr uint64_t PipelineCache::kMaxLength;
+
+namespace
+{
+constexpr uint64_t kFnvOffsetBasis = 0xcbf29ce484222325ULL;
+constexpr uint64_t kFnvPrime       = 0x100000001b3ULL;
+
+uint64_t
+fnv1a(const std::string &data, uint64_t hash)
+{
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= kFnvPrime;
+    }
+    return hash;
+}
+
+bool
+writeAll(int fd, const char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = ::write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+//
+// Flush the directory holding path so that a rename into it is durable
+//
+bool
+syncParentDir(const std::string &path)
+{
+    size_t      slash = path.find_last_of('/');
+    std::string dir   = (slash == std::string::npos) ? "."
+                        : (slash == 0)               ? "/"
+                                                     : path.substr(0, slash);
+
+    int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok  = (::fsync(fd) == 0);
+    int  err = errno;
+    ::close(fd);
+    errno = err;
+    return ok;
+}
+}  // namespace
+
+//
+// @fn
+// fingerprint
+//
+// @brief
+// Fingerprint of a pipeline config
+//
+// @param[in]
+//     config Pipeline config
+// @return FNV-1a hash of the p4info encoding and the device config
+//
+
+uint64_t
+PipelineCache::fingerprint(const p4::ForwardingPipelineConfig &config)
+{
+    uint64_t hash = fnv1a(config.p4info().SerializeAsString(),
+                          kFnvOffsetBasis);
+    return fnv1a(config.p4_device_config(), hash);
+}
+
+//
+// @fn
+// store
+//
+// @brief
+// Write config to the cache file. The file is written aside, flushed to
+// disk and renamed into place, and the rename is flushed in turn, so that
+// a crash never leaves a partial cache behind.
+//
+// @param[in]
+//     config Committed pipeline config
+// @param[in]
+//     fingerprint Fingerprint of config
+// @return true on success
+//
+
+bool
+PipelineCache::store(const p4::ForwardingPipelineConfig &config,
+                     uint64_t                            fingerprint) const
+{
+    if (!enabled()) {
+        return false;
+    }
+
+    std::string data;
+    if (!config.SerializeToString(&data)) {
+        Log(ERROR) << "Unable to encode pipeline config for " << _path;
+        return false;
+    }
+
+    Header hdr{kMagic, kVersion, fingerprint, data.size()};
+
+    std::string tmpPath = _path + ".tmp";
+    int         fd      = ::open(tmpPath.c_str(),
+                      O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        Log(ERROR) << "Unable to open pipeline cache " << tmpPath << ": "
+                   << std::strerror(errno);
+        return false;
+    }
+
+    bool ok = writeAll(fd, reinterpret_cast<const char *>(&hdr),
+                       sizeof(hdr)) &&
+              writeAll(fd, data.data(), data.size()) && (::fsync(fd) == 0);
+    int err = errno;
+    if ((::close(fd) != 0) && ok) {
+        ok  = false;
+        err = errno;
+    }
+    if (!ok) {
+        Log(ERROR) << "Unable to write pipeline cache " << tmpPath << ": "
+                   << std::strerror(err);
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+
+    if (std::rename(tmpPath.c_str(), _path.c_str()) != 0) {
+        Log(ERROR) << "Unable to rename " << tmpPath << " to " << _path;
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+
+    if (!syncParentDir(_path)) {
+        // The cache is in place but may not survive a power loss
+        Log(WARNING) << "Unable to flush the directory of " << _path << ": "
+                     << std::strerror(errno);
+    }
+
+    Log(DEBUG) << "Pipeline cache " << _path << " written, fingerprint "
+               << std::hex << fingerprint << std::dec;
+    return true;
+}
+
+//
+// @fn
+// load
+//
+// @brief
+// Read the config from the cache file. The fingerprint recorded in the
+// file is checked against the config read.
+//
+// @param[out]
+//     config Cached pipeline config
+// @param[out]
+//     fingerprint Fingerprint of config
+// @return true if a valid cache was read
+//
+
+bool
+PipelineCache::load(p4::ForwardingPipelineConfig &config,
+                    uint64_t &                    fingerprint) const
+{
+    if (!enabled()) {
+        return false;
+    }
+
+    std::ifstream in(_path, std::ios::binary);
+    if (!in) {
+        Log(DEBUG) << "No pipeline cache " << _path;
+        return false;
+    }
+
+    Header hdr;
+    if (!in.read(reinterpret_cast<char *>(&hdr), sizeof(hdr)) ||
+        (hdr.magic != kMagic) || (hdr.version != kVersion) ||
+        (hdr.length > kMaxLength)) {
+        Log(ERROR) << "Pipeline cache " << _path << " has a bad header";
+        return false;
+    }
+
+    std::string data(hdr.length, '\0');
+    if (!in.read(&data[0], data.size()) || !config.ParseFromString(data)) {
+        Log(ERROR) << "Pipeline cache " << _path << " is truncated";
+        return false;
+    }
+
+    fingerprint = PipelineCache::fingerprint(config);
+    if (fingerprint != hdr.fingerprint) {
+        Log(ERROR) << "Pipeline cache " << _path << " fingerprint mismatch";
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,293 @@
+//
+// Juniper P4 Agent
+//
+/// @file  PuntPolicer.cpp
+/// @brief Token bucket policer of hostpath punts
+//
+// Copyright (c) [2018] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+
+#include "PuntPolicer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <sstream>
+
+constexpr size_t PuntPolicer::kStripes;
+
+namespace
+{
+std::string
+anyOr(int32_t value)
+{
+    return (value < 0) ? std::string("any") : std::to_string(value);
+}
+}  // namespace
+
+//
+// @fn
+// instance
+//
+// @brief
+// The punt policer shared by hostpath and CLI
+//
+// @return Policer
+//
+
+PuntPolicer &
+PuntPolicer::instance()
+{
+    static PuntPolicer policer;
+    return policer;
+}
+
+//
+// @fn
+// configure
+//
+// @brief
+// Replace all rules. Buckets restart full.
+//
+// @param[in]
+//     rules Policer rules
+// @return void
+//
+
+void
+PuntPolicer::configure(const std::vector<PuntPolicerRule> &rules)
+{
+    {
+        std::lock_guard<std::mutex> guard(_rulesMtx);
+        _rules.clear();
+    }
+    for (const auto &rule : rules) {
+        setRule(rule);
+    }
+    rulesChanged();
+}
+
+//
+// @fn
+// setRule
+//
+// @brief
+// Add a rule, replacing the one of the same reason and port
+//
+// @param[in]
+//     rule Policer rule
+// @return void
+//
+
+void
+PuntPolicer::setRule(const PuntPolicerRule &rule)
+{
+    PuntPolicerRule r = rule;
+    r.burst           = std::max(r.burst, 1.0);
+    {
+        std::lock_guard<std::mutex> guard(_rulesMtx);
+        auto it = std::find_if(_rules.begin(), _rules.end(),
+                               [&r](const PuntPolicerRule &e) {
+                                   return (e.reason == r.reason) &&
+                                          (e.port == r.port);
+                               });
+        if (it != _rules.end()) {
+            *it = r;
+        } else {
+            _rules.push_back(r);
+        }
+    }
+    rulesChanged();
+}
+
+//
+// @fn
+// clearRule
+//
+// @brief
+// Remove the rule of reason and port
+//
+// @param[in]
+//     reason Punt reason, -1 for any
+// @param[in]
+//     port Ingress port, -1 for any
+// @return false if there is no such rule
+//
+
+bool
+PuntPolicer::clearRule(int32_t reason, int32_t port)
+{
+    {
+        std::lock_guard<std::mutex> guard(_rulesMtx);
+        auto it = std::find_if(_rules.begin(), _rules.end(),
+                               [=](const PuntPolicerRule &e) {
+                                   return (e.reason == reason) &&
+                                          (e.port == port);
+                               });
+        if (it == _rules.end()) {
+            return false;
+        }
+        _rules.erase(it);
+    }
+    rulesChanged();
+    return true;
+}
+
+//
+// @fn
+// rulesChanged
+//
+// @brief
+// Make buckets pick up the rules again
+//
+
+void
+PuntPolicer::rulesChanged()
+{
+    std::lock_guard<std::mutex> guard(_rulesMtx);
+    _enabled.store(!_rules.empty());
+    _generation.fetch_add(1);
+}
+
+//
+// @fn
+// match
+//
+// @brief
+// Most specific rule of a (reason, port): exact, then reason, then port,
+// then the default rule. Called with _rulesMtx held.
+//
+// @param[in]
+//     reason Punt reason
+// @param[in]
+//     port Ingress port
+// @return Rule, nullptr if none matches
+//
+
+const PuntPolicerRule *
+PuntPolicer::match(uint16_t reason, uint16_t port) const
+{
+    const PuntPolicerRule *best      = nullptr;
+    int                    bestScore = -1;
+    for (const auto &rule : _rules) {
+        if (((rule.reason >= 0) && (rule.reason != reason)) ||
+            ((rule.port >= 0) && (rule.port != port))) {
+            continue;
+        }
+        int score = ((rule.reason >= 0) ? 2 : 0) + ((rule.port >= 0) ? 1 : 0);
+        if (score > bestScore) {
+            best      = &rule;
+            bestScore = score;
+        }
+    }
+    return best;
+}
+
+//
+// @fn
+// admit
+//
+// @brief
+// Refill the bucket of (reason, port) and take a token from it
+//
+// @param[in]
+//     reason Punt reason
+// @param[in]
+//     port Ingress port
+// @return false if the packet is to be dropped
+//
+
+bool
+PuntPolicer::admit(uint16_t reason, uint16_t port)
+{
+    if (!_enabled.load(std::memory_order_relaxed)) {
+        return true;
+    }
+
+    uint64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now().time_since_epoch())
+                       .count();
+    uint32_t key        = (uint32_t(reason) << 16) | port;
+    uint64_t generation = _generation.load(std::memory_order_acquire);
+    Stripe & stripe     = _stripes[(key ^ (key >> 16)) % kStripes];
+
+    std::lock_guard<std::mutex> guard(stripe.mtx);
+    Bucket &                    b = stripe.buckets[key];
+    if (b.generation != generation) {
+        std::lock_guard<std::mutex> rulesGuard(_rulesMtx);
+        const PuntPolicerRule *     rule = match(reason, port);
+        b.generation                     = generation;
+        b.policed                        = (rule != nullptr);
+        b.rate                           = rule ? rule->rate : 0;
+        b.burst                          = rule ? rule->burst : 0;
+        b.tokens                         = b.burst;
+        b.lastNs                         = now;
+    }
+
+    if (!b.policed) {
+        b.passed++;
+        return true;
+    }
+
+    b.tokens = std::min(b.burst, b.tokens + (now - b.lastNs) * b.rate / 1e9);
+    b.lastNs = now;
+    if (b.tokens < 1.0) {
+        b.dropped++;
+        return false;
+    }
+    b.tokens -= 1.0;
+    b.passed++;
+    return true;
+}
+
+//
+// @fn
+// show
+//
+// @brief
+// Describe rules and buckets for the CLI
+//
+// @return Text, one rule or bucket per line
+//
+
+std::string
+PuntPolicer::show() const
+{
+    std::ostringstream os;
+    {
+        std::lock_guard<std::mutex> guard(_rulesMtx);
+        os << "Rules:\n";
+        for (const auto &rule : _rules) {
+            os << "  reason " << anyOr(rule.reason) << " port "
+               << anyOr(rule.port) << " rate " << rule.rate << " pps burst "
+               << rule.burst << "\n";
+        }
+    }
+
+    std::map<uint32_t, Bucket> buckets;
+    for (const auto &stripe : _stripes) {
+        std::lock_guard<std::mutex> guard(stripe.mtx);
+        buckets.insert(stripe.buckets.begin(), stripe.buckets.end());
+    }
+    os << "Buckets:\n";
+    for (const auto &kv : buckets) {
+        const Bucket &b = kv.second;
+        os << "  reason " << (kv.first >> 16) << " port " << (kv.first & 0xffff)
+           << (b.policed ? "" : " not policed") << " passed " << b.passed
+           << " dropped " << b.dropped << "\n";
+    }
+    return os.str();
+}
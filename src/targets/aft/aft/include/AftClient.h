@@ -26,6 +26,7 @@
 
 #include <string>
 #include "Aft.h"
+#include "AfiMetrics.h"
 #include "Log.h"
 #include "Utils.h"
 #include "jnx/AfiTransport.h"
@@ -105,6 +106,13 @@ class AftClient
     AftNodeToken outputPortToken(AftIndex portIndex);
     AftNodeToken puntPortToken(void);
 
+    //
+    // Batch mode: while a batch is open all nodes and entries are pushed
+    // into one insert context which is sent to the sandbox on commit.
+    //
+    void beginBatch();
+    int  commitBatch();
+
  protected:
     AftClient() {}
     //
@@ -119,6 +127,7 @@ class AftClient
     const std::string _sandbox_name = "jp4agent";  //< Sandbox name
     AftSandboxPtr     _sandbox;
     AftTransportPtr   _transport;
+    AftInsertPtr      _batchInsert;  //< Open batch insert context, if any
 
     bool _tracing;  //< True if debug tracing is enabled
 
@@ -148,14 +157,38 @@ class AftClient
     //
     int openSandbox();
 
-    void sendboxSend(AftInsertPtr insert)
+    //
+    // Insert context for the next operation: the open batch, if any.
+    //
+    AftInsertPtr allocInsert()
+    {
+        if (_batchInsert != nullptr) {
+            return _batchInsert;
+        }
+        return AftInsert::create(_sandbox);
+    }
+
+    //
+    // Send an insert context to the sandbox. Returns false if the sandbox
+    // did not take it.
+    //
+    bool sendboxSend(AftInsertPtr insert)
     {
+        if (insert == _batchInsert) {
+            //
+            // Sent as a whole by commitBatch()
+            //
+            return true;
+        }
         if (_aft_debugmode.find("no-aft-server") != std::string::npos) {
             Log(DEBUG) << "_aft_debugmode: " << _aft_debugmode
                        << " Not calling _sandbox->send()";
-            return;
+            return true;
         }
-        _sandbox->send(insert);
+        static MetricHistogram &latency =
+            AFIHAL::targetCallLatency("aft", "sandboxSend");
+        MetricTimer timer(latency);
+        return _sandbox->send(insert);
     }
 };
 
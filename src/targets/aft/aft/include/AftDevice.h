@@ -51,6 +51,9 @@ class AftDevice final : public AFIHAL::AfiDevice
     void                 destroy();
 
     void setObjectCreators();
+
+    bool beginBatch() override;
+    bool commitBatch() override;
 };
 
 }  // namespace AFTHALP
@@ -139,11 +139,42 @@ class AftObjectTemplate : public AftObject, public AfiObjType
         //
         // Let the caller know whether it worked or not
         //
-        std::cout << "AftObjectTemplate: bind" << std::endl;
+        Log(DEBUG) << "AftObjectTemplate: bind";
+        static MetricHistogram &latency = AFIHAL::targetBindLatency(
+            "aft", this->AFIHAL::AfiObject::type());
+        MetricTimer timer(latency);
         _bind();
         return true;
     }
 
+    ///
+    /// @brief  Default update function: no in-place update, the caller
+    ///         unbinds the old object and binds this one.
+    ///         Derived classes can have specific implementation.
+    ///
+    /// @param [in] oldObj  Bound object of the same name
+    ///
+    /// @return true, if the hardware state was updated in place
+    ///
+    virtual bool _update(const AFIHAL::AfiObjectPtr &oldObj)
+    {
+        return false;
+    }
+
+    ///
+    /// @brief  Update function which moves the hardware state of oldObj
+    ///         to this object
+    ///
+    /// @param [in] oldObj  Bound object of the same name
+    ///
+    /// @return true, on successful in-place update
+    ///
+    virtual bool update(const AFIHAL::AfiObjectPtr &oldObj) override
+    {
+        Log(DEBUG) << "AftObjectTemplate: update";
+        return _update(oldObj);
+    }
+
     ///
     /// Destroy routine to uninstall JNH handle
     ///
@@ -152,7 +183,7 @@ class AftObjectTemplate : public AftObject, public AfiObjType
         //
         // Release any hardware memory
         //
-        std::cout << "AftObjectTemplate: destroy" << std::endl;
+        Log(DEBUG) << "AftObjectTemplate: destroy";
         this->unbind();
     }
 
@@ -164,7 +195,7 @@ class AftObjectTemplate : public AftObject, public AfiObjType
         //
         // Free the counter in the hardware
         //
-        std::cout << "AftObjectTemplate: unbind" << std::endl;
+        Log(DEBUG) << "AftObjectTemplate: unbind";
         return true;
     }
 
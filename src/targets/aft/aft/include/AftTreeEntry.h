@@ -50,6 +50,16 @@ class AftTreeEntry
     ///
     void _bind() override;
 
+    ///
+    /// @brief  Repoint the route of oldObj to this entry's target. The
+    ///         route itself is left in place.
+    ///
+    /// @param [in] oldObj Bound tree entry of the same name
+    ///
+    /// @return false if the prefix differs
+    ///
+    bool _update(const AFIHAL::AfiObjectPtr &oldObj) override;
+
     //
     // Debug
     //
@@ -210,7 +210,7 @@ AftClient::puntPortToken(void)
 int
 AftClient::setInputPortNextNode(AftIndex inputPortIndex, AftNodeToken nextToken)
 {
-    AftInsertPtr insert = AftInsert::create(_sandbox);
+    AftInsertPtr insert = allocInsert();
 
     AftNodePtr inputPort =
         _sandbox->setInputPortByIndex(inputPortIndex, nextToken);
@@ -289,7 +289,7 @@ AftClient::addTable(const std::string &tableName, const std::string &fieldName,
     //
     // Allocate an insert context
     //
-    insert = AftInsert::create(_sandbox);
+    insert = allocInsert();
 
     //
     // Create a route lookup tree
@@ -343,7 +343,7 @@ AftClient::addRouteTable(const std::string &rttName,
     //
     // Allocate an insert context
     //
-    insert = AftInsert::create(_sandbox);
+    insert = allocInsert();
 
     //
     // Create a route lookup tree
@@ -388,7 +388,7 @@ AftClient::addRoute(AftNodeToken rttNodeToken, const char *prefix_bytes,
     //
     // Allocate an insert context
     //
-    insert = AftInsert::create(_sandbox);
+    insert = allocInsert();
 
     std::cout << "Adding route ---> Node token " << routeTargetToken
               << std::endl;
@@ -453,7 +453,7 @@ AftClient::addRoute(AftNodeToken rttNodeToken, const std::string &prefix,
     //
     // Allocate an insert context
     //
-    insert = AftInsert::create(_sandbox);
+    insert = allocInsert();
 
     std::cout << "Adding route ";
     std::cout << prefix << " ---> Node token " << routeTargetToken << std::endl;
@@ -502,7 +502,7 @@ AftClient::createList(AftTokenVector tokVec)
     //
     // Allocate an insert context
     //
-    insert = AftInsert::create(_sandbox);
+    insert = allocInsert();
 
     //
     // Build a list of provided tokens
@@ -515,7 +515,7 @@ AftClient::createList(AftTokenVector tokVec)
     //
     // Send all the nodes to the sandbox
     //
-    _sandbox->send(insert);
+    sendboxSend(insert);
 
     return list->nodeToken();
 }
@@ -562,7 +562,7 @@ AftClient::addReceiveNode(uint32_t receiveCode, uint64_t context)
     //
     // Allocate an insert context
     //
-    AftInsertPtr insert = AftInsert::create(_sandbox);
+    AftInsertPtr insert = allocInsert();
 
     //
     // Create aft encap node
@@ -578,7 +578,7 @@ AftClient::addReceiveNode(uint32_t receiveCode, uint64_t context)
     //
     // Send all the nodes to the sandbox
     //
-    _sandbox->send(insert);
+    sendboxSend(insert);
 
     return nhReceiveToken;
 }
@@ -610,7 +610,7 @@ AftClient::addEtherEncapNode(const std::string &dst_mac,
     //
     // Allocate an insert context
     //
-    AftInsertPtr insert = AftInsert::create(_sandbox);
+    AftInsertPtr insert = allocInsert();
     //
     // Create a key vector of ethernet data
     //
@@ -634,9 +634,61 @@ AftClient::addEtherEncapNode(const std::string &dst_mac,
     //
     // Send all the nodes to the sandbox
     //
-    _sandbox->send(insert);
+    sendboxSend(insert);
 
     return nhEncapToken;
 }
 
+//
+// @fn
+// beginBatch
+//
+// @brief
+// Open a batch. Nodes and entries added until commitBatch() share one
+// insert context, so tokens handed out inside the batch can be referenced
+// by later nodes of the same batch.
+//
+// @param[in] void
+// @return void
+//
+
+void
+AftClient::beginBatch()
+{
+    if (_batchInsert != nullptr) {
+        Log(ERROR) << "AftClient: batch already open";
+        return;
+    }
+    _batchInsert = AftInsert::create(_sandbox);
+}
+
+//
+// @fn
+// commitBatch
+//
+// @brief
+// Send all nodes of the open batch to the sandbox in one go
+//
+// @param[in] void
+// @return 0 - Success, -1 - Error
+//
+
+int
+AftClient::commitBatch()
+{
+    if (_batchInsert == nullptr) {
+        Log(ERROR) << "AftClient: no batch open";
+        return -1;
+    }
+
+    AftInsertPtr insert = _batchInsert;
+    _batchInsert        = nullptr;
+    if (!sendboxSend(insert)) {
+        Log(ERROR) << "AftClient: sandbox send of batch failed";
+        return -1;
+    }
+
+    return 0;
+}
+
 //}  // namespace AFTHALP
@@ -34,6 +34,22 @@ AftDevice::setObjectCreators()
     setObjectCreator("afi-tree-entry", &AftTreeEntry::create);
 }
 
+//
+// All objects of a change set go to the sandbox in one insert
+//
+bool
+AftDevice::beginBatch()
+{
+    AftClient::instance().beginBatch();
+    return true;
+}
+
+bool
+AftDevice::commitBatch()
+{
+    return (AftClient::instance().commitBatch() == 0);
+}
+
 //
 // Factory creation method, constructors and destructors
 //
@@ -29,15 +29,13 @@ namespace AFTHALP
 void
 AftTree::_bind()
 {
-    std::cout << "AftTree: _bind" << std::endl;
+    Log(DEBUG) << "AftTree: _bind";
     Log(DEBUG) << "Pushing AftTree to ASIC";
 
     ::ywrapper::StringValue key_field = _tree.key_field();
     Log(DEBUG) << "key_field: " << key_field.value();
 
-    std::stringstream ks;
-    ks << key_field.value();
-    JaegerLog::getInstance()->Log("Aft:AftTree:Key Field", ks.str());
+    JaegerLog::getInstance()->log("Aft:AftTree:Key Field", key_field.value());
 
     AftNodeToken puntToken = AftClient::instance().puntPortToken();
     setDefaultTargetToken(puntToken);
@@ -31,7 +31,8 @@ namespace AFTHALP
 void
 AftTreeEntry::_bind()
 {
-    std::cout << "AftTreeEntry: _bind" << std::endl;
+    JaegerSpan span("Aft TreeEntry bind");
+    Log(DEBUG) << "AftTreeEntry: _bind";
     Log(DEBUG) << "Pushing AftTreeEntry to ASIC";
 
     Log(DEBUG) << "tree.ByteSize(): " << _treeEntry.ByteSize();
@@ -58,25 +59,18 @@ AftTreeEntry::_bind()
     AftTreePtr aftTreePtr = std::dynamic_pointer_cast<AftTree>(
         AFIHAL::Afi::instance().getAfiObject(parent_name.value()));
 
-    std::stringstream es;
-    es << entry_name.value();
-    JaegerLog::getInstance()->Log("AFT:AFTTreeEntry:Name", es.str());
-
-    std::stringstream ps;
-    ps << parent_name.value();
-    JaegerLog::getInstance()->Log("AFT:AFTTreeEntry:Parent Name", ps.str());
-
-    std::stringstream as;
-    as << target_afi_object.value();
-    JaegerLog::getInstance()->Log("AFT:AFTTreeEntry:Target AFI Object", as.str());
-    JaegerLog::getInstance()->finishSpan();
+    JaegerLog::getInstance()->log("AFT:AFTTreeEntry:Name", entry_name.value());
+    JaegerLog::getInstance()->log("AFT:AFTTreeEntry:Parent Name",
+                                  parent_name.value());
+    JaegerLog::getInstance()->log("AFT:AFTTreeEntry:Target AFI Object",
+                                  target_afi_object.value());
 
     if (aftTreePtr == nullptr) {
         Log(ERROR) << "Could not find parent AfiTree";
         return;
     }
 
-    std::cout << "aftTree :" << aftTreePtr << "\n";
+    Log(DEBUG) << "aftTree :" << aftTreePtr;
     AftNodeToken aftTreeToken = aftTreePtr->token();
 
     Log(DEBUG) << "aftTreePtr->token() :" << aftTreeToken;
@@ -92,10 +86,6 @@ AftTreeEntry::_bind()
     // jP4Agent->afiClient().addRoute(aftTreeToken, "1.1.1.1/10",
     // etherEncapToken);
     Log(DEBUG) << "Adding route...";
-    for (unsigned int i = 0; i < prefix_length.value(); i++) {
-        std::cout << int(prefix_bytes_str[i]) << ".";
-    }
-    std::cout << "\n";
     Log(DEBUG) << "prefix_bytes_str.c_str():" << prefix_bytes_str.c_str();
     Log(DEBUG) << "prefix_bytes_str.size() :" << prefix_bytes_str.size();
     Log(DEBUG) << "prefix_length.value()   :" << prefix_length.value();
@@ -107,6 +97,63 @@ AftTreeEntry::_bind()
                                    etherEncapToken);
 }
 
+bool
+AftTreeEntry::_update(const AFIHAL::AfiObjectPtr &oldObj)
+{
+    JaegerSpan span("Aft TreeEntry update");
+    Log(DEBUG) << "AftTreeEntry: _update";
+
+    AftTreeEntryPtr oldEntry = std::dynamic_pointer_cast<AftTreeEntry>(oldObj);
+    if (oldEntry == nullptr) {
+        return false;
+    }
+
+    std::string prefix_bytes_str = _treeEntry.prefix_bytes().value();
+    if ((prefix_bytes_str != oldEntry->_treeEntry.prefix_bytes().value()) ||
+        (_treeEntry.prefix_length().value() !=
+         oldEntry->_treeEntry.prefix_length().value())) {
+        Log(DEBUG) << "Prefix changed, no in-place update";
+        return false;
+    }
+
+    ::ywrapper::StringValue target_afi_object = _treeEntry.target_afi_object();
+    if (target_afi_object.value() ==
+        oldEntry->_treeEntry.target_afi_object().value()) {
+        //
+        // Same target, nothing to reprogram
+        //
+        return true;
+    }
+
+    AftTreePtr aftTreePtr = std::dynamic_pointer_cast<AftTree>(
+        AFIHAL::Afi::instance().getAfiObject(_treeEntry.parent_name().value()));
+    if (aftTreePtr == nullptr) {
+        Log(ERROR) << "Could not find parent AfiTree";
+        return false;
+    }
+
+    JaegerLog::getInstance()->log("AFT:AFTTreeEntry:Update Target",
+                                  target_afi_object.value());
+
+    uint16_t     portId = 1;  // TBD: FIXME
+    AftNodeToken outputPortToken =
+        AftClient::instance().outputPortToken(portId);
+
+    AftNodeToken etherEncapToken = AftClient::instance().addEtherEncapNode(
+        "32:26:0a:2e:ff:f1", "5e:d8:f9:32:bd:85", outputPortToken);
+
+    //
+    // Re-adding the route entry with the same prefix replaces its target
+    //
+    Log(DEBUG) << "Updating route target, etherEncapToken: "
+               << etherEncapToken;
+    AftClient::instance().addRoute(aftTreePtr->token(),
+                                   prefix_bytes_str.c_str(),
+                                   prefix_bytes_str.size(), 32,
+                                   etherEncapToken);
+    return true;
+}
+
 //
 // Description
 //
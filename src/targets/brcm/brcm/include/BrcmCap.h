@@ -39,7 +39,7 @@ public:
     /// 
     /// @brief  Create the hardware state
     /// 
-    void _bind() override;
+    bool _bind() override;
     
     //
     // @brief  Debug
@@ -63,7 +63,7 @@ public:
     /// 
     /// @brief  Create the hardware state
     /// 
-    void _bind() { }
+    bool _bind() { return true; }
     
     //
     // @brief  Debug
@@ -90,7 +90,7 @@ public:
     /// 
     /// @brief  Create the hardware state
     /// 
-    void _bind() { } 
+    bool _bind() { return true; } 
     
     //
     // @brief  Debug
@@ -39,7 +39,12 @@ public:
     /// 
     /// @brief  Create the hardware state
     /// 
-    void _bind() override;
+    bool _bind() override;
+
+    /// 
+    /// @brief  Replace the rule of oldObj by one with the new action
+    /// 
+    bool _update(const AFIHAL::AfiObjectPtr &oldObj) override;
     
     //
     // @brief  Debug
@@ -65,7 +70,7 @@ public:
     /// 
     /// @brief  Create the hardware state
     /// 
-    void _bind() { }
+    bool _bind() { return true; }
     
     //
     // @brief  Debug
@@ -92,7 +97,7 @@ public:
     /// 
     /// @brief  Create the hardware state
     /// 
-    void _bind() { }
+    bool _bind() { return true; }
     
     //
     // @brief  Debug
@@ -109,9 +109,11 @@ public:
     /// @brief  Default bind function for Brcm objects.
     ///         Derived classes can have specific implementation.
     ///
-    virtual void _bind()
+    /// @return false if the hardware state could not be created
+    ///
+    virtual bool _bind()
     {
-         //return Brcmptr;
+        return true;
     }
 
 
@@ -123,9 +125,30 @@ public:
         //
         // Let the caller know whether it worked or not
         //
-        std::cout << "BrcmObjectTemplate: bind" << std::endl;
-        _bind();
-        return true;
+        Log(DEBUG) << "BrcmObjectTemplate: bind";
+        static MetricHistogram &latency = AFIHAL::targetBindLatency(
+            "brcm", this->AFIHAL::AfiObject::type());
+        MetricTimer timer(latency);
+        return _bind();
+    }
+
+    ///
+    /// @brief  Default update function for Brcm objects: no in-place
+    ///         update. Derived classes can have specific implementation.
+    ///
+    virtual bool _update(const AFIHAL::AfiObjectPtr &oldObj)
+    {
+        return false;
+    }
+
+    ///
+    /// @brief  Update function which moves the hardware state of oldObj
+    ///         to this object
+    ///
+    virtual bool update(const AFIHAL::AfiObjectPtr &oldObj) override
+    {
+        Log(DEBUG) << "BrcmObjectTemplate: update";
+        return _update(oldObj);
     }
 
     ///
@@ -136,7 +159,7 @@ public:
         //
         // Release any hardware memory
         //
-        std::cout << "BrcmObjectTemplate: destroy" << std::endl;
+        Log(DEBUG) << "BrcmObjectTemplate: destroy";
         this->unbind();
     }
 
@@ -148,7 +171,7 @@ public:
         //
         // Free the state in the hardware
         //
-        std::cout << "BrcmObjectTemplate: unbind" << std::endl;
+        Log(DEBUG) << "BrcmObjectTemplate: unbind";
         return true;
     }
 
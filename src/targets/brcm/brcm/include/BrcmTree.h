@@ -39,7 +39,7 @@ public:
     /// 
     /// @brief  Create the hardware state
     /// 
-    void _bind() override;
+    bool _bind() override;
     
     //
     // @brief  Debug
@@ -39,7 +39,12 @@ public:
     /// 
     /// @brief  Create the hardware state
     /// 
-    void _bind() override;
+    bool _bind() override;
+
+    /// 
+    /// @brief  Move the route of oldObj to this entry's next hop
+    /// 
+    bool _update(const AFIHAL::AfiObjectPtr &oldObj) override;
     
     //
     // @brief  Debug
@@ -28,11 +28,11 @@
 
 namespace BRCMHALP {
 
-void BrcmCap::_bind()
+bool BrcmCap::_bind()
 {
     std::vector<Fp::MatchKey> key;
 
-    std::cout << "BrcmCap: _bind" << std::endl;
+    Log(DEBUG) << "BrcmCap: _bind";
     Log(DEBUG)<< "Pushing BrcmCap to ASIC";
 
     ::ywrapper::UintValue gid = _cap.group_id();
@@ -47,7 +47,7 @@ void BrcmCap::_bind()
 
     if (cmo == nullptr) {
         Log(ERROR) << ": Unable to find afi-cap-match object " << mo.value();
-        return;
+        return false;
     }
 
     ::ywrapper::BoolValue et = cmo->capMatch.ethertype();
@@ -70,7 +70,7 @@ void BrcmCap::_bind()
         AFIHAL::Afi::instance().getAfiObject(ao.value()));
     if (cao == nullptr) {
         Log(ERROR) << ": Unable to find afi-cap-action object " << ao.value();
-        return;
+        return false;
     }
 
     ::ywrapper::BoolValue vrf = cao->capAction.vrf();
@@ -83,15 +83,15 @@ void BrcmCap::_bind()
     ::ywrapper::StringValue key_field = _filter.key_field();
     Log(DEBUG) << "key_field: " << key_field.value();
 
-    std::stringstream ks;
-    ks  << key_field.value();
-    JaegerLog::getInstance()->Log("Brcm:BrcmFilter:Key Field", ks.str());
+    JaegerLog::getInstance()->log("Brcm:BrcmFilter:Key Field",
+                                  key_field.value());
 
     // Write into file for Brcm test
     gtestFile.open("../BrcmTest.txt", std::fstream::app);
     gtestFile << "key_field: " << key_field.value() << "\n";
     gtestFile.close();
 #endif // SUD
+    return true;
 }
 
 //  
@@ -27,9 +27,9 @@
 
 namespace BRCMHALP {
 
-void BrcmCapEntry::_bind()
+bool BrcmCapEntry::_bind()
 {
-    std::cout << "BrcmCapEntry: _bind" << std::endl;
+    Log(DEBUG) << "BrcmCapEntry: _bind";
     Log(DEBUG)<< "Pushing BrcmCapEntry to ASIC";
 
     ::ywrapper::StringValue po = _capEntry.parent_name();
@@ -37,7 +37,7 @@ void BrcmCapEntry::_bind()
         AFIHAL::Afi::instance().getAfiObject(po.value()));
     if (co == nullptr) {
         Log(ERROR) << ": Unable to find afi-cap object " << po.value();
-        return;
+        return false;
     }
 
     ::ywrapper::StringValue mo = _capEntry.match_object();
@@ -46,7 +46,7 @@ void BrcmCapEntry::_bind()
     if (cemo == nullptr) {
         Log(ERROR) << ": Unable to find afi-cap-entry-match object "
                    << mo.value();
-        return;
+        return false;
     }
 
     ::ywrapper::StringValue ao = _capEntry.action_object();
@@ -55,12 +55,16 @@ void BrcmCapEntry::_bind()
     if (ceao == nullptr) {
         Log(ERROR) << ": Unable to find afi-cap-entry-action object "
                    << ao.value();
-        return;
+        return false;
     }
 
     ::ywrapper::UintValue gid = co->gid();
     Log(DEBUG) << "group_id: " << gid.value();
     _fpe = Fp::createRule(gid.value());
+    if (_fpe == nullptr) {
+        Log(ERROR) << ": Unable to create rule in field group " << gid.value();
+        return false;
+    }
 
     ::ywrapper::UintValue gp = co->gp();
     Log(DEBUG) << "group_priority: " << gp.value();
@@ -116,15 +120,37 @@ void BrcmCapEntry::_bind()
     ::ywrapper::StringValue key_field = _filter.key_field();
     Log(DEBUG) << "key_field: " << key_field.value();
 
-    std::stringstream ks;
-    ks  << key_field.value();
-    JaegerLog::getInstance()->Log("Brcm:BrcmFilter:Key Field", ks.str());
+    JaegerLog::getInstance()->log("Brcm:BrcmFilter:Key Field",
+                                  key_field.value());
 
     // Write into file for Brcm test
     gtestFile.open("../BrcmTest.txt", std::fstream::app);
     gtestFile << "key_field: " << key_field.value() << "\n";
     gtestFile.close();
 #endif // SUD
+    return true;
+}
+
+//
+// A MODIFY keeps the match key but the rule API can only add actions to
+// an installed rule, not replace one. The rule is therefore built again
+// with the new action and takes the place of the rule of oldObj.
+//
+bool BrcmCapEntry::_update(const AFIHAL::AfiObjectPtr &oldObj)
+{
+    Log(DEBUG) << "BrcmCapEntry: _update";
+
+    BrcmCapEntryPtr oldEntry = std::dynamic_pointer_cast<BrcmCapEntry>(oldObj);
+    if ((oldEntry == nullptr) || (oldEntry->_fpe == nullptr)) {
+        return false;
+    }
+
+    if (!_bind()) {
+        _fpe = nullptr;
+        return false;
+    }
+    oldEntry->_fpe = nullptr;
+    return true;
 }
 
 //  
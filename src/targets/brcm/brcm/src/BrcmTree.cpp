@@ -25,23 +25,22 @@
 
 namespace BRCMHALP {
 
-void BrcmTree::_bind()
+bool BrcmTree::_bind()
 {
-    std::cout << "BrcmTree: _bind" << std::endl;
+    Log(DEBUG) << "BrcmTree: _bind";
     Log(DEBUG)<< "Pushing BrcmTree to ASIC";
 
 
     ::ywrapper::StringValue key_field = _tree.key_field();
     Log(DEBUG) << "key_field: " << key_field.value();
 
-    std::stringstream ks;
-    ks  << key_field.value();
-    JaegerLog::getInstance()->Log("Brcm:BrcmTree:Key Field", ks.str());
+    JaegerLog::getInstance()->log("Brcm:BrcmTree:Key Field", key_field.value());
 
     // Write into file for Brcm test
     gtestFile.open("../BrcmTest.txt", std::fstream::app);
     gtestFile << "key_field: " << key_field.value() << "\n";
     gtestFile.close();
+    return true;
 }
 
 //  
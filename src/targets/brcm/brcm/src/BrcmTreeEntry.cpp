@@ -32,10 +32,56 @@
 
 namespace BRCMHALP {
 
+//
+// Resolve the next hop of a route
+//
+static bool nextHop(uint32_t dstAddr, bcm_if_t *bcmNhid)
+{
+    uint16_t              port;
+
+    // Temporary
+    char m[24];
+    if (dstAddr == 0x022c2c2c) {
+        strcpy(m, "88:a2:5e:91:c0:a9");
+        port = 9;
+    } else if (dstAddr == 0x02373737) {
+        strcpy(m, "88:a2:5e:91:75:ff");
+        port = 13;
+    } else if (dstAddr == 0x012c2c2c) {
+        strcpy(m, "88:a2:5e:91:a2:a8");
+        port = 0;
+    } else if (dstAddr == 0x01373737) {
+        strcpy(m, "88:a2:5e:91:a2:a9");
+        port = 0;
+    }
+
+    Log(DEBUG) << "dst_mac_addr            :" << m;
+    Log(DEBUG) << "dst_port                :" << port;
+
+    if (port == 0) {
+        // cpu port
+        *bcmNhid = 100002;
+    } else {
+        // not the CPU port, so L3 interface must exist
+        std::shared_ptr<BrcmL3Intf> brcmL3Intf = BrcmL3Intf::get(port);
+        if (brcmL3Intf == nullptr) {
+            Log(ERROR) << "L3 interface does not exist for port " << port;
+            return false;
+        }
+
+        BrcmNhParamsUcast nhParams((uint8_t *) ether_aton(m),
+                                   brcmL3Intf->getVlanToken(),
+                                   port);
+        BrcmNhUcast::add(nhParams, bcmNhid);
+    }
+    return true;
+}
+
 //BrcmNodeToken BrcmTreeEntry::bind(void)
-void BrcmTreeEntry::_bind()
+bool BrcmTreeEntry::_bind()
 {
-    std::cout << "BrcmTreeEntry: _bind" << std::endl;
+    JaegerSpan span("Brcm TreeEntry bind");
+    Log(DEBUG) << "BrcmTreeEntry: _bind";
     Log(DEBUG)<< "Pushing BrcmTreeEntry to ASIC";
 
     Log(DEBUG) << "tree.ByteSize(): " << _treeEntry.ByteSize();
@@ -64,78 +110,91 @@ void BrcmTreeEntry::_bind()
 
     if (BrcmTreePtr == nullptr) {
         Log(ERROR) << "Could not find parent AfiTree";
-        return;
+        return false;
     }
 
-    std::cout<<"BrcmTree :" << BrcmTreePtr << "\n";
-
-    std::stringstream es;
-    es << entry_name.value();
-    JaegerLog::getInstance()->Log("Brcm:BrcmTreeEntry:Name", es.str());
+    Log(DEBUG) << "BrcmTree :" << BrcmTreePtr;
 
-    std::stringstream ps;
-    ps << parent_name.value();
-    JaegerLog::getInstance()->Log("Brcm:BrcmTreeEntry:Parent Name", ps.str());
-
-    std::stringstream as;
-    as << target_afi_object.value();
-    JaegerLog::getInstance()->Log("Brcm:BrcmTreeEntry:Target AFI Object", as.str());
-
-    JaegerLog::getInstance()->finishSpan();
+    JaegerLog::getInstance()->log("Brcm:BrcmTreeEntry:Name",
+                                  entry_name.value());
+    JaegerLog::getInstance()->log("Brcm:BrcmTreeEntry:Parent Name",
+                                  parent_name.value());
+    JaegerLog::getInstance()->log("Brcm:BrcmTreeEntry:Target AFI Object",
+                                  target_afi_object.value());
 
     uint32_t              dstAddr;
-    uint16_t              port;
     bcm_if_t              bcmNhid = 0;
 
     memcpy(&dstAddr, prefix_bytes_str.c_str(), prefix_bytes_str.size());
 
-    // Temporary
-    char m[24];
-    if (dstAddr == 0x022c2c2c) {
-        strcpy(m, "88:a2:5e:91:c0:a9");
-        port = 9;
-    } else if (dstAddr == 0x02373737) {
-        strcpy(m, "88:a2:5e:91:75:ff");
-        port = 13;
-    } else if (dstAddr == 0x012c2c2c) {
-        strcpy(m, "88:a2:5e:91:a2:a8");
-        port = 0;
-    } else if (dstAddr == 0x01373737) {
-        strcpy(m, "88:a2:5e:91:a2:a9");
-        port = 0;
-    }
-
-    std::cout << "\n";
     Log(DEBUG) << "prefix_bytes_str.c_str():" << prefix_bytes_str.c_str();
     Log(DEBUG) << "prefix_bytes_str.size() :" << prefix_bytes_str.size();
     Log(DEBUG) << "prefix_length.value()   :" << prefix_length.value();
     //Log(DEBUG) << "dest_ip_addr            :" << std::hex(dstAddr);
-    Log(DEBUG) << "dst_mac_addr            :" << m;
-    Log(DEBUG) << "dst_port                :" << port;
 
-    if (port == 0) {
-        // cpu port
-        bcmNhid = 100002;
-    } else {
-        // not the CPU port, so L3 interface must exist
-        std::shared_ptr<BrcmL3Intf> brcmL3Intf = BrcmL3Intf::get(port);
-        if (brcmL3Intf == nullptr) {
-            std::cout << "L3 interface does not exist for port "
-                      << port
-                      << std::endl;
-            return;
-        }
-
-        BrcmNhParamsUcast nhParams((uint8_t *) ether_aton(m),
-                                   brcmL3Intf->getVlanToken(),
-                                   port);
-        BrcmNhUcast::add(nhParams, &bcmNhid);
+    if (!nextHop(dstAddr, &bcmNhid)) {
+        return false;
     }
 
-    std::cout << "bcmNhid = " << bcmNhid << std::endl;
+    Log(DEBUG) << "bcmNhid = " << bcmNhid;
 
     BrcmRtParamsV4 rtParams(0, bcmNhid, dstAddr, prefix_length.value());
+    static MetricHistogram &latency =
+        AFIHAL::targetCallLatency("brcm", "BrcmRtV4::add");
+    MetricTimer timer(latency);
+    BrcmRtV4::add(rtParams);
+    return true;
+}
+
+//
+// Move the route of oldObj to this entry's next hop. The route is
+// rewritten with the new next hop only if the target changed.
+//
+bool BrcmTreeEntry::_update(const AFIHAL::AfiObjectPtr &oldObj)
+{
+    JaegerSpan span("Brcm TreeEntry update");
+    Log(DEBUG) << "BrcmTreeEntry: _update";
+
+    BrcmTreeEntryPtr oldEntry = std::dynamic_pointer_cast<BrcmTreeEntry>(oldObj);
+    if (oldEntry == nullptr) {
+        return false;
+    }
+
+    std::string prefix_bytes_str = _treeEntry.prefix_bytes().value();
+    if ((prefix_bytes_str != oldEntry->_treeEntry.prefix_bytes().value()) ||
+        (_treeEntry.prefix_length().value() !=
+         oldEntry->_treeEntry.prefix_length().value())) {
+        Log(DEBUG) << "Prefix changed, no in-place update";
+        return false;
+    }
+
+    ::ywrapper::StringValue target_afi_object = _treeEntry.target_afi_object();
+    if (target_afi_object.value() ==
+        oldEntry->_treeEntry.target_afi_object().value()) {
+        return true;
+    }
+
+    JaegerLog::getInstance()->log("Brcm:BrcmTreeEntry:Update Target",
+                                  target_afi_object.value());
+
+    uint32_t              dstAddr;
+    bcm_if_t              bcmNhid = 0;
+
+    memcpy(&dstAddr, prefix_bytes_str.c_str(), prefix_bytes_str.size());
+    if (!nextHop(dstAddr, &bcmNhid)) {
+        return false;
+    }
+
+    Log(DEBUG) << "bcmNhid = " << bcmNhid;
+
+    // Replaces the next hop of the existing route
+    BrcmRtParamsV4 rtParams(0, bcmNhid, dstAddr,
+                            _treeEntry.prefix_length().value());
+    static MetricHistogram &latency =
+        AFIHAL::targetCallLatency("brcm", "BrcmRtV4::add");
+    MetricTimer timer(latency);
     BrcmRtV4::add(rtParams);
+    return true;
 }
 
 //  
@@ -140,11 +140,42 @@ class NullObjectTemplate : public NullObject, public AfiObjType
         //
         // Let the caller know whether it worked or not
         //
-        std::cout << "NullObjectTemplate: bind" << std::endl;
+        Log(DEBUG) << "NullObjectTemplate: bind";
+        static MetricHistogram &latency = AFIHAL::targetBindLatency(
+            "null", this->AFIHAL::AfiObject::type());
+        MetricTimer timer(latency);
         _bind();
         return true;
     }
 
+    ///
+    /// @brief  Default update function: no in-place update, the caller
+    ///         unbinds the old object and binds this one.
+    ///         Derived classes can have specific implementation.
+    ///
+    /// @param [in] oldObj  Bound object of the same name
+    ///
+    /// @return true, if the hardware state was updated in place
+    ///
+    virtual bool _update(const AFIHAL::AfiObjectPtr &oldObj)
+    {
+        return false;
+    }
+
+    ///
+    /// @brief  Update function which moves the hardware state of oldObj
+    ///         to this object
+    ///
+    /// @param [in] oldObj  Bound object of the same name
+    ///
+    /// @return true, on successful in-place update
+    ///
+    virtual bool update(const AFIHAL::AfiObjectPtr &oldObj) override
+    {
+        Log(DEBUG) << "NullObjectTemplate: update";
+        return _update(oldObj);
+    }
+
     ///
     /// Destroy routine to uninstall JNH handle
     ///
@@ -153,7 +184,7 @@ class NullObjectTemplate : public NullObject, public AfiObjType
         //
         // Release any hardware memory
         //
-        std::cout << "NullObjectTemplate: destroy" << std::endl;
+        Log(DEBUG) << "NullObjectTemplate: destroy";
         this->unbind();
     }
 
@@ -165,7 +196,7 @@ class NullObjectTemplate : public NullObject, public AfiObjType
         //
         // Free the counter in the hardware
         //
-        std::cout << "NullObjectTemplate: unbind" << std::endl;
+        Log(DEBUG) << "NullObjectTemplate: unbind";
         return true;
     }
 
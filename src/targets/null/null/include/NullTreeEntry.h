@@ -52,6 +52,16 @@ class NullTreeEntry
     ///
     void _bind() override;
 
+    ///
+    /// @brief  Repoint the route of oldObj to this entry's target. The
+    ///         route itself is left in place.
+    ///
+    /// @param [in] oldObj Bound tree entry of the same name
+    ///
+    /// @return false if the prefix differs
+    ///
+    bool _update(const AFIHAL::AfiObjectPtr &oldObj) override;
+
     //
     // Debug
     //
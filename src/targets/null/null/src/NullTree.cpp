@@ -29,15 +29,13 @@ namespace NULLHALP
 void
 NullTree::_bind()
 {
-    std::cout << "NullTree: _bind" << std::endl;
+    Log(DEBUG) << "NullTree: _bind";
     Log(DEBUG) << "Pushing NullTree to ASIC";
 
     ::ywrapper::StringValue key_field = _tree.key_field();
     Log(DEBUG) << "key_field: " << key_field.value();
 
-    std::stringstream ks;
-    ks << key_field.value();
-    JaegerLog::getInstance()->Log("Null:NullTree:Key Field", ks.str());
+    JaegerLog::getInstance()->log("Null:NullTree:Key Field", key_field.value());
     // Write into file for null test
     gtestFile.open("../NullTest.txt", std::fstream::app);
     gtestFile << "key_field: " << key_field.value() << "\n";
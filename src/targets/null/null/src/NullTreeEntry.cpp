@@ -31,7 +31,8 @@ namespace NULLHALP
 void
 NullTreeEntry::_bind()
 {
-    std::cout << "NullTreeEntry: _bind" << std::endl;
+    JaegerSpan span("Null TreeEntry bind");
+    Log(DEBUG) << "NullTreeEntry: _bind";
     Log(DEBUG) << "Pushing NullTreeEntry to ASIC";
 
     Log(DEBUG) << "tree.ByteSize(): " << _treeEntry.ByteSize();
@@ -63,21 +64,14 @@ NullTreeEntry::_bind()
         return;
     }
 
-    std::cout << "nullTree :" << nullTreePtr << "\n";
+    Log(DEBUG) << "nullTree :" << nullTreePtr;
 
-    std::stringstream es;
-    es << entry_name.value();
-    JaegerLog::getInstance()->Log("Null:NullTreeEntry:Name", es.str());
-
-    std::stringstream ps;
-    ps << parent_name.value();
-    JaegerLog::getInstance()->Log("Null:NullTreeEntry:Parent Name", ps.str());
-
-    std::stringstream as;
-    as << target_afi_object.value();
-    JaegerLog::getInstance()->Log("Null:NullTreeEntry:Target AFI Object", as.str());
-
-    JaegerLog::getInstance()->finishSpan();
+    JaegerLog::getInstance()->log("Null:NullTreeEntry:Name",
+                                  entry_name.value());
+    JaegerLog::getInstance()->log("Null:NullTreeEntry:Parent Name",
+                                  parent_name.value());
+    JaegerLog::getInstance()->log("Null:NullTreeEntry:Target AFI Object",
+                                  target_afi_object.value());
 
     // Write into file
     gtestFile.open("../NullTest.txt", std::fstream::app);
@@ -88,6 +82,36 @@ NullTreeEntry::_bind()
     gtestFile.close();
 }
 
+bool
+NullTreeEntry::_update(const AFIHAL::AfiObjectPtr &oldObj)
+{
+    JaegerSpan span("Null TreeEntry update");
+    Log(DEBUG) << "NullTreeEntry: _update";
+
+    NullTreeEntryPtr oldEntry = std::dynamic_pointer_cast<NullTreeEntry>(oldObj);
+    if (oldEntry == nullptr) {
+        return false;
+    }
+
+    if ((_treeEntry.prefix_bytes().value() !=
+         oldEntry->_treeEntry.prefix_bytes().value()) ||
+        (_treeEntry.prefix_length().value() !=
+         oldEntry->_treeEntry.prefix_length().value())) {
+        Log(DEBUG) << "Prefix changed, no in-place update";
+        return false;
+    }
+
+    ::ywrapper::StringValue target_afi_object = _treeEntry.target_afi_object();
+    Log(DEBUG) << "Updating NullTreeEntry " << _treeEntry.name().value()
+               << " target: " << oldEntry->_treeEntry.target_afi_object().value()
+               << " -> " << target_afi_object.value();
+
+    JaegerLog::getInstance()->log("Null:NullTreeEntry:Update Target",
+                                  target_afi_object.value());
+
+    return true;
+}
+
 //
 // Description
 //
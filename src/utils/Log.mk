@@ -0,0 +1,28 @@
+#
+# Log.mk -- Makefile fragment setting the compile time log level
+#
+# JP4Agent : Juniper P4 Agent
+#
+# Copyright (c) [2018] Juniper Networks, Inc. All rights reserved.
+#
+# All rights reserved.
+#
+# Notice and Disclaimer: This code is licensed to you under the Apache
+# License 2.0 (the "License"). You may not use this code except in compliance
+# with the License. This code is not an official Juniper product. You can
+# obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+#
+# Third-Party Code: This code may depend on other components under separate
+# copyright notice and license terms. Your use of the source code for those
+# components is subject to the terms and conditions of the respective license
+# as noted in the Third-Party source code file.
+#
+
+#
+# Included by every Makefile building code that includes Log.h. The
+# inline functions of Log.h depend on LOG_MIN_LEVEL, so all objects
+# linked together must be built with the same value.
+#
+ifndef DEBUG_BUILD
+	CPPFLAGS += -DLOG_MIN_LEVEL=INFO
+endif
@@ -20,36 +20,97 @@
 // as noted in the Third-Party source code file.
 //
 
-
 #ifndef JaegerLog_h
 #define JaegerLog_h
 
-#include <iostream>
+#include <atomic>
+#include <memory>
 #include <sstream>
-#include <unistd.h>
+#include <string>
 #ifdef OPENTRACING
 #include <jaegertracing/Tracer.h>
 #endif // OPENTRACING
 
+class JaegerSpan;
 
+//
+// Tracer setup and tagging of the active span of the calling thread.
+// Tracing is off until initTracing() succeeds.
+//
 class JaegerLog
 {
   private:
     static JaegerLog* _instance;
-#ifdef OPENTRACING
-    std::unique_ptr<opentracing::v1::Span> _span; 
-#endif // OPENTRACING
-    JaegerLog();
-    ~JaegerLog();
+    std::atomic<bool>   _enabled{false};
+    std::atomic<double> _samplingRate{1.0};  // Of root spans, 0..1
+    JaegerLog() = default;
+    ~JaegerLog() = default;
   public:
     /* Static access method. */
     static JaegerLog* getInstance();
-    void initTracing(std::string configFileName);
+    void initTracing(const std::string &configFileName, double samplingRate);
     void teardownTracing();
-    void startSpan(const std::string spanName);
-    void finishSpan();
-    void Log(const std::string type, std::string val);
+
+    bool enabled() const { return _enabled.load(std::memory_order_relaxed); }
+
+    //
+    // Head based sampling decision for a new root span
+    //
+    bool sample() const;
+
+    //
+    // True if the calling thread has an active span that is recorded.
+    // Callers check it before building expensive tag values.
+    //
+    bool sampled() const;
+
+    //
+    // Tag the active span of the calling thread, if any
+    //
+    void log(const std::string &type, const std::string &val);
+
+    template <class T>
+    void log(const std::string &type, const T &val)
+    {
+        if (!sampled()) return;
+        std::ostringstream os;
+        os << val;
+        log(type, os.str());
+    }
 };
 
+//
+// Scoped span. The first span on a thread is the root of a trace and is
+// sampled; spans created while it is active become its children, so an
+// RPC is traced down into AFI and the target without passing a context
+// around. Unsampled roots record nothing, neither do their children.
+//
+class JaegerSpan
+{
+  public:
+    explicit JaegerSpan(const std::string &name);
+    ~JaegerSpan();
+
+    JaegerSpan(const JaegerSpan &) = delete;
+    JaegerSpan &operator=(const JaegerSpan &) = delete;
+
+    bool sampled() const { return _sampled; }
+
+    //
+    // Active span of the calling thread, nullptr if none
+    //
+    static JaegerSpan *active() { return _active; }
+
+  private:
+    friend class JaegerLog;
+
+    static thread_local JaegerSpan *_active;
+
+    JaegerSpan *_parent;
+    bool        _sampled;
+#ifdef OPENTRACING
+    std::unique_ptr<opentracing::Span> _span;
+#endif // OPENTRACING
+};
 
 #endif /* JaegerLog_h */
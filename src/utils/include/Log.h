@@ -25,12 +25,24 @@
 #define Log_h
 
 
+#include <atomic>
+#include <cctype>
+#include <cstdint>
+#include <ctime>
 #include <iostream>
+#include <sstream>
+#include <string>
 #include <unistd.h>
 
 //
 // Log
 //
+// Log(level) << ... is a statement that evaluates nothing right of the
+// first << unless level is enabled. A level is enabled if it is at least
+// LOG_MIN_LEVEL, fixed at compile time, and the runtime threshold set with
+// setLogLevel(). Builds without DEBUG_BUILD set LOG_MIN_LEVEL to INFO, so
+// their DEBUG logs are compiled out.
+//
 
 enum LogLevel{
     DEBUG = 0,
@@ -39,46 +51,110 @@ enum LogLevel{
     ERROR
 };
 
-class Log {
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL DEBUG
+#endif
+
+inline std::atomic<int> &logThreshold()
+{
+    static std::atomic<int> threshold{DEBUG};
+    return threshold;
+}
+
+inline void setLogLevel(LogLevel level) { logThreshold().store(level); }
+
+inline LogLevel logLevel()
+{
+    return static_cast<LogLevel>(logThreshold().load());
+}
+
+inline bool logEnabled(LogLevel level)
+{
+    return (level >= LOG_MIN_LEVEL) &&
+           (level >= logThreshold().load(std::memory_order_relaxed));
+}
+
+inline const char *logLevelStr(LogLevel level)
+{
+    switch (level) {
+        case DEBUG:    return "DEBUG";
+        case INFO:     return "INFO";
+        case WARNING:  return "WARNING";
+        case ERROR:    return "ERROR";
+    }
+    return "";
+}
+
+//
+// Parse a level name as found in the config ("debug", "info", ...)
+//
+inline bool logLevelFromStr(const std::string &str, LogLevel &level)
+{
+    for (auto l : {DEBUG, INFO, WARNING, ERROR}) {
+        std::string name(logLevelStr(l));
+        if (str.size() != name.size()) continue;
+        bool match = true;
+        for (size_t i = 0; i < str.size(); i++) {
+            match = match && (::toupper(str[i]) == name[i]);
+        }
+        if (match) {
+            level = l;
+            return true;
+        }
+    }
+    return false;
+}
+
+//
+// Log backend, see Log.cpp. Until logStart() is called, and after
+// logStop(), lines are written to stdout synchronously. Once started,
+// DEBUG and INFO lines are queued to a per thread lock-free ring and
+// written out by a background thread; a line that does not fit its ring
+// is dropped and counted rather than blocking the logging thread.
+// WARNING and ERROR lines are still written synchronously, after the
+// queued ones, so a crash does not lose them.
+//
+struct LogConfig {
+    bool        async{true};    // Write from a background thread
+    std::string file;           // Log file, stdout if empty
+    size_t      fileSize{0};    // Rotate when the file reaches it, 0: never
+    int         fileCount{5};   // Rotated files kept, file.1 ... file.N
+};
+
+bool     logStart(const LogConfig &cfg);
+void     logStop();
+void     logEmit(LogLevel level, const std::string &msg);
+uint64_t logDropped();
+
+//
+// One log line. Formatted in a buffer and handed to the backend as a
+// whole when the statement ends, so lines of different threads do not
+// interleave. The timestamp and level are added by the backend.
+//
+class LogLine {
 public:
-    Log(LogLevel level) : _logLevel(level) { }
-    ~Log() { std::cout << std::endl; }
+    LogLine(LogLevel level) : _logLevel(level) { }
+    ~LogLine() { logEmit(_logLevel, _buf.str()); }
     template<class T>
-    Log &operator<<(const T &msg) {
-        if (_hdrDisplayed == false) {
-	  std::cout << currentDateTime();
-            //std::cout << " {" << ::getpid() << "}";
-	  std::cout << " [" << logLevelStr() << "]";
-            _hdrDisplayed = true;
-        }
-	std::cout << msg;
+    LogLine &operator<<(const T &msg) {
+        _buf << msg;
         return *this;
     }
 
-
 private:
-    LogLevel   _logLevel = DEBUG;
-    bool       _hdrDisplayed = false;
-
-    const std::string currentDateTime() {
-        time_t     now = time(0);
-        struct tm  tstruct;
-        char       buf[80];
-        tstruct = *localtime(&now);
-        strftime(buf, sizeof(buf), "%Y-%m-%d.%X", &tstruct);
-        return buf;
-    }
+    LogLevel           _logLevel;
+    std::ostringstream _buf;
+};
 
-    inline std::string logLevelStr() {
-        std::string str;
-        switch(_logLevel) {
-            case DEBUG:    str = "DEBUG"  ; break;
-            case INFO:     str = "INFO"   ; break;
-            case WARNING:  str = "WARNING"; break;
-            case ERROR:    str = "ERROR"  ; break;
-        }
-        return str;
-    }
+//
+// Gives "Log(level) << ..." the type void so it fits the conditional
+// operator of the Log macro. & binds looser than <<.
+//
+struct LogVoidify {
+    void operator&(const LogLine &) {}
 };
 
+#define Log(level) \
+    !logEnabled(level) ? (void)0 : LogVoidify() & LogLine(level)
+
 #endif /* Log_h */
@@ -0,0 +1,152 @@
+//
+// Juniper P4 Agent
+//
+/// @file  Metrics.h
+/// @brief In-process metrics registry
+//
+// Copyright (c) [2018] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+
+#ifndef __Metrics__
+#define __Metrics__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+//
+// Monotonic counter. Updates are a single relaxed atomic add.
+//
+class MetricCounter
+{
+ public:
+    void inc(uint64_t n = 1) { _value.fetch_add(n, std::memory_order_relaxed); }
+
+    uint64_t value() const { return _value.load(std::memory_order_relaxed); }
+
+ private:
+    std::atomic<uint64_t> _value{0};
+};
+
+//
+// Latency histogram in nanoseconds with HDR style log-linear buckets:
+// every power of two is split in kSub buckets, so a recorded value is
+// off by less than 1/kSub. Recording is lock free.
+//
+class MetricHistogram
+{
+ public:
+    static constexpr int      kSubBits = 3;
+    static constexpr uint64_t kSub     = 1ULL << kSubBits;
+    static constexpr int      kMaxBits = 44;  // Clamped above ~4.8 hours
+    static constexpr size_t   kBuckets = (kMaxBits - kSubBits + 1) * kSub;
+
+    void record(uint64_t ns);
+
+    uint64_t count() const { return _count.load(std::memory_order_relaxed); }
+    uint64_t sum() const { return _sum.load(std::memory_order_relaxed); }
+    uint64_t max() const { return _max.load(std::memory_order_relaxed); }
+
+    //
+    // Value at quantile q (0..1), the upper bound of its bucket
+    //
+    uint64_t quantile(double q) const;
+
+ private:
+    std::atomic<uint64_t> _buckets[kBuckets]{};
+    std::atomic<uint64_t> _count{0};
+    std::atomic<uint64_t> _sum{0};
+    std::atomic<uint64_t> _max{0};
+
+    static size_t   bucket(uint64_t ns);
+    static uint64_t bucketMax(size_t idx);
+};
+
+//
+// Records the time spent in a scope
+//
+class MetricTimer
+{
+ public:
+    explicit MetricTimer(MetricHistogram &hist)
+        : _hist(hist), _start(std::chrono::steady_clock::now())
+    {
+    }
+
+    ~MetricTimer()
+    {
+        _hist.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::steady_clock::now() - _start)
+                         .count());
+    }
+
+    MetricTimer(const MetricTimer &) = delete;
+    MetricTimer &operator=(const MetricTimer &) = delete;
+
+ private:
+    MetricHistogram &                     _hist;
+    std::chrono::steady_clock::time_point _start;
+};
+
+//
+// Registry of all metrics of the agent. Metrics are looked up once by
+// name and labels (e.g. rpc="Write") and the returned reference is kept
+// by the caller, typically in a function local static; they are never
+// freed. render() formats them in the Prometheus text format.
+//
+class Metrics
+{
+ public:
+    static Metrics &instance();
+
+    MetricCounter &counter(const std::string &name, const std::string &help,
+                           const std::string &labels = "");
+
+    MetricHistogram &histogram(const std::string &name,
+                               const std::string &help,
+                               const std::string &labels = "");
+
+    //
+    // Value sampled by calling fn whenever the metrics are rendered
+    //
+    void gauge(const std::string &name, const std::string &help,
+               std::function<double()> fn, const std::string &labels = "");
+
+    std::string render() const;
+
+ private:
+    template <class T>
+    struct Family {
+        std::string                                 help;
+        std::map<std::string, std::unique_ptr<T>> series;  // By labels
+    };
+
+    using Gauge = std::function<double()>;
+
+    Metrics() = default;
+
+    mutable std::mutex                               _mtx;
+    std::map<std::string, Family<MetricCounter>>     _counters;
+    std::map<std::string, Family<MetricHistogram>>   _histograms;
+    std::map<std::string, Family<Gauge>>             _gauges;
+};
+
+#endif  // __Metrics__
@@ -22,19 +22,17 @@
 
 #include "JaegerLog.h"
 
-JaegerLog* JaegerLog::_instance = 0;
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <random>
+#include <thread>
 
-JaegerLog::JaegerLog()
-{
-#ifdef OPENTRACING
-  _span = NULL;
-#endif // OPENTRACING
-}
+#include "Log.h"
 
-JaegerLog::~JaegerLog()
-{
-  delete this;
-}
+JaegerLog* JaegerLog::_instance = 0;
+
+thread_local JaegerSpan *JaegerSpan::_active = nullptr;
 
 JaegerLog* JaegerLog::getInstance()
 {
@@ -46,49 +44,107 @@ JaegerLog* JaegerLog::getInstance()
   return _instance;
 }
 
+//
+// @fn
+// initTracing
+//
+// @brief
+// Create the global tracer from a jaeger client config. Spans are only
+// recorded once this succeeded.
+//
+// @param[in]
+//     configFileName Jaeger client YAML config
+// @param[in]
+//     samplingRate Fraction of root spans recorded
+// @return void
+//
 
-void JaegerLog::initTracing(std::string configFileName)
+void JaegerLog::initTracing(const std::string &configFileName,
+                            double samplingRate)
 {
+  _samplingRate.store(std::min(std::max(samplingRate, 0.0), 1.0));
 #ifdef OPENTRACING
   try {
     YAML::Node cfgFile = YAML::LoadFile(configFileName);
     const auto cfg = jaegertracing::Config::parse(cfgFile);
     auto tracer = jaegertracing::Tracer::make("JP4Agent", cfg);
     opentracing::Tracer::InitGlobal(tracer);
-    } catch (const std::exception& e) {
+    _enabled.store(true);
+  } catch (const std::exception& e) {
+    Log(ERROR) << "Unable to start tracing with " << configFileName << ": "
+               << e.what();
   }
+#else
+  Log(WARNING) << "Tracing not compiled in, ignoring " << configFileName;
 #endif // OPENTRACING
 }
 
 void JaegerLog::teardownTracing()
 {
+  if (!_enabled.exchange(false)) {
+    return;
+  }
 #ifdef OPENTRACING
   opentracing::Tracer::Global()->Close();
 #endif // OPENTRACING
 }
 
-void JaegerLog::startSpan(const std::string spanName)
+bool JaegerLog::sample() const
+{
+  double rate = _samplingRate.load(std::memory_order_relaxed);
+  if (rate >= 1.0) return true;
+  if (rate <= 0.0) return false;
+
+  thread_local std::minstd_rand rng(
+      std::hash<std::thread::id>()(std::this_thread::get_id()) ^
+      std::chrono::steady_clock::now().time_since_epoch().count());
+  return std::uniform_real_distribution<double>(0.0, 1.0)(rng) < rate;
+}
+
+bool JaegerLog::sampled() const
 {
+  const JaegerSpan *span = JaegerSpan::active();
+  return (span != nullptr) && span->sampled();
+}
+
+void JaegerLog::log(const std::string &type, const std::string &val)
+{
+  if (!sampled()) return;
 #ifdef OPENTRACING
-  auto tracer = opentracing::Tracer::Global();
-  _span       = tracer->StartSpan(spanName);
-  std::this_thread::sleep_for(std::chrono::milliseconds{10});
+  JaegerSpan::active()->_span->SetTag(type, val);
+#else
+  (void)type;
+  (void)val;
 #endif // OPENTRACING
 }
 
-void JaegerLog::finishSpan()
+JaegerSpan::JaegerSpan(const std::string &name) : _parent(_active)
 {
+  JaegerLog *jl = JaegerLog::getInstance();
+  _sampled = (_parent != nullptr) ? _parent->_sampled
+                                  : (jl->enabled() && jl->sample());
 #ifdef OPENTRACING
-  _span->Finish();
+  if (_sampled) {
+    auto tracer = opentracing::Tracer::Global();
+    if (_parent != nullptr) {
+      _span = tracer->StartSpan(
+          name, {opentracing::ChildOf(&_parent->_span->context())});
+    } else {
+      _span = tracer->StartSpan(name);
+    }
+  }
+#else
+  (void)name;
 #endif // OPENTRACING
+  _active = this;
 }
 
-void JaegerLog::Log(const std::string type, std::string val)
+JaegerSpan::~JaegerSpan()
 {
 #ifdef OPENTRACING
-  opentracing::string_view name(type);
-  opentracing::string_view name_val(val);
-  _span->SetBaggageItem(name, name_val);
+  if (_span) {
+    _span->Finish();
+  }
 #endif // OPENTRACING
-
+  _active = _parent;
 }
@@ -0,0 +1,539 @@
+//
+// Juniper P4 Agent
+//
+/// @file  Log.cpp
+/// @brief Log backend
+//
+// Copyright (c) [2018] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#include "Log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+//
+// Record as queued by a logging thread: this header followed by the
+// formatted message, padded to 8 bytes
+//
+struct LogRecord {
+    uint32_t len;    // Message length
+    uint16_t level;  // LogLevel, or kPad for the filler at the ring end
+    uint16_t rsvd;
+    uint64_t ns;     // CLOCK_REALTIME_COARSE
+};
+
+constexpr uint16_t kPad        = 0xffff;
+constexpr size_t   kRingSize   = 256 * 1024;  // Per logging thread
+constexpr size_t   kMaxMessage = kRingSize / 4;
+constexpr size_t   kBatchSize  = 64 * 1024;   // Bytes per write()
+
+inline size_t
+recordSize(size_t len)
+{
+    return (sizeof(LogRecord) + len + 7) & ~size_t(7);
+}
+
+//
+// Single producer, single consumer ring of log records. The producer is
+// the thread owning the ring, the consumer the backend thread.
+// Positions are free running byte counts.
+//
+class LogRing
+{
+ public:
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<bool>     closed{false};  // Owning thread exited
+
+    bool push(LogLevel level, uint64_t ns, const char *msg, size_t len)
+    {
+        len = std::min(len, kMaxMessage);
+        size_t   total = recordSize(len);
+        uint64_t head  = _head.load(std::memory_order_relaxed);
+        uint64_t tail  = _tail.load(std::memory_order_acquire);
+        size_t   pos   = head & (kRingSize - 1);
+        size_t   room  = kRingSize - pos;
+        size_t   need  = (room < total) ? room + total : total;
+
+        if (kRingSize - (head - tail) < need) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        if (room < total) {
+            // Records never wrap, fill up the end of the ring
+            if (room >= sizeof(LogRecord)) {
+                LogRecord pad{uint32_t(room - sizeof(LogRecord)), kPad, 0, 0};
+                std::memcpy(&_buf[pos], &pad, sizeof(pad));
+            }
+            head += room;
+            pos = 0;
+        }
+
+        LogRecord rec{uint32_t(len), uint16_t(level), 0, ns};
+        std::memcpy(&_buf[pos], &rec, sizeof(rec));
+        std::memcpy(&_buf[pos + sizeof(rec)], msg, len);
+        _head.store(head + total, std::memory_order_release);
+        return true;
+    }
+
+    //
+    // Hand every queued record to f(record, message)
+    //
+    template <class F>
+    size_t drain(F &&f)
+    {
+        uint64_t tail  = _tail.load(std::memory_order_relaxed);
+        uint64_t head  = _head.load(std::memory_order_acquire);
+        size_t   count = 0;
+
+        while (tail != head) {
+            size_t pos  = tail & (kRingSize - 1);
+            size_t room = kRingSize - pos;
+            if (room < sizeof(LogRecord)) {
+                tail += room;
+                continue;
+            }
+            LogRecord rec;
+            std::memcpy(&rec, &_buf[pos], sizeof(rec));
+            if (rec.level == kPad) {
+                tail += room;
+                continue;
+            }
+            f(rec, &_buf[pos + sizeof(rec)]);
+            tail += recordSize(rec.len);
+            count++;
+        }
+
+        _tail.store(tail, std::memory_order_release);
+        return count;
+    }
+
+    bool empty() const
+    {
+        return _head.load(std::memory_order_seq_cst) ==
+               _tail.load(std::memory_order_relaxed);
+    }
+
+ private:
+    alignas(64) std::atomic<uint64_t> _head{0};
+    alignas(64) std::atomic<uint64_t> _tail{0};
+    std::unique_ptr<char[]> _buf{new char[kRingSize]};
+};
+
+using LogRingPtr = std::shared_ptr<LogRing>;
+
+//
+// Where lines end up: stdout or a file rotated by size
+//
+class LogSink
+{
+ public:
+    ~LogSink() { closeFile(); }
+
+    bool open(const LogConfig &cfg)
+    {
+        closeFile();
+        _cfg = cfg;
+        if (_cfg.file.empty()) {
+            _fd = STDOUT_FILENO;
+            return true;
+        }
+        return openFile();
+    }
+
+    //
+    // Append one line to the batch, written out when it is full
+    //
+    void append(LogLevel level, uint64_t ns, const char *msg, size_t len)
+    {
+        time_t sec = ns / 1000000000ULL;
+        if (sec != _lastSec) {
+            struct tm tstruct;
+            localtime_r(&sec, &tstruct);
+            strftime(_timeStr, sizeof(_timeStr), "%Y-%m-%d.%X", &tstruct);
+            _lastSec = sec;
+        }
+
+        _batch.append(_timeStr);
+        _batch.append(" [");
+        _batch.append(logLevelStr(level));
+        _batch.append("]");
+        _batch.append(msg, len);
+        _batch.push_back('\n');
+
+        if (_batch.size() >= kBatchSize) {
+            flush();
+        }
+    }
+
+    void flush()
+    {
+        const char *p    = _batch.data();
+        size_t      left = _batch.size();
+        while (left > 0) {
+            ssize_t n = ::write(_fd, p, left);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            p += n;
+            left -= n;
+        }
+        _written += _batch.size();
+        _batch.clear();
+
+        if ((_cfg.fileSize != 0) && (_fd != STDOUT_FILENO) &&
+            (_written >= _cfg.fileSize)) {
+            rotate();
+        }
+    }
+
+ private:
+    LogConfig   _cfg;
+    int         _fd{STDOUT_FILENO};
+    size_t      _written{0};  // Bytes in the current file
+    std::string _batch;
+    time_t      _lastSec{0};
+    char        _timeStr[32]{};
+
+    bool openFile()
+    {
+        _fd = ::open(_cfg.file.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (_fd < 0) {
+            _fd = STDOUT_FILENO;
+            return false;
+        }
+        struct stat st;
+        _written = (::fstat(_fd, &st) == 0) ? st.st_size : 0;
+        return true;
+    }
+
+    void closeFile()
+    {
+        if (_fd != STDOUT_FILENO) {
+            ::close(_fd);
+            _fd = STDOUT_FILENO;
+        }
+    }
+
+    void rotate()
+    {
+        closeFile();
+        for (int i = _cfg.fileCount - 1; i >= 1; i--) {
+            std::string from = _cfg.file + "." + std::to_string(i);
+            std::string to   = _cfg.file + "." + std::to_string(i + 1);
+            std::rename(from.c_str(), to.c_str());
+        }
+        if (_cfg.fileCount > 0) {
+            std::rename(_cfg.file.c_str(), (_cfg.file + ".1").c_str());
+        } else {
+            ::truncate(_cfg.file.c_str(), 0);
+        }
+        openFile();
+    }
+};
+
+//
+// Owns the rings of all logging threads and the thread writing them out
+//
+class LogBackend
+{
+ public:
+    //
+    // Never destroyed, threads may log while the process exits. logStop()
+    // runs at exit instead, to write out what is queued.
+    //
+    static LogBackend &instance()
+    {
+        static LogBackend *backend = new LogBackend();
+        return *backend;
+    }
+
+    bool start(const LogConfig &cfg)
+    {
+        static bool atExit = (std::atexit(logStop) == 0);
+        (void)atExit;
+
+        stop();
+        std::lock_guard<std::mutex> guard(_sinkMtx);
+        bool ok = _sink.open(cfg);
+        if (cfg.async) {
+            _running.store(true);
+            _thread = std::thread([this] { run(); });
+        }
+        return ok;
+    }
+
+    void stop()
+    {
+        if (!_running.exchange(false)) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> guard(_wakeMtx);
+            _wake = true;
+        }
+        _wakeCv.notify_one();
+        _thread.join();
+        std::lock_guard<std::mutex> guard(_sinkMtx);
+        drainAll();
+        _sink.flush();
+    }
+
+    void emit(LogLevel level, const std::string &msg)
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+        uint64_t ns = uint64_t(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+
+        if (!_running.load(std::memory_order_acquire)) {
+            std::lock_guard<std::mutex> guard(_sinkMtx);
+            _sink.append(level, ns, msg.data(), msg.size());
+            _sink.flush();
+            return;
+        }
+
+        //
+        // Warnings and errors are written out before returning, after the
+        // lines queued so far, so neither they nor what led up to them are
+        // lost if the process dies right after
+        //
+        if (level >= WARNING) {
+            std::lock_guard<std::mutex> guard(_sinkMtx);
+            drainAll();
+            _sink.append(level, ns, msg.data(), msg.size());
+            _sink.flush();
+            return;
+        }
+
+        if (ring().push(level, ns, msg.data(), msg.size())) {
+            // Pairs with the fence of an idle backend thread
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (_sleeping.load(std::memory_order_relaxed)) {
+                {
+                    std::lock_guard<std::mutex> guard(_wakeMtx);
+                    _wake = true;
+                }
+                _wakeCv.notify_one();
+            }
+        }
+    }
+
+    uint64_t dropped()
+    {
+        std::lock_guard<std::mutex> guard(_ringsMtx);
+        uint64_t total = _retiredDropped;
+        for (const auto &ring : _rings) {
+            total += ring->dropped.load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+ private:
+    std::mutex              _ringsMtx;
+    std::vector<LogRingPtr> _rings;
+    uint64_t                _retiredDropped{0};  // Of rings freed
+
+    std::mutex        _sinkMtx;
+    LogSink           _sink;
+    std::atomic<bool> _running{false};
+    std::thread       _thread;
+    uint64_t          _reportedDropped{0};
+
+    // The backend thread sleeps while the rings are empty
+    std::mutex              _wakeMtx;
+    std::condition_variable _wakeCv;
+    bool                    _wake{false};
+    std::atomic<bool>       _sleeping{false};
+
+    //
+    // Ring of the calling thread, marked closed when the thread exits
+    //
+    struct RingHolder {
+        LogRingPtr ring;
+        ~RingHolder()
+        {
+            if (ring != nullptr) ring->closed.store(true);
+        }
+    };
+
+    LogRing &ring()
+    {
+        thread_local RingHolder holder;
+        if (holder.ring == nullptr) {
+            holder.ring = std::make_shared<LogRing>();
+            std::lock_guard<std::mutex> guard(_ringsMtx);
+            _rings.push_back(holder.ring);
+        }
+        return *holder.ring;
+    }
+
+    size_t drainAll()
+    {
+        std::vector<LogRingPtr> rings;
+        {
+            std::lock_guard<std::mutex> guard(_ringsMtx);
+            rings = _rings;
+        }
+
+        size_t count = 0;
+        for (const auto &ring : rings) {
+            bool closed = ring->closed.load();
+            count += ring->drain([this](const LogRecord &rec, const char *msg) {
+                _sink.append(static_cast<LogLevel>(rec.level), rec.ns, msg,
+                             rec.len);
+            });
+            if (closed) {
+                // Nothing can be queued to it any more
+                std::lock_guard<std::mutex> guard(_ringsMtx);
+                _retiredDropped += ring->dropped.load();
+                _rings.erase(std::find(_rings.begin(), _rings.end(), ring));
+            }
+        }
+        return count;
+    }
+
+    void run()
+    {
+        while (_running.load()) {
+            size_t count;
+            {
+                std::lock_guard<std::mutex> guard(_sinkMtx);
+                count = drainAll();
+
+                uint64_t total = dropped();
+                if (total != _reportedDropped) {
+                    std::string msg = std::to_string(total - _reportedDropped) +
+                                      " log records dropped";
+                    struct timespec ts;
+                    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+                    _sink.append(WARNING,
+                                 uint64_t(ts.tv_sec) * 1000000000ULL +
+                                     ts.tv_nsec,
+                                 msg.data(), msg.size());
+                    _reportedDropped = total;
+                }
+                _sink.flush();
+            }
+
+            if (count == 0) {
+                idle();
+            }
+        }
+    }
+
+    bool queued()
+    {
+        std::lock_guard<std::mutex> guard(_ringsMtx);
+        for (const auto &ring : _rings) {
+            if (!ring->empty()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    //
+    // Wait for a logging thread to queue a line. A thread checks
+    // _sleeping after queueing, the backend the rings after setting it,
+    // so one of the two sees the other.
+    //
+    void idle()
+    {
+        std::unique_lock<std::mutex> lock(_wakeMtx);
+        _sleeping.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!queued()) {
+            _wakeCv.wait(lock, [this] { return _wake || !_running.load(); });
+        }
+        _wake = false;
+        _sleeping.store(false);
+    }
+};
+}  // namespace
+
+//
+// @fn
+// logStart
+//
+// @brief
+// Open the log sink and, for an async config, start the backend thread
+//
+// @param[in]
+//     cfg Backend configuration
+// @return false if the log file could not be opened; stdout is used then
+//
+
+bool
+logStart(const LogConfig &cfg)
+{
+    return LogBackend::instance().start(cfg);
+}
+
+//
+// @fn
+// logStop
+//
+// @brief
+// Stop the backend thread after writing out everything queued. Lines
+// are written synchronously afterwards.
+//
+
+void
+logStop()
+{
+    LogBackend::instance().stop();
+}
+
+//
+// @fn
+// logEmit
+//
+// @brief
+// Hand a formatted line to the backend
+//
+
+void
+logEmit(LogLevel level, const std::string &msg)
+{
+    LogBackend::instance().emit(level, msg);
+}
+
+//
+// @fn
+// logDropped
+//
+// @brief
+// Number of lines dropped because the ring of their thread was full
+//
+
+uint64_t
+logDropped()
+{
+    return LogBackend::instance().dropped();
+}
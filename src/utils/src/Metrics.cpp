@@ -0,0 +1,239 @@
+//
+// Juniper P4 Agent
+//
+/// @file  Metrics.cpp
+/// @brief In-process metrics registry
+//
+// Copyright (c) [2018] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+
+#include "Metrics.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+constexpr int      MetricHistogram::kSubBits;
+constexpr uint64_t MetricHistogram::kSub;
+constexpr int      MetricHistogram::kMaxBits;
+constexpr size_t   MetricHistogram::kBuckets;
+
+size_t
+MetricHistogram::bucket(uint64_t ns)
+{
+    if (ns < kSub) {
+        return ns;
+    }
+    if (ns >= (1ULL << kMaxBits)) {
+        ns = (1ULL << kMaxBits) - 1;
+    }
+    int msb = 63 - __builtin_clzll(ns);
+    int shift = msb - kSubBits;
+    return (shift + 1) * kSub + ((ns >> shift) & (kSub - 1));
+}
+
+uint64_t
+MetricHistogram::bucketMax(size_t idx)
+{
+    if (idx < kSub) {
+        return idx;
+    }
+    int      shift = idx / kSub - 1;
+    uint64_t sub   = idx % kSub;
+    return ((kSub + sub + 1) << shift) - 1;
+}
+
+//
+// @fn
+// record
+//
+// @brief
+// Record a latency
+//
+// @param[in]
+//     ns Latency in nanoseconds
+//
+
+void
+MetricHistogram::record(uint64_t ns)
+{
+    _buckets[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+    _count.fetch_add(1, std::memory_order_relaxed);
+    _sum.fetch_add(ns, std::memory_order_relaxed);
+
+    uint64_t max = _max.load(std::memory_order_relaxed);
+    while ((ns > max) &&
+           !_max.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {
+    }
+}
+
+uint64_t
+MetricHistogram::quantile(double q) const
+{
+    uint64_t counts[kBuckets];
+    uint64_t total = 0;
+    for (size_t i = 0; i < kBuckets; i++) {
+        counts[i] = _buckets[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    uint64_t rank = static_cast<uint64_t>(q * total + 0.5);
+    if (rank == 0) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBuckets; i++) {
+        seen += counts[i];
+        if (seen >= rank) {
+            return std::min(bucketMax(i), max());
+        }
+    }
+    return max();
+}
+
+Metrics &
+Metrics::instance()
+{
+    // Never destroyed, metrics are updated until the process exits
+    static Metrics *metrics = new Metrics();
+    return *metrics;
+}
+
+MetricCounter &
+Metrics::counter(const std::string &name, const std::string &help,
+                 const std::string &labels)
+{
+    std::lock_guard<std::mutex> guard(_mtx);
+    auto &family = _counters[name];
+    family.help  = help;
+    auto &series = family.series[labels];
+    if (series == nullptr) {
+        series = std::make_unique<MetricCounter>();
+    }
+    return *series;
+}
+
+MetricHistogram &
+Metrics::histogram(const std::string &name, const std::string &help,
+                   const std::string &labels)
+{
+    std::lock_guard<std::mutex> guard(_mtx);
+    auto &family = _histograms[name];
+    family.help  = help;
+    auto &series = family.series[labels];
+    if (series == nullptr) {
+        series = std::make_unique<MetricHistogram>();
+    }
+    return *series;
+}
+
+void
+Metrics::gauge(const std::string &name, const std::string &help,
+               std::function<double()> fn, const std::string &labels)
+{
+    std::lock_guard<std::mutex> guard(_mtx);
+    auto &family = _gauges[name];
+    family.help  = help;
+    family.series[labels] = std::make_unique<Gauge>(std::move(fn));
+}
+
+namespace
+{
+std::string
+series(const std::string &name, const std::string &labels,
+       const std::string &extra = "")
+{
+    std::string s = name;
+    if (!labels.empty() || !extra.empty()) {
+        s += "{" + labels;
+        if (!labels.empty() && !extra.empty()) {
+            s += ",";
+        }
+        s += extra + "}";
+    }
+    return s;
+}
+
+void
+header(std::ostream &os, const std::string &name, const std::string &help,
+       const char *type)
+{
+    os << "# HELP " << name << " " << help << "\n";
+    os << "# TYPE " << name << " " << type << "\n";
+}
+}  // namespace
+
+//
+// @fn
+// render
+//
+// @brief
+// Format all metrics in the Prometheus text exposition format. Histograms
+// are rendered as summaries in seconds, quantile 1 being the maximum.
+//
+// @return Metrics text
+//
+
+std::string
+Metrics::render() const
+{
+    std::lock_guard<std::mutex> guard(_mtx);
+    std::ostringstream          os;
+    os << std::setprecision(9);
+
+    for (const auto &f : _counters) {
+        header(os, f.first, f.second.help, "counter");
+        for (const auto &s : f.second.series) {
+            os << series(f.first, s.first) << " " << s.second->value()
+               << "\n";
+        }
+    }
+
+    for (const auto &f : _gauges) {
+        header(os, f.first, f.second.help, "gauge");
+        for (const auto &s : f.second.series) {
+            os << series(f.first, s.first) << " " << (*s.second)() << "\n";
+        }
+    }
+
+    static const struct {
+        const char *label;
+        double      q;
+    } quantiles[] = {{"0.5", 0.5},     {"0.9", 0.9}, {"0.99", 0.99},
+                     {"0.999", 0.999}, {"1", 1.0}};
+
+    for (const auto &f : _histograms) {
+        header(os, f.first, f.second.help, "summary");
+        for (const auto &s : f.second.series) {
+            const MetricHistogram &h = *s.second;
+            for (const auto &q : quantiles) {
+                uint64_t ns = (q.q < 1.0) ? h.quantile(q.q) : h.max();
+                os << series(f.first, s.first,
+                             std::string("quantile=\"") + q.label + "\"")
+                   << " " << ns / 1e9 << "\n";
+            }
+            os << series(f.first + "_sum", s.first) << " " << h.sum() / 1e9
+               << "\n";
+            os << series(f.first + "_count", s.first) << " " << h.count()
+               << "\n";
+        }
+    }
+
+    return os.str();
+}
@@ -21,6 +21,7 @@
 //
 
 #include "Utils.h"
+#include "Log.h"
 
 //
 // @fn
@@ -223,11 +224,14 @@ void
 pktTrace(const std::string &ctx, char *pkt, int pkt_len)
 {
 #define DATA_HEX_STR_LEN 10000
+	if (!logEnabled(DEBUG)) {
+		return;
+	}
+
 	char      data_hex_str[DATA_HEX_STR_LEN];
 
 	getHex(pkt, pkt_len, data_hex_str, DATA_HEX_STR_LEN, 16);
-	std::cout << std::endl << ctx << ": " << std::endl;
-	std::cout << data_hex_str << std::endl;
+	Log(DEBUG) << ctx << ":\n" << data_hex_str;
 }
 
 
@@ -483,6 +483,8 @@ main(int argc, char **argv)
             ::testing::GTEST_FLAG(filter) = "P4BRCMSPINE.PuntTableTraffic";
     } else if (strcmp(argv[1], "brcmvrf")  == 0) {
             ::testing::GTEST_FLAG(filter) = "P4BRCMVRF.*";
+    } else if (strcmp(argv[1], "unit")  == 0) {
+            ::testing::GTEST_FLAG(filter) = "Unit*";
     } else {
         ::testing::GTEST_FLAG(filter) = "*nullTest*";
     }
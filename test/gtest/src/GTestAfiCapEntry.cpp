@@ -0,0 +1,455 @@
+//
+// GTestAfiCapEntry.cpp - GTESTs
+//
+// Unit GTESTs of cap table entries going through Afi
+//
+// Copyright (c) [2018] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "Afi.h"
+
+using namespace AFIHAL;
+
+namespace
+{
+using OpLog = std::vector<std::string>;
+
+// Target operations of all objects, in order
+OpLog targetOps;
+
+// Name of the object whose bind fails, empty if none
+std::string failBind;
+
+//
+// Object recording its target operations
+//
+template <typename AfiObjType>
+class TestObject : public AfiObjType
+{
+ public:
+    explicit TestObject(const AfiJsonResource &res) : AfiObjType(res) {}
+
+    static AfiObjectPtr create(const AfiJsonResource &res)
+    {
+        return std::make_shared<TestObject<AfiObjType>>(res);
+    }
+
+    bool bind() override
+    {
+        targetOps.push_back("bind " + this->name());
+        return (this->name() != failBind);
+    }
+
+    bool unbind() override
+    {
+        targetOps.push_back("unbind " + this->name());
+        return true;
+    }
+};
+
+//
+// Cap entry which, like the Broadcom one, looks up its match and action
+// objects by name when it is bound
+//
+class TestCapEntry : public TestObject<AfiCapEntry>
+{
+ public:
+    explicit TestCapEntry(const AfiJsonResource &res)
+        : TestObject<AfiCapEntry>(res)
+    {
+    }
+
+    static AfiObjectPtr create(const AfiJsonResource &res)
+    {
+        return std::make_shared<TestCapEntry>(res);
+    }
+
+    bool bind() override
+    {
+        if ((Afi::instance().getAfiObject(
+                 _capEntry.match_object().value()) == nullptr) ||
+            (Afi::instance().getAfiObject(
+                 _capEntry.action_object().value()) == nullptr)) {
+            targetOps.push_back("missing object " + name());
+            return false;
+        }
+        return TestObject<AfiCapEntry>::bind();
+    }
+};
+
+class TestDevice : public AfiDevice
+{
+ public:
+    TestDevice() : AfiDevice("test") { setObjectCreators(); }
+
+    void setObjectCreators() override
+    {
+        setObjectCreator("afi-cap", &TestObject<AfiCap>::create);
+        setObjectCreator("afi-cap-entry-match",
+                         &TestObject<AfiCapEntryMatch>::create);
+        setObjectCreator("afi-cap-entry-action",
+                         &TestObject<AfiCapEntryAction>::create);
+        setObjectCreator("afi-cap-entry", &TestCapEntry::create);
+    }
+};
+}  // namespace
+
+AfiDeviceUPtr
+createDevice(const std::string &name)
+{
+    return AfiDeviceUPtr(new TestDevice());
+}
+
+//
+// Cap table acl matching the ethertype, with action set_vrf
+//
+class UnitAfiCapEntry : public ::testing::Test
+{
+ protected:
+    static constexpr uint32_t kTable  = 1;
+    static constexpr uint32_t kAction = 2;
+
+    static void SetUpTestCase()
+    {
+        p4::config::P4Info p4info;
+        auto *action = p4info.add_actions();
+        action->mutable_preamble()->set_id(kAction);
+        action->mutable_preamble()->set_name("set_vrf");
+        auto *param = action->add_params();
+        param->set_id(1);
+        param->set_name("vrf_id");
+        param->set_bitwidth(16);
+
+        auto *table = p4info.add_tables();
+        table->mutable_preamble()->set_id(kTable);
+        table->mutable_preamble()->set_name("acl");
+        auto *field = table->add_match_fields();
+        field->set_id(1);
+        field->set_name("hdr.ethernet.ether_type");
+        field->set_bitwidth(16);
+        field->set_match_type(p4::config::MatchField::EXACT);
+        table->add_action_refs()->set_id(kAction);
+
+        std::string    error;
+        P4InfoIndexPtr index = P4Info::build(p4info, error);
+        ASSERT_NE(index, nullptr) << error;
+        P4Info::instance().swap(index);
+
+        Json::Value cap;
+        cap["afi-object-type"] = "afi-cap";
+        cap["afi-object-id"]   = 1;
+        cap["afi-object-name"] = "acl";
+        cap["afi-object"]      = "";
+        Json::Value cfg(Json::arrayValue);
+        cfg.append(cap);
+
+        Afi::instance().init("");
+        pipeline = Afi::instance().stagePipelineConfig(cfg, *index, error);
+        ASSERT_NE(pipeline, nullptr) << error;
+        ASSERT_TRUE(Afi::instance().commitPipeline(pipeline, error)) << error;
+    }
+
+    static void TearDownTestCase() { pipeline.reset(); }
+
+    static AfiPipelinePtr pipeline;  // Committed pipeline
+
+    void SetUp() override
+    {
+        targetOps.clear();
+        failBind.clear();
+    }
+
+    static p4::TableEntry entry(const std::string &etherType)
+    {
+        p4::TableEntry e;
+        e.set_table_id(kTable);
+        auto *mf = e.add_match();
+        mf->set_field_id(1);
+        mf->mutable_exact()->set_value(etherType);
+        return e;
+    }
+
+    static std::vector<AfiTEntryMatchField> match(const std::string &value)
+    {
+        return {AfiTEntryMatchField(1, AfiTEntryMatchField::MfType::EXACT,
+                                    value, 0, "")};
+    }
+
+    static std::vector<AfiAEntry> vrf(const std::string &value)
+    {
+        return {AfiAEntry(1, value)};
+    }
+
+    //
+    // Translate the next update of a batch against the write overlay and
+    // record it there, as the P4Runtime service does for a table entry
+    //
+    static bool batchUpdate(AfiChangeSet &changeSet, AfiShadowOverlay &shadow,
+                            p4::Update_Type type, const std::string &etherType,
+                            const std::string &vrfId,
+                            std::vector<AfiObjectPtr> &objs)
+    {
+        const p4::TableEntry e    = entry(etherType);
+        const std::string    name = AfiShadowStore::entryName(e);
+        p4::TableEntry       installed;
+
+        bool ok = false;
+        switch (type) {
+            case p4::Update_Type_INSERT:
+                ok = Afi::instance().afiAddObjEntry(kTable, kAction,
+                                                    match(etherType),
+                                                    vrf(vrfId), name,
+                                                    &changeSet, &objs);
+                break;
+            case p4::Update_Type_MODIFY:
+                ok = shadow.lookup(e, installed, &objs) &&
+                     Afi::instance().afiModObjEntry(kTable, kAction,
+                                                    match(etherType),
+                                                    vrf(vrfId), name, objs,
+                                                    &changeSet);
+                break;
+            case p4::Update_Type_DELETE:
+                ok = shadow.lookup(e, installed, &objs) &&
+                     Afi::instance().afiDelObjEntry(objs, &changeSet);
+                break;
+            default:
+                break;
+        }
+        if (!ok) {
+            return false;
+        }
+
+        const int last = shadow.lastUpdate(e);
+        if (last >= 0) {
+            changeSet.dependsOn(changeSet.update(), last);
+        }
+        switch (type) {
+            case p4::Update_Type_INSERT:
+                shadow.insert(changeSet.update(), e, objs);
+                break;
+            case p4::Update_Type_MODIFY:
+                shadow.modify(changeSet.update(), e, objs);
+                break;
+            default:
+                shadow.erase(changeSet.update(), e);
+                break;
+        }
+        return true;
+    }
+};
+
+constexpr uint32_t UnitAfiCapEntry::kTable;
+constexpr uint32_t UnitAfiCapEntry::kAction;
+AfiPipelinePtr     UnitAfiCapEntry::pipeline;
+
+// An action-only MODIFY keeps the match object and rebinds the action and
+// the cap entry, which still finds its match object
+TEST_F(UnitAfiCapEntry, ModifyAction)
+{
+    const std::string ethertype("\x08\x00", 2);
+    const std::string name = AfiShadowStore::entryName(entry(ethertype));
+
+    std::vector<AfiObjectPtr> objs;
+    ASSERT_TRUE(Afi::instance().afiAddObjEntry(kTable, kAction,
+                                               match(ethertype),
+                                               vrf(std::string("\x00\x01", 2)),
+                                               name, nullptr, &objs));
+    ASSERT_EQ(objs.size(), 3U);
+    const std::vector<AfiObjectPtr> installed = objs;
+
+    targetOps.clear();
+    ASSERT_TRUE(Afi::instance().afiModObjEntry(kTable, kAction,
+                                               match(ethertype),
+                                               vrf(std::string("\x00\x02", 2)),
+                                               name, objs));
+    ASSERT_EQ(objs.size(), 3U);
+    EXPECT_EQ(objs[0], installed[0]);
+    EXPECT_NE(objs[1], installed[1]);
+    EXPECT_NE(objs[2], installed[2]);
+    EXPECT_EQ(targetOps,
+              OpLog({"unbind acl_entry_action_" + name,
+                     "bind acl_entry_action_" + name,
+                     "unbind acl_entry_" + name, "bind acl_entry_" + name}));
+    for (const auto &obj : objs) {
+        EXPECT_EQ(Afi::instance().getAfiObject(obj->name()), obj);
+    }
+
+    Afi::instance().afiDelObjEntry(objs);
+}
+
+// A MODIFY to the installed action changes nothing
+TEST_F(UnitAfiCapEntry, ModifySame)
+{
+    const std::string ethertype("\x86\xdd", 2);
+    const std::string name = AfiShadowStore::entryName(entry(ethertype));
+
+    std::vector<AfiObjectPtr> objs;
+    ASSERT_TRUE(Afi::instance().afiAddObjEntry(kTable, kAction,
+                                               match(ethertype),
+                                               vrf(std::string("\x00\x01", 2)),
+                                               name, nullptr, &objs));
+    const std::vector<AfiObjectPtr> installed = objs;
+
+    targetOps.clear();
+    ASSERT_TRUE(Afi::instance().afiModObjEntry(kTable, kAction,
+                                               match(ethertype),
+                                               vrf(std::string("\x00\x01", 2)),
+                                               name, objs));
+    EXPECT_EQ(objs, installed);
+    EXPECT_TRUE(targetOps.empty());
+
+    Afi::instance().afiDelObjEntry(objs);
+}
+
+// Unknown objects are not added to the object map by a lookup
+TEST_F(UnitAfiCapEntry, LookupMissing)
+{
+    EXPECT_EQ(Afi::instance().getAfiObject("acl_entry_missing"), nullptr);
+    for (const auto &obj : Afi::instance().getAfiObjects()) {
+        EXPECT_NE(obj, nullptr);
+    }
+}
+
+// Committing the committed pipeline again keeps its objects and only drops
+// the table entries
+TEST_F(UnitAfiCapEntry, CommitAgain)
+{
+    const std::string ethertype("\x08\x06", 2);
+    const std::string name = AfiShadowStore::entryName(entry(ethertype));
+    AfiObjectPtr      cap  = Afi::instance().getAfiObject("acl");
+    ASSERT_NE(cap, nullptr);
+
+    std::vector<AfiObjectPtr> objs;
+    ASSERT_TRUE(Afi::instance().afiAddObjEntry(kTable, kAction,
+                                               match(ethertype),
+                                               vrf(std::string("\x00\x01", 2)),
+                                               name, nullptr, &objs));
+    Afi::instance().shadow().insert(entry(ethertype), objs);
+
+    targetOps.clear();
+    std::string error;
+    ASSERT_TRUE(Afi::instance().commitPipeline(pipeline, error)) << error;
+    EXPECT_EQ(targetOps, OpLog({"unbind acl_entry_" + name,
+                                "unbind acl_entry_action_" + name,
+                                "unbind acl_entry_match_" + name}));
+    EXPECT_EQ(Afi::instance().shadow().size(), 0U);
+    EXPECT_EQ(Afi::instance().getAfiObject("acl"), cap);
+    EXPECT_EQ(Afi::instance().getAfiObject(objs[0]->name()), nullptr);
+}
+
+// INSERT, MODIFY and DELETE of one entry in a batch: the MODIFY finds the
+// objects of the INSERT, the DELETE those of the MODIFY, and nothing is
+// left installed
+TEST_F(UnitAfiCapEntry, BatchInsertModifyDelete)
+{
+    const std::string ethertype("\x88\xcc", 2);
+    const std::string name = AfiShadowStore::entryName(entry(ethertype));
+
+    AfiChangeSet              changeSet(3);
+    AfiShadowOverlay          shadow(Afi::instance().shadow());
+    std::vector<AfiObjectPtr> inserted, modified, deleted;
+
+    ASSERT_TRUE(batchUpdate(changeSet, shadow, p4::Update_Type_INSERT,
+                            ethertype, std::string("\x00\x01", 2),
+                            inserted));
+    changeSet.setUpdate(1);
+    ASSERT_TRUE(batchUpdate(changeSet, shadow, p4::Update_Type_MODIFY,
+                            ethertype, std::string("\x00\x02", 2),
+                            modified));
+    changeSet.setUpdate(2);
+    ASSERT_TRUE(batchUpdate(changeSet, shadow, p4::Update_Type_DELETE,
+                            ethertype, "", deleted));
+
+    ASSERT_EQ(modified.size(), 3U);
+    EXPECT_EQ(modified[0], inserted[0]);
+    EXPECT_NE(modified[1], inserted[1]);
+    EXPECT_EQ(deleted, modified);
+    EXPECT_EQ(shadow.lastUpdate(entry(ethertype)), 2);
+
+    EXPECT_TRUE(Afi::instance().commitChangeSet(changeSet));
+    EXPECT_EQ(targetOps,
+              OpLog({"bind acl_entry_match_" + name,
+                     "bind acl_entry_action_" + name,
+                     "bind acl_entry_" + name,
+                     "unbind acl_entry_action_" + name,
+                     "bind acl_entry_action_" + name,
+                     "unbind acl_entry_" + name, "bind acl_entry_" + name,
+                     "unbind acl_entry_" + name,
+                     "unbind acl_entry_action_" + name,
+                     "unbind acl_entry_match_" + name}));
+    for (const auto &obj : inserted) {
+        EXPECT_EQ(Afi::instance().getAfiObject(obj->name()), nullptr);
+    }
+    EXPECT_EQ(Afi::instance().shadow().size(), 0U);
+}
+
+// A failed INSERT fails the MODIFY and DELETE of the same entry in the
+// batch, and all their operations are rolled back; an unrelated update of
+// the batch is committed
+TEST_F(UnitAfiCapEntry, BatchDependentRolledBack)
+{
+    const std::string ethertype("\x88\x47", 2);
+    const std::string other("\x88\x48", 2);
+    const std::string name = AfiShadowStore::entryName(entry(ethertype));
+
+    AfiChangeSet              changeSet(4);
+    AfiShadowOverlay          shadow(Afi::instance().shadow());
+    std::vector<AfiObjectPtr> inserted, modified, deleted, unrelated;
+
+    ASSERT_TRUE(batchUpdate(changeSet, shadow, p4::Update_Type_INSERT,
+                            ethertype, std::string("\x00\x01", 2),
+                            inserted));
+    changeSet.setUpdate(1);
+    ASSERT_TRUE(batchUpdate(changeSet, shadow, p4::Update_Type_INSERT, other,
+                            std::string("\x00\x01", 2), unrelated));
+    changeSet.setUpdate(2);
+    ASSERT_TRUE(batchUpdate(changeSet, shadow, p4::Update_Type_MODIFY,
+                            ethertype, std::string("\x00\x02", 2),
+                            modified));
+    changeSet.setUpdate(3);
+    ASSERT_TRUE(batchUpdate(changeSet, shadow, p4::Update_Type_DELETE,
+                            ethertype, "", deleted));
+
+    failBind = "acl_entry_" + name;
+    EXPECT_FALSE(Afi::instance().commitChangeSet(changeSet));
+    EXPECT_TRUE(changeSet.failed(0));
+    EXPECT_FALSE(changeSet.failed(1));
+    EXPECT_TRUE(changeSet.failed(2));
+    EXPECT_TRUE(changeSet.failed(3));
+    EXPECT_EQ(changeSet.error(3), "Update 0 failed: " + changeSet.error(0));
+
+    EXPECT_EQ(targetOps,
+              OpLog({"bind acl_entry_match_" + name,
+                     "bind acl_entry_action_" + name,
+                     "bind acl_entry_" + name,
+                     "bind " + unrelated[0]->name(),
+                     "bind " + unrelated[1]->name(),
+                     "bind " + unrelated[2]->name(),
+                     "unbind acl_entry_action_" + name,
+                     "unbind acl_entry_match_" + name}));
+    for (const auto &obj : inserted) {
+        EXPECT_EQ(Afi::instance().getAfiObject(obj->name()), nullptr);
+    }
+    for (const auto &obj : unrelated) {
+        EXPECT_EQ(Afi::instance().getAfiObject(obj->name()), obj);
+    }
+
+    Afi::instance().afiDelObjEntry(unrelated);
+}
@@ -0,0 +1,260 @@
+//
+// GTestAfiChangeSet.cpp - GTESTs
+//
+// Unit GTESTs of AFI change set commits and their rollback
+//
+// Copyright (c) [2018] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "AfiDevice.h"
+
+using namespace AFIHAL;
+
+namespace
+{
+using OpLog = std::vector<std::string>;
+
+//
+// Object recording the target operations done on it
+//
+class TestObject : public AfiObject
+{
+ public:
+    TestObject(const std::string &name, OpLog &log, bool failBind)
+        : AfiObject(AfiJsonResource("test", 0, name, "")),
+          _log(log),
+          _failBind(failBind)
+    {
+    }
+
+    bool bind() override
+    {
+        _log.push_back("bind " + name());
+        if (_failBind) {
+            return false;
+        }
+        bound = true;
+        return true;
+    }
+
+    bool unbind() override
+    {
+        _log.push_back("unbind " + name());
+        bound = false;
+        return true;
+    }
+
+    bool update(const AfiObjectPtr &oldObj) override
+    {
+        _log.push_back("update " + name());
+        std::static_pointer_cast<TestObject>(oldObj)->bound = false;
+        bound = true;
+        return true;
+    }
+
+    std::ostream &description(std::ostream &os) const override
+    {
+        return os << name();
+    }
+
+    bool bound{false};
+
+ private:
+    OpLog &_log;
+    bool   _failBind;
+};
+
+//
+// Device whose target batches can be made to fail
+//
+class TestDevice : public AfiDevice
+{
+ public:
+    TestDevice() : AfiDevice("test") {}
+
+    void setObjectCreators() override {}
+    bool beginBatch() override { return !failBegin; }
+    bool commitBatch() override { return !failCommit; }
+
+    bool failBegin{false};
+    bool failCommit{false};
+};
+}  // namespace
+
+class UnitAfiChangeSet : public ::testing::Test
+{
+ protected:
+    TestDevice device;
+    OpLog      log;
+
+    std::shared_ptr<TestObject> object(const std::string &name,
+                                       bool               failBind = false)
+    {
+        return std::make_shared<TestObject>(name, log, failBind);
+    }
+
+    // A bound object of the object map
+    std::shared_ptr<TestObject> installed(const std::string &name)
+    {
+        auto obj   = object(name);
+        obj->bound = true;
+        device.insertToObjectMap(obj);
+        return obj;
+    }
+
+    // Stage the bind of a new object, added to the object map as the
+    // agent does when it creates it
+    void stage(AfiChangeSet &changeSet, const AfiObjectPtr &obj)
+    {
+        device.insertToObjectMap(obj);
+        changeSet.stage(obj);
+    }
+
+    bool inMap(const AfiObjectPtr &obj)
+    {
+        return device.getAfiObject(obj->name()) == obj;
+    }
+};
+
+TEST_F(UnitAfiChangeSet, Committed)
+{
+    AfiChangeSet changeSet(2);
+    auto         a = object("a");
+    auto         b = object("b");
+    auto         c = object("c");
+    stage(changeSet, a);
+    stage(changeSet, b);
+    changeSet.setUpdate(1);
+    stage(changeSet, c);
+
+    EXPECT_TRUE(device.commitChangeSet(changeSet));
+    EXPECT_EQ(log, OpLog({"bind a", "bind b", "bind c"}));
+    EXPECT_TRUE(a->bound && b->bound && c->bound);
+    EXPECT_TRUE(inMap(a) && inMap(b) && inMap(c));
+}
+
+// A failed bind undoes its update in reverse order, other updates are
+// committed
+TEST_F(UnitAfiChangeSet, FailedUpdateRolledBack)
+{
+    AfiChangeSet changeSet(2);
+    auto         a = object("a");
+    auto         b = object("b");
+    auto         c = object("c", true);
+    auto         d = object("d");
+    stage(changeSet, a);
+    stage(changeSet, b);
+    stage(changeSet, c);
+    stage(changeSet, d);
+    changeSet.setUpdate(1);
+    auto e = object("e");
+    stage(changeSet, e);
+
+    EXPECT_FALSE(device.commitChangeSet(changeSet));
+    EXPECT_EQ(log, OpLog({"bind a", "bind b", "bind c", "bind e", "unbind b",
+                          "unbind a"}));
+    EXPECT_TRUE(changeSet.failed(0));
+    EXPECT_EQ(changeSet.error(0), "Unable to apply afi object c");
+    EXPECT_FALSE(changeSet.failed(1));
+
+    EXPECT_FALSE(a->bound || b->bound || d->bound);
+    EXPECT_FALSE(inMap(a) || inMap(b) || inMap(c) || inMap(d));
+    EXPECT_TRUE(e->bound);
+    EXPECT_TRUE(inMap(e));
+}
+
+// Unbinds and in place updates of a failed update are undone
+TEST_F(UnitAfiChangeSet, UnbindAndUpdateRolledBack)
+{
+    auto deleted = installed("deleted");
+    auto oldObj  = installed("modified");
+    auto newObj  = object("modified");
+
+    AfiChangeSet changeSet(1);
+    changeSet.stageUnbind(deleted);
+    changeSet.stageUpdate(oldObj, newObj);
+    stage(changeSet, object("fails", true));
+
+    EXPECT_FALSE(device.commitChangeSet(changeSet));
+    EXPECT_EQ(log, OpLog({"unbind deleted", "update modified", "bind fails",
+                          "update modified", "bind deleted"}));
+    EXPECT_TRUE(deleted->bound);
+    EXPECT_TRUE(inMap(deleted));
+    EXPECT_TRUE(oldObj->bound);
+    EXPECT_FALSE(newObj->bound);
+    EXPECT_TRUE(inMap(oldObj));
+}
+
+// An update depending on a failed one is skipped and fails with it
+TEST_F(UnitAfiChangeSet, DependentUpdate)
+{
+    AfiChangeSet changeSet(3);
+    stage(changeSet, object("a", true));
+    changeSet.setUpdate(1);
+    auto b = object("b");
+    stage(changeSet, b);
+    changeSet.setUpdate(2);
+    auto c = object("c");
+    stage(changeSet, c);
+    changeSet.dependsOn(1, 0);
+    changeSet.dependsOn(2, 1);
+
+    EXPECT_FALSE(device.commitChangeSet(changeSet));
+    EXPECT_EQ(log, OpLog({"bind a"}));
+    EXPECT_TRUE(changeSet.failed(1));
+    EXPECT_TRUE(changeSet.failed(2));
+    EXPECT_EQ(changeSet.error(2),
+              "Update 0 failed: Unable to apply afi object a");
+    EXPECT_FALSE(inMap(b) || inMap(c));
+}
+
+// Nothing reached the target if the batch is not taken, only the object
+// map is restored
+TEST_F(UnitAfiChangeSet, BatchCommitFailed)
+{
+    auto deleted = installed("deleted");
+    auto a       = object("a");
+
+    AfiChangeSet changeSet(2);
+    changeSet.stageUnbind(deleted);
+    changeSet.setUpdate(1);
+    stage(changeSet, a);
+    device.failCommit = true;
+
+    EXPECT_FALSE(device.commitChangeSet(changeSet));
+    EXPECT_EQ(log, OpLog({"unbind deleted", "bind a"}));
+    EXPECT_EQ(changeSet.error(0), "Target batch commit failed");
+    EXPECT_EQ(changeSet.error(1), "Target batch commit failed");
+    EXPECT_TRUE(inMap(deleted));
+    EXPECT_FALSE(inMap(a));
+}
+
+TEST_F(UnitAfiChangeSet, BatchBeginFailed)
+{
+    AfiChangeSet changeSet(1);
+    auto         a = object("a");
+    stage(changeSet, a);
+    device.failBegin = true;
+
+    EXPECT_FALSE(device.commitChangeSet(changeSet));
+    EXPECT_TRUE(log.empty());
+    EXPECT_EQ(changeSet.error(0), "Unable to open target batch");
+    EXPECT_FALSE(inMap(a));
+}
@@ -0,0 +1,87 @@
+//
+// GTestAfiJsonResource.cpp - GTESTs
+//
+// Unit GTESTs of AFI object resources
+//
+// Copyright (c) [2018] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#include <google/protobuf/wrappers.pb.h>
+
+#include <memory>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "AfiJsonResource.h"
+#include "Utils.h"
+
+using namespace AFIHAL;
+using google::protobuf::Int32Value;
+using google::protobuf::StringValue;
+
+namespace
+{
+AfiJsonResource
+builtRes(const std::string &value)
+{
+    auto msg = std::make_shared<StringValue>();
+    msg->set_value(value);
+    return AfiJsonResource("test", 0, "obj", msg);
+}
+}  // namespace
+
+// An agent built object is moved into the object message, which the
+// object's copy of the resource then refers to
+TEST(UnitAfiJsonResource, TakeBuilt)
+{
+    AfiJsonResource res    = builtRes("abc");
+    AfiJsonResource objRes = res;
+
+    StringValue msg;
+    ASSERT_TRUE(objRes.take(msg));
+    EXPECT_EQ(msg.value(), "abc");
+    EXPECT_EQ(objRes.msg().get(), &msg);
+    EXPECT_TRUE(objRes.sameObject(builtRes("abc")));
+    EXPECT_FALSE(objRes.sameObject(builtRes("abd")));
+
+    // The message was not copied, the resource handed it over
+    EXPECT_TRUE(static_cast<StringValue &>(*res.msg()).value().empty());
+}
+
+// A message of another type is refused
+TEST(UnitAfiJsonResource, TakeWrongType)
+{
+    AfiJsonResource res = builtRes("abc");
+
+    Int32Value msg;
+    EXPECT_FALSE(res.take(msg));
+    EXPECT_EQ(static_cast<StringValue &>(*res.msg()).value(), "abc");
+}
+
+// A json object is decoded from its base64 string
+TEST(UnitAfiJsonResource, TakeJson)
+{
+    StringValue built;
+    built.set_value("json");
+    std::string     bytes = built.SerializeAsString();
+    AfiJsonResource res("test", 0, "obj",
+                        base64_encode(bytes.data(), bytes.size()));
+
+    StringValue msg;
+    ASSERT_TRUE(res.take(msg));
+    EXPECT_EQ(msg.value(), "json");
+    EXPECT_TRUE(res.sameObject(AfiJsonResource("test", 0, "obj",
+                                               res.objStr())));
+}
@@ -0,0 +1,307 @@
+//
+// GTestAfiShadowStore.cpp - GTESTs
+//
+// Unit GTESTs of the AFI shadow store and of its write overlay
+//
+// Copyright (c) [2018] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "AfiShadowStore.h"
+
+using namespace AFIHAL;
+
+class UnitAfiShadowStore : public ::testing::Test
+{
+ protected:
+    AfiShadowStore store;
+
+    static p4::TableEntry exact(uint32_t tableId, const std::string &value)
+    {
+        p4::TableEntry e;
+        e.set_table_id(tableId);
+        auto *mf = e.add_match();
+        mf->set_field_id(1);
+        mf->mutable_exact()->set_value(value);
+        return e;
+    }
+
+    static p4::TableEntry ternary(const std::string &value,
+                                  const std::string &mask,
+                                  int32_t            priority)
+    {
+        p4::TableEntry e;
+        e.set_table_id(1);
+        e.set_priority(priority);
+        auto *mf = e.add_match();
+        mf->set_field_id(1);
+        mf->mutable_ternary()->set_value(value);
+        mf->mutable_ternary()->set_mask(mask);
+        return e;
+    }
+
+    static p4::TableEntry lpm(const std::string &value, int32_t prefixLen)
+    {
+        p4::TableEntry e;
+        e.set_table_id(1);
+        auto *mf = e.add_match();
+        mf->set_field_id(1);
+        mf->mutable_lpm()->set_value(value);
+        mf->mutable_lpm()->set_prefix_len(prefixLen);
+        return e;
+    }
+
+    static p4::TableEntry withAction(p4::TableEntry e, uint32_t actionId)
+    {
+        e.mutable_action()->mutable_action()->set_action_id(actionId);
+        return e;
+    }
+
+    static uint32_t actionOf(const p4::TableEntry &e)
+    {
+        return e.action().action().action_id();
+    }
+
+    // Read a table (all tables if 0) in chunks of chunkSize entries
+    std::vector<std::vector<p4::TableEntry>> readChunks(uint32_t tableId,
+                                                        size_t   chunkSize)
+    {
+        std::vector<std::vector<p4::TableEntry>> chunks;
+        AfiShadowCursor                          cursor;
+        while (!cursor.done) {
+            p4::ReadResponse response;
+            store.read(tableId, cursor, chunkSize, SIZE_MAX, response);
+            std::vector<p4::TableEntry> chunk;
+            for (const auto &entity : response.entities()) {
+                chunk.push_back(entity.table_entry());
+            }
+            chunks.push_back(chunk);
+        }
+        return chunks;
+    }
+};
+
+// Leading zero bytes of a value do not make a different key
+TEST_F(UnitAfiShadowStore, KeyLeadingZeros)
+{
+    EXPECT_EQ(AfiShadowStore::canonicalKey(
+                  exact(1, std::string("\x00\x00\x08\x00", 4))),
+              AfiShadowStore::canonicalKey(
+                  exact(1, std::string("\x08\x00", 2))));
+    EXPECT_NE(AfiShadowStore::canonicalKey(
+                  exact(1, std::string("\x08\x00", 2))),
+              AfiShadowStore::canonicalKey(exact(1, "\x08")));
+}
+
+// Bits outside the mask are ignored, the mask and the priority are not
+TEST_F(UnitAfiShadowStore, KeyTernary)
+{
+    const std::string key =
+        AfiShadowStore::canonicalKey(ternary("\x0a\x0b", "\xff\xf0", 10));
+
+    EXPECT_EQ(AfiShadowStore::canonicalKey(
+                  ternary("\x0a\x0f", "\xff\xf0", 10)),
+              key);
+    EXPECT_NE(AfiShadowStore::canonicalKey(
+                  ternary("\x0a\x0b", "\xff\xff", 10)),
+              key);
+    EXPECT_NE(AfiShadowStore::canonicalKey(
+                  ternary("\x0a\x0b", "\xff\xf0", 20)),
+              key);
+}
+
+// Bits beyond the prefix length are ignored, the prefix length is not
+TEST_F(UnitAfiShadowStore, KeyLpm)
+{
+    EXPECT_EQ(AfiShadowStore::canonicalKey(lpm("\x0a\x01\x02\x03", 16)),
+              AfiShadowStore::canonicalKey(lpm("\x0a\x01\xff\xff", 16)));
+    EXPECT_EQ(AfiShadowStore::canonicalKey(lpm("\x0a\x01\x02\x03", 12)),
+              AfiShadowStore::canonicalKey(lpm("\x0a\x0f\x02\x03", 12)));
+    EXPECT_NE(AfiShadowStore::canonicalKey(lpm("\x0a\x01\x02\x03", 16)),
+              AfiShadowStore::canonicalKey(lpm("\x0a\x01\x02\x03", 24)));
+}
+
+// Match fields are keyed in field id order, whatever the request order
+TEST_F(UnitAfiShadowStore, KeyFieldOrder)
+{
+    p4::TableEntry a;
+    a.set_table_id(1);
+    auto *mf = a.add_match();
+    mf->set_field_id(1);
+    mf->mutable_exact()->set_value("\x01");
+    mf = a.add_match();
+    mf->set_field_id(2);
+    mf->mutable_exact()->set_value("\x02");
+
+    p4::TableEntry b;
+    b.set_table_id(1);
+    *b.add_match() = a.match(1);
+    *b.add_match() = a.match(0);
+
+    EXPECT_EQ(AfiShadowStore::canonicalKey(a),
+              AfiShadowStore::canonicalKey(b));
+}
+
+// Entries are found by their normalized key and keep their match fields
+TEST_F(UnitAfiShadowStore, InsertModifyErase)
+{
+    store.insert(withAction(ternary("\x0a\x0b", "\xff\xf0", 10), 1));
+
+    p4::TableEntry installed;
+    ASSERT_TRUE(store.lookup(ternary("\x0a\x0e", "\xff\xf0", 10), installed));
+    EXPECT_EQ(installed.match(0).ternary().value(), "\x0a\x0b");
+    EXPECT_FALSE(store.lookup(ternary("\x0a\x0b", "\xff\xf0", 20), installed));
+
+    EXPECT_TRUE(
+        store.modify(withAction(ternary("\x0a\x0e", "\xff\xf0", 10), 2), {}));
+    ASSERT_TRUE(store.lookup(ternary("\x0a\x0b", "\xff\xf0", 10), installed));
+    EXPECT_EQ(installed.match(0).ternary().value(), "\x0a\x0b");
+    EXPECT_EQ(actionOf(installed), 2U);
+
+    EXPECT_FALSE(store.modify(withAction(exact(2, "\x01"), 2), {}));
+    EXPECT_TRUE(store.erase(ternary("\x0a\x0b", "\xff\xf0", 10)));
+    EXPECT_FALSE(store.erase(ternary("\x0a\x0b", "\xff\xf0", 10)));
+    EXPECT_EQ(store.size(), 0U);
+}
+
+// A chunked read of all tables resumes after the last entry returned,
+// across table boundaries
+TEST_F(UnitAfiShadowStore, ReadAllTables)
+{
+    for (const char *v : {"\x01", "\x02", "\x03"}) {
+        store.insert(exact(1, v));
+    }
+    for (const char *v : {"\x04", "\x05"}) {
+        store.insert(exact(2, v));
+    }
+    store.insert(exact(3, "\x06"));
+
+    auto chunks = readChunks(0, 2);
+    ASSERT_EQ(chunks.size(), 3U);
+    std::vector<std::string> values;
+    std::vector<uint32_t>    tables;
+    for (const auto &chunk : chunks) {
+        EXPECT_EQ(chunk.size(), 2U);
+        for (const auto &e : chunk) {
+            tables.push_back(e.table_id());
+            values.push_back(e.match(0).exact().value());
+        }
+    }
+    EXPECT_EQ(tables, std::vector<uint32_t>({1, 1, 1, 2, 2, 3}));
+    EXPECT_EQ(values, std::vector<std::string>(
+                          {"\x01", "\x02", "\x03", "\x04", "\x05", "\x06"}));
+}
+
+// A chunked read of one table stops at its end
+TEST_F(UnitAfiShadowStore, ReadOneTable)
+{
+    for (const char *v : {"\x01", "\x02"}) {
+        store.insert(exact(1, v));
+    }
+    for (const char *v : {"\x03", "\x04", "\x05"}) {
+        store.insert(exact(2, v));
+    }
+    store.insert(exact(3, "\x06"));
+
+    auto chunks = readChunks(2, 2);
+    ASSERT_EQ(chunks.size(), 2U);
+    EXPECT_EQ(chunks[0].size(), 2U);
+    ASSERT_EQ(chunks[1].size(), 1U);
+    EXPECT_EQ(chunks[1][0].table_id(), 2U);
+    EXPECT_EQ(chunks[1][0].match(0).exact().value(), "\x05");
+}
+
+// Entries changed between chunks are seen by the rest of the read
+TEST_F(UnitAfiShadowStore, ReadResumesAfterChange)
+{
+    for (const char *v : {"\x01", "\x03", "\x05"}) {
+        store.insert(exact(1, v));
+    }
+
+    AfiShadowCursor  cursor;
+    p4::ReadResponse response;
+    EXPECT_EQ(store.read(1, cursor, 1, SIZE_MAX, response), 1U);
+    EXPECT_FALSE(cursor.done);
+
+    store.erase(exact(1, "\x01"));
+    store.erase(exact(1, "\x03"));
+    store.insert(exact(1, "\x04"));
+
+    response.Clear();
+    EXPECT_EQ(store.read(1, cursor, 10, SIZE_MAX, response), 2U);
+    EXPECT_TRUE(cursor.done);
+    EXPECT_EQ(response.entities(0).table_entry().match(0).exact().value(),
+              "\x04");
+    EXPECT_EQ(response.entities(1).table_entry().match(0).exact().value(),
+              "\x05");
+}
+
+// INSERT, MODIFY and DELETE of one key in a write are seen by the later
+// updates of the write, and leave the store alone
+TEST_F(UnitAfiShadowStore, OverlayOneKey)
+{
+    AfiShadowOverlay overlay(store);
+    p4::TableEntry   key = exact(1, "\x08");
+    p4::TableEntry   installed;
+
+    EXPECT_EQ(overlay.lastUpdate(key), -1);
+    EXPECT_FALSE(overlay.lookup(key, installed));
+
+    overlay.insert(0, withAction(key, 1), {});
+    EXPECT_EQ(overlay.lastUpdate(key), 0);
+    ASSERT_TRUE(overlay.lookup(key, installed));
+    EXPECT_EQ(actionOf(installed), 1U);
+
+    overlay.modify(1, withAction(exact(1, std::string("\x00\x08", 2)), 2),
+                   {});
+    EXPECT_EQ(overlay.lastUpdate(key), 1);
+    ASSERT_TRUE(overlay.lookup(key, installed));
+    EXPECT_EQ(actionOf(installed), 2U);
+    EXPECT_EQ(installed.match(0).exact().value(), "\x08");
+
+    overlay.erase(2, key);
+    EXPECT_EQ(overlay.lastUpdate(key), 2);
+    EXPECT_FALSE(overlay.lookup(key, installed));
+
+    EXPECT_EQ(store.size(), 0U);
+}
+
+// Entries the write did not change are looked up in the store; a DELETE
+// in the write hides an installed entry
+TEST_F(UnitAfiShadowStore, OverlayInstalled)
+{
+    store.insert(withAction(exact(1, "\x01"), 1));
+    store.insert(withAction(exact(1, "\x02"), 1));
+
+    AfiShadowOverlay overlay(store);
+    p4::TableEntry   installed;
+    overlay.erase(0, exact(1, "\x02"));
+
+    EXPECT_TRUE(overlay.lookup(exact(1, "\x01"), installed));
+    EXPECT_EQ(overlay.lastUpdate(exact(1, "\x01")), -1);
+    EXPECT_FALSE(overlay.lookup(exact(1, "\x02"), installed));
+    EXPECT_TRUE(store.lookup(exact(1, "\x02"), installed));
+
+    overlay.modify(1, withAction(exact(1, "\x01"), 2), {});
+    ASSERT_TRUE(overlay.lookup(exact(1, "\x01"), installed));
+    EXPECT_EQ(actionOf(installed), 2U);
+    ASSERT_TRUE(store.lookup(exact(1, "\x01"), installed));
+    EXPECT_EQ(actionOf(installed), 1U);
+}
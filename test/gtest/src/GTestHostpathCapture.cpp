@@ -0,0 +1,322 @@
+//
+// GTestHostpathCapture.cpp - GTESTs
+//
+// Unit GTESTs of the hostpath capture ring and its pcap-ng dumps
+//
+// Copyright (c) [2018] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "HostpathCapture.h"
+
+namespace
+{
+//
+// Blocks of a pcap-ng section, as far as the capture writes them
+//
+struct PcapngBlock {
+    uint32_t             type{0};
+    std::string          ifName;  // Interface description
+    uint32_t             ifId{0};  // Enhanced packet
+    uint64_t             ns{0};
+    uint32_t             capLen{0};
+    uint32_t             len{0};
+    uint32_t             flags{0};
+    std::vector<uint8_t> data;
+};
+
+uint16_t
+get16(const std::string &buf, size_t off)
+{
+    uint16_t v;
+    memcpy(&v, &buf[off], sizeof(v));
+    return v;
+}
+
+uint32_t
+get32(const std::string &buf, size_t off)
+{
+    uint32_t v;
+    memcpy(&v, &buf[off], sizeof(v));
+    return v;
+}
+
+//
+// Parse the options from off to the end of the block at end
+//
+void
+parseOptions(const std::string &buf, size_t off, size_t end,
+             PcapngBlock &block)
+{
+    while (off + 4 <= end) {
+        uint16_t code = get16(buf, off);
+        uint16_t len  = get16(buf, off + 2);
+        off += 4;
+        if (code == 0) {
+            break;
+        }
+        if ((block.type == 1) && (code == 2)) {
+            block.ifName = buf.substr(off, len);
+        } else if ((block.type == 6) && (code == 2)) {
+            block.flags = get32(buf, off);
+        }
+        off += (len + 3) & ~3U;
+    }
+}
+
+//
+// Split a pcap-ng section in blocks, checking their framing
+//
+std::vector<PcapngBlock>
+parsePcapng(const std::string &buf)
+{
+    std::vector<PcapngBlock> blocks;
+    size_t                   off = 0;
+    while (off < buf.size()) {
+        EXPECT_LE(off + 12, buf.size());
+        PcapngBlock block;
+        block.type   = get32(buf, off);
+        uint32_t len = get32(buf, off + 4);
+        EXPECT_EQ(len % 4, 0U);
+        EXPECT_LE(off + len, buf.size());
+        if ((len < 12) || (off + len > buf.size())) {
+            break;
+        }
+        EXPECT_EQ(get32(buf, off + len - 4), len);
+        size_t end = off + len - 4;
+
+        if (block.type == 0x0a0d0d0a) {
+            EXPECT_EQ(get32(buf, off + 8), 0x1a2b3c4dU);
+            EXPECT_EQ(get16(buf, off + 12), 1);
+        } else if (block.type == 1) {
+            EXPECT_EQ(get16(buf, off + 8), 1);  // Ethernet
+            parseOptions(buf, off + 16, end, block);
+        } else if (block.type == 6) {
+            block.ifId   = get32(buf, off + 8);
+            block.ns     = (uint64_t(get32(buf, off + 12)) << 32) |
+                       get32(buf, off + 16);
+            block.capLen = get32(buf, off + 20);
+            block.len    = get32(buf, off + 24);
+            const char *data = &buf[off + 28];
+            block.data.assign(data, data + block.capLen);
+            parseOptions(buf, off + 28 + ((block.capLen + 3) & ~3U), end,
+                         block);
+        } else {
+            ADD_FAILURE() << "Unexpected block type " << block.type;
+        }
+        blocks.push_back(block);
+        off += len;
+    }
+    return blocks;
+}
+
+std::vector<uint8_t>
+frame(size_t len, uint8_t seed)
+{
+    std::vector<uint8_t> f(len);
+    for (size_t i = 0; i < len; i++) {
+        f[i] = uint8_t(seed + i);
+    }
+    return f;
+}
+}  // namespace
+
+//
+// The capture is a singleton, every test configures it afresh with a
+// dump directory of its own
+//
+class UnitHostpathCapture : public ::testing::Test
+{
+ protected:
+    static constexpr uint32_t kSnapLen = 64;
+
+    HostpathCapture &capture{HostpathCapture::instance()};
+    std::string      dir;
+    std::vector<std::string> files;
+
+    void SetUp() override
+    {
+        dir = "/tmp/jp4agent-gtest-capture-" + std::to_string(getpid());
+        capture.configure(4, kSnapLen, dir);
+    }
+
+    void TearDown() override
+    {
+        for (const auto &f : files) {
+            ::unlink((dir + "/" + f).c_str());
+        }
+        ::rmdir(dir.c_str());
+        capture.configure(0, 0, "");
+    }
+
+    void record(HostpathCapture::Dir d, uint16_t port,
+                const std::vector<uint8_t> &f)
+    {
+        capture.record(d, port, f.data(), f.size());
+    }
+
+    std::vector<PcapngBlock> blocks(const HostpathCaptureFilter &filter,
+                                    size_t &count)
+    {
+        return parsePcapng(capture.pcapng(filter, count));
+    }
+};
+
+constexpr uint32_t UnitHostpathCapture::kSnapLen;
+
+TEST_F(UnitHostpathCapture, Disabled)
+{
+    capture.configure(0, kSnapLen, "");
+    EXPECT_FALSE(capture.enabled());
+    record(HostpathCapture::Punt, 1, frame(60, 0));
+
+    size_t count  = 1;
+    auto   blocks = this->blocks(HostpathCaptureFilter(), count);
+    EXPECT_EQ(count, 0U);
+    ASSERT_EQ(blocks.size(), 1U);
+    EXPECT_EQ(blocks[0].type, 0x0a0d0d0aU);
+}
+
+// One interface per port, described before its first packet, and the
+// direction in the packet flags
+TEST_F(UnitHostpathCapture, Packets)
+{
+    ASSERT_TRUE(capture.enabled());
+    record(HostpathCapture::Punt, 5, frame(61, 1));
+    record(HostpathCapture::Inject, 9, frame(62, 2));
+    record(HostpathCapture::Inject, 5, frame(63, 3));
+
+    size_t count  = 0;
+    auto   blocks = this->blocks(HostpathCaptureFilter(), count);
+    EXPECT_EQ(count, 3U);
+    ASSERT_EQ(blocks.size(), 6U);
+
+    EXPECT_EQ(blocks[0].type, 0x0a0d0d0aU);
+    EXPECT_EQ(blocks[1].type, 1U);
+    EXPECT_EQ(blocks[1].ifName, "port5");
+    EXPECT_EQ(blocks[2].type, 6U);
+    EXPECT_EQ(blocks[2].ifId, 0U);
+    EXPECT_EQ(blocks[2].flags, 1U);
+    EXPECT_EQ(blocks[2].data, frame(61, 1));
+    EXPECT_EQ(blocks[2].len, 61U);
+    EXPECT_NE(blocks[2].ns, 0U);
+
+    EXPECT_EQ(blocks[3].type, 1U);
+    EXPECT_EQ(blocks[3].ifName, "port9");
+    EXPECT_EQ(blocks[4].ifId, 1U);
+    EXPECT_EQ(blocks[4].flags, 2U);
+    EXPECT_EQ(blocks[4].data, frame(62, 2));
+
+    EXPECT_EQ(blocks[5].ifId, 0U);
+    EXPECT_EQ(blocks[5].flags, 2U);
+    EXPECT_EQ(blocks[5].data, frame(63, 3));
+    EXPECT_GE(blocks[5].ns, blocks[2].ns);
+}
+
+// Frames are cut at the snap length, their length kept
+TEST_F(UnitHostpathCapture, SnapLen)
+{
+    record(HostpathCapture::Punt, 1, frame(1500, 0));
+
+    size_t count  = 0;
+    auto   blocks = this->blocks(HostpathCaptureFilter(), count);
+    ASSERT_EQ(blocks.size(), 3U);
+    EXPECT_EQ(blocks[2].capLen, kSnapLen);
+    EXPECT_EQ(blocks[2].len, 1500U);
+    EXPECT_EQ(blocks[2].data, frame(kSnapLen, 0));
+}
+
+// A full ring keeps the last packets, oldest first
+TEST_F(UnitHostpathCapture, Wrap)
+{
+    for (uint8_t i = 0; i < 6; i++) {
+        record(HostpathCapture::Punt, 1, frame(60, i));
+    }
+
+    size_t count  = 0;
+    auto   blocks = this->blocks(HostpathCaptureFilter(), count);
+    EXPECT_EQ(count, 4U);
+    ASSERT_EQ(blocks.size(), 6U);
+    for (uint8_t i = 0; i < 4; i++) {
+        EXPECT_EQ(blocks[2 + i].data, frame(60, i + 2)) << int(i);
+    }
+}
+
+TEST_F(UnitHostpathCapture, Filter)
+{
+    record(HostpathCapture::Punt, 1, frame(60, 1));
+    record(HostpathCapture::Inject, 1, frame(60, 2));
+    record(HostpathCapture::Punt, 2, frame(60, 3));
+
+    HostpathCaptureFilter filter;
+    filter.port  = 1;
+    size_t count = 0;
+    auto   blocks = this->blocks(filter, count);
+    EXPECT_EQ(count, 2U);
+    ASSERT_EQ(blocks.size(), 4U);
+    EXPECT_EQ(blocks[1].ifName, "port1");
+
+    filter.dir = HostpathCapture::Inject;
+    blocks     = this->blocks(filter, count);
+    EXPECT_EQ(count, 1U);
+    ASSERT_EQ(blocks.size(), 3U);
+    EXPECT_EQ(blocks[2].data, frame(60, 2));
+
+    filter.port = 3;
+    blocks      = this->blocks(filter, count);
+    EXPECT_EQ(count, 0U);
+    EXPECT_EQ(blocks.size(), 1U);
+}
+
+// Dumps create new files of the capture directory only
+TEST_F(UnitHostpathCapture, Dump)
+{
+    record(HostpathCapture::Punt, 1, frame(60, 1));
+
+    size_t      count = 0;
+    std::string error;
+    files.push_back("dump.pcapng");
+    ASSERT_TRUE(capture.dump("dump.pcapng", HostpathCaptureFilter(), count,
+                             error))
+        << error;
+    EXPECT_EQ(count, 1U);
+
+    std::ifstream     in(dir + "/dump.pcapng", std::ios::binary);
+    std::stringstream contents;
+    contents << in.rdbuf();
+    size_t unused;
+    EXPECT_EQ(contents.str(), capture.pcapng(HostpathCaptureFilter(), unused));
+
+    EXPECT_FALSE(capture.dump("dump.pcapng", HostpathCaptureFilter(), count,
+                              error));
+    for (const char *name : {"", ".", "..", "../dump.pcapng", "a/b"}) {
+        EXPECT_FALSE(
+            capture.dump(name, HostpathCaptureFilter(), count, error))
+            << name;
+    }
+
+    capture.configure(4, kSnapLen, "");
+    EXPECT_FALSE(capture.dump("other.pcapng", HostpathCaptureFilter(), count,
+                              error));
+}
@@ -0,0 +1,191 @@
+//
+// GTestHostpathShm.cpp - GTESTs
+//
+// Unit GTESTs of the shared memory hostpath transport
+//
+// Copyright (c) [2018] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#include <unistd.h>
+
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "HostpathShm.h"
+
+using namespace std::chrono_literals;
+
+//
+// Agent side transport and one PktIO peer connected to it
+//
+class UnitHostpathShm : public ::testing::Test
+{
+ protected:
+    static constexpr uint32_t kSlots    = 4;
+    static constexpr uint32_t kMaxFrame = 256;
+
+    std::string                           sockPath;
+    std::unique_ptr<HostpathShmTransport> agent;
+    std::unique_ptr<HostpathShmPeer>      peer;
+
+    void SetUp() override
+    {
+        sockPath = "/tmp/jp4agent-gtest-shm-" + std::to_string(getpid()) +
+                   ".sock";
+        agent.reset(new HostpathShmTransport(sockPath, kSlots, kMaxFrame));
+        ASSERT_TRUE(agent->start());
+        peer.reset(new HostpathShmPeer());
+        ASSERT_TRUE(peer->connect(sockPath));
+    }
+
+    HostpathShmPeer &pktio() { return *peer; }
+
+    static std::vector<uint8_t> packet(size_t len, uint8_t seed)
+    {
+        std::vector<uint8_t> pkt(len);
+        for (size_t i = 0; i < len; i++) {
+            pkt[i] = uint8_t(seed + i);
+        }
+        return pkt;
+    }
+
+    static std::vector<uint8_t> popPacket(HostpathShmRing &ring)
+    {
+        size_t         len = 0;
+        const uint8_t *p   = ring.front(len);
+        if (p == nullptr) {
+            return {};
+        }
+        std::vector<uint8_t> pkt(p, p + len);
+        ring.pop();
+        return pkt;
+    }
+};
+
+constexpr uint32_t UnitHostpathShm::kSlots;
+constexpr uint32_t UnitHostpathShm::kMaxFrame;
+
+// Packets pushed by PktIO reach the agent and the other way round
+TEST_F(UnitHostpathShm, RoundTrip)
+{
+    auto punted = packet(64, 1);
+    ASSERT_TRUE(pktio().punt().push(punted.data(), punted.size()));
+    EXPECT_EQ(popPacket(agent->punt()), punted);
+    EXPECT_TRUE(popPacket(agent->punt()).empty());
+
+    // Injected in two parts, device header first
+    auto hdr      = packet(8, 100);
+    auto payload  = packet(120, 7);
+    auto injected = hdr;
+    injected.insert(injected.end(), payload.begin(), payload.end());
+    ASSERT_TRUE(agent->inject().push(hdr.data(), hdr.size(), payload.data(),
+                                     payload.size()));
+    EXPECT_EQ(popPacket(pktio().inject()), injected);
+    EXPECT_TRUE(popPacket(pktio().inject()).empty());
+}
+
+// A consumer waiting on the doorbell is woken by the producer
+TEST_F(UnitHostpathShm, Doorbell)
+{
+    auto punted = packet(32, 3);
+    std::thread producer([&] {
+        std::this_thread::sleep_for(50ms);
+        pktio().punt().push(punted.data(), punted.size());
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    agent->punt().wait(5000);
+    auto waited = std::chrono::steady_clock::now() - start;
+    producer.join();
+
+    EXPECT_LT(waited, 4s);
+    EXPECT_EQ(popPacket(agent->punt()), punted);
+}
+
+// A full ring refuses packets until the consumer frees a slot
+TEST_F(UnitHostpathShm, FullRing)
+{
+    for (uint32_t i = 0; i < kSlots; i++) {
+        auto pkt = packet(60, uint8_t(i));
+        ASSERT_TRUE(pktio().punt().push(pkt.data(), pkt.size())) << i;
+    }
+    auto extra = packet(60, 0xee);
+    EXPECT_FALSE(pktio().punt().push(extra.data(), extra.size()));
+
+    EXPECT_EQ(popPacket(agent->punt()), packet(60, 0));
+    EXPECT_TRUE(pktio().punt().push(extra.data(), extra.size()));
+
+    for (uint32_t i = 1; i < kSlots; i++) {
+        EXPECT_EQ(popPacket(agent->punt()), packet(60, uint8_t(i)));
+    }
+    EXPECT_EQ(popPacket(agent->punt()), extra);
+}
+
+// Packets larger than a slot are refused
+TEST_F(UnitHostpathShm, Oversize)
+{
+    uint32_t maxFrame = pktio().punt().maxFrame();
+    EXPECT_GE(maxFrame, kMaxFrame);
+
+    auto fits = packet(maxFrame, 0);
+    EXPECT_TRUE(pktio().punt().push(fits.data(), fits.size()));
+    auto big = packet(maxFrame + 1, 0);
+    EXPECT_FALSE(pktio().punt().push(big.data(), big.size()));
+    EXPECT_FALSE(pktio().punt().push(big.data(), 8, big.data() + 8,
+                                   big.size() - 8));
+}
+
+// A slot whose length the producer scribbled over reads as length 0 and
+// can still be released
+TEST_F(UnitHostpathShm, BadLengthSlot)
+{
+    auto pkt = packet(40, 9);
+    ASSERT_TRUE(pktio().punt().push(pkt.data(), pkt.size()));
+    ASSERT_TRUE(pktio().punt().push(pkt.data(), pkt.size()));
+
+    size_t         len  = 0;
+    const uint8_t *data = agent->punt().front(len);
+    ASSERT_NE(data, nullptr);
+    uint32_t bogus = 0xffffffff;
+    std::memcpy(const_cast<uint8_t *>(data) - HostpathShmRing::kSlotHeader,
+                &bogus, sizeof(bogus));
+
+    ASSERT_NE(agent->punt().front(len), nullptr);
+    EXPECT_EQ(len, 0U);
+    agent->punt().pop();
+
+    EXPECT_EQ(popPacket(agent->punt()), pkt);
+}
+
+// Only one PktIO gets the rings at a time
+TEST_F(UnitHostpathShm, OnePeer)
+{
+    HostpathShmPeer second;
+    EXPECT_FALSE(second.connect(sockPath));
+
+    // Free once the first one let go of them
+    peer.reset();
+    bool connected = false;
+    for (int i = 0; (i < 50) && !connected; i++) {
+        std::this_thread::sleep_for(10ms);
+        connected = second.connect(sockPath);
+    }
+    EXPECT_TRUE(connected);
+}
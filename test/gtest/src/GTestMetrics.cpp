@@ -0,0 +1,157 @@
+//
+// GTestMetrics.cpp - GTESTs
+//
+// Unit GTESTs of the metrics registry and latency histograms
+//
+// Copyright (c) [2018] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "Metrics.h"
+
+TEST(UnitMetricHistogram, Empty)
+{
+    MetricHistogram h;
+    EXPECT_EQ(h.count(), 0U);
+    EXPECT_EQ(h.sum(), 0U);
+    EXPECT_EQ(h.max(), 0U);
+    EXPECT_EQ(h.quantile(0.5), 0U);
+    EXPECT_EQ(h.quantile(1.0), 0U);
+}
+
+TEST(UnitMetricHistogram, CountSumMax)
+{
+    MetricHistogram h;
+    h.record(100);
+    h.record(3000);
+    h.record(20);
+    EXPECT_EQ(h.count(), 3U);
+    EXPECT_EQ(h.sum(), 3120U);
+    EXPECT_EQ(h.max(), 3000U);
+}
+
+// Values below kSub have a bucket each
+TEST(UnitMetricHistogram, SmallValuesExact)
+{
+    MetricHistogram h;
+    for (uint64_t ns = 0; ns < MetricHistogram::kSub; ns++) {
+        h.record(ns);
+    }
+    EXPECT_EQ(h.quantile(0.0), 0U);
+    EXPECT_EQ(h.quantile(0.5), MetricHistogram::kSub / 2 - 1);
+    EXPECT_EQ(h.quantile(1.0), MetricHistogram::kSub - 1);
+}
+
+// A value is reported as the upper bound of its bucket, less than 1/kSub
+// above it, and never above the maximum
+TEST(UnitMetricHistogram, BucketError)
+{
+    for (uint64_t ns = 1; ns < (1ULL << 40); ns = ns * 3 + 1) {
+        MetricHistogram h;
+        h.record(ns);
+        h.record(ns + ns / 2);
+        uint64_t q = h.quantile(0.5);
+        EXPECT_GE(q, ns) << ns;
+        EXPECT_LE(q, ns + ns / MetricHistogram::kSub) << ns;
+        EXPECT_LE(h.quantile(1.0), h.max()) << ns;
+    }
+}
+
+// Values past the last bucket are clamped, the maximum is kept
+TEST(UnitMetricHistogram, Clamped)
+{
+    MetricHistogram h;
+    uint64_t        huge = 1ULL << 60;
+    h.record(huge);
+    EXPECT_EQ(h.max(), huge);
+    EXPECT_GE(h.quantile(0.5), (1ULL << MetricHistogram::kMaxBits) - 1);
+    EXPECT_LE(h.quantile(0.5), huge);
+}
+
+TEST(UnitMetricHistogram, Quantiles)
+{
+    MetricHistogram h;
+    for (uint64_t us = 1; us <= 1000; us++) {
+        h.record(us * 1000);
+    }
+    uint64_t p50 = h.quantile(0.5);
+    uint64_t p99 = h.quantile(0.99);
+    EXPECT_GE(p50, 500000U);
+    EXPECT_LE(p50, 500000U + 500000U / MetricHistogram::kSub);
+    EXPECT_GE(p99, 990000U);
+    EXPECT_LE(p99, 1000000U);
+    EXPECT_EQ(h.quantile(1.0), 1000000U);
+}
+
+TEST(UnitMetricHistogram, ConcurrentRecord)
+{
+    constexpr int kThreads = 4;
+    constexpr int kRecords = 10000;
+
+    MetricHistogram          h;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; t++) {
+        threads.emplace_back([&h, t] {
+            for (int i = 0; i < kRecords; i++) {
+                h.record(uint64_t(t) * kRecords + i);
+            }
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    EXPECT_EQ(h.count(), uint64_t(kThreads) * kRecords);
+    EXPECT_EQ(h.max(), uint64_t(kThreads) * kRecords - 1);
+}
+
+// A metric is looked up once per name and labels
+TEST(UnitMetrics, Lookup)
+{
+    Metrics &m = Metrics::instance();
+    EXPECT_EQ(&m.counter("jp4_gtest_total", "Test", "a=\"1\""),
+              &m.counter("jp4_gtest_total", "Test", "a=\"1\""));
+    EXPECT_NE(&m.counter("jp4_gtest_total", "Test", "a=\"1\""),
+              &m.counter("jp4_gtest_total", "Test", "a=\"2\""));
+    EXPECT_EQ(&m.histogram("jp4_gtest_seconds", "Test"),
+              &m.histogram("jp4_gtest_seconds", "Test"));
+}
+
+TEST(UnitMetrics, Render)
+{
+    Metrics &m = Metrics::instance();
+    m.counter("jp4_gtest_render_total", "Test counter", "a=\"1\"").inc(3);
+    m.gauge("jp4_gtest_render_depth", "Test gauge", [] { return 7.0; });
+    MetricHistogram &h =
+        m.histogram("jp4_gtest_render_seconds", "Test histogram");
+    h.record(2000000000);
+
+    std::string text = m.render();
+    for (const char *line :
+         {"# HELP jp4_gtest_render_total Test counter\n",
+          "# TYPE jp4_gtest_render_total counter\n",
+          "jp4_gtest_render_total{a=\"1\"} 3\n",
+          "# TYPE jp4_gtest_render_depth gauge\n",
+          "jp4_gtest_render_depth 7\n",
+          "# TYPE jp4_gtest_render_seconds summary\n",
+          "jp4_gtest_render_seconds{quantile=\"1\"} 2\n",
+          "jp4_gtest_render_seconds_sum 2\n",
+          "jp4_gtest_render_seconds_count 1\n"}) {
+        EXPECT_NE(text.find(line), std::string::npos) << line;
+    }
+}
@@ -0,0 +1,165 @@
+//
+// GTestP4InfoPacketMetadata.cpp - GTESTs
+//
+// Unit GTESTs of the PacketIn and PacketOut metadata layout
+//
+// Copyright (c) [2018] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#include <string>
+
+#include "gtest/gtest.h"
+#include "pvtPI.h"
+
+//
+// packet_in header of ingress_port (9 bits), reason (16 bits) and
+// padding (7 bits)
+//
+class UnitP4InfoPacketMetadata : public ::testing::Test
+{
+ protected:
+    p4::config::ControllerPacketMetadata header;
+    P4InfoPacketMetadata                 layout;
+    std::string                          error;
+
+    void SetUp() override
+    {
+        header.mutable_preamble()->set_name("packet_in");
+        addField(1, "ingress_port", 9);
+        addField(2, "reason", 16);
+        addField(3, "_padding", 7);
+    }
+
+    void addField(uint32_t id, const std::string &name, int32_t bitWidth)
+    {
+        auto *md = header.add_metadata();
+        md->set_id(id);
+        md->set_name(name);
+        md->set_bitwidth(bitWidth);
+    }
+
+    static void addMetadata(p4::PacketOut &packetOut, uint32_t id,
+                            const std::string &value)
+    {
+        auto *md = packetOut.add_metadata();
+        md->set_metadata_id(id);
+        md->set_value(value);
+    }
+};
+
+TEST_F(UnitP4InfoPacketMetadata, Compile)
+{
+    ASSERT_TRUE(layout.compile(header, error)) << error;
+    ASSERT_TRUE(layout.present());
+
+    const auto &fields = layout.fields();
+    ASSERT_EQ(fields.size(), 3U);
+    EXPECT_EQ(fields[0].id, 1U);
+    EXPECT_EQ(fields[0].bytes, 2U);
+    EXPECT_EQ(fields[0].role, P4InfoPacketMetadataField::Port);
+    EXPECT_EQ(fields[1].bytes, 2U);
+    EXPECT_EQ(fields[1].role, P4InfoPacketMetadataField::Reason);
+    EXPECT_EQ(fields[2].bytes, 1U);
+    EXPECT_EQ(fields[2].role, P4InfoPacketMetadataField::Other);
+}
+
+TEST_F(UnitP4InfoPacketMetadata, NoHeader)
+{
+    p4::config::ControllerPacketMetadata none;
+    ASSERT_TRUE(layout.compile(none, error)) << error;
+    EXPECT_FALSE(layout.present());
+
+    p4::PacketOut packetOut;
+    uint16_t      port = 0;
+    EXPECT_FALSE(layout.port(packetOut, port));
+}
+
+TEST_F(UnitP4InfoPacketMetadata, BadHeader)
+{
+    addField(1, "duplicate", 8);
+    EXPECT_FALSE(layout.compile(header, error));
+    EXPECT_NE(error.find("bad metadata id 1"), std::string::npos) << error;
+
+    header.mutable_metadata()->RemoveLast();
+    addField(0, "no_id", 8);
+    EXPECT_FALSE(layout.compile(header, error));
+
+    header.mutable_metadata()->RemoveLast();
+    addField(4, "no_width", 0);
+    EXPECT_FALSE(layout.compile(header, error));
+    EXPECT_NE(error.find("no_width"), std::string::npos) << error;
+}
+
+// Values are big endian in whole bytes, masked to the bitwidth
+TEST_F(UnitP4InfoPacketMetadata, Encode)
+{
+    ASSERT_TRUE(layout.compile(header, error)) << error;
+
+    p4::PacketIn packetIn;
+    layout.encode(0x3ab, 0x1234, packetIn);
+    ASSERT_EQ(packetIn.metadata_size(), 3);
+    EXPECT_EQ(packetIn.metadata(0).metadata_id(), 1U);
+    EXPECT_EQ(packetIn.metadata(0).value(), std::string("\x01\xab", 2));
+    EXPECT_EQ(packetIn.metadata(1).metadata_id(), 2U);
+    EXPECT_EQ(packetIn.metadata(1).value(), std::string("\x12\x34", 2));
+    EXPECT_EQ(packetIn.metadata(2).metadata_id(), 3U);
+    EXPECT_EQ(packetIn.metadata(2).value(), std::string("\x00", 1));
+    EXPECT_EQ(layout.reason(packetIn), 0x1234);
+}
+
+// A reused PacketIn gets exactly the fields of the header
+TEST_F(UnitP4InfoPacketMetadata, EncodeReused)
+{
+    ASSERT_TRUE(layout.compile(header, error)) << error;
+
+    p4::PacketIn packetIn;
+    for (int i = 0; i < 5; i++) {
+        auto *md = packetIn.add_metadata();
+        md->set_metadata_id(100 + i);
+        md->set_value("stale value");
+    }
+    layout.encode(7, 2, packetIn);
+    ASSERT_EQ(packetIn.metadata_size(), 3);
+    EXPECT_EQ(packetIn.metadata(0).value(), std::string("\x00\x07", 2));
+    EXPECT_EQ(packetIn.metadata(2).metadata_id(), 3U);
+    EXPECT_EQ(packetIn.metadata(2).value(), std::string("\x00", 1));
+    EXPECT_EQ(layout.reason(packetIn), 2);
+}
+
+TEST_F(UnitP4InfoPacketMetadata, NoReason)
+{
+    header.mutable_metadata()->DeleteSubrange(1, 2);
+    ASSERT_TRUE(layout.compile(header, error)) << error;
+
+    p4::PacketIn packetIn;
+    layout.encode(7, 2, packetIn);
+    ASSERT_EQ(packetIn.metadata_size(), 1);
+    EXPECT_EQ(layout.reason(packetIn), 0);
+}
+
+// The egress port is matched by id, in any order
+TEST_F(UnitP4InfoPacketMetadata, Port)
+{
+    ASSERT_TRUE(layout.compile(header, error)) << error;
+
+    p4::PacketOut packetOut;
+    uint16_t      port = 0;
+    addMetadata(packetOut, 3, std::string("\x00", 1));
+    EXPECT_FALSE(layout.port(packetOut, port));
+
+    addMetadata(packetOut, 1, std::string("\x01\x02", 2));
+    ASSERT_TRUE(layout.port(packetOut, port));
+    EXPECT_EQ(port, 0x102);
+}
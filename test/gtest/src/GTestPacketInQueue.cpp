@@ -0,0 +1,219 @@
+//
+// GTestPacketInQueue.cpp - GTESTs
+//
+// Unit GTESTs of the PacketIn queue and its overflow policies
+//
+// Copyright (c) [2018] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "PacketInQueue.h"
+
+//
+// PacketIns tagged with a number in their payload
+//
+class UnitPacketInQueue : public ::testing::Test
+{
+ protected:
+    static bool push(PacketInQueue &queue, int n, bool priority = false)
+    {
+        p4::PacketIn pkt;
+        pkt.set_payload(std::to_string(n));
+        return queue.push(pkt, priority);
+    }
+
+    static int pop(PacketInQueue &queue)
+    {
+        p4::PacketIn pkt;
+        if (!queue.pop(pkt)) {
+            return -1;
+        }
+        return std::stoi(pkt.payload());
+    }
+
+    static PacketInQueueConfig config(size_t size, PacketInOverflow overflow)
+    {
+        PacketInQueueConfig cfg;
+        cfg.size     = size;
+        cfg.overflow = overflow;
+        return cfg;
+    }
+};
+
+TEST_F(UnitPacketInQueue, OverflowFromStr)
+{
+    PacketInOverflow policy;
+    ASSERT_TRUE(packetInOverflowFromStr("drop-oldest", policy));
+    EXPECT_EQ(policy, PacketInOverflow::DropOldest);
+    ASSERT_TRUE(packetInOverflowFromStr("drop-newest", policy));
+    EXPECT_EQ(policy, PacketInOverflow::DropNewest);
+    ASSERT_TRUE(packetInOverflowFromStr("priority", policy));
+    EXPECT_EQ(policy, PacketInOverflow::Priority);
+    EXPECT_FALSE(packetInOverflowFromStr("drop-all", policy));
+}
+
+// PacketIns come out in order with their punt timestamps
+TEST_F(UnitPacketInQueue, Fifo)
+{
+    PacketInQueue queue(config(4, PacketInOverflow::DropNewest));
+    EXPECT_TRUE(queue.empty());
+
+    p4::PacketIn  pkt;
+    PacketInTimes times;
+    times.ingress = 10;
+    times.queued  = 20;
+    pkt.set_payload("0");
+    ASSERT_TRUE(queue.push(pkt, false, times));
+    ASSERT_TRUE(push(queue, 1));
+    EXPECT_EQ(queue.size(), 2U);
+
+    PacketInTimes popped;
+    ASSERT_TRUE(queue.pop(pkt, popped));
+    EXPECT_EQ(pkt.payload(), "0");
+    EXPECT_EQ(popped.ingress, 10U);
+    EXPECT_EQ(popped.queued, 20U);
+    EXPECT_EQ(pop(queue), 1);
+    EXPECT_EQ(pop(queue), -1);
+    EXPECT_TRUE(queue.empty());
+}
+
+// The size is rounded up to a power of 2
+TEST_F(UnitPacketInQueue, SizeRoundedUp)
+{
+    PacketInQueue queue(config(5, PacketInOverflow::DropNewest));
+    for (int i = 0; i < 8; i++) {
+        EXPECT_TRUE(push(queue, i)) << i;
+    }
+    EXPECT_FALSE(push(queue, 8));
+    EXPECT_EQ(queue.size(), 8U);
+}
+
+TEST_F(UnitPacketInQueue, DropOldest)
+{
+    MetricCounter &dropped = packetInCounter("dropped-oldest");
+    uint64_t       before  = dropped.value();
+
+    PacketInQueue queue(config(4, PacketInOverflow::DropOldest));
+    for (int i = 0; i < 6; i++) {
+        EXPECT_TRUE(push(queue, i)) << i;
+    }
+    EXPECT_EQ(dropped.value() - before, 2U);
+
+    for (int i = 2; i < 6; i++) {
+        EXPECT_EQ(pop(queue), i);
+    }
+    EXPECT_TRUE(queue.empty());
+}
+
+TEST_F(UnitPacketInQueue, DropNewest)
+{
+    MetricCounter &dropped = packetInCounter("dropped-newest");
+    uint64_t       before  = dropped.value();
+
+    PacketInQueue queue(config(4, PacketInOverflow::DropNewest));
+    for (int i = 0; i < 4; i++) {
+        EXPECT_TRUE(push(queue, i)) << i;
+    }
+    EXPECT_FALSE(push(queue, 4));
+    EXPECT_FALSE(push(queue, 5, true));
+    EXPECT_EQ(dropped.value() - before, 2U);
+
+    for (int i = 0; i < 4; i++) {
+        EXPECT_EQ(pop(queue), i);
+    }
+    EXPECT_TRUE(queue.empty());
+}
+
+TEST_F(UnitPacketInQueue, Clear)
+{
+    PacketInQueue queue(config(4, PacketInOverflow::DropNewest));
+    EXPECT_EQ(queue.clear(), 0U);
+    for (int i = 0; i < 3; i++) {
+        ASSERT_TRUE(push(queue, i));
+    }
+    EXPECT_EQ(queue.clear(), 3U);
+    EXPECT_TRUE(queue.empty());
+
+    ASSERT_TRUE(push(queue, 7));
+    EXPECT_EQ(pop(queue), 7);
+}
+
+// Low priority PacketIns leave the last quarter to high priority ones,
+// which drop the oldest when the queue is full
+TEST_F(UnitPacketInQueue, Priority)
+{
+    MetricCounter &low    = packetInCounter("dropped-low-priority");
+    MetricCounter &oldest = packetInCounter("dropped-oldest");
+    uint64_t       lowBefore    = low.value();
+    uint64_t       oldestBefore = oldest.value();
+
+    PacketInQueue queue(config(8, PacketInOverflow::Priority));
+    for (int i = 0; i < 6; i++) {
+        EXPECT_TRUE(push(queue, i)) << i;
+    }
+    EXPECT_FALSE(push(queue, 6));
+    EXPECT_EQ(low.value() - lowBefore, 1U);
+
+    for (int i = 6; i < 9; i++) {
+        EXPECT_TRUE(push(queue, i, true)) << i;
+    }
+    EXPECT_EQ(oldest.value() - oldestBefore, 1U);
+    EXPECT_EQ(queue.size(), 8U);
+
+    for (int i = 1; i < 9; i++) {
+        EXPECT_EQ(pop(queue), i);
+    }
+    EXPECT_TRUE(queue.empty());
+}
+
+// Concurrent producers lose nothing while there is room, and each
+// producer's PacketIns keep their order
+TEST_F(UnitPacketInQueue, Producers)
+{
+    constexpr int kProducers = 4;
+    constexpr int kPackets   = 1000;
+
+    PacketInQueue queue(
+        config(kProducers * kPackets, PacketInOverflow::DropNewest));
+    std::vector<std::thread> producers;
+    for (int p = 0; p < kProducers; p++) {
+        producers.emplace_back([&queue, p] {
+            for (int i = 0; i < kPackets; i++) {
+                EXPECT_TRUE(push(queue, p * kPackets + i));
+            }
+        });
+    }
+
+    std::vector<int> next(kProducers, 0);
+    int              popped = 0;
+    while (popped < kProducers * kPackets) {
+        int n = pop(queue);
+        if (n < 0) {
+            std::this_thread::yield();
+            continue;
+        }
+        EXPECT_EQ(n % kPackets, next[n / kPackets]);
+        next[n / kPackets] = n % kPackets + 1;
+        popped++;
+    }
+    for (auto &t : producers) {
+        t.join();
+    }
+    EXPECT_TRUE(queue.empty());
+}
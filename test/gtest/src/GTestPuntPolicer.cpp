@@ -0,0 +1,162 @@
+//
+// GTestPuntPolicer.cpp - GTESTs
+//
+// Unit GTESTs of the punt policer token buckets
+//
+// Copyright (c) [2018] Juniper Networks, Inc. All rights reserved.
+//
+// All rights reserved.
+//
+// Notice and Disclaimer: This code is licensed to you under the Apache
+// License 2.0 (the "License"). You may not use this code except in compliance
+// with the License. This code is not an official Juniper product. You can
+// obtain a copy of the License at http://www.apache.org/licenses/LICENSE-2.0
+//
+// Third-Party Code: This code may depend on other components under separate
+// copyright notice and license terms. Your use of the source code for those
+// components is subject to the terms and conditions of the respective license
+// as noted in the Third-Party source code file.
+//
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "PuntPolicer.h"
+
+using namespace std::chrono_literals;
+
+//
+// The policer is a singleton, every test starts and ends without rules
+//
+class UnitPuntPolicer : public ::testing::Test
+{
+ protected:
+    // Slow enough for buckets not to refill during a test
+    static constexpr double kSlowRate = 0.001;
+
+    PuntPolicer &policer{PuntPolicer::instance()};
+
+    void SetUp() override { policer.configure({}); }
+    void TearDown() override { policer.configure({}); }
+
+    static PuntPolicerRule rule(int32_t reason, int32_t port, double burst,
+                                double rate = kSlowRate)
+    {
+        PuntPolicerRule r;
+        r.reason = reason;
+        r.port   = port;
+        r.rate   = rate;
+        r.burst  = burst;
+        return r;
+    }
+
+    // Packets of (reason, port) admitted out of count
+    int admitted(uint16_t reason, uint16_t port, int count)
+    {
+        int n = 0;
+        for (int i = 0; i < count; i++) {
+            n += policer.admit(reason, port) ? 1 : 0;
+        }
+        return n;
+    }
+};
+
+constexpr double UnitPuntPolicer::kSlowRate;
+
+TEST_F(UnitPuntPolicer, NoRules)
+{
+    EXPECT_EQ(admitted(1, 1, 100), 100);
+}
+
+// A full bucket passes a burst, then drops
+TEST_F(UnitPuntPolicer, Burst)
+{
+    policer.setRule(rule(-1, -1, 5));
+    EXPECT_EQ(admitted(1, 1, 10), 5);
+    EXPECT_FALSE(policer.admit(1, 1));
+}
+
+// The burst is at least one packet
+TEST_F(UnitPuntPolicer, MinimumBurst)
+{
+    policer.setRule(rule(-1, -1, 0));
+    EXPECT_EQ(admitted(1, 1, 10), 1);
+}
+
+// Tokens come back at the rate
+TEST_F(UnitPuntPolicer, Refill)
+{
+    policer.setRule(rule(-1, -1, 1, 100));
+    EXPECT_TRUE(policer.admit(1, 1));
+    EXPECT_FALSE(policer.admit(1, 1));
+
+    std::this_thread::sleep_for(30ms);
+    EXPECT_TRUE(policer.admit(1, 1));
+}
+
+// Every (reason, port) has a bucket of its own
+TEST_F(UnitPuntPolicer, BucketPerReasonAndPort)
+{
+    policer.setRule(rule(-1, -1, 2));
+    EXPECT_EQ(admitted(1, 1, 5), 2);
+    EXPECT_EQ(admitted(1, 2, 5), 2);
+    EXPECT_EQ(admitted(2, 1, 5), 2);
+}
+
+// The exact rule wins over the reason, the port and the default rules
+TEST_F(UnitPuntPolicer, MostSpecificRule)
+{
+    policer.configure({rule(-1, -1, 1), rule(-1, 7, 2), rule(3, -1, 3),
+                       rule(3, 7, 4)});
+    EXPECT_EQ(admitted(3, 7, 10), 4);
+    EXPECT_EQ(admitted(3, 8, 10), 3);
+    EXPECT_EQ(admitted(4, 7, 10), 2);
+    EXPECT_EQ(admitted(4, 8, 10), 1);
+}
+
+// Changing the rules refills the buckets with the new burst
+TEST_F(UnitPuntPolicer, RulesChanged)
+{
+    policer.setRule(rule(3, 7, 1));
+    EXPECT_EQ(admitted(3, 7, 10), 1);
+
+    policer.setRule(rule(3, 7, 3));
+    EXPECT_EQ(admitted(3, 7, 10), 3);
+
+    EXPECT_TRUE(policer.clearRule(3, 7));
+    EXPECT_FALSE(policer.clearRule(3, 7));
+    EXPECT_EQ(admitted(3, 7, 10), 10);
+}
+
+// Buckets outlive the rules, so this test uses reasons of its own
+TEST_F(UnitPuntPolicer, Show)
+{
+    policer.setRule(rule(90, -1, 2));
+    admitted(90, 7, 5);
+    admitted(91, 7, 1);
+
+    std::string show = policer.show();
+    EXPECT_NE(show.find("reason 90 port any rate"), std::string::npos)
+        << show;
+    EXPECT_NE(show.find("reason 90 port 7 passed 2 dropped 3"),
+              std::string::npos)
+        << show;
+    EXPECT_NE(show.find("reason 91 port 7 not policed passed 1 dropped 0"),
+              std::string::npos)
+        << show;
+}
+
+TEST_F(UnitPuntPolicer, ValidRule)
+{
+    EXPECT_TRUE(rule(-1, -1, 1, 10).valid());
+    EXPECT_TRUE(rule(0xffff, 0xffff, 1, 10).valid());
+    EXPECT_FALSE(rule(0x10000, -1, 1, 10).valid());
+    EXPECT_FALSE(rule(-1, 0x10000, 1, 10).valid());
+    EXPECT_FALSE(rule(-2, -1, 1, 10).valid());
+    EXPECT_FALSE(rule(-1, -1, 1, 0).valid());
+    EXPECT_FALSE(rule(-1, -1, 0, 10).valid());
+    EXPECT_FALSE(rule(-1, -1, 1, -10).valid());
+}